@@ -0,0 +1,47 @@
+#!/usr/bin/env ruby
+# frozen_string_literal: true
+
+# Compares Rack's query parsing with Iodine's native implementation.
+#
+# Parses a few typical query strings (a search query, a paginated API query,
+# a nested form submission) using `Rack::Utils` before and after
+# `Iodine.patch_rack`, verifying both produce the same Hash.
+#
+#      ruby -Ilib bin/query_bench.rb [iterations]
+
+require 'iodine'
+require 'benchmark'
+begin
+  require 'rack'
+rescue LoadError
+  abort 'This benchmark requires the rack gem.'
+end
+
+ITERATIONS = (ARGV[0] || 200_000).to_i
+
+QUERIES = {
+  'search' => 'q=iodine+web+server&lang=en&page=2',
+  'api' => 'filter%5Bstatus%5D=active&filter%5Btags%5D%5B%5D=ruby&filter%5Btags%5D%5B%5D=c&sort=-created_at&page%5Bsize%5D=25&page%5Bnumber%5D=3',
+  'form' => 'user[name]=Jane+Doe&user[email]=jane%40example.com&user[address][city]=Tel+Aviv&user[address][zip]=61000' \
+            '&items[][id]=1&items[][qty]=2&items[][id]=7&items[][qty]=1&commit=Save',
+}.freeze
+
+def run(title)
+  QUERIES.each do |name, q|
+    Benchmark.bm(24) do |bm|
+      bm.report("#{title} #{name} flat") { ITERATIONS.times { Rack::Utils.parse_query(q) } }
+      bm.report("#{title} #{name} nested") { ITERATIONS.times { Rack::Utils.parse_nested_query(q) } }
+    end
+  end
+end
+
+expected = QUERIES.transform_values { |q| [Rack::Utils.parse_query(q), Rack::Utils.parse_nested_query(q)] }
+puts "Rack #{Rack.release}, #{ITERATIONS} iterations per test."
+run('Rack')
+Iodine.patch_rack
+puts '            --- Monkey Patching Rack ---'
+QUERIES.each do |name, q|
+  result = [Rack::Utils.parse_query(q), Rack::Utils.parse_nested_query(q)]
+  warn "WARNING: results differ for #{name}: #{result.inspect}" unless result == expected[name]
+end
+run('Iodine')
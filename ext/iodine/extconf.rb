@@ -107,4 +107,13 @@ EOS
   end
 end
 
+# Test for zlib (used for compressing HTTP responses).
+unless ENV['NO_ZLIB']
+  dir_config("zlib")
+  if have_header('zlib.h') && have_library('z', 'deflateInit2_')
+    $defs << "-DHAVE_ZLIB"
+    puts "detected zlib, compiling with HAVE_ZLIB."
+  end
+end
+
 create_makefile 'iodine/iodine_ext'
@@ -362,6 +362,8 @@ typedef struct {
   uint8_t open;
   /** indicated that the connection should be closed. */
   uint8_t close;
+  /** the fd is a duplicate, removed from the poll before closing. */
+  uint8_t shared;
   /** peer address length */
   uint8_t addr_len;
   /** peer address */
@@ -3589,6 +3591,26 @@ void fio_close(intptr_t uuid) {
   fio_force_close(uuid);
 }
 
+/**
+ * Removes the connection's file descriptor from the polling system, so no more
+ * events are reported for the connection.
+ */
+void fio_poll_forget(intptr_t uuid) {
+  if (!uuid_is_valid(uuid))
+    return;
+  fio_poll_remove_fd(fio_uuid2fd(uuid));
+}
+
+/**
+ * Marks the connection's file descriptor as a duplicate (`dup`), so it's
+ * removed from the polling system before it's closed (see `fio_poll_forget`).
+ */
+void fio_poll_shared(intptr_t uuid) {
+  if (!uuid_is_valid(uuid))
+    return;
+  uuid_data(uuid).shared = 1;
+}
+
 /**
  * `fio_force_close` closes the connection immediately, without adhering to any
  * protocol restrictions and without sending any remaining data in the
@@ -3624,9 +3646,13 @@ void fio_force_close(intptr_t uuid) {
     fio_poll_add_write(fio_uuid2fd(uuid));
     return;
   }
+  const uint8_t shared = uuid_data(uuid).shared;
   fio_lock(&uuid_data(uuid).protocol_lock);
   fio_clear_fd(fio_uuid2fd(uuid), 0);
   fio_unlock(&uuid_data(uuid).protocol_lock);
+  /* a duplicated fd might remain in the poll after it's closed */
+  if (shared)
+    fio_poll_remove_fd(fio_uuid2fd(uuid));
 #ifdef __MINGW32__
   fio_sock_perform_close_fd(fio_uuid2fd(uuid));
 #else
@@ -1119,6 +1119,23 @@ void fio_close(intptr_t uuid);
  */
 void fio_force_close(intptr_t uuid);
 
+/**
+ * Removes the connection's file descriptor from the polling system, so no more
+ * events are reported for the connection.
+ *
+ * This should be called before closing a connection that was attached using a
+ * duplicated file descriptor (`dup`), since `epoll` keeps reporting events for
+ * a closed file descriptor while another descriptor refers to the same file.
+ */
+void fio_poll_forget(intptr_t uuid);
+
+/**
+ * Marks the connection's file descriptor as a duplicate (`dup`), so it's
+ * removed from the polling system (`fio_poll_forget`) whenever it's closed,
+ * including errors and hang ups reported by the polling system.
+ */
+void fio_poll_shared(intptr_t uuid);
+
 /**
  * Returns the information available about the socket's peer address.
  *
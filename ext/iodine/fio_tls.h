@@ -89,6 +89,17 @@ uintptr_t fio_tls_alpn_count(fio_tls_s *tls);
  */
 void fio_tls_trust(fio_tls_s *, const char *public_cert_file);
 
+/**
+ * Requires client connections to verify the peer's certificate for `host_name`
+ * (which is also sent using the SNI extension, unless it's an IP address).
+ *
+ * Unless certificates were added using `fio_tls_trust`, the system's default
+ * trusted certificates (CA store) are used.
+ *
+ *      fio_tls_verify_host(tls, "www.example.com");
+ */
+void fio_tls_verify_host(fio_tls_s *, const char *host_name);
+
 /**
  * Establishes an SSL/TLS connection as an SSL/TLS Server, using the specified
  * context / settings object.
@@ -590,6 +590,19 @@ file_missing:
   exit(-1);
 }
 
+/**
+ * Requires client connections to verify the peer's certificate for `host_name`
+ * (which is also sent using the SNI extension, unless it's an IP address).
+ *
+ *      fio_tls_verify_host(tls, "www.example.com");
+ */
+void FIO_TLS_WEAK fio_tls_verify_host(fio_tls_s *tls, const char *host_name) {
+  /* `fio_tls_new` already required a library, this only reports the issue */
+  FIO_LOG_ERROR("No supported SSL/TLS library, can't verify %s.",
+                (host_name ? host_name : "the peer"));
+  (void)tls;
+}
+
 /**
  * Establishes an SSL/TLS connection as an SSL/TLS Server, using the specified
  * context / settings object.
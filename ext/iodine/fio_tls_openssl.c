@@ -22,6 +22,7 @@ typedef struct {
 #include "fio_tls.h"
 
 #if HAVE_OPENSSL
+#include <arpa/inet.h>
 #include <openssl/bio.h>
 #include <openssl/err.h>
 #include <openssl/ssl.h>
@@ -144,6 +145,7 @@ struct fio_tls_s {
 
   cert_ary_s sni;    /* SNI (server name extension) stores ID certificates */
   trust_ary_s trust; /* Trusted certificate registry (peer verification) */
+  fio_str_s host;    /* The verified peer host name (client connections) */
 
   /************ TODO: implementation data fields go here ******************/
 
@@ -553,6 +555,11 @@ static void fio_tls_build_context(fio_tls_s *tls) {
       }
       BIO_free(bio);
     }
+  } else if (fio_str_len(&tls->host)) {
+    /* verify the peer host using the system's default trusted certificates */
+    SSL_CTX_set_verify(tls->ctx, SSL_VERIFY_PEER, NULL);
+    if (!SSL_CTX_set_default_verify_paths(tls->ctx))
+      FIO_LOG_WARNING("TLS couldn't load the default trusted certificates.");
   }
 
   FIO_LOG_DEBUG("(re)built TLS context for OpenSSL %p", (void *)tls);
@@ -563,7 +570,8 @@ SSL/TLS RW Hooks
 ***************************************************************************** */
 
 static void fio_tls_delayed_close(void *uuid, void *ignr_) {
-  fio_close((intptr_t)uuid);
+  /* after a failed handshake, pending data can't be sent (don't wait for it) */
+  fio_force_close((intptr_t)uuid);
   (void)ignr_;
 }
 
@@ -920,6 +928,18 @@ static inline void fio_tls_attach2uuid(intptr_t uuid,
     /* Client mode (connect) */
     FIO_LOG_DEBUG("Attaching TLS read/write hook for %p (client mode).",
                   (void *)uuid);
+    if (fio_str_len(&tls->host)) {
+      /* SNI and host name verification (IP addresses are verified as such) */
+      char *host = fio_str_data(&tls->host);
+      unsigned char ip[16];
+      if (inet_pton(AF_INET, host, ip) == 1 ||
+          inet_pton(AF_INET6, host, ip) == 1) {
+        X509_VERIFY_PARAM_set1_ip_asc(SSL_get0_param(c->ssl), host);
+      } else {
+        SSL_set_tlsext_host_name(c->ssl, host);
+        SSL_set1_host(c->ssl, host);
+      }
+    }
     SSL_set_connect_state(c->ssl);
   }
   fio_force_event(uuid, FIO_EVENT_ON_READY);
@@ -1046,6 +1066,20 @@ file_missing:
   exit(-1);
 }
 
+/**
+ * Requires client connections to verify the peer's certificate for `host_name`
+ * (which is also sent using the SNI extension, unless it's an IP address).
+ *
+ *      fio_tls_verify_host(tls, "www.example.com");
+ */
+void FIO_TLS_WEAK fio_tls_verify_host(fio_tls_s *tls, const char *host_name) {
+  REQUIRE_LIBRARY();
+  fio_str_resize(&tls->host, 0);
+  if (host_name)
+    fio_str_write(&tls->host, host_name, strlen(host_name));
+  fio_tls_build_context(tls);
+}
+
 /**
  * Establishes an SSL/TLS connection as an SSL/TLS Server, using the specified
  * context / settings object.
@@ -1098,6 +1132,7 @@ void FIO_TLS_WEAK fio_tls_destroy(fio_tls_s *tls) {
   alpn_list_free(&tls->alpn);
   cert_ary_free(&tls->sni);
   trust_ary_free(&tls->trust);
+  fio_str_free(&tls->host);
   free(tls);
   FIO_LOG_DEBUG("freed TLS context %p", (void *)tls);
 }
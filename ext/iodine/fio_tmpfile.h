@@ -22,9 +22,34 @@ License: MIT
 #include <fileapi.h>
 #endif
 
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
+
+/**
+ * Creates an anonymous temporary file, returning its file descriptor (or -1).
+ *
+ * When supported, the file is never linked to a name (`O_TMPFILE`), or lives
+ * in memory (`memfd_create`), so the data never reaches a named file.
+ */
 static inline int fio_tmpfile(void) {
   // create a temporary file to contain the data.
   int fd = 0;
+#if defined(__linux__) && defined(O_TMPFILE)
+#if defined(P_tmpdir)
+  fd = open(P_tmpdir, O_TMPFILE | O_RDWR | O_CLOEXEC, S_IRUSR | S_IWUSR);
+#else
+  fd = open("/tmp", O_TMPFILE | O_RDWR | O_CLOEXEC, S_IRUSR | S_IWUSR);
+#endif
+  if (fd != -1)
+    return fd;
+#endif
+#if defined(__linux__) && defined(SYS_memfd_create)
+  /* the folder doesn't support O_TMPFILE, keep the data in memory */
+  fd = (int)syscall(SYS_memfd_create, "facil_io_tmpfile", 1U /* CLOEXEC */);
+  if (fd != -1)
+    return fd;
+#endif
 #ifdef __MINGW32__
   char name_template[] = "fio";
   TCHAR temp_path[(MAX_PATH-14)];
@@ -37,13 +62,19 @@ static inline int fio_tmpfile(void) {
   if (P_tmpdir[sizeof(P_tmpdir) - 1] == '/') {
     char name_template[] = P_tmpdir "facil_io_tmpfile_XXXXXXXX";
     fd = mkstemp(name_template);
+    if (fd != -1)
+      unlink(name_template);
   } else {
     char name_template[] = P_tmpdir "/facil_io_tmpfile_XXXXXXXX";
     fd = mkstemp(name_template);
+    if (fd != -1)
+      unlink(name_template);
   }
 #else
   char name_template[] = "/tmp/facil_io_tmpfile_XXXXXXXX";
   fd = mkstemp(name_template);
+  if (fd != -1)
+    unlink(name_template);
 #endif
   return fd;
 }
@@ -757,6 +757,16 @@ intptr_t fiobj_data_len(FIOBJ io) {
   return fiobj_data_i(io);
 }
 
+/**
+ * Returns the file descriptor of a file based IO object, or -1 if the data is
+ * stored in memory (or a slice).
+ */
+int fiobj_data_fd(FIOBJ io) {
+  if (!io || !FIOBJ_TYPE_IS(io, FIOBJ_T_DATA) || obj2io(io)->fd < 0)
+    return -1;
+  return obj2io(io)->fd;
+}
+
 /**
  * Moves the reading position to the requested position.
  */
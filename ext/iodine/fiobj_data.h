@@ -108,6 +108,14 @@ intptr_t fiobj_data_pos(FIOBJ io);
  */
 intptr_t fiobj_data_len(FIOBJ io);
 
+/**
+ * Returns the file descriptor of a file based IO object, or -1 if the data is
+ * stored in memory (or a slice).
+ *
+ * The file descriptor is owned by the object (use `dup` to keep it).
+ */
+int fiobj_data_fd(FIOBJ io);
+
 /**
  * Moves the reading position to the requested position.
  */
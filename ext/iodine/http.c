@@ -20,6 +20,10 @@ Feel free to copy, use and enjoy according to the license provided.
 
 #include <pthread.h>
 
+#ifndef __MINGW32__
+#include <poll.h>
+#endif
+
 #ifndef HAVE_TM_TM_ZONE
 #if defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__) ||     \
     defined(__DragonFly__) || defined(__bsdi__) || defined(__ultrix) ||        \
@@ -146,6 +150,362 @@ static int write_header(FIOBJ o, void *w_) {
 static char invalid_cookie_name_char[256];
 
 static char invalid_cookie_value_char[256];
+/* *****************************************************************************
+Response Compression (gzip / deflate)
+***************************************************************************** */
+
+#if HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+typedef enum {
+  HTTP_ENCODING_NONE = 0,
+  HTTP_ENCODING_GZIP = 1,
+  HTTP_ENCODING_DEFLATE = 2,
+} http_encoding_e;
+
+/* tests if the content type (ignoring parameters) is worth compressing */
+static int http_compress_type_allowed(FIOBJ content_type) {
+  static const struct {
+    const char *name;
+    size_t len;
+  } allowed[] = {
+#define HTTP_COMPRESS_TYPE(str) {.name = str, .len = sizeof(str) - 1}
+      HTTP_COMPRESS_TYPE("text/"),
+      HTTP_COMPRESS_TYPE("application/json"),
+      HTTP_COMPRESS_TYPE("application/javascript"),
+      HTTP_COMPRESS_TYPE("application/x-javascript"),
+      HTTP_COMPRESS_TYPE("application/xml"),
+      HTTP_COMPRESS_TYPE("application/xhtml+xml"),
+      HTTP_COMPRESS_TYPE("application/rss+xml"),
+      HTTP_COMPRESS_TYPE("application/atom+xml"),
+      HTTP_COMPRESS_TYPE("application/ld+json"),
+      HTTP_COMPRESS_TYPE("application/manifest+json"),
+      HTTP_COMPRESS_TYPE("application/wasm"),
+      HTTP_COMPRESS_TYPE("application/vnd.ms-fontobject"),
+      HTTP_COMPRESS_TYPE("image/svg+xml"),
+      HTTP_COMPRESS_TYPE("font/ttf"),
+      HTTP_COMPRESS_TYPE("font/otf"),
+#undef HTTP_COMPRESS_TYPE
+  };
+  if (!FIOBJ_TYPE_IS(content_type, FIOBJ_T_STRING))
+    return 0;
+  fio_str_info_s t = fiobj_obj2cstr(content_type);
+  for (size_t i = 0; i < sizeof(allowed) / sizeof(allowed[0]); ++i) {
+    if (t.len < allowed[i].len ||
+        strncasecmp(t.data, allowed[i].name, allowed[i].len))
+      continue;
+    /* prefixes ending with '/' match a whole family of types */
+    if (allowed[i].name[allowed[i].len - 1] == '/' || t.len == allowed[i].len ||
+        t.data[allowed[i].len] == ';' || t.data[allowed[i].len] == ' ')
+      return 1;
+  }
+  return 0;
+}
+
+/* tests if a token in the `accept-encoding` header is acceptable (q != 0) */
+static int http_encoding_accepted(fio_str_info_s ac, const char *name,
+                                  size_t len) {
+  char *pos = ac.data;
+  char *end = ac.data + ac.len;
+  while (pos + len <= end) {
+    while (pos < end && (*pos == ' ' || *pos == ','))
+      ++pos;
+    if (pos + len <= end && !strncasecmp(pos, name, len) &&
+        (pos + len == end || pos[len] == ',' || pos[len] == ';' ||
+         pos[len] == ' ')) {
+      pos += len;
+      while (pos < end && *pos == ' ')
+        ++pos;
+      if (pos >= end || *pos != ';')
+        return 1;
+      /* test for "q=0" (or "q=0.0", etc') */
+      ++pos;
+      while (pos < end && *pos == ' ')
+        ++pos;
+      if (end - pos < 3 || (pos[0] | 32) != 'q' || pos[1] != '=')
+        return 1;
+      pos += 2;
+      while (pos < end && (*pos == '0' || *pos == '.'))
+        ++pos;
+      return (pos < end && *pos >= '1' && *pos <= '9');
+    }
+    pos = memchr(pos, ',', end - pos);
+    if (!pos)
+      return 0;
+  }
+  return 0;
+}
+
+/* returns the preferred encoding supported by the client (gzip first) */
+static http_encoding_e http_accepted_encoding(http_s *h) {
+  static uint64_t accept_enc_hash = 0;
+  if (!accept_enc_hash)
+    accept_enc_hash = fiobj_hash_string("accept-encoding", 15);
+  FIOBJ tmp = fiobj_hash_get2(h->headers, accept_enc_hash);
+  if (!tmp)
+    return HTTP_ENCODING_NONE;
+  fio_str_info_s ac = fiobj_obj2cstr(tmp);
+  if (!ac.data || !ac.len)
+    return HTTP_ENCODING_NONE;
+  if (http_encoding_accepted(ac, "gzip", 4))
+    return HTTP_ENCODING_GZIP;
+  if (http_encoding_accepted(ac, "deflate", 7))
+    return HTTP_ENCODING_DEFLATE;
+  return HTTP_ENCODING_NONE;
+}
+
+/* adds `vary: accept-encoding` to the response (unless already listed) */
+static void http_vary_accept_encoding(http_s *h) {
+  static uint64_t vary_hash = 0;
+  if (!vary_hash)
+    vary_hash = fiobj_hash_string("vary", 4);
+  FIOBJ vary = fiobj_hash_get2(h->private_data.out_headers, vary_hash);
+  if (vary) {
+    if (FIOBJ_TYPE_IS(vary, FIOBJ_T_ARRAY)) {
+      for (size_t i = 0; i < fiobj_ary_count(vary); ++i) {
+        fio_str_info_s v = fiobj_obj2cstr(fiobj_ary_index(vary, i));
+        if (v.data && (v.data[0] == '*' ||
+                       strcasestr(v.data, "accept-encoding")))
+          return;
+      }
+    } else {
+      fio_str_info_s v = fiobj_obj2cstr(vary);
+      if (v.data && (v.data[0] == '*' || strcasestr(v.data, "accept-encoding")))
+        return;
+    }
+  }
+  http_set_header(h, HTTP_HEADER_VARY, fiobj_dup(HTTP_HVALUE_ACCEPT_ENCODING));
+}
+
+/* replaces a strong `etag` header with a weak one */
+static void http_weaken_etag(http_s *h) {
+  static uint64_t etag_hash = 0;
+  if (!etag_hash)
+    etag_hash = fiobj_hash_string("etag", 4);
+  FIOBJ etag = fiobj_hash_get2(h->private_data.out_headers, etag_hash);
+  if (!etag || !FIOBJ_TYPE_IS(etag, FIOBJ_T_STRING))
+    return;
+  fio_str_info_s e = fiobj_obj2cstr(etag);
+  if (e.len >= 2 && (e.data[0] | 32) == 'w' && e.data[1] == '/')
+    return;
+  FIOBJ weak = fiobj_str_buf(e.len + 2);
+  fiobj_str_write(weak, "W/", 2);
+  fiobj_str_write(weak, e.data, e.len);
+  fiobj_hash_set(h->private_data.out_headers, HTTP_HEADER_ETAG, weak);
+}
+
+#if HAVE_ZLIB
+/**
+ * Compresses the data, returning a new String object, or FIOBJ_INVALID if the
+ * compressed data isn't smaller than the original.
+ */
+static FIOBJ http_compress(const void *data, size_t len, http_encoding_e enc) {
+  z_stream strm = {.zalloc = Z_NULL};
+  if (deflateInit2(&strm, HTTP_COMPRESS_LEVEL, Z_DEFLATED,
+                   (enc == HTTP_ENCODING_GZIP ? 15 + 16 : 15), 8,
+                   Z_DEFAULT_STRATEGY) != Z_OK)
+    return FIOBJ_INVALID;
+  size_t capa = deflateBound(&strm, len);
+  FIOBJ out = fiobj_str_buf(capa);
+  strm.next_in = (Bytef *)data;
+  strm.avail_in = len;
+  strm.next_out = (Bytef *)fiobj_obj2cstr(out).data;
+  strm.avail_out = capa;
+  int ret = deflate(&strm, Z_FINISH);
+  size_t out_len = strm.total_out;
+  deflateEnd(&strm);
+  if (ret != Z_STREAM_END || out_len >= len) {
+    fiobj_free(out);
+    return FIOBJ_INVALID;
+  }
+  fiobj_str_resize(out, out_len);
+  fiobj_str_freeze(out);
+  return out;
+}
+#else
+#define http_compress(data, len, enc) ((void)(data), (void)(len), FIOBJ_INVALID)
+#endif
+
+/* *****************************************************************************
+Compressed response cache - for responses with a public cache policy, avoiding
+repeated compression of the same (dynamic) content.
+***************************************************************************** */
+
+typedef struct {
+  fio_ls_embd_s node;
+  uint64_t hash;
+  /* the uncompressed content (owned by `src`, unless this is a lookup) */
+  const char *data;
+  size_t len;
+  http_encoding_e enc;
+  FIOBJ src;
+  FIOBJ out;
+} http_zcache_entry_s;
+
+/* the content is compared, a hash collision mustn't leak another response */
+#define FIO_INCLUDE_LINKED_LIST
+#define FIO_SET_NAME http_zcache_map
+#define FIO_SET_OBJ_TYPE http_zcache_entry_s *
+#define FIO_SET_OBJ_COMPARE(o1, o2)                                            \
+  ((o1)->len == (o2)->len && (o1)->enc == (o2)->enc &&                         \
+   !memcmp((o1)->data, (o2)->data, (o1)->len))
+#include <fio.h>
+
+static struct {
+  http_zcache_map_s map;
+  fio_ls_embd_s lru;
+  size_t memory;
+  size_t hits;
+  size_t misses;
+  fio_lock_i lock;
+} http_zcache = {
+    .map = FIO_SET_INIT,
+    .lru = FIO_LS_INIT(http_zcache.lru),
+    .lock = FIO_LOCK_INIT,
+};
+
+static void http_zcache_remove_unsafe(http_zcache_entry_s *e) {
+  http_zcache_map_remove(&http_zcache.map, e->hash, e, NULL);
+  fio_ls_embd_remove(&e->node);
+  http_zcache.memory -= e->len + fiobj_obj2cstr(e->out).len;
+  fiobj_free(e->src);
+  fiobj_free(e->out);
+  fio_free(e);
+}
+
+static void http_zcache_clear(void *ignr_) {
+  fio_lock(&http_zcache.lock);
+  while (fio_ls_embd_any(&http_zcache.lru)) {
+    http_zcache_entry_s *e = FIO_LS_EMBD_OBJ(
+        http_zcache_entry_s, node, fio_ls_embd_pop(&http_zcache.lru));
+    fiobj_free(e->src);
+    fiobj_free(e->out);
+    fio_free(e);
+  }
+  http_zcache_map_free(&http_zcache.map);
+  http_zcache.memory = 0;
+  fio_unlock(&http_zcache.lock);
+  (void)ignr_;
+}
+
+static void http_zcache_on_fork(void *ignr_) {
+  http_zcache.lock = FIO_LOCK_INIT;
+  (void)ignr_;
+}
+
+static __attribute__((constructor)) void http_zcache_constructor(void) {
+  fio_state_callback_add(FIO_CALL_IN_CHILD, http_zcache_on_fork, NULL);
+  fio_state_callback_add(FIO_CALL_AT_EXIT, http_zcache_clear, NULL);
+}
+
+/* tests if the response's `cache-control` header allows shared caching */
+static int http_response_is_public(http_s *h) {
+  static uint64_t cc_hash = 0;
+  if (!cc_hash)
+    cc_hash = fiobj_hash_string("cache-control", 13);
+  FIOBJ cc = fiobj_hash_get2(h->private_data.out_headers, cc_hash);
+  if (!cc || !FIOBJ_TYPE_IS(cc, FIOBJ_T_STRING))
+    return 0;
+  fio_str_info_s v = fiobj_obj2cstr(cc);
+  if (strcasestr(v.data, "private") || strcasestr(v.data, "no-store") ||
+      strcasestr(v.data, "no-cache"))
+    return 0;
+  return (strcasestr(v.data, "public") || strcasestr(v.data, "max-age"));
+}
+
+/* compresses the data, using the cache when the response is public */
+static FIOBJ http_zcache_compress(const void *data, size_t len,
+                                  http_encoding_e enc, uint8_t cacheable) {
+  if (!cacheable)
+    return http_compress(data, len, enc);
+  http_zcache_entry_s tmp = {.data = data, .len = len, .enc = enc};
+  tmp.hash = fiobj_hash_string(data, len);
+  FIOBJ out = FIOBJ_INVALID;
+  fio_lock(&http_zcache.lock);
+  http_zcache_entry_s *e = http_zcache_map_find(&http_zcache.map, tmp.hash, &tmp);
+  if (e) {
+    ++http_zcache.hits;
+    out = fiobj_dup(e->out);
+    fio_ls_embd_remove(&e->node);
+    fio_ls_embd_push(&http_zcache.lru, &e->node);
+  } else {
+    ++http_zcache.misses;
+  }
+  fio_unlock(&http_zcache.lock);
+  if (out)
+    return out;
+  out = http_compress(data, len, enc);
+  if (!out)
+    return out;
+  const size_t out_len = fiobj_obj2cstr(out).len;
+  if (len + out_len > (HTTP_COMPRESS_CACHE_MEMORY >> 2))
+    return out;
+  /* copy the content outside the lock */
+  FIOBJ src = fiobj_str_new(data, len);
+  fio_lock(&http_zcache.lock);
+  if (!http_zcache_map_find(&http_zcache.map, tmp.hash, &tmp)) {
+    e = fio_malloc(sizeof(*e));
+    FIO_ASSERT_ALLOC(e);
+    *e = tmp;
+    e->src = src;
+    e->data = fiobj_obj2cstr(src).data;
+    e->out = fiobj_dup(out);
+    src = FIOBJ_INVALID;
+    http_zcache_map_insert(&http_zcache.map, e->hash, e);
+    fio_ls_embd_push(&http_zcache.lru, &e->node);
+    http_zcache.memory += len + out_len;
+    while (http_zcache.memory > HTTP_COMPRESS_CACHE_MEMORY) {
+      /* evict the least recently used responses */
+      http_zcache_remove_unsafe(FIO_LS_EMBD_OBJ(http_zcache_entry_s, node,
+                                                http_zcache.lru.prev));
+    }
+  }
+  fio_unlock(&http_zcache.lock);
+  fiobj_free(src);
+  return out;
+}
+
+/**
+ * Compresses the response body when the settings, the client and the
+ * response's headers allow it.
+ *
+ * On success, the response headers are updated and the compressed body is
+ * returned (it should be freed using `fiobj_free`).
+ */
+static FIOBJ http_compress_response(http_s *r, void *data, uintptr_t length) {
+  http_settings_s *settings = http_settings(r);
+  if (!settings || !settings->compress || length < settings->compress ||
+      r->status < 200 || r->status == 204 || r->status == 206 ||
+      r->status >= 300)
+    return FIOBJ_INVALID;
+  static uint64_t ce_hash = 0;
+  static uint64_t ct_hash = 0;
+  if (!ce_hash) {
+    ce_hash = fiobj_hash_string("content-encoding", 16);
+    ct_hash = fiobj_hash_string("content-type", 12);
+  }
+  FIOBJ out_headers = r->private_data.out_headers;
+  if (fiobj_hash_get2(out_headers, ce_hash) ||
+      !http_compress_type_allowed(fiobj_hash_get2(out_headers, ct_hash)))
+    return FIOBJ_INVALID;
+  http_vary_accept_encoding(r);
+  http_encoding_e enc = http_accepted_encoding(r);
+  if (enc == HTTP_ENCODING_NONE)
+    return FIOBJ_INVALID;
+  FIOBJ out =
+      http_zcache_compress(data, length, enc, http_response_is_public(r));
+  if (!out)
+    return FIOBJ_INVALID;
+  fiobj_hash_set(out_headers, HTTP_HEADER_CONTENT_ENCODING,
+                 fiobj_dup(enc == HTTP_ENCODING_GZIP ? HTTP_HVALUE_GZIP
+                                                     : HTTP_HVALUE_DEFLATE));
+  fiobj_hash_set(out_headers, HTTP_HEADER_CONTENT_LENGTH,
+                 fiobj_num_new(fiobj_obj2cstr(out).len));
+  http_weaken_etag(r);
+  return out;
+}
+
 /* *****************************************************************************
 The Request / Response type and functions
 ***************************************************************************** */
@@ -330,12 +690,57 @@ int http_send_body(http_s *r, void *data, uintptr_t length) {
     http_finish(r);
     return 0;
   }
+  FIOBJ compressed = http_compress_response(r, data, length);
+  if (compressed) {
+    fio_str_info_s c = fiobj_obj2cstr(compressed);
+    add_date(r);
+    int ret = ((http_vtable_s *)r->private_data.vtbl)
+                  ->http_send_body(r, c.data, c.len);
+    fiobj_free(compressed);
+    return ret;
+  }
   add_content_length(r, length);
   // add_content_type(r);
   add_date(r);
   return ((http_vtable_s *)r->private_data.vtbl)
       ->http_send_body(r, data, length);
 }
+/**
+ * Sends the response headers and body without copying the body.
+ *
+ * Returns -1 on error and 0 on success.
+ *
+ * AFTER THIS FUNCTION IS CALLED, THE `http_s` OBJECT IS NO LONGER VALID.
+ */
+int http_send_body_nocopy(http_s *r, void *data, uintptr_t length,
+                          void (*dealloc)(void *data)) {
+  if (HTTP_INVALID_HANDLE(r)) {
+    if (dealloc)
+      dealloc(data);
+    return -1;
+  }
+  if (!dealloc || !length || !data) {
+    int ret = http_send_body(r, data, length);
+    if (dealloc)
+      dealloc(data);
+    return ret;
+  }
+  FIOBJ compressed = http_compress_response(r, data, length);
+  if (compressed) {
+    /* the original data is no longer required */
+    fio_str_info_s c = fiobj_obj2cstr(compressed);
+    dealloc(data);
+    add_date(r);
+    int ret = ((http_vtable_s *)r->private_data.vtbl)
+                  ->http_send_body(r, c.data, c.len);
+    fiobj_free(compressed);
+    return ret;
+  }
+  add_content_length(r, length);
+  add_date(r);
+  return ((http_vtable_s *)r->private_data.vtbl)
+      ->http_send_body_nocopy(r, data, length, dealloc);
+}
 /**
  * Sends the response headers and the specified file (the response's body).
  *
@@ -355,6 +760,894 @@ int http_sendfile(http_s *r, int fd, uintptr_t length, uintptr_t offset) {
       ->http_sendfile(r, fd, length, offset);
 }
 
+/**
+ * Sends the response headers and the specified file (the response's body),
+ * calling `close_fd(fd)` once the file was sent or on error.
+ *
+ * Returns -1 on error and 0 on success.
+ *
+ * AFTER THIS FUNCTION IS CALLED, THE `http_s` OBJECT IS NO LONGER VALID.
+ */
+int http_sendfile_notify(http_s *r, int fd, uintptr_t length, uintptr_t offset,
+                         void (*close_fd)(intptr_t fd)) {
+  if (!close_fd)
+    return http_sendfile(r, fd, length, offset);
+  if (HTTP_INVALID_HANDLE(r)) {
+    close_fd(fd);
+    return -1;
+  };
+  add_content_length(r, length);
+  add_content_type(r);
+  add_date(r);
+  return ((http_vtable_s *)r->private_data.vtbl)
+      ->http_sendfile_notify(r, fd, length, offset, close_fd);
+}
+
+/**
+ * Sends the response headers (on the first call) and a part of the response's
+ * body.
+ *
+ * Returns -1 on error, or the number of outgoing packets waiting to be sent.
+ */
+int http_stream(http_s *r, void *data, uintptr_t length) {
+  if (HTTP_INVALID_HANDLE(r))
+    return -1;
+  http_vtable_s *vtbl = (http_vtable_s *)r->private_data.vtbl;
+  if (!vtbl->http_stream)
+    return -1;
+  add_date(r);
+  return vtbl->http_stream(r, data, length);
+}
+
+/**
+ * Blocks until no more than `max_pending` outgoing packets are waiting to be
+ * sent.
+ */
+int http_stream_wait(http_s *r, size_t max_pending) {
+  if (HTTP_INVALID_HANDLE(r))
+    return -1;
+  const intptr_t uuid = http2protocol(r)->uuid;
+  const int timeout = (int)http_settings(r)->timeout * 1000;
+  while (fio_pending(uuid) > max_pending) {
+    ssize_t flushed = fio_flush(uuid);
+    if (flushed < 0 && errno != EWOULDBLOCK)
+      return -1;
+    if (fio_pending(uuid) <= max_pending)
+      break;
+#ifndef __MINGW32__
+    /* wait for the socket to drain (or for another thread to flush it) */
+    struct pollfd pfd = {.fd = fio_uuid2fd(uuid), .events = POLLOUT};
+    int i = poll(&pfd, 1, (flushed < 0 ? 1 : timeout));
+    if (i == -1 && errno == EINTR)
+      continue;
+    if (i < 0 || (!i && flushed >= 0))
+      return -1;
+#else
+    break;
+#endif
+  }
+  return fio_is_valid(uuid) ? 0 : -1;
+}
+
+/**
+ * Closes the connection without completing a streamed response.
+ *
+ * AFTER THIS FUNCTION IS CALLED, THE `http_s` OBJECT IS NO LONGER VALID.
+ */
+void http_stream_abort(http_s *r) {
+  if (HTTP_INVALID_HANDLE(r))
+    return;
+  /* once the connection is closed, the response can't be completed */
+  fio_force_close(http2protocol(r)->uuid);
+  http_finish(r);
+}
+
+/* *****************************************************************************
+Static File Cache (open file descriptors and `stat` data)
+***************************************************************************** */
+
+#if defined(__linux__)
+#include <sys/inotify.h>
+#endif
+
+/**
+ * A cached file's data - `etag` is FIOBJ_INVALID for known missing files.
+ *
+ * Small files are kept in memory (`body`), other files keep an open `fd`.
+ */
+typedef struct {
+  fio_ls_embd_s node;
+  FIOBJ path;
+  FIOBJ etag;
+  FIOBJ last_modified;
+  FIOBJ body;
+  FIOBJ gzip;
+  int fd;
+  int64_t size;
+  time_t loaded_at;
+  uint8_t no_gzip;
+} http_fcache_entry_s;
+
+#define FIO_INCLUDE_LINKED_LIST
+#define FIO_SET_NAME http_fcache_map
+#define FIO_SET_OBJ_TYPE http_fcache_entry_s *
+#define FIO_SET_OBJ_COMPARE(o1, o2) fiobj_iseq((o1)->path, (o2)->path)
+#include <fio.h>
+
+static struct {
+  http_fcache_map_s map;
+  fio_ls_embd_s lru;
+  FIOBJ dirs; /* watched folder names, indexed by inotify watch descriptor */
+  FIOBJ links; /* symbolic links in watched paths (a Hash, names => true) */
+  size_t memory;
+  size_t gzip_memory;
+  size_t hits;
+  size_t misses;
+  fio_lock_i lock;
+  int inotify;
+  uint8_t initialized;
+  uint8_t watching;
+} http_fcache = {
+    .map = FIO_SET_INIT,
+    .lru = FIO_LS_INIT(http_fcache.lru),
+    .lock = FIO_LOCK_INIT,
+    .inotify = -1,
+};
+
+static void http_fcache_entry_free(http_fcache_entry_s *e) {
+  if (e->fd != -1)
+    close(e->fd);
+  fiobj_free(e->path);
+  fiobj_free(e->etag);
+  fiobj_free(e->last_modified);
+  fiobj_free(e->body);
+  fiobj_free(e->gzip);
+  fio_free(e);
+}
+
+/* releases the response data collected by `http_fcache_get` */
+static inline void http_fcache_release(http_fcache_entry_s *file) {
+  if (file->fd != -1)
+    close(file->fd);
+  fiobj_free(file->body);
+}
+
+/* removes an entry from the cache - call within the lock */
+static void http_fcache_remove_unsafe(http_fcache_entry_s *e) {
+  http_fcache_map_remove(&http_fcache.map, fiobj_obj2hash(e->path), e, NULL);
+  fio_ls_embd_remove(&e->node);
+  if (e->body)
+    http_fcache.memory -= e->size;
+  if (e->gzip)
+    http_fcache.gzip_memory -= fiobj_obj2cstr(e->gzip).len;
+  http_fcache_entry_free(e);
+}
+
+/* removes all entries from the cache - call within the lock */
+static void http_fcache_clear_unsafe(void) {
+  while (fio_ls_embd_any(&http_fcache.lru)) {
+    http_fcache_entry_s *e = FIO_LS_EMBD_OBJ(
+        http_fcache_entry_s, node, fio_ls_embd_pop(&http_fcache.lru));
+    http_fcache_entry_free(e);
+  }
+  http_fcache_map_free(&http_fcache.map);
+  http_fcache.memory = 0;
+  http_fcache.gzip_memory = 0;
+}
+
+/* removes the entry for the named file (if any) - call within the lock */
+static void http_fcache_forget_unsafe(FIOBJ path) {
+  http_fcache_entry_s tmp = {.path = path};
+  http_fcache_entry_s *e =
+      http_fcache_map_find(&http_fcache.map, fiobj_obj2hash(path), &tmp);
+  if (e)
+    http_fcache_remove_unsafe(e);
+}
+
+/* *****************************************************************************
+Public Folder Index (missing files are detected without file system access)
+***************************************************************************** */
+
+#if defined(__linux__)
+#include <dirent.h>
+
+static void http_fcache_init_unsafe(void);
+static void http_fcache_watch_links_unsafe(const char *path, size_t len);
+
+/* the events watched for both the file cache and the public folder index */
+#define HTTP_FCACHE_WATCH_MASK                                                 \
+  (IN_ATTRIB | IN_CLOSE_WRITE | IN_MODIFY | IN_CREATE | IN_DELETE |            \
+   IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF)
+
+/* file name hashes (relative to the public folder) => reference count */
+#define FIO_SET_NAME http_pindex_map
+#define FIO_SET_OBJ_TYPE uintptr_t
+#include <fio.h>
+
+/**
+ * A public folder's index, listing the files in the folder (by hash).
+ *
+ * Hash collisions only cause false positives (the file system is tested), so
+ * file names aren't stored.
+ */
+typedef struct http_pindex_s {
+  struct http_pindex_s *next;
+  FIOBJ folder; /* the folder's name, without a trailing `/` */
+  http_pindex_map_s map;
+  volatile uint8_t state;
+} http_pindex_s;
+
+enum {
+  HTTP_PINDEX_EMPTY = 0,
+  HTTP_PINDEX_READY = 1,
+  HTTP_PINDEX_DISABLED = 2,
+};
+
+static struct {
+  http_pindex_s *list;
+  fio_lock_i lock; /* protects the list and the maps */
+} http_pindex = {.lock = FIO_LOCK_INIT};
+
+/* updates a file name's reference count - call within the index lock */
+static void http_pindex_count(http_pindex_map_s *map, uint64_t hash,
+                              intptr_t diff) {
+  uintptr_t old = 0;
+  http_pindex_map_remove(map, hash, 0, &old);
+  if ((intptr_t)old + diff > 0)
+    http_pindex_map_overwrite(map, hash, old + diff, NULL);
+}
+
+/* (un)indexes a file, `.gz` files also index the uncompressed file name */
+static void http_pindex_file(http_pindex_map_s *map, const char *name,
+                             size_t len, intptr_t diff) {
+  http_pindex_count(map, fiobj_hash_string(name, len), diff);
+  if (len > 3 && name[len - 3] == '.' && name[len - 2] == 'g' &&
+      name[len - 1] == 'z')
+    http_pindex_count(map, fiobj_hash_string(name, len - 3), diff);
+}
+
+/**
+ * Indexes a folder's files (recursively), watching each folder for changes.
+ *
+ * `dir` is used as a buffer, `root_len` is the public folder's name length.
+ *
+ * Returns -1 if the index can't be trusted. Call within the file cache lock.
+ */
+static int http_pindex_walk_unsafe(http_pindex_map_s *map, FIOBJ dir,
+                                   size_t root_len, size_t depth) {
+  if (depth > 32)
+    return -1; /* symbolic link loops? */
+  const size_t dir_len = fiobj_obj2cstr(dir).len;
+  int wd = inotify_add_watch(http_fcache.inotify, fiobj_obj2cstr(dir).data,
+                             HTTP_FCACHE_WATCH_MASK);
+  if (wd < 0)
+    return -1;
+  if (!fiobj_ary_index(http_fcache.dirs, wd))
+    fiobj_ary_set(http_fcache.dirs, fiobj_str_copy(dir), wd);
+  DIR *d = opendir(fiobj_obj2cstr(dir).data);
+  if (!d)
+    return -1;
+  int ret = 0;
+  struct dirent *ent;
+  while (!ret && (ent = readdir(d))) {
+    if (ent->d_name[0] == '.' &&
+        (!ent->d_name[1] || (ent->d_name[1] == '.' && !ent->d_name[2])))
+      continue;
+    fiobj_str_write(dir, "/", 1);
+    fiobj_str_write(dir, ent->d_name, strlen(ent->d_name));
+    fio_str_info_s path = fiobj_obj2cstr(dir);
+    unsigned char type = ent->d_type;
+    if (type == DT_LNK || type == DT_UNKNOWN) {
+      struct stat st;
+      type = stat(path.data, &st) ? DT_UNKNOWN
+                                  : S_ISDIR(st.st_mode)
+                                        ? DT_DIR
+                                        : S_ISREG(st.st_mode) ? DT_REG
+                                                              : DT_UNKNOWN;
+    }
+    if (type == DT_DIR) {
+      ret = http_pindex_walk_unsafe(map, dir, root_len, depth + 1);
+    } else if (type == DT_REG) {
+      if (http_pindex_map_count(map) >= HTTP_PUBLIC_INDEX_LIMIT)
+        ret = -1;
+      else
+        http_pindex_file(map, path.data + root_len, path.len - root_len, 1);
+    }
+    fiobj_str_resize(dir, dir_len);
+  }
+  closedir(d);
+  return ret;
+}
+
+/* drops an index, so it won't be used - call within the index lock */
+static void http_pindex_disable_unsafe(http_pindex_s *idx, uint8_t state) {
+  http_pindex_map_free(&idx->map);
+  idx->map = (http_pindex_map_s)FIO_SET_INIT;
+  idx->state = state;
+}
+
+/* builds a public folder's index - call within the file cache lock */
+static void http_pindex_build_unsafe(http_pindex_s *idx) {
+  if (!http_fcache.initialized)
+    http_fcache_init_unsafe();
+  int ret = -1;
+  http_pindex_map_s map = FIO_SET_INIT;
+  if (http_fcache.watching) {
+    FIOBJ dir = fiobj_str_copy(idx->folder);
+    ret = http_pindex_walk_unsafe(&map, dir, fiobj_obj2cstr(dir).len, 0);
+    fiobj_free(dir);
+    fio_str_info_s f = fiobj_obj2cstr(idx->folder);
+    http_fcache_watch_links_unsafe(f.data, f.len);
+  }
+  fio_lock(&http_pindex.lock);
+  http_pindex_disable_unsafe(idx, HTTP_PINDEX_DISABLED);
+  if (!ret) {
+    idx->map = map;
+    idx->state = HTTP_PINDEX_READY;
+  }
+  fio_unlock(&http_pindex.lock);
+  if (ret) {
+    http_pindex_map_free(&map);
+    FIO_LOG_DEBUG("(HTTP) the public folder %s can't be indexed (or watched), "
+                  "every request will test the file system.",
+                  fiobj_obj2cstr(idx->folder).data);
+  }
+}
+
+/* updates the indexes after a file system event - call within the cache lock */
+static void http_pindex_on_event_unsafe(FIOBJ path, uint32_t mask) {
+  if (!(mask & (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO)))
+    return;
+  const intptr_t diff = (mask & (IN_CREATE | IN_MOVED_TO)) ? 1 : -1;
+  fio_str_info_s p = fiobj_obj2cstr(path);
+  for (http_pindex_s *idx = http_pindex.list; idx; idx = idx->next) {
+    fio_str_info_s f = fiobj_obj2cstr(idx->folder);
+    if (idx->state != HTTP_PINDEX_READY || p.len <= f.len ||
+        p.data[f.len] != '/' || memcmp(p.data, f.data, f.len))
+      continue;
+    if (diff > 0) {
+      struct stat st;
+      if ((mask & IN_ISDIR) ||
+          (!stat(p.data, &st) && S_ISDIR(st.st_mode))) {
+        /* a new folder, index its content */
+        http_pindex_map_s map = FIO_SET_INIT;
+        FIOBJ dir = fiobj_str_copy(path);
+        int ret = http_pindex_walk_unsafe(&map, dir, f.len, 1);
+        fiobj_free(dir);
+        fio_lock(&http_pindex.lock);
+        if (!ret && http_pindex_map_count(&idx->map) +
+                            http_pindex_map_count(&map) <=
+                        HTTP_PUBLIC_INDEX_LIMIT) {
+          FIO_SET_FOR_LOOP(&map, pos) {
+            if (pos->obj)
+              http_pindex_count(&idx->map, pos->hash, pos->obj);
+          }
+        } else {
+          http_pindex_disable_unsafe(idx, HTTP_PINDEX_DISABLED);
+        }
+        fio_unlock(&http_pindex.lock);
+        http_pindex_map_free(&map);
+        continue;
+      }
+    } else if (mask & IN_ISDIR) {
+      continue; /* stale entries for a removed folder are harmless */
+    }
+    fio_lock(&http_pindex.lock);
+    http_pindex_file(&idx->map, p.data + f.len, p.len - f.len, diff);
+    fio_unlock(&http_pindex.lock);
+  }
+}
+
+/* drops all indexes, they're rebuilt when required - call within the lock */
+static void http_pindex_reset_unsafe(void) {
+  fio_lock(&http_pindex.lock);
+  for (http_pindex_s *idx = http_pindex.list; idx; idx = idx->next)
+    http_pindex_disable_unsafe(idx, HTTP_PINDEX_EMPTY);
+  fio_unlock(&http_pindex.lock);
+}
+
+/* the parent's watches are gone, so each worker rebuilds the indexes */
+static void http_pindex_on_fork(void) {
+  http_pindex.lock = FIO_LOCK_INIT;
+  http_pindex_reset_unsafe();
+}
+
+/* frees the indexes (at exit) */
+static void http_pindex_free(void) {
+  while (http_pindex.list) {
+    http_pindex_s *idx = http_pindex.list;
+    http_pindex.list = idx->next;
+    http_pindex_map_free(&idx->map);
+    fiobj_free(idx->folder);
+    fio_free(idx);
+  }
+}
+
+/**
+ * Tests the public folder's index for the requested (URL encoded) path.
+ *
+ * Returns -1 if the file is known to be missing or 0 if the file might exist
+ * (the file system should be tested).
+ */
+int http_public_index_test(const char *folder, size_t folder_len,
+                           const char *path, size_t path_len) {
+  while (folder_len > 1 && folder[folder_len - 1] == '/')
+    --folder_len;
+  if (!folder_len || !path_len || path[0] != '/' || path_len > 1024)
+    return 0;
+  /* URL encoded and unusual (`/./`) paths are left to the file system */
+  for (size_t i = 0; i < path_len; ++i) {
+    if (path[i] == '%' || (path[i] == '/' && i + 1 < path_len &&
+                           (path[i + 1] == '.' || path[i + 1] == '/')))
+      return 0;
+  }
+  http_pindex_s *idx;
+  fio_lock(&http_pindex.lock);
+  for (idx = http_pindex.list; idx; idx = idx->next) {
+    fio_str_info_s f = fiobj_obj2cstr(idx->folder);
+    if (f.len == folder_len && !memcmp(f.data, folder, folder_len))
+      break;
+  }
+  if (!idx) {
+    idx = fio_malloc(sizeof(*idx));
+    FIO_ASSERT_ALLOC(idx);
+    *idx = (http_pindex_s){
+        .next = http_pindex.list,
+        .folder = fiobj_str_new(folder, folder_len),
+        .map = FIO_SET_INIT,
+    };
+    http_pindex.list = idx;
+  }
+  fio_unlock(&http_pindex.lock);
+  if (idx->state == HTTP_PINDEX_EMPTY) {
+    fio_lock(&http_fcache.lock);
+    if (idx->state == HTTP_PINDEX_EMPTY)
+      http_pindex_build_unsafe(idx);
+    fio_unlock(&http_fcache.lock);
+  }
+  if (idx->state != HTTP_PINDEX_READY)
+    return 0;
+  uint64_t hash;
+  if (path[path_len - 1] == '/') {
+    char buf[1040];
+    memcpy(buf, path, path_len);
+    memcpy(buf + path_len, "index.html", 10);
+    hash = fiobj_hash_string(buf, path_len + 10);
+  } else {
+    hash = fiobj_hash_string(path, path_len);
+  }
+  fio_lock(&http_pindex.lock);
+  int ret = (idx->state != HTTP_PINDEX_READY ||
+             http_pindex_map_find(&idx->map, hash, 0))
+                ? 0
+                : -1;
+  fio_unlock(&http_pindex.lock);
+  return ret;
+}
+#endif
+
+#if defined(__linux__)
+/* reads inotify events and invalidates the related cache entries */
+static void http_fcache_on_data(intptr_t uuid, fio_protocol_s *pr) {
+  char buf[4096]
+      __attribute__((aligned(__alignof__(struct inotify_event))));
+  ssize_t len;
+  while ((len = fio_read(uuid, buf, sizeof(buf))) > 0) {
+    fio_lock(&http_fcache.lock);
+    for (char *pos = buf; pos < buf + len;) {
+      struct inotify_event *ev = (struct inotify_event *)pos;
+      pos += sizeof(*ev) + ev->len;
+      if (ev->mask & (IN_Q_OVERFLOW | IN_IGNORED | IN_DELETE_SELF |
+                      IN_MOVE_SELF)) {
+        /* lost track of the folder (or of events), start fresh */
+        if (ev->wd >= 0)
+          fiobj_ary_set(http_fcache.dirs, FIOBJ_INVALID, ev->wd);
+        http_fcache_clear_unsafe();
+        http_pindex_reset_unsafe();
+        continue;
+      }
+      if (!ev->len)
+        continue;
+      FIOBJ dir = fiobj_ary_index(http_fcache.dirs, ev->wd);
+      if (!dir)
+        continue;
+      FIOBJ path = fiobj_str_tmp();
+      fiobj_str_join(path, dir);
+      fiobj_str_write(path, "/", 1);
+      fiobj_str_write(path, ev->name, strlen(ev->name));
+      if (fiobj_hash_get(http_fcache.links, path)) {
+        /* a symbolic link was replaced (i.e., a deployment), start fresh */
+        fiobj_hash_delete(http_fcache.links, path);
+        http_fcache_clear_unsafe();
+        http_pindex_reset_unsafe();
+        continue;
+      }
+      http_fcache_forget_unsafe(path);
+      http_pindex_on_event_unsafe(path, ev->mask);
+    }
+    fio_unlock(&http_fcache.lock);
+  }
+  (void)pr;
+}
+
+/* called if the inotify file descriptor is closed (i.e., after `fork`) */
+static void http_fcache_on_close(intptr_t uuid, fio_protocol_s *pr) {
+  /* may run while forking, so the lock must be avoided */
+  http_fcache.watching = 0;
+  http_fcache.inotify = -1;
+  (void)uuid;
+  (void)pr;
+}
+
+static uint8_t http_fcache_on_shutdown(intptr_t uuid, fio_protocol_s *pr) {
+  return 255; /* never close the watcher before the server stops */
+  (void)uuid;
+  (void)pr;
+}
+
+static void http_fcache_ping(intptr_t uuid, fio_protocol_s *pr) {
+  fio_touch(uuid);
+  (void)pr;
+}
+
+static fio_protocol_s HTTP_FCACHE_WATCHER = {
+    .on_data = http_fcache_on_data,
+    .on_close = http_fcache_on_close,
+    .on_shutdown = http_fcache_on_shutdown,
+    .ping = http_fcache_ping,
+};
+
+/*
+ * Watches the folder containing a symbolic link (a path's prefix), so replacing
+ * the link (i.e., `ln -sfn` deployments) is noticed even though the watches
+ * follow the link's original target - call within the lock.
+ */
+static void http_fcache_watch_links_unsafe(const char *path, size_t len) {
+  char buf[1024];
+  if (!len || len >= sizeof(buf))
+    return;
+  memcpy(buf, path, len);
+  buf[len] = 0;
+  size_t name = (buf[0] == '/'); /* the path component's offset */
+  for (size_t i = name + 1; i <= len; ++i) {
+    if (i < len && buf[i] != '/')
+      continue;
+    struct stat st;
+    buf[i] = 0;
+    if (!lstat(buf, &st) && S_ISLNK(st.st_mode)) {
+      /* watch the link's folder (`.` for a relative path's first component) */
+      const char *dir_name = ".";
+      if (name > 1) {
+        buf[name - 1] = 0;
+        dir_name = buf;
+      } else if (name == 1) {
+        dir_name = "/";
+      }
+      int wd = inotify_add_watch(http_fcache.inotify, dir_name,
+                                 HTTP_FCACHE_WATCH_MASK);
+      if (wd >= 0 && !fiobj_ary_index(http_fcache.dirs, wd))
+        fiobj_ary_set(http_fcache.dirs,
+                      (name ? fiobj_str_new(buf, name - 1)
+                            : fiobj_str_new(".", 1)),
+                      wd);
+      if (name > 1)
+        buf[name - 1] = '/';
+      if (wd >= 0) {
+        /* the name events for the link produce (see `http_fcache_on_data`) */
+        FIOBJ key = fiobj_str_copy(fiobj_ary_index(http_fcache.dirs, wd));
+        fiobj_str_write(key, "/", 1);
+        fiobj_str_write(key, buf + name, i - name);
+        fiobj_hash_set(http_fcache.links, key, fiobj_true());
+        fiobj_free(key);
+      }
+    }
+    if (i < len)
+      buf[i] = '/';
+    name = i + 1;
+  }
+}
+
+/* watches the folder containing the file - call within the lock */
+static void http_fcache_watch_unsafe(FIOBJ path) {
+  if (!http_fcache.watching)
+    return;
+  fio_str_info_s s = fiobj_obj2cstr(path);
+  size_t dir_len = s.len;
+  while (dir_len && s.data[dir_len - 1] != '/')
+    --dir_len;
+  if (!dir_len)
+    return;
+  --dir_len;
+  char *dir_name = fio_malloc(dir_len + 1);
+  FIO_ASSERT_ALLOC(dir_name);
+  memcpy(dir_name, s.data, dir_len);
+  dir_name[dir_len] = 0;
+  int wd = inotify_add_watch(http_fcache.inotify, dir_len ? dir_name : "/",
+                             HTTP_FCACHE_WATCH_MASK);
+  if (wd >= 0 && !fiobj_ary_index(http_fcache.dirs, wd)) {
+    fiobj_ary_set(http_fcache.dirs, fiobj_str_new(s.data, dir_len), wd);
+    /* a new folder, its path might pass through symbolic links */
+    http_fcache_watch_links_unsafe(s.data, dir_len);
+  }
+  fio_free(dir_name);
+}
+
+/* starts watching the file system (if possible) - call within the lock */
+static void http_fcache_init_unsafe(void) {
+  http_fcache.initialized = 1;
+  if (!http_fcache.dirs)
+    http_fcache.dirs = fiobj_ary_new();
+  if (!http_fcache.links)
+    http_fcache.links = fiobj_hash_new();
+  http_fcache.inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (http_fcache.inotify == -1) {
+    FIO_LOG_DEBUG("(HTTP) static file cache can't use inotify, "
+                  "falling back to timed revalidation.");
+    return;
+  }
+  http_fcache.watching = 1;
+  fio_attach_fd(http_fcache.inotify, &HTTP_FCACHE_WATCHER);
+}
+#else
+#define http_fcache_watch_unsafe(path)
+static void http_fcache_init_unsafe(void) { http_fcache.initialized = 1; }
+#define http_pindex_reset_unsafe()
+#define http_pindex_on_fork()
+#define http_pindex_free()
+
+/** Without `inotify`, the public folder can't be indexed. */
+int http_public_index_test(const char *folder, size_t folder_len,
+                           const char *path, size_t path_len) {
+  return 0;
+  (void)folder;
+  (void)folder_len;
+  (void)path;
+  (void)path_len;
+}
+#endif
+
+/* the parent's cache is dropped, so each worker watches its own files */
+static void http_fcache_on_fork(void *ignr_) {
+  http_fcache.lock = FIO_LOCK_INIT;
+  http_fcache_clear_unsafe();
+  http_pindex_on_fork();
+  fiobj_free(http_fcache.dirs);
+  http_fcache.dirs = FIOBJ_INVALID;
+  fiobj_free(http_fcache.links);
+  http_fcache.links = FIOBJ_INVALID;
+  http_fcache.initialized = 0;
+  http_fcache.watching = 0;
+  http_fcache.inotify = -1;
+  (void)ignr_;
+}
+
+static void http_fcache_cleanup(void *ignr_) {
+  fio_lock(&http_fcache.lock);
+  http_fcache_clear_unsafe();
+  http_pindex_free();
+  fiobj_free(http_fcache.dirs);
+  http_fcache.dirs = FIOBJ_INVALID;
+  fiobj_free(http_fcache.links);
+  http_fcache.links = FIOBJ_INVALID;
+  fio_unlock(&http_fcache.lock);
+  (void)ignr_;
+}
+
+static __attribute__((constructor)) void http_fcache_constructor(void) {
+  fio_state_callback_add(FIO_CALL_IN_CHILD, http_fcache_on_fork, NULL);
+  fio_state_callback_add(FIO_CALL_AT_EXIT, http_fcache_cleanup, NULL);
+}
+
+/* loads a file's data, returns NULL if the file is missing */
+static http_fcache_entry_s *http_fcache_load(FIOBJ path) {
+  struct stat file_data = {.st_size = 0};
+  fio_str_info_s s = fiobj_obj2cstr(path);
+  if (stat(s.data, &file_data) || !S_ISREG(file_data.st_mode))
+    return NULL;
+  int fd = open(s.data, O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    FIO_LOG_ERROR("(HTTP) couldn't open file %s!\n", s.data);
+    perror("     ");
+    return NULL;
+  }
+  FIOBJ body = FIOBJ_INVALID;
+  /* `memory` is read without the lock, it's tested again before caching */
+  if (file_data.st_size <= HTTP_FILE_CACHE_SMALL_FILE &&
+      http_fcache.memory + file_data.st_size <= HTTP_FILE_CACHE_MEMORY) {
+    /* small files are served from memory, saving the file descriptor */
+    body = fiobj_str_buf(file_data.st_size);
+    fio_str_info_s b = fiobj_obj2cstr(body);
+    if (pread(fd, b.data, file_data.st_size, 0) == file_data.st_size) {
+      fiobj_str_resize(body, file_data.st_size);
+      fiobj_str_freeze(body);
+      close(fd);
+      fd = -1;
+    } else {
+      fiobj_free(body);
+      body = FIOBJ_INVALID;
+    }
+  }
+  http_fcache_entry_s *e = fio_malloc(sizeof(*e));
+  FIO_ASSERT_ALLOC(e);
+  *e = (http_fcache_entry_s){
+      .path = fiobj_str_copy(path),
+      .etag = fiobj_str_buf(32),
+      .last_modified = fiobj_str_buf(32),
+      .body = body,
+      .fd = fd,
+      .size = file_data.st_size,
+      .loaded_at = fio_last_tick().tv_sec,
+  };
+  fiobj_str_resize(e->last_modified,
+                   http_time2str(fiobj_obj2cstr(e->last_modified).data,
+                                 file_data.st_mtime));
+  uint64_t etag = (uint64_t)file_data.st_size;
+  etag ^= (uint64_t)file_data.st_mtime;
+  etag = fiobj_hash_string(&etag, sizeof(uint64_t));
+  fiobj_str_resize(e->etag, fio_base64_encode(fiobj_obj2cstr(e->etag).data,
+                                              (void *)&etag, sizeof(uint64_t)));
+  return e;
+}
+
+/**
+ * Finds (or loads) a file's cached data, returning 0 on success and -1 if the
+ * file is missing or an error occurred.
+ *
+ * On success (unless `file` is NULL), either `file->body` holds the (small)
+ * file's content or `file->fd` is a duplicate file descriptor. These should be
+ * released using `http_fcache_release` and `file->etag` and
+ * `file->last_modified` must be freed using `fiobj_free`.
+ *
+ * If `cache_missing` is set, a missing file will be remembered as such.
+ */
+static int http_fcache_get(http_fcache_entry_s *file, FIOBJ path,
+                           uint8_t cache_missing) {
+  http_fcache_entry_s tmp = {.path = path};
+  const uint64_t hash = fiobj_obj2hash(path);
+  http_fcache_entry_s *e;
+  http_fcache_entry_s *uncached = NULL;
+  fio_lock(&http_fcache.lock);
+  if (!http_fcache.initialized)
+    http_fcache_init_unsafe();
+  e = http_fcache_map_find(&http_fcache.map, hash, &tmp);
+  if (e && !http_fcache.watching &&
+      fio_last_tick().tv_sec - e->loaded_at >= HTTP_FILE_CACHE_TTL) {
+    http_fcache_remove_unsafe(e);
+    e = NULL;
+  }
+  if (!e) {
+    ++http_fcache.misses;
+    /* perform IO outside the lock */
+    fio_unlock(&http_fcache.lock);
+    http_fcache_entry_s *loaded = http_fcache_load(path);
+    if (!loaded && !cache_missing)
+      return -1;
+    if (!loaded) {
+      loaded = fio_malloc(sizeof(*loaded));
+      FIO_ASSERT_ALLOC(loaded);
+      *loaded = (http_fcache_entry_s){
+          .path = fiobj_str_copy(path),
+          .fd = -1,
+          .loaded_at = fio_last_tick().tv_sec,
+      };
+    }
+    fio_lock(&http_fcache.lock);
+    e = http_fcache_map_find(&http_fcache.map, hash, &tmp);
+    if (e) {
+      /* another thread loaded the same file */
+      http_fcache_entry_free(loaded);
+    } else if (loaded->body &&
+               http_fcache.memory + loaded->size > HTTP_FILE_CACHE_MEMORY) {
+      /* other files used up the memory while the file was loaded */
+      e = uncached = loaded;
+    } else {
+      e = loaded;
+      http_fcache_map_insert(&http_fcache.map, hash, e);
+      fio_ls_embd_push(&http_fcache.lru, &e->node);
+      if (e->body)
+        http_fcache.memory += e->size;
+      http_fcache_watch_unsafe(path);
+    }
+  } else {
+    ++http_fcache.hits;
+    /* mark as most recently used */
+    fio_ls_embd_remove(&e->node);
+    fio_ls_embd_push(&http_fcache.lru, &e->node);
+  }
+  int ret = e->etag ? 0 : -1;
+  if (file && !ret) {
+    *file = (http_fcache_entry_s){
+        .etag = fiobj_dup(e->etag),
+        .last_modified = fiobj_dup(e->last_modified),
+        .body = fiobj_dup(e->body),
+        /* the duplicate shares the file offset with the cached descriptor,
+         * which is safe only because `pread` / `sendfile` use explicit
+         * offsets (the offset is never read or moved) */
+        .fd = (e->body ? -1 : dup(e->fd)),
+        .size = e->size,
+    };
+  }
+  while (http_fcache_map_count(&http_fcache.map) > HTTP_FILE_CACHE_LIMIT) {
+    /* evict the least recently used files */
+    http_fcache_remove_unsafe(FIO_LS_EMBD_OBJ(http_fcache_entry_s, node,
+                                              http_fcache.lru.prev));
+  }
+  fio_unlock(&http_fcache.lock);
+  if (uncached)
+    http_fcache_entry_free(uncached); /* `file` holds its own references */
+  if (file && !ret && !file->body && file->fd == -1) {
+    fiobj_free(file->etag);
+    fiobj_free(file->last_modified);
+    return -1;
+  }
+  return ret;
+}
+
+/**
+ * Returns the gzip compressed content of a file collected by `http_fcache_get`
+ * (compressing it if required), or FIOBJ_INVALID if the file shouldn't be
+ * compressed.
+ */
+static FIOBJ http_fcache_gzip(FIOBJ path, http_fcache_entry_s *file) {
+  http_fcache_entry_s tmp = {.path = path};
+  const uint64_t hash = fiobj_obj2hash(path);
+  http_fcache_entry_s *e;
+  FIOBJ out = FIOBJ_INVALID;
+  uint8_t no_gzip = 0;
+  fio_lock(&http_fcache.lock);
+  e = http_fcache_map_find(&http_fcache.map, hash, &tmp);
+  /* `file` holds a reference, so the `etag` pointer identifies the entry */
+  if (e && e->etag == file->etag) {
+    out = fiobj_dup(e->gzip);
+    no_gzip = e->no_gzip;
+  }
+  fio_unlock(&http_fcache.lock);
+  if (out || no_gzip)
+    return out;
+  /* compress outside the lock */
+  if (file->body) {
+    fio_str_info_s b = fiobj_obj2cstr(file->body);
+    out = http_compress(b.data, b.len, HTTP_ENCODING_GZIP);
+  } else {
+    FIOBJ buf = fiobj_str_buf(file->size);
+    fio_str_info_s b = fiobj_obj2cstr(buf);
+    if (pread(file->fd, b.data, file->size, 0) == file->size)
+      out = http_compress(b.data, file->size, HTTP_ENCODING_GZIP);
+    else
+      no_gzip = 1; /* don't mark the file, this might be a transient error */
+    fiobj_free(buf);
+  }
+  if (no_gzip)
+    return out;
+  fio_lock(&http_fcache.lock);
+  e = http_fcache_map_find(&http_fcache.map, hash, &tmp);
+  if (e && e->etag == file->etag && !e->gzip) {
+    if (!out) {
+      e->no_gzip = 1;
+    } else if (http_fcache.gzip_memory + fiobj_obj2cstr(out).len <=
+               HTTP_COMPRESS_CACHE_MEMORY) {
+      e->gzip = fiobj_dup(out);
+      http_fcache.gzip_memory += fiobj_obj2cstr(out).len;
+    }
+  }
+  fio_unlock(&http_fcache.lock);
+  return out;
+}
+
+/** Collects the static file cache statistics for the calling process. */
+void http_sendfile_cache_stats(http_sendfile_cache_stats_s *stats) {
+  fio_lock(&http_fcache.lock);
+  *stats = (http_sendfile_cache_stats_s){
+      .files = http_fcache_map_count(&http_fcache.map),
+      .files_limit = HTTP_FILE_CACHE_LIMIT,
+      .memory = http_fcache.memory,
+      .memory_limit = HTTP_FILE_CACHE_MEMORY,
+      .hits = http_fcache.hits,
+      .misses = http_fcache.misses,
+  };
+  fio_unlock(&http_fcache.lock);
+}
+
 static inline int http_test_encoded_path(const char *mem, size_t len) {
   const char *pos = NULL;
   const char *end = mem + len;
@@ -380,7 +1673,6 @@ int http_sendfile2(http_s *h, const char *prefix, size_t prefix_len,
                    const char *encoded, size_t encoded_len) {
   if (HTTP_INVALID_HANDLE(h))
     return -1;
-  struct stat file_data = {.st_size = 0};
   static uint64_t accept_enc_hash = 0;
   if (!accept_enc_hash)
     accept_enc_hash = fiobj_hash_string("accept-encoding", 15);
@@ -424,7 +1716,7 @@ int http_sendfile2(http_s *h, const char *prefix, size_t prefix_len,
   }
   /* test for file existance  */
 
-  int file = -1;
+  http_fcache_entry_s file = {.fd = -1};
   uint8_t is_gz = 0;
 
   fio_str_info_s s = fiobj_obj2cstr(filename);
@@ -437,38 +1729,32 @@ int http_sendfile2(http_s *h, const char *prefix, size_t prefix_len,
       goto no_gzip_support;
     if (s.data[s.len - 3] != '.' || s.data[s.len - 2] != 'g' ||
         s.data[s.len - 1] != 'z') {
+      /* remember missing `gz` variants only for existing files */
+      uint8_t has_original = !http_fcache_get(NULL, filename, 0);
       fiobj_str_write(filename, ".gz", 3);
       s = fiobj_obj2cstr(filename);
-      if (!stat(s.data, &file_data) &&
-          (S_ISREG(file_data.st_mode) || S_ISLNK(file_data.st_mode))) {
+      if (!http_fcache_get(&file, filename, has_original)) {
         is_gz = 1;
         goto found_file;
       }
       fiobj_str_resize(filename, s.len - 3);
+      if (!has_original)
+        return -1;
     }
   }
 no_gzip_support:
-  if (stat(s.data, &file_data) ||
-      !(S_ISREG(file_data.st_mode) || S_ISLNK(file_data.st_mode)))
+  if (http_fcache_get(&file, filename, 0))
     return -1;
 found_file:
   /* set last-modified */
-  {
-    FIOBJ tmp = fiobj_str_buf(32);
-    fiobj_str_resize(
-        tmp, http_time2str(fiobj_obj2cstr(tmp).data, file_data.st_mtime));
-    http_set_header(h, HTTP_HEADER_LAST_MODIFIED, tmp);
-  }
-  /* set cache-control */
-  http_set_header(h, HTTP_HEADER_CACHE_CONTROL, fiobj_dup(HTTP_HVALUE_MAX_AGE));
+  http_set_header(h, HTTP_HEADER_LAST_MODIFIED, file.last_modified);
+  /* set cache-control (unless set by the application) */
+  if (!fiobj_hash_get2(h->private_data.out_headers,
+                       fiobj_obj2hash(HTTP_HEADER_CACHE_CONTROL)))
+    http_set_header(h, HTTP_HEADER_CACHE_CONTROL,
+                    fiobj_dup(HTTP_HVALUE_MAX_AGE));
   /* set & test etag */
-  uint64_t etag = (uint64_t)file_data.st_size;
-  etag ^= (uint64_t)file_data.st_mtime;
-  etag = fiobj_hash_string(&etag, sizeof(uint64_t));
-  FIOBJ etag_str = fiobj_str_buf(32);
-  fiobj_str_resize(etag_str,
-                   fio_base64_encode(fiobj_obj2cstr(etag_str).data,
-                                     (void *)&etag, sizeof(uint64_t)));
+  FIOBJ etag_str = file.etag;
   /* set */
   http_set_header(h, HTTP_HEADER_ETAG, etag_str);
   /* test */
@@ -477,7 +1763,15 @@ found_file:
     if (!none_match_hash)
       none_match_hash = fiobj_hash_string("if-none-match", 13);
     FIOBJ tmp2 = fiobj_hash_get2(h->headers, none_match_hash);
-    if (tmp2 && fiobj_iseq(tmp2, etag_str)) {
+    fio_str_info_s inm = fiobj_obj2cstr(tmp2);
+    fio_str_info_s et = fiobj_obj2cstr(etag_str);
+    /* weak comparison, compressed variants use a weak etag */
+    if (inm.len > 2 && inm.data[0] == 'W' && inm.data[1] == '/') {
+      inm.data += 2;
+      inm.len -= 2;
+    }
+    if (tmp2 && inm.len == et.len && !memcmp(inm.data, et.data, et.len)) {
+      http_fcache_release(&file);
       h->status = 304;
       http_finish(h);
       return 0;
@@ -485,7 +1779,7 @@ found_file:
   }
   /* handle range requests */
   int64_t offset = 0;
-  int64_t length = file_data.st_size;
+  int64_t length = file.size;
   {
     static uint64_t ifrange_hash = 0;
     if (!ifrange_hash)
@@ -503,31 +1797,38 @@ found_file:
         if (!range.data || memcmp("bytes=", range.data, 6))
           goto open_file;
         char *pos = range.data + 6;
-        int64_t start_at = 0, end_at = 0;
-        start_at = fio_atol(&pos);
-        if (start_at >= file_data.st_size)
-          goto open_file;
-        if (start_at >= 0) {
-          pos++;
-          end_at = fio_atol(&pos);
-          if (end_at <= 0)
-            goto open_file;
-        }
+        int64_t start_at, end_at;
         /* we ignore multimple ranges, only responding with the first range. */
-        if (start_at < 0) {
-          if (0 - start_at < file_data.st_size) {
-            offset = file_data.st_size - start_at;
-            length = 0 - start_at;
-          }
-        } else if (end_at) {
-          offset = start_at;
-          length = end_at - start_at + 1;
-          if (length + start_at > file_data.st_size || length <= 0)
-            length = length - start_at;
+        if (*pos == '-') {
+          /* a suffix range (the last N bytes) */
+          ++pos;
+          if (*pos < '0' || *pos > '9')
+            goto open_file;
+          const int64_t suffix = fio_atol(&pos);
+          if (suffix <= 0 || !file.size)
+            goto range_not_satisfiable;
+          start_at = (suffix < file.size ? file.size - suffix : 0);
+          end_at = file.size - 1;
         } else {
-          offset = start_at;
-          length = length - start_at;
+          if (*pos < '0' || *pos > '9')
+            goto open_file;
+          start_at = fio_atol(&pos);
+          if (*pos != '-')
+            goto open_file;
+          ++pos;
+          end_at = file.size - 1;
+          if (*pos >= '0' && *pos <= '9') {
+            end_at = fio_atol(&pos);
+            if (end_at < start_at)
+              goto open_file; /* invalid ranges are ignored */
+          }
+          if (start_at >= file.size)
+            goto range_not_satisfiable;
+          if (end_at >= file.size)
+            end_at = file.size - 1;
         }
+        offset = start_at;
+        length = end_at - start_at + 1;
         h->status = 206;
 
         {
@@ -535,7 +1836,7 @@ found_file:
           fiobj_str_printf(cranges, "bytes %lu-%lu/%lu",
                            (unsigned long)start_at,
                            (unsigned long)(start_at + length - 1),
-                           (unsigned long)file_data.st_size);
+                           (unsigned long)file.size);
           http_set_header(h, HTTP_HEADER_CONTENT_RANGE, cranges);
         }
         http_set_header(h, HTTP_HEADER_ACCEPT_RANGES,
@@ -548,6 +1849,7 @@ found_file:
   switch (s.len) {
   case 7:
     if (!strncasecmp("options", s.data, 7)) {
+      http_fcache_release(&file);
       http_set_header2(h, (fio_str_info_s){.data = (char *)"allow", .len = 5},
                        (fio_str_info_s){.data = (char *)"GET, HEAD", .len = 9});
       h->status = 200;
@@ -561,6 +1863,7 @@ found_file:
     break;
   case 4:
     if (!strncasecmp("head", s.data, 4)) {
+      http_fcache_release(&file);
       http_set_header(h, HTTP_HEADER_CONTENT_LENGTH, fiobj_num_new(length));
       http_finish(h);
       return 0;
@@ -568,23 +1871,32 @@ found_file:
     goto open_file;
     break;
   }
+  http_fcache_release(&file);
   http_send_error(h, 403);
   return 0;
+range_not_satisfiable:
+  http_fcache_release(&file);
+  {
+    FIOBJ cranges = fiobj_str_buf(1);
+    fiobj_str_printf(cranges, "bytes */%lu", (unsigned long)file.size);
+    http_set_header(h, HTTP_HEADER_CONTENT_RANGE, cranges);
+  }
+  http_send_error(h, 416);
+  return 0;
 open_file:
   s = fiobj_obj2cstr(filename);
-  file = open(s.data, O_RDONLY);
-  if (file == -1) {
-    FIO_LOG_ERROR("(HTTP) couldn't open file %s!\n", s.data);
-    perror("     ");
-    http_send_error(h, 500);
-    return 0;
-  }
   {
     FIOBJ tmp = 0;
     uintptr_t pos = 0;
+    /* keep the content type set by the application (X-Sendfile / `to_path`) */
+    const uint8_t has_type =
+        fiobj_hash_get2(h->private_data.out_headers,
+                        fiobj_obj2hash(HTTP_HEADER_CONTENT_TYPE)) !=
+        FIOBJ_INVALID;
     if (is_gz) {
       http_set_header(h, HTTP_HEADER_CONTENT_ENCODING,
                       fiobj_dup(HTTP_HVALUE_GZIP));
+      http_vary_accept_encoding(h);
 
       pos = s.len - 4;
       while (pos && s.data[pos] != '.')
@@ -598,11 +1910,46 @@ open_file:
         pos--;
       pos++; /* assuming, but that's fine. */
       tmp = http_mimetype_find(s.data + pos, s.len - pos);
+      http_settings_s *settings = http_settings(h);
+      if (settings->compress && h->status != 206 &&
+          length >= (int64_t)settings->compress &&
+          length <= HTTP_COMPRESS_STATIC_LIMIT &&
+          http_compress_type_allowed(tmp)) {
+        /* compress on the fly (once), unless a `.gz` file was provided */
+        http_vary_accept_encoding(h);
+        FIOBJ gz = FIOBJ_INVALID;
+        if (http_accepted_encoding(h) == HTTP_ENCODING_GZIP)
+          gz = http_fcache_gzip(filename, &file);
+        if (gz) {
+          http_fcache_release(&file);
+          if (has_type)
+            fiobj_free(tmp);
+          else
+            http_set_header(h, HTTP_HEADER_CONTENT_TYPE, tmp);
+          http_set_header(h, HTTP_HEADER_CONTENT_ENCODING,
+                          fiobj_dup(HTTP_HVALUE_GZIP));
+          http_weaken_etag(h);
+          fio_str_info_s body = fiobj_obj2cstr(gz);
+          http_send_body(h, body.data, body.len);
+          fiobj_free(gz);
+          return 0;
+        }
+      }
     }
-    if (tmp)
+    if (has_type)
+      fiobj_free(tmp);
+    else if (tmp)
       http_set_header(h, HTTP_HEADER_CONTENT_TYPE, tmp);
   }
-  http_sendfile(h, file, length, offset);
+  if (file.body) {
+    /* small files are sent from memory, along with the headers */
+    fio_str_info_s body = fiobj_obj2cstr(file.body);
+    add_content_type(h);
+    http_send_body(h, body.data + offset, length);
+    fiobj_free(file.body);
+    return 0;
+  }
+  http_sendfile(h, file.fd, length, offset);
   return 0;
 }
 
@@ -796,6 +2143,19 @@ intptr_t http_hijack(http_s *h, fio_str_info_s *leftover) {
   return ((http_vtable_s *)h->private_data.vtbl)->http_hijack(h, leftover);
 }
 
+/**
+ * Reads up to `length` bytes of a streamed request body (see the `stream_body`
+ * setting) directly from the connection.
+ */
+ssize_t http_body_read(http_s *h, void *buffer, size_t length) {
+  if (HTTP_INVALID_HANDLE(h))
+    return 0;
+  http_vtable_s *vtbl = (http_vtable_s *)h->private_data.vtbl;
+  if (!vtbl->http_body_read)
+    return 0;
+  return vtbl->http_body_read(h, buffer, length);
+}
+
 /* *****************************************************************************
 Setting the default settings and allocating a persistent copy
 ***************************************************************************** */
@@ -819,6 +2179,8 @@ static http_settings_s *http_settings_new(http_settings_s arg_settings) {
 
   if (!arg_settings.max_body_size)
     arg_settings.max_body_size = HTTP_DEFAULT_BODY_LIMIT;
+  if (!arg_settings.max_body_memory)
+    arg_settings.max_body_memory = HTTP_DEFAULT_BODY_MEMORY;
   if (!arg_settings.timeout)
     arg_settings.timeout = 40;
   if (!arg_settings.ws_max_msg_size)
@@ -827,6 +2189,8 @@ static http_settings_s *http_settings_new(http_settings_s arg_settings) {
     arg_settings.ws_timeout = 40; /* defaults to 40 seconds */
   if (!arg_settings.max_header_size)
     arg_settings.max_header_size = 32 * 1024; /* defaults to 32Kib seconds */
+  if (!arg_settings.pipeline)
+    arg_settings.pipeline = 8; /* defaults to 8 requests per read cycle */
   if (arg_settings.max_clients <= 0 ||
       (size_t)(arg_settings.max_clients + HTTP_BUSY_UNLESS_HAS_FDS) >
           fio_capa()) {
@@ -1232,10 +2596,43 @@ static inline void http_sse_copy2str(FIOBJ dest, char *prefix, size_t pre_len,
   }
 }
 
+/** Formats an SSE event, returning a FIOBJ String. */
+static FIOBJ http_sse_format(struct http_sse_write_args args) {
+  FIOBJ buf;
+  {
+    /* best guess at data length, ignoring missing fields and multiline data */
+    const size_t total = 4 + args.id.len + 2 + 7 + args.event.len + 2 + 6 +
+                         args.data.len + 2 + 7 + 10 + 4;
+    buf = fiobj_str_buf(total);
+  }
+  http_sse_copy2str(buf, (char *)"id: ", 4, args.id);
+  http_sse_copy2str(buf, (char *)"event: ", 7, args.event);
+  if (args.retry) {
+    FIOBJ i = fiobj_num_new(args.retry);
+    fiobj_str_write(buf, (char *)"retry: ", 7);
+    fiobj_str_join(buf, i);
+    fiobj_free(i);
+  }
+  http_sse_copy2str(buf, (char *)"data: ", 6, args.data);
+  fiobj_str_write(buf, "\r\n", 2);
+  return buf;
+}
+
+static void http_sse_on_message__direct(http_sse_s *sse, fio_str_info_s channel,
+                                        fio_str_info_s msg, void *udata);
+
 /** The on message callback. the `*msg` pointer is to a temporary object. */
 static void http_sse_on_message(fio_msg_s *msg) {
   http_sse_internal_s *sse = msg->udata1;
   struct http_sse_subscribe_args *args = msg->udata2;
+  if (args->on_message == http_sse_on_message__direct) {
+    /* use the shared pre-formatted event, if available */
+    FIOBJ event = (FIOBJ)fio_message_metadata(msg, HTTP_SSE_OPTIMIZE_PUBSUB);
+    if (event) {
+      http_sse_write_formatted(&sse->sse, fiobj_dup(event));
+      return;
+    }
+  }
   /* perform a callback */
   fio_protocol_s *pr = fio_protocol_try_lock(sse->uuid, FIO_PR_LOCK_TASK);
   if (!pr)
@@ -1262,6 +2659,8 @@ static void http_sse_on_unsubscribe(void *sse_, void *args_) {
   struct http_sse_subscribe_args *args = args_;
   if (args->on_unsubscribe)
     args->on_unsubscribe(args->udata);
+  if (args->on_message == http_sse_on_message__direct)
+    http_sse_optimize4broadcasts(0);
   fio_free(args);
   http_sse_try_free(sse);
 }
@@ -1286,8 +2685,10 @@ uintptr_t http_sse_subscribe(http_sse_s *sse_,
   http_sse_internal_s *sse = FIO_LS_EMBD_OBJ(http_sse_internal_s, sse, sse_);
   if (sse->uuid == -1)
     return 0;
-  if (!args.on_message)
+  if (!args.on_message) {
     args.on_message = http_sse_on_message__direct;
+    http_sse_optimize4broadcasts(1);
+  }
   struct http_sse_subscribe_args *udata = fio_malloc(sizeof(*udata));
   FIO_ASSERT_ALLOC(udata);
   *udata = args;
@@ -1356,25 +2757,63 @@ int http_sse_write(http_sse_s *sse, struct http_sse_write_args args) {
   if (!sse || !(args.id.len + args.data.len + args.event.len) ||
       fio_is_closed(FIO_LS_EMBD_OBJ(http_sse_internal_s, sse, sse)->uuid))
     return -1;
-  FIOBJ buf;
-  {
-    /* best guess at data length, ignoring missing fields and multiline data */
-    const size_t total = 4 + args.id.len + 2 + 7 + args.event.len + 2 + 6 +
-                         args.data.len + 2 + 7 + 10 + 4;
-    buf = fiobj_str_buf(total);
-  }
-  http_sse_copy2str(buf, (char *)"id: ", 4, args.id);
-  http_sse_copy2str(buf, (char *)"event: ", 7, args.event);
-  if (args.retry) {
-    FIOBJ i = fiobj_num_new(args.retry);
-    fiobj_str_write(buf, (char *)"retry: ", 7);
-    fiobj_str_join(buf, i);
-    fiobj_free(i);
+  return FIO_LS_EMBD_OBJ(http_sse_internal_s, sse, sse)
+      ->vtable->http_sse_write(sse, http_sse_format(args));
+}
+
+/**
+ * Writes a pre-formatted event (a FIOBJ String) to an EventSource (SSE)
+ * connection, taking ownership of `event`.
+ */
+int http_sse_write_formatted(http_sse_s *sse, FIOBJ event) {
+  if (!sse ||
+      fio_is_closed(FIO_LS_EMBD_OBJ(http_sse_internal_s, sse, sse)->uuid)) {
+    fiobj_free(event);
+    return -1;
   }
-  http_sse_copy2str(buf, (char *)"data: ", 6, args.data);
-  fiobj_str_write(buf, "\r\n", 2);
   return FIO_LS_EMBD_OBJ(http_sse_internal_s, sse, sse)
-      ->vtable->http_sse_write(sse, buf);
+      ->vtable->http_sse_write(sse, event);
+}
+
+/* *****************************************************************************
+SSE broadcast optimizations
+***************************************************************************** */
+
+static void http_sse_optimize_free(fio_msg_s *msg, void *metadata) {
+  fiobj_free((FIOBJ)metadata);
+  (void)msg;
+}
+
+static fio_msg_metadata_s http_sse_optimize(fio_str_info_s ch,
+                                            fio_str_info_s msg,
+                                            uint8_t is_json) {
+  fio_msg_metadata_s ret = {
+      .type_id = HTTP_SSE_OPTIMIZE_PUBSUB,
+      .on_finish = http_sse_optimize_free,
+      .metadata =
+          (void *)http_sse_format((struct http_sse_write_args){.data = msg}),
+  };
+  return ret;
+  (void)ch;
+  (void)is_json;
+}
+
+/**
+ * Enables (or disables) the SSE broadcast optimization.
+ *
+ * Reference counted, same as `websocket_optimize4broadcasts`.
+ */
+void http_sse_optimize4broadcasts(int enable) {
+  static intptr_t counter = 0;
+  if (enable) {
+    if (fio_atomic_add(&counter, 1) == 1) {
+      fio_message_metadata_callback_set(http_sse_optimize, 1);
+    }
+  } else {
+    if (fio_atomic_sub(&counter, 1) == 0) {
+      fio_message_metadata_callback_set(http_sse_optimize, 0);
+    }
+  }
 }
 
 /**
@@ -1805,16 +3244,272 @@ typedef struct {
   size_t partial_offset;
   size_t partial_length;
   FIOBJ partial_name;
+  /* set when the body is parsed while it's received */
+  http_multipart_s *stream;
 } http_fio_mime_s;
 
 #define http_mime_parser2fio(parser) ((http_fio_mime_s *)(parser))
 
+/* *****************************************************************************
+Parsing `multipart/form-data` while the body is received (`parse_multipart`)
+***************************************************************************** */
+
+struct http_multipart_s {
+  http_fio_mime_s mime;
+  /* unparsed data */
+  char *buf;
+  size_t len;
+  size_t capa;
+  http_multipart_part_s *parts;
+  http_multipart_part_s **last;
+  /* a part that didn't fit in the buffer */
+  http_multipart_part_s *partial;
+  size_t count;
+  size_t files;
+  /* an HTTP error status code */
+  size_t error;
+};
+
+static void http_multipart_part_free(http_multipart_part_s *part) {
+  fiobj_free(part->name);
+  fiobj_free(part->filename);
+  fiobj_free(part->type);
+  fiobj_free(part->value);
+  if (part->path) {
+    /* the application might have moved the file (and the name reused) */
+    struct stat f, p;
+    if (!fstat(part->fd, &f) && !stat(fiobj_obj2cstr(part->path).data, &p) &&
+        f.st_dev == p.st_dev && f.st_ino == p.st_ino)
+      unlink(fiobj_obj2cstr(part->path).data);
+    fiobj_free(part->path);
+  }
+  if (part->fd != -1)
+    close(part->fd);
+  fio_free(part);
+}
+
+/*
+ * Creates a named temporary file for an upload (applications might move the
+ * file or pass its name to other processes). The file is removed with the
+ * request.
+ */
+static int http_multipart_tmpfile(http_multipart_part_s *part) {
+  const char *dir = getenv("TMPDIR");
+  if (!dir || !dir[0]) {
+#if defined(P_tmpdir)
+    dir = P_tmpdir;
+#else
+    dir = "/tmp";
+#endif
+  }
+  size_t len = strlen(dir);
+  while (len > 1 && dir[len - 1] == '/')
+    --len;
+  part->path = fiobj_str_buf(len + 32);
+  fiobj_str_write(part->path, dir, len);
+  fiobj_str_write(part->path, "/iodine_upload_XXXXXX", 21);
+  part->fd = mkstemp(fiobj_obj2cstr(part->path).data);
+  if (part->fd == -1) {
+    fiobj_free(part->path);
+    part->path = FIOBJ_INVALID;
+    return -1;
+  }
+  fcntl(part->fd, F_SETFD, FD_CLOEXEC);
+  return 0;
+}
+
+/* creates a part, returns NULL if the part should be ignored */
+static http_multipart_part_s *
+http_multipart_part_new(http_multipart_s *m, void *name, size_t name_len,
+                        void *filename, size_t filename_len, void *mimetype,
+                        size_t mimetype_len) {
+  /* an empty file name means no file was selected */
+  if (m->error || (filename && !filename_len))
+    return NULL;
+  if (++m->count > HTTP_MULTIPART_PART_LIMIT ||
+      (filename && ++m->files > HTTP_MULTIPART_FILE_LIMIT)) {
+    m->error = 413;
+    return NULL;
+  }
+  http_multipart_part_s *part = fio_malloc(sizeof(*part));
+  FIO_ASSERT_ALLOC(part);
+  *part = (http_multipart_part_s){
+      .name = fiobj_str_new(name, name_len),
+      .type = (mimetype_len ? fiobj_str_new(mimetype, mimetype_len)
+                            : FIOBJ_INVALID),
+      .fd = -1,
+  };
+  if (filename) {
+    part->filename = fiobj_str_new(filename, filename_len);
+    if (http_multipart_tmpfile(part)) {
+      FIO_LOG_ERROR("(HTTP) couldn't create a temporary file for an upload.");
+      m->error = 500;
+      http_multipart_part_free(part);
+      return NULL;
+    }
+  } else {
+    part->value = fiobj_str_buf(0);
+  }
+  return part;
+}
+
+static void http_multipart_part_write(http_multipart_s *m,
+                                      http_multipart_part_s *part, char *data,
+                                      size_t len) {
+  if (part->fd == -1) {
+    fiobj_str_write(part->value, data, len);
+    return;
+  }
+  part->size += len;
+  while (len) {
+    ssize_t w = write(part->fd, data, len);
+    if (w <= 0) {
+      if (w < 0 && errno == EINTR)
+        continue;
+      FIO_LOG_ERROR("(HTTP) couldn't write upload to temporary file: %s",
+                    strerror(errno));
+      m->error = 500;
+      return;
+    }
+    data += w;
+    len -= w;
+  }
+}
+
+static void http_multipart_part_push(http_multipart_s *m,
+                                     http_multipart_part_s *part) {
+  if (part->fd != -1)
+    lseek(part->fd, 0, SEEK_SET);
+  *m->last = part;
+  m->last = &part->next;
+}
+
+static void http_multipart_on_data(http_multipart_s *m, void *name,
+                                   size_t name_len, void *filename,
+                                   size_t filename_len, void *mimetype,
+                                   size_t mimetype_len, void *value,
+                                   size_t value_len) {
+  http_multipart_part_s *part = http_multipart_part_new(
+      m, name, name_len, filename, filename_len, mimetype, mimetype_len);
+  if (!part)
+    return;
+  http_multipart_part_write(m, part, value, value_len);
+  http_multipart_part_push(m, part);
+}
+
+/* parses the buffered data, keeping anything the parser didn't consume */
+static void http_multipart_consume(http_multipart_s *m, uint8_t final) {
+  size_t len = m->len;
+  /* a trailing CR might belong to the next boundary's line */
+  if (!final && len && m->buf[len - 1] == '\r')
+    --len;
+  size_t consumed = http_mime_parse(&m->mime.p, m->buf, len);
+  if (m->mime.p.error && !m->error)
+    m->error = 400;
+  if (consumed > m->len)
+    consumed = m->len;
+  m->len -= consumed;
+  if (m->len)
+    memmove(m->buf, m->buf + consumed, m->len);
+  m->buf[m->len] = 0;
+}
+
+int http_multipart_start(http_s *h) {
+  static uint64_t content_type_hash;
+  if (!content_type_hash)
+    content_type_hash = fiobj_hash_string("content-type", 12);
+  FIOBJ ct = fiobj_hash_get2(h->headers, content_type_hash);
+  if (!ct || !FIOBJ_TYPE_IS(ct, FIOBJ_T_STRING))
+    return -1;
+  fio_str_info_s content_type = fiobj_obj2cstr(ct);
+  http_multipart_s *m = fio_malloc(sizeof(*m));
+  FIO_ASSERT_ALLOC(m);
+  *m = (http_multipart_s){.mime = {.h = h}};
+  /* the parser points to the Content-Type header, owned by the request */
+  if (http_mime_parser_init(&m->mime.p, content_type.data, content_type.len) ||
+      !m->mime.p.boundary_len) {
+    fio_free(m);
+    return -1;
+  }
+  m->mime.stream = m;
+  m->last = &m->parts;
+  m->capa = HTTP_MULTIPART_BUFFER;
+  m->buf = fio_malloc(m->capa + 1);
+  FIO_ASSERT_ALLOC(m->buf);
+  h->multipart = m;
+  return 0;
+}
+
+size_t http_multipart_write(http_s *h, char *data, size_t len) {
+  http_multipart_s *m = h->multipart;
+  if (m->error)
+    return m->error;
+  if (m->mime.p.done)
+    return 0;
+  if (m->len + len > m->capa) {
+    size_t capa = m->capa;
+    while (capa < m->len + len)
+      capa <<= 1;
+    m->buf = fio_realloc2(m->buf, capa + 1, m->len);
+    FIO_ASSERT_ALLOC(m->buf);
+    m->capa = capa;
+  }
+  memcpy(m->buf + m->len, data, len);
+  m->len += len;
+  /* the parser expects the part headers to be complete */
+  if (m->len >= HTTP_MULTIPART_BUFFER || m->mime.p.in_obj)
+    http_multipart_consume(m, 0);
+  return m->error;
+}
+
+size_t http_multipart_finish(http_s *h) {
+  http_multipart_s *m = h->multipart;
+  if (!m->error && !m->mime.p.done)
+    http_multipart_consume(m, 1);
+  if (!m->error && !m->mime.p.done)
+    m->error = 400;
+  fio_free(m->buf);
+  m->buf = NULL;
+  m->len = m->capa = 0;
+  return m->error;
+}
+
+void http_multipart_free(http_s *h) {
+  http_multipart_s *m = h->multipart;
+  h->multipart = NULL;
+  while (m->parts) {
+    http_multipart_part_s *part = m->parts;
+    m->parts = part->next;
+    http_multipart_part_free(part);
+  }
+  if (m->partial)
+    http_multipart_part_free(m->partial);
+  fio_free(m->buf);
+  fio_free(m);
+}
+
+/**
+ * Returns the request's `multipart/form-data` parts (in order) if the body was
+ * parsed while it was received (see the `parse_multipart` setting), or NULL.
+ */
+http_multipart_part_s *http_multipart_parts(http_s *h) {
+  if (!h->multipart || h->multipart->error)
+    return NULL;
+  return h->multipart->parts;
+}
+
 /** Called when all the data is available at once. */
 static void http_mime_parser_on_data(http_mime_parser_s *parser, void *name,
                                      size_t name_len, void *filename,
                                      size_t filename_len, void *mimetype,
                                      size_t mimetype_len, void *value,
                                      size_t value_len) {
+  if (http_mime_parser2fio(parser)->stream) {
+    http_multipart_on_data(http_mime_parser2fio(parser)->stream, name,
+                           name_len, filename, filename_len, mimetype,
+                           mimetype_len, value, value_len);
+    return;
+  }
   if (!filename_len) {
     http_add2hash(http_mime_parser2fio(parser)->h->params, name, name_len,
                   value, value_len, 0);
@@ -1844,6 +3539,12 @@ static void http_mime_parser_on_data(http_mime_parser_s *parser, void *name,
 static void http_mime_parser_on_partial_start(
     http_mime_parser_s *parser, void *name, size_t name_len, void *filename,
     size_t filename_len, void *mimetype, size_t mimetype_len) {
+  if (http_mime_parser2fio(parser)->stream) {
+    http_multipart_s *m = http_mime_parser2fio(parser)->stream;
+    m->partial = http_multipart_part_new(m, name, name_len, filename,
+                                         filename_len, mimetype, mimetype_len);
+    return;
+  }
   http_mime_parser2fio(parser)->partial_length = 0;
   http_mime_parser2fio(parser)->partial_offset = 0;
   http_mime_parser2fio(parser)->partial_name = fiobj_str_new(name, name_len);
@@ -1870,6 +3571,12 @@ static void http_mime_parser_on_partial_start(
 /** Called when partial data is available. */
 static void http_mime_parser_on_partial_data(http_mime_parser_s *parser,
                                              void *value, size_t value_len) {
+  if (http_mime_parser2fio(parser)->stream) {
+    http_multipart_s *m = http_mime_parser2fio(parser)->stream;
+    if (m->partial)
+      http_multipart_part_write(m, m->partial, value, value_len);
+    return;
+  }
   if (!http_mime_parser2fio(parser)->partial_offset)
     http_mime_parser2fio(parser)->partial_offset =
         http_mime_parser2fio(parser)->pos +
@@ -1881,6 +3588,13 @@ static void http_mime_parser_on_partial_data(http_mime_parser_s *parser,
 
 /** Called when the partial data is complete. */
 static void http_mime_parser_on_partial_end(http_mime_parser_s *parser) {
+  if (http_mime_parser2fio(parser)->stream) {
+    http_multipart_s *m = http_mime_parser2fio(parser)->stream;
+    if (m->partial)
+      http_multipart_part_push(m, m->partial);
+    m->partial = NULL;
+    return;
+  }
 
   fio_str_info_s tmp =
       fiobj_obj2cstr(http_mime_parser2fio(parser)->partial_name);
@@ -2032,8 +3746,482 @@ FIOBJ http_req2str(http_s *h) {
   return w.dest;
 }
 
+/* *****************************************************************************
+Access Log
+
+Log lines are formatted by the thread that handled the request and copied to
+that thread's ring buffer (single producer, single consumer, no locks). A
+background thread drains the buffers and writes the lines in batches to
+`stderr`, a file or a syslog socket. The writer thread sleeps until a line is
+pushed to an empty log. Lines are dropped (and counted) when a thread's buffer
+is full. A thread's buffer is freed by the writer thread once the thread exited
+and its last lines were drained.
+***************************************************************************** */
+
+#ifndef __MINGW32__
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
+
+#define HTTP_LOG_LINE_LIMIT 2048
+
+typedef struct http_log_ring_s http_log_ring_s;
+struct http_log_ring_s {
+  http_log_ring_s *next;
+  /* the number of bytes written (by the producer) */
+  volatile size_t head;
+  /* the number of bytes consumed (by the writer thread) */
+  volatile size_t tail;
+  volatile size_t lines;
+  volatile size_t dropped;
+  /* set when the producer thread exited */
+  volatile uint8_t orphaned;
+  char buf[HTTP_LOG_BUFFER];
+};
+
+static struct {
+  /* registered buffers (orphaned buffers are freed by the writer thread) */
+  http_log_ring_s *rings;
+  /* statistics collected from freed buffers */
+  size_t lines;
+  size_t dropped;
+  /* -1 == stderr */
+  int fd;
+  uint8_t syslog;
+  uint8_t format;
+  volatile uint8_t running;
+  /* set by the first line pushed since the writer thread woke up */
+  volatile uint8_t pending;
+  /* the process that started the writer thread */
+  pid_t pid;
+  pthread_t writer;
+  /* protects the buffer list */
+  fio_lock_i lock;
+  /* protects the destination (held while writing) */
+  pthread_mutex_t write_lock;
+  /* the writer thread waits for `pending` */
+  pthread_mutex_t wait_lock;
+  pthread_cond_t wait_cond;
+} http_log = {.fd = -1,
+              .lock = FIO_LOCK_INIT,
+              .write_lock = PTHREAD_MUTEX_INITIALIZER,
+              .wait_lock = PTHREAD_MUTEX_INITIALIZER,
+              .wait_cond = PTHREAD_COND_INITIALIZER};
+
+/* the current process (`getpid` is updated after forking) */
+static pid_t http_log_self;
+
+static pthread_key_t http_log_ring_key;
+static pthread_once_t http_log_ring_once = PTHREAD_ONCE_INIT;
+/* the thread exited, the writer thread frees the buffer once it's drained */
+static void http_log_ring_orphan(void *r_) {
+  http_log_ring_s *r = r_;
+  fio_atomic_xchange(&r->orphaned, 1);
+}
+static void http_log_init_key(void) {
+  pthread_key_create(&http_log_ring_key, http_log_ring_orphan);
+}
+
+/* writes data to the destination (call with `write_lock` held) */
+static void http_log_write_unsafe(char *data, size_t len) {
+  const int fd = (http_log.fd == -1 ? STDERR_FILENO : http_log.fd);
+#ifndef __MINGW32__
+  if (http_log.syslog) {
+    /* each line is a datagram: "<134>" is local0.info */
+    char msg[HTTP_LOG_LINE_LIMIT + 16] = "<134>iodine: ";
+    while (len) {
+      char *eol = memchr(data, '\n', len);
+      size_t line = (eol ? (size_t)(eol - data) : len);
+      size_t copy = (line > HTTP_LOG_LINE_LIMIT ? HTTP_LOG_LINE_LIMIT : line);
+      if (copy && data[copy - 1] == '\r')
+        --copy;
+      memcpy(msg + 13, data, copy);
+      if (send(fd, msg, copy + 13, MSG_DONTWAIT | MSG_NOSIGNAL) < 0) {
+        /* syslog is down, lines are lost */
+      }
+      line += (eol ? 1 : 0);
+      data += line;
+      len -= line;
+    }
+    return;
+  }
+#endif
+  while (len) {
+    ssize_t w = write(fd, data, len);
+    if (w <= 0) {
+      if (w < 0 && errno == EINTR)
+        continue;
+      return;
+    }
+    data += w;
+    len -= w;
+  }
+}
+
+/* drains the buffers, returns the number of bytes written */
+static size_t http_log_drain(void) {
+  static char out[1024 * 64];
+  size_t pos = 0;
+  /* data is copied under the lock and written once it's released */
+  fio_lock(&http_log.lock);
+  http_log_ring_s **prev = &http_log.rings;
+  while (*prev) {
+    http_log_ring_s *r = *prev;
+    const uint8_t orphaned = fio_atomic_add(&r->orphaned, 0);
+    size_t tail = r->tail;
+    const size_t head = fio_atomic_add(&r->head, 0);
+    while (tail < head && pos < sizeof(out)) {
+      /* copy complete lines only (the producer writes whole lines) */
+      size_t len = head - tail;
+      const size_t offset = tail % HTTP_LOG_BUFFER;
+      if (len > HTTP_LOG_BUFFER - offset)
+        len = HTTP_LOG_BUFFER - offset;
+      if (len > sizeof(out) - pos)
+        len = sizeof(out) - pos;
+      memcpy(out + pos, r->buf + offset, len);
+      pos += len;
+      tail += len;
+    }
+    fio_atomic_xchange(&r->tail, tail);
+    if (orphaned && tail == head) {
+      /* the thread exited and its last lines were copied */
+      *prev = r->next;
+      http_log.lines += r->lines;
+      http_log.dropped += r->dropped;
+      free(r);
+      continue;
+    }
+    prev = &r->next;
+  }
+  fio_unlock(&http_log.lock);
+  if (pos) {
+    pthread_mutex_lock(&http_log.write_lock);
+    http_log_write_unsafe(out, pos);
+    pthread_mutex_unlock(&http_log.write_lock);
+  }
+  return pos;
+}
+
+static void *http_log_writer(void *ignr_) {
+#ifndef __MINGW32__
+  /* signals are handled by the other threads */
+  sigset_t set;
+  sigfillset(&set);
+  pthread_sigmask(SIG_BLOCK, &set, NULL);
+#endif
+  while (http_log.running) {
+    pthread_mutex_lock(&http_log.wait_lock);
+    while (http_log.running && !http_log.pending)
+      pthread_cond_wait(&http_log.wait_cond, &http_log.wait_lock);
+    http_log.pending = 0;
+    pthread_mutex_unlock(&http_log.wait_lock);
+    /* batch small writes */
+    struct timespec tm = {.tv_nsec = HTTP_LOG_FLUSH_INTERVAL * 1000000L};
+    nanosleep(&tm, NULL);
+    while (http_log_drain() >= 4096)
+      ;
+  }
+  while (http_log_drain())
+    ;
+  return NULL;
+  (void)ignr_;
+}
+
+/* returns the calling thread's buffer (registering a new one if missing) */
+static http_log_ring_s *http_log_ring(void) {
+  pthread_once(&http_log_ring_once, http_log_init_key);
+  http_log_ring_s *r = pthread_getspecific(http_log_ring_key);
+  if (r && http_log.running && http_log.pid == http_log_self)
+    return r;
+  fio_lock(&http_log.lock);
+  if (!r) {
+    r = malloc(sizeof(*r));
+    FIO_ASSERT_ALLOC(r);
+    r->head = r->tail = r->lines = r->dropped = 0;
+    r->orphaned = 0;
+    r->next = http_log.rings;
+    http_log.rings = r;
+    pthread_setspecific(http_log_ring_key, r);
+  }
+  if (!http_log.running || http_log.pid != http_log_self) {
+    http_log.running = 1;
+    http_log.pid = http_log_self;
+    if (pthread_create(&http_log.writer, NULL, http_log_writer, NULL)) {
+      http_log.running = 0;
+      FIO_LOG_ERROR("(HTTP) couldn't start the access log thread.");
+    }
+  }
+  fio_unlock(&http_log.lock);
+  return r;
+}
+
+/* copies a complete line to the calling thread's buffer */
+static void http_log_push(char *line, size_t len) {
+  http_log_ring_s *r = http_log_ring();
+  const size_t head = r->head;
+  if (!http_log.running) {
+    pthread_mutex_lock(&http_log.write_lock);
+    http_log_write_unsafe(line, len);
+    pthread_mutex_unlock(&http_log.write_lock);
+    return;
+  }
+  if (HTTP_LOG_BUFFER - (head - fio_atomic_add(&r->tail, 0)) < len) {
+    ++r->dropped;
+    return;
+  }
+  const size_t offset = head % HTTP_LOG_BUFFER;
+  const size_t first =
+      (len > HTTP_LOG_BUFFER - offset ? HTTP_LOG_BUFFER - offset : len);
+  memcpy(r->buf + offset, line, first);
+  memcpy(r->buf, line + first, len - first);
+  ++r->lines;
+  fio_atomic_xchange(&r->head, head + len);
+  /* wake the writer thread (signaled under the lock, so it isn't missed) */
+  if (!http_log.pending && !fio_atomic_xchange(&http_log.pending, 1)) {
+    pthread_mutex_lock(&http_log.wait_lock);
+    pthread_cond_signal(&http_log.wait_cond);
+    pthread_mutex_unlock(&http_log.wait_lock);
+  }
+}
+
+static void http_log_stop(void *ignr_) {
+  if (http_log.running && http_log.pid == http_log_self) {
+    pthread_mutex_lock(&http_log.wait_lock);
+    http_log.running = 0;
+    pthread_cond_signal(&http_log.wait_cond);
+    pthread_mutex_unlock(&http_log.wait_lock);
+    pthread_join(http_log.writer, NULL);
+  }
+  http_log.running = 0;
+  (void)ignr_;
+}
+
+static void http_log_on_fork(void *ignr_) {
+  /* the writer thread doesn't exist in the child, buffered lines belong to the
+   * parent */
+  http_log.lock = FIO_LOCK_INIT;
+  http_log.running = 0;
+  http_log.pending = 0;
+  http_log.lines = http_log.dropped = 0;
+  http_log.write_lock = (pthread_mutex_t)PTHREAD_MUTEX_INITIALIZER;
+  http_log.wait_lock = (pthread_mutex_t)PTHREAD_MUTEX_INITIALIZER;
+  http_log.wait_cond = (pthread_cond_t)PTHREAD_COND_INITIALIZER;
+  http_log_self = getpid();
+  /* only the forking thread exists in the child */
+  http_log_ring_s *self = NULL;
+  if (http_log.rings)
+    self = pthread_getspecific(http_log_ring_key);
+  for (http_log_ring_s *r = http_log.rings; r; r = r->next) {
+    r->tail = r->head;
+    r->lines = r->dropped = 0;
+    if (r != self)
+      r->orphaned = 1;
+  }
+  (void)ignr_;
+}
+
+static __attribute__((constructor)) void http_log_constructor(void) {
+  http_log_self = getpid();
+  fio_state_callback_add(FIO_CALL_IN_CHILD, http_log_on_fork, NULL);
+  fio_state_callback_add(FIO_CALL_ON_FINISH, http_log_stop, NULL);
+  fio_state_callback_add(FIO_CALL_AT_EXIT, http_log_stop, NULL);
+}
+
+/**
+ * Sets the access log destination and format (process wide).
+ *
+ * `path` is a file name (lines are appended), `"syslog"` (the `/dev/log`
+ * socket), `"syslog:<socket path>"` or NULL for `stderr`.
+ *
+ * Returns -1 on error (the current destination is kept).
+ */
+int http_log_setup(const char *path, http_log_format_e format) {
+  int fd = -1;
+  uint8_t syslog = 0;
+  if (path && !strncmp(path, "syslog", 6) && (!path[6] || path[6] == ':')) {
+#ifdef __MINGW32__
+    FIO_LOG_ERROR("(HTTP) syslog isn't supported on this system.");
+    return -1;
+#else
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    const char *name = (path[6] ? path + 7 : "/dev/log");
+    if (strlen(name) >= sizeof(addr.sun_path)) {
+      FIO_LOG_ERROR("(HTTP) syslog socket name too long: %s", name);
+      return -1;
+    }
+    strcpy(addr.sun_path, name);
+    fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+    if (fd == -1 || connect(fd, (struct sockaddr *)&addr, sizeof(addr))) {
+      FIO_LOG_ERROR("(HTTP) couldn't connect to syslog (%s): %s", name,
+                    strerror(errno));
+      if (fd != -1)
+        close(fd);
+      return -1;
+    }
+    syslog = 1;
+#endif
+  } else if (path) {
+    fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd == -1) {
+      FIO_LOG_ERROR("(HTTP) couldn't open access log %s: %s", path,
+                    strerror(errno));
+      return -1;
+    }
+  }
+  pthread_mutex_lock(&http_log.write_lock);
+  if (http_log.fd != -1)
+    close(http_log.fd);
+  http_log.fd = fd;
+  http_log.syslog = syslog;
+  http_log.format = (uint8_t)format;
+  pthread_mutex_unlock(&http_log.write_lock);
+  return 0;
+}
+
+/** Collects the access log statistics for the current process. */
+void http_log_stats(http_log_stats_s *stats) {
+  fio_lock(&http_log.lock);
+  *stats = (http_log_stats_s){.lines = http_log.lines,
+                              .dropped = http_log.dropped};
+  for (http_log_ring_s *r = http_log.rings; r; r = r->next) {
+    stats->lines += r->lines;
+    stats->dropped += r->dropped;
+  }
+  fio_unlock(&http_log.lock);
+}
+
+/* a bounded line buffer */
+typedef struct {
+  char *data;
+  size_t len;
+} http_log_line_s;
+
+static inline void http_log_write(http_log_line_s *l, const char *data,
+                                  size_t len) {
+  if (l->len + len > HTTP_LOG_LINE_LIMIT - 2)
+    len = HTTP_LOG_LINE_LIMIT - 2 - l->len;
+  memcpy(l->data + l->len, data, len);
+  l->len += len;
+}
+
+static inline void http_log_write_i(http_log_line_s *l, int64_t i) {
+  char buf[32];
+  http_log_write(l, buf, fio_ltoa(buf, i, 10));
+}
+
+/* writes milliseconds with 3 decimal places */
+static inline void http_log_write_ms(http_log_line_s *l, int64_t us) {
+  if (us < 0)
+    us = 0;
+  char buf[32];
+  size_t len = fio_ltoa(buf, us / 1000, 10);
+  buf[len++] = '.';
+  buf[len++] = '0' + ((us / 100) % 10);
+  buf[len++] = '0' + ((us / 10) % 10);
+  buf[len++] = '0' + (us % 10);
+  http_log_write(l, buf, len);
+}
+
+/* returns the length of a valid UTF-8 multi-byte sequence (or 0) */
+static size_t http_log_utf8_len(const uint8_t *p, size_t len) {
+  size_t n;
+  uint8_t min = 0x80, max = 0xBF;
+  if (p[0] >= 0xC2 && p[0] <= 0xDF) {
+    n = 2;
+  } else if (p[0] >= 0xE0 && p[0] <= 0xEF) {
+    n = 3;
+    if (p[0] == 0xE0)
+      min = 0xA0; /* overlong */
+    else if (p[0] == 0xED)
+      max = 0x9F; /* surrogates */
+  } else if (p[0] >= 0xF0 && p[0] <= 0xF4) {
+    n = 4;
+    if (p[0] == 0xF0)
+      min = 0x90; /* overlong */
+    else if (p[0] == 0xF4)
+      max = 0x8F; /* above U+10FFFF */
+  } else {
+    return 0;
+  }
+  if (len < n || p[1] < min || p[1] > max)
+    return 0;
+  for (size_t i = 2; i < n; ++i) {
+    if ((p[i] & 0xC0) != 0x80)
+      return 0;
+  }
+  return n;
+}
+
+/* writes a JSON escaped String (bytes that aren't UTF-8 are escaped) */
+static void http_log_write_json(http_log_line_s *l, fio_str_info_s s) {
+  static const char hex[] = "0123456789abcdef";
+  http_log_write(l, "\"", 1);
+  for (size_t i = 0; i < s.len; ++i) {
+    const uint8_t c = (uint8_t)s.data[i];
+    size_t n;
+    if (c == '"' || c == '\\') {
+      char esc[2] = {'\\', (char)c};
+      http_log_write(l, esc, 2);
+    } else if (c < 0x20 || c == 0x7F) {
+      char esc[6] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 15]};
+      http_log_write(l, esc, 6);
+    } else if (c < 0x80) {
+      http_log_write(l, (char *)s.data + i, 1);
+    } else if ((n = http_log_utf8_len((uint8_t *)s.data + i, s.len - i))) {
+      http_log_write(l, (char *)s.data + i, n);
+      i += n - 1;
+    } else {
+      char esc[6] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 15]};
+      http_log_write(l, esc, 6);
+    }
+  }
+  http_log_write(l, "\"", 1);
+}
+
+/* returns the first `X-Forwarded-For` (or `Forwarded: for=`) address */
+static fio_str_info_s http_log_forwarded_for(http_s *h) {
+  static uint64_t xff_hash = 0, fwd_hash = 0;
+  if (!xff_hash) {
+    xff_hash = fiobj_hash_string("x-forwarded-for", 15);
+    fwd_hash = fiobj_hash_string("forwarded", 9);
+  }
+  fio_str_info_s ret = {.data = NULL};
+  FIOBJ tmp = fiobj_hash_get2(h->headers, xff_hash);
+  if (tmp) {
+    if (FIOBJ_TYPE_IS(tmp, FIOBJ_T_ARRAY))
+      tmp = fiobj_ary_index(tmp, 0);
+    ret = fiobj_obj2cstr(tmp);
+  } else if ((tmp = fiobj_hash_get2(h->headers, fwd_hash))) {
+    if (FIOBJ_TYPE_IS(tmp, FIOBJ_T_ARRAY))
+      tmp = fiobj_ary_index(tmp, 0);
+    ret = fiobj_obj2cstr(tmp);
+    char *pos = ret.data;
+    char *end = ret.data + ret.len;
+    while (pos + 4 <= end && strncasecmp(pos, "for=", 4))
+      ++pos;
+    if (pos + 4 > end)
+      return (fio_str_info_s){.data = NULL};
+    pos += 4;
+    if (*pos == '"')
+      ++pos;
+    ret.len = end - pos;
+    ret.data = pos;
+  }
+  while (ret.len && ret.data[0] == ' ') {
+    ++ret.data;
+    --ret.len;
+  }
+  size_t len = 0;
+  while (len < ret.len && ret.data[len] != ',' && ret.data[len] != ';' &&
+         ret.data[len] != '"' && ret.data[len] != ' ')
+    ++len;
+  ret.len = len;
+  return ret;
+}
+
 void http_write_log(http_s *h) {
-  FIOBJ l = fiobj_str_buf(128);
+  char buffer[HTTP_LOG_LINE_LIMIT];
+  http_log_line_s l = {.data = buffer};
 
   intptr_t bytes_sent = fiobj_obj2num(fiobj_hash_get2(
       h->private_data.out_headers, fiobj_obj2hash(HTTP_HEADER_CONTENT_LENGTH)));
@@ -2041,54 +4229,79 @@ void http_write_log(http_s *h) {
   struct timespec start, end;
   clock_gettime(CLOCK_REALTIME, &end);
   start = h->received_at;
+  const int64_t duration = ((int64_t)(end.tv_sec - start.tv_sec) * 1000000) +
+                           ((end.tv_nsec - start.tv_nsec) / 1000);
 
-  {
-    // TODO Guess IP address from headers (forwarded) where possible
-    fio_str_info_s peer = fio_peer_addr(http2protocol(h)->uuid);
-    fiobj_str_write(l, peer.data, peer.len);
-  }
-  fio_str_info_s buff = fiobj_obj2cstr(l);
+  fio_str_info_s peer = fio_peer_addr(http2protocol(h)->uuid);
+  if (!peer.len)
+    peer = (fio_str_info_s){.data = (char *)"[unknown]", .len = 9};
 
-  if (buff.len == 0) {
-    memcpy(buff.data, "[unknown]", 9);
-    buff.len = 9;
-  }
-  memcpy(buff.data + buff.len, " - - [", 6);
-  buff.len += 6;
-  fiobj_str_resize(l, buff.len);
-  {
-    FIOBJ date;
-    fio_lock(&date_lock);
-    date = fiobj_dup(current_date);
-    fio_unlock(&date_lock);
-    fiobj_str_join(l, current_date);
-    fiobj_free(date);
-  }
-  fiobj_str_write(l, "] \"", 3);
-  fiobj_str_join(l, h->method);
-  fiobj_str_write(l, " ", 1);
-  fiobj_str_join(l, h->path);
-  fiobj_str_write(l, " ", 1);
-  fiobj_str_join(l, h->version);
-  fiobj_str_write(l, "\" ", 2);
-  if (bytes_sent > 0) {
-    fiobj_str_write_i(l, h->status);
-    fiobj_str_write(l, " ", 1);
-    fiobj_str_write_i(l, bytes_sent);
-    fiobj_str_write(l, "b ", 2);
+  if (http_log.format == HTTP_LOG_JSON) {
+    struct tm tm;
+    http_gmtime(end.tv_sec, &tm);
+    http_log_write(&l, "{\"time\":\"", 9);
+    l.len += strftime(l.data + l.len, 32, "%Y-%m-%dT%H:%M:%SZ", &tm);
+    http_log_write(&l, "\",\"remote\":", 11);
+    http_log_write_json(&l, peer);
+    fio_str_info_s fwd = http_log_forwarded_for(h);
+    if (fwd.len) {
+      http_log_write(&l, ",\"forwarded_for\":", 17);
+      http_log_write_json(&l, fwd);
+    }
+    http_log_write(&l, ",\"method\":", 10);
+    http_log_write_json(&l, fiobj_obj2cstr(h->method));
+    http_log_write(&l, ",\"path\":", 8);
+    http_log_write_json(&l, fiobj_obj2cstr(h->path));
+    http_log_write(&l, ",\"version\":", 11);
+    http_log_write_json(&l, fiobj_obj2cstr(h->version));
+    http_log_write(&l, ",\"status\":", 10);
+    http_log_write_i(&l, h->status);
+    http_log_write(&l, ",\"bytes\":", 9);
+    http_log_write_i(&l, (bytes_sent > 0 ? bytes_sent : 0));
+    http_log_write(&l, ",\"duration_ms\":", 15);
+    http_log_write_ms(&l, duration);
+    if (h->phases.queue | h->phases.gvl | h->phases.app | h->phases.body) {
+      http_log_write(&l, ",\"queue_ms\":", 12);
+      http_log_write_ms(&l, h->phases.queue);
+      http_log_write(&l, ",\"gvl_ms\":", 10);
+      http_log_write_ms(&l, h->phases.gvl);
+      http_log_write(&l, ",\"app_ms\":", 10);
+      http_log_write_ms(&l, h->phases.app);
+      http_log_write(&l, ",\"body_ms\":", 11);
+      http_log_write_ms(&l, h->phases.body);
+    }
+    http_log_write(&l, "}", 1);
   } else {
-    fiobj_str_join(l, fiobj_num_tmp(h->status));
-    fiobj_str_write(l, " -- ", 4);
+    char date[48];
+    http_log_write(&l, peer.data, peer.len);
+    http_log_write(&l, " - - [", 6);
+    http_log_write(&l, date, http_time2str(date, end.tv_sec));
+    http_log_write(&l, "] \"", 3);
+    fio_str_info_s tmp = fiobj_obj2cstr(h->method);
+    http_log_write(&l, tmp.data, tmp.len);
+    http_log_write(&l, " ", 1);
+    tmp = fiobj_obj2cstr(h->path);
+    http_log_write(&l, tmp.data, tmp.len);
+    http_log_write(&l, " ", 1);
+    tmp = fiobj_obj2cstr(h->version);
+    http_log_write(&l, tmp.data, tmp.len);
+    http_log_write(&l, "\" ", 2);
+    http_log_write_i(&l, h->status);
+    if (bytes_sent > 0) {
+      http_log_write(&l, " ", 1);
+      http_log_write_i(&l, bytes_sent);
+      http_log_write(&l, "b ", 2);
+    } else {
+      http_log_write(&l, " -- ", 4);
+    }
+    http_log_write_i(&l, duration / 1000);
+    http_log_write(&l, "ms", 2);
   }
-
-  bytes_sent = ((end.tv_sec - start.tv_sec) * 1000) +
-               ((end.tv_nsec - start.tv_nsec) / 1000000);
-  fiobj_str_write_i(l, bytes_sent);
-  fiobj_str_write(l, "ms\r\n", 4);
-
-  buff = fiobj_obj2cstr(l);
-  fwrite(buff.data, 1, buff.len, stderr);
-  fiobj_free(l);
+  /* `http_log_write` leaves room for the line's end (JSON lines end with LF) */
+  if (http_log.format != HTTP_LOG_JSON)
+    l.data[l.len++] = '\r';
+  l.data[l.len++] = '\n';
+  http_log_push(l.data, l.len);
 }
 
 /**
@@ -33,6 +33,11 @@ Compile Time Settings
 #define HTTP_DEFAULT_BODY_LIMIT (1024 * 1024 * 50)
 #endif
 
+#ifndef HTTP_DEFAULT_BODY_MEMORY
+/** request bodies up to this size are kept in memory (unless configured) */
+#define HTTP_DEFAULT_BODY_MEMORY (1024 * 64)
+#endif
+
 #ifndef HTTP_MAX_HEADER_COUNT
 #define HTTP_MAX_HEADER_COUNT 128
 #endif
@@ -42,6 +47,110 @@ Compile Time Settings
 #define HTTP_MAX_HEADER_LENGTH 8192
 #endif
 
+#ifndef HTTP_FILE_CACHE_LIMIT
+/**
+ * The maximum number of static files (open file descriptors and `stat` data)
+ * cached by each worker process for `http_sendfile2`.
+ */
+#define HTTP_FILE_CACHE_LIMIT 256
+#endif
+
+#ifndef HTTP_FILE_CACHE_SMALL_FILE
+/**
+ * Static files up to this size (in bytes) are cached in memory and sent along
+ * with the response headers, using a single write.
+ */
+#define HTTP_FILE_CACHE_SMALL_FILE 16384
+#endif
+
+#ifndef HTTP_FILE_CACHE_MEMORY
+/**
+ * The maximum number of bytes used (per worker) for small static files cached
+ * in memory.
+ */
+#define HTTP_FILE_CACHE_MEMORY (1024 * 1024 * 8)
+#endif
+
+#ifndef HTTP_PUBLIC_INDEX_LIMIT
+/**
+ * The maximum number of files indexed (per worker) for each public folder.
+ *
+ * The index is used (when `inotify` is available) to detect requests for
+ * missing files without testing the file system. Larger folders aren't indexed.
+ */
+#define HTTP_PUBLIC_INDEX_LIMIT 65536
+#endif
+
+#ifndef HTTP_FILE_CACHE_TTL
+/**
+ * The number of seconds a cached static file is trusted when the file system
+ * can't be watched for changes (no `inotify` support).
+ */
+#define HTTP_FILE_CACHE_TTL 1
+#endif
+
+#ifndef HTTP_LOG_BUFFER
+/**
+ * The size (in bytes) of each thread's access log buffer.
+ *
+ * Log lines are written to per thread buffers and written to the log by a
+ * background thread. Lines are dropped (and counted) if a buffer is full.
+ */
+#define HTTP_LOG_BUFFER (1024 * 256)
+#endif
+
+#ifndef HTTP_LOG_FLUSH_INTERVAL
+/** The time (in milliseconds) the access log waits to batch new lines. */
+#define HTTP_LOG_FLUSH_INTERVAL 10
+#endif
+
+#ifndef HTTP_MULTIPART_BUFFER
+/**
+ * The amount of `multipart/form-data` body data (in bytes) collected before
+ * it's parsed (see `parse_multipart`). Part headers must fit in the buffer.
+ */
+#define HTTP_MULTIPART_BUFFER (1024 * 16)
+#endif
+
+#ifndef HTTP_MULTIPART_FILE_LIMIT
+/** The maximum number of uploaded files per request (see `parse_multipart`). */
+#define HTTP_MULTIPART_FILE_LIMIT 128
+#endif
+
+#ifndef HTTP_MULTIPART_PART_LIMIT
+/** The maximum number of form parts per request (see `parse_multipart`). */
+#define HTTP_MULTIPART_PART_LIMIT 4096
+#endif
+
+#ifndef HTTP_COMPRESS_LEVEL
+/** The zlib compression level used when compressing responses (1-9). */
+#define HTTP_COMPRESS_LEVEL 6
+#endif
+
+#ifndef HTTP_COMPRESS_CACHE_MEMORY
+/**
+ * The maximum number of bytes used (per worker) for caching compressed
+ * responses, including compressed static files.
+ */
+#define HTTP_COMPRESS_CACHE_MEMORY (1024 * 1024 * 4)
+#endif
+
+#ifndef HTTP_COMPRESS_STATIC_LIMIT
+/**
+ * Static files larger than this size (in bytes) are never compressed on the
+ * fly (a pre-compressed `.gz` file could be provided instead).
+ */
+#define HTTP_COMPRESS_STATIC_LIMIT (1024 * 1024)
+#endif
+
+#ifndef HTTP_COALESCE_LIMIT
+/**
+ * The maximum number of bytes an HTTP/1.x connection will buffer while
+ * coalescing pipelined responses before writing them to the socket.
+ */
+#define HTTP_COALESCE_LIMIT 65536
+#endif
+
 #ifndef FIO_HTTP_EXACT_LOGGING
 /**
  * By default, facil.io logs the HTTP request cycle using a fuzzy starting point
@@ -71,6 +180,9 @@ The Request / Response type and functions
  * The `http_s` data can only be accessed safely from within the `on_request`
  * HTTP callback OR an `http_defer` callback.
  */
+/** A request body parsed while it's received (see `parse_multipart`). */
+typedef struct http_multipart_s http_multipart_s;
+
 typedef struct {
   /** the HTTP request's "head" starts with a private data used by facil.io */
   struct {
@@ -116,8 +228,23 @@ typedef struct {
    * see fiobj_data.h for details.
    */
   FIOBJ body;
+  /**
+   * The `multipart/form-data` parts, when the body was parsed while it was
+   * received (the `body` isn't kept). See `http_multipart_parts`.
+   */
+  http_multipart_s *multipart;
   /** an opaque user data pointer, to be used BEFORE calling `http_defer`. */
   void *udata;
+  /**
+   * Request phase durations (in microseconds), optionally set by the request
+   * handler before the response is sent. Reported by the JSON access log.
+   */
+  struct {
+    uint32_t queue;
+    uint32_t gvl;
+    uint32_t app;
+    uint32_t body;
+  } phases;
 } http_s;
 
 /**
@@ -196,6 +323,20 @@ int http_set_cookie(http_s *h, http_cookie_args_s);
  */
 int http_send_body(http_s *h, void *data, uintptr_t length);
 
+/**
+ * Sends the response headers and body without copying the body.
+ *
+ * The `data` must remain valid (and unchanged) until `dealloc(data)` is called
+ * (from any thread), once the data was sent or on error. `dealloc` might be
+ * called before this function returns (i.e., when the body was compressed).
+ *
+ * Returns -1 on error and 0 on success.
+ *
+ * AFTER THIS FUNCTION IS CALLED, THE `http_s` OBJECT IS NO LONGER VALID.
+ */
+int http_send_body_nocopy(http_s *h, void *data, uintptr_t length,
+                          void (*dealloc)(void *data));
+
 /**
  * Sends the response headers and the specified file (the response's body).
  *
@@ -207,6 +348,61 @@ int http_send_body(http_s *h, void *data, uintptr_t length);
  */
 int http_sendfile(http_s *h, int fd, uintptr_t length, uintptr_t offset);
 
+/**
+ * Sends the response headers and the specified file (the response's body),
+ * calling `close_fd(fd)` (instead of `close`) once the file was sent or on
+ * error.
+ *
+ * `close_fd` might be called from any thread (including the IO thread) and
+ * before this function returns. It MUST NOT call any `fio_sock` functions.
+ *
+ * Unlike `http_sendfile2`, the file isn't cached and no headers other than
+ * `content-length`, `content-type` and `date` are added (when missing).
+ *
+ * Returns -1 on error and 0 on success.
+ *
+ * AFTER THIS FUNCTION IS CALLED, THE `http_s` OBJECT IS NO LONGER VALID.
+ */
+int http_sendfile_notify(http_s *h, int fd, uintptr_t length, uintptr_t offset,
+                         void (*close_fd)(intptr_t fd));
+
+/**
+ * Sends the response headers (on the first call) and a part of the response's
+ * body, allowing the body to be sent as it's being produced.
+ *
+ * Unless a `content-length` header was set, HTTP/1.1 responses are sent using
+ * chunked transfer encoding (HTTP/1.0 connections are closed once the response
+ * is complete).
+ *
+ * **Note**: The data is *copied* to the HTTP stream.
+ *
+ * Call `http_finish` to complete the response. Other response functions
+ * (`http_send_body`, etc') MUST NOT be called once streaming had begun.
+ *
+ * Returns -1 on error. Otherwise, returns the number of outgoing packets
+ * waiting to be sent (see `http_stream_wait`).
+ */
+int http_stream(http_s *h, void *data, uintptr_t length);
+
+/**
+ * Blocks until no more than `max_pending` outgoing packets are waiting to be
+ * sent, allowing a streaming response to respect the client's pace.
+ *
+ * Returns 0 on success and -1 if the connection was lost or timed out.
+ */
+int http_stream_wait(http_s *h, size_t max_pending);
+
+/**
+ * Closes the connection without completing a streamed response (the data
+ * already handed to the network layer is discarded if it wasn't sent yet).
+ *
+ * This should be used when the response's body failed, so the client can't
+ * mistake a partial response for a complete one.
+ *
+ * AFTER THIS FUNCTION IS CALLED, THE `http_s` OBJECT IS NO LONGER VALID.
+ */
+void http_stream_abort(http_s *h);
+
 /**
  * Sends the response headers and the specified file (the response's body).
  *
@@ -224,6 +420,29 @@ int http_sendfile(http_s *h, int fd, uintptr_t length, uintptr_t offset);
 int http_sendfile2(http_s *h, const char *prefix, size_t prefix_len,
                    const char *encoded, size_t encoded_len);
 
+/** Static file cache statistics, see `http_sendfile_cache_stats`. */
+typedef struct {
+  /** The number of cached files (including known missing files). */
+  size_t files;
+  /** The maximum number of cached files (HTTP_FILE_CACHE_LIMIT). */
+  size_t files_limit;
+  /** The number of bytes used for small files served from memory. */
+  size_t memory;
+  /** The memory limit for small files (HTTP_FILE_CACHE_MEMORY). */
+  size_t memory_limit;
+  /** The number of lookups answered by the cache. */
+  size_t hits;
+  /** The number of lookups that required file system access. */
+  size_t misses;
+} http_sendfile_cache_stats_s;
+
+/**
+ * Collects the `http_sendfile2` cache statistics for the calling process.
+ *
+ * The cache is per process (worker), so is the data.
+ */
+void http_sendfile_cache_stats(http_sendfile_cache_stats_s *stats);
+
 /**
  * Sends an HTTP error response.
  *
@@ -318,6 +537,14 @@ HTTP Connections - Listening / Connecting / Hijacking
 struct http_settings_s {
   /** Callback for normal HTTP requests. */
   void (*on_request)(http_s *request);
+  /**
+   * (optional) Callback for fast routes, called before `on_request` (and before
+   * the `public_folder` is tested).
+   *
+   * Should return 0 if the request was handled (`on_request` is skipped) or -1
+   * to continue normally.
+   */
+  int (*on_route)(http_s *request);
   /**
    * Callback for Upgrade and EventSource (SSE) requests.
    *
@@ -357,6 +584,14 @@ struct http_settings_s {
    * Defaults to ~ 50Mb.
    */
   size_t max_body_size;
+  /**
+   * Request bodies up to this size (in bytes) are kept in memory. Larger
+   * bodies are buffered using an anonymous temporary file (or streamed, see
+   * `stream_body`).
+   *
+   * Defaults to HTTP_DEFAULT_BODY_MEMORY (64Kb).
+   */
+  size_t max_body_memory;
   /**
    * The maximum number of clients that are allowed to connect concurrently.
    *
@@ -383,6 +618,14 @@ struct http_settings_s {
    * connections. Defaults to ~250KB.
    */
   size_t ws_max_msg_size;
+  /**
+   * The minimal response size (in bytes) for compressing responses using gzip
+   * (or deflate), when supported by the client and the response's content
+   * type is compressible. Defaults to 0 (compression disabled).
+   *
+   * Compression requires zlib (the `HAVE_ZLIB` flag).
+   */
+  size_t compress;
   /**
    * An HTTP/1.x connection timeout.
    *
@@ -401,6 +644,27 @@ struct http_settings_s {
   uint8_t ws_timeout;
   /** Logging flag - set to TRUE to log HTTP requests. */
   uint8_t log;
+  /**
+   * The maximum number of pipelined HTTP/1.x requests handled in a single
+   * read cycle before yielding to other connections. Defaults to 8.
+   *
+   * Responses to requests handled within the same read cycle are coalesced and
+   * written to the socket together.
+   */
+  uint8_t pipeline;
+  /**
+   * Set to TRUE to handle requests with a `content-length` bigger than
+   * `max_body_memory` as soon as their headers arrive, before the body was
+   * received. The rest of the body is read on demand using `http_body_read`.
+   */
+  uint8_t stream_body;
+  /**
+   * Set to TRUE to parse `multipart/form-data` request bodies while they're
+   * received. Uploaded files are written to anonymous temporary files, form
+   * fields are kept in memory and the body itself isn't kept (see
+   * `http_multipart_parts`).
+   */
+  uint8_t parse_multipart;
   /** a read only flag set automatically to indicate the protocol's mode. */
   uint8_t is_client;
 };
@@ -483,6 +747,23 @@ fio_str_info_s http_peer_addr(http_s *h);
  */
 intptr_t http_hijack(http_s *h, fio_str_info_s *leftover);
 
+/**
+ * Reads up to `length` bytes of a streamed request body (see the `stream_body`
+ * setting) directly from the connection, blocking until data is available.
+ *
+ * Data that arrived along with the request's headers is placed in `h->body`
+ * and should be consumed first.
+ *
+ * Returns the number of bytes read, 0 once the whole body was read (or if the
+ * body isn't streamed) and -1 on error (i.e., timeout or disconnection).
+ *
+ * If `length` is 0, returns the number of body bytes still waiting to be read
+ * (nothing is read and the call never blocks).
+ *
+ * Only valid within the `on_request` callback and from the calling thread.
+ */
+ssize_t http_body_read(http_s *h, void *buffer, size_t length);
+
 /* *****************************************************************************
 Websocket Upgrade (Server and Client connection establishment)
 ***************************************************************************** */
@@ -728,6 +1009,35 @@ int http_sse_write(http_sse_s *sse, struct http_sse_write_args);
 #define http_sse_write(sse, ...)                                               \
   http_sse_write((sse), (struct http_sse_write_args){__VA_ARGS__})
 
+/**
+ * Writes a pre-formatted event (a FIOBJ String) to an EventSource (SSE)
+ * connection, taking ownership of `event`.
+ *
+ * i.e., writes the `HTTP_SSE_OPTIMIZE_PUBSUB` metadata of a pub/sub message.
+ */
+int http_sse_write_formatted(http_sse_s *sse, FIOBJ event);
+
+/** Optimize SSE broadcasts, for use in http_sse_optimize4broadcasts. */
+#define HTTP_SSE_OPTIMIZE_PUBSUB (-35)
+
+/**
+ * Enables (or disables) the SSE broadcast optimization.
+ *
+ * When enabled, published messages are formatted once as an SSE event (with
+ * only a `data` field), rather than once for each SSE subscriber.
+ *
+ * Note: to disable the optimization it should be disabled the same amount of
+ * times it was enabled (the optimization is reference counted).
+ *
+ * The pub/sub metadata type ID is `HTTP_SSE_OPTIMIZE_PUBSUB` and the data is a
+ * FIOBJ String containing the formatted event, i.e.:
+ *
+ *     FIOBJ event = (FIOBJ)fio_message_metadata(msg, HTTP_SSE_OPTIMIZE_PUBSUB);
+ *     if (event)
+ *       http_sse_write_formatted(sse, fiobj_dup(event));
+ */
+void http_sse_optimize4broadcasts(int enable);
+
 /**
  * Get the connection's UUID (for `fio_defer_io_task`, pub/sub, etc').
  */
@@ -775,6 +1085,35 @@ HTTP GET and POST parsing helpers
  */
 int http_parse_body(http_s *h);
 
+/** A `multipart/form-data` part, see `http_multipart_parts`. */
+typedef struct http_multipart_part_s http_multipart_part_s;
+struct http_multipart_part_s {
+  /** the next part (or NULL). */
+  http_multipart_part_s *next;
+  /** the part's (form field) name. */
+  FIOBJ name;
+  /** the uploaded file's name (FIOBJ_INVALID for form fields). */
+  FIOBJ filename;
+  /** the part's content type (FIOBJ_INVALID if missing). */
+  FIOBJ type;
+  /** the form field's value (FIOBJ_INVALID for uploaded files). */
+  FIOBJ value;
+  /** the temporary file with the uploaded data (or -1). */
+  int fd;
+  /** the temporary file's name (removed with the request). */
+  FIOBJ path;
+  /** the uploaded file's size. */
+  size_t size;
+};
+
+/**
+ * Returns the request's `multipart/form-data` parts (in order) if the body was
+ * parsed while it was received (see the `parse_multipart` setting), or NULL.
+ *
+ * The parts (and file descriptors) are owned by the request.
+ */
+http_multipart_part_s *http_multipart_parts(http_s *h);
+
 /**
  * Parses the query part of an HTTP request/response. Uses `http_add2hash`.
  *
@@ -887,11 +1226,42 @@ HTTP General Helper functions that could be used globally
 FIOBJ http_req2str(http_s *h);
 
 /**
- * Writes a log line to `stderr` about the request / response object.
+ * Writes an access log line about the request / response object.
  *
  * This function is called automatically if the `.log` setting is enabled.
+ *
+ * Lines are buffered and written by a background thread (see
+ * `http_log_setup`).
  */
 void http_write_log(http_s *h);
+
+/** Access log formats. */
+typedef enum {
+  /** `ip - - [date] "GET /path HTTP/1.1" 200 12b 1ms` */
+  HTTP_LOG_COMMON = 0,
+  /** one JSON object per line, including phase timings (see `http_s`). */
+  HTTP_LOG_JSON = 1,
+} http_log_format_e;
+
+/**
+ * Sets the access log destination and format (process wide).
+ *
+ * `path` is a file name (lines are appended), `"syslog"` (the `/dev/log`
+ * socket), `"syslog:<socket path>"` or NULL for `stderr`.
+ *
+ * Returns -1 on error (the current destination is kept).
+ */
+int http_log_setup(const char *path, http_log_format_e format);
+
+typedef struct {
+  /** the number of log lines buffered (per process). */
+  size_t lines;
+  /** the number of log lines dropped because a buffer was full. */
+  size_t dropped;
+} http_log_stats_s;
+
+/** Collects the access log statistics for the current process. */
+void http_log_stats(http_log_stats_s *stats);
 /* *****************************************************************************
 HTTP Time related helper functions that could be used globally
 ***************************************************************************** */
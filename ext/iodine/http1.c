@@ -12,8 +12,13 @@ License: MIT
 #include <fiobj.h>
 
 #include <assert.h>
+#include <errno.h>
 #include <stddef.h>
 
+#ifndef __MINGW32__
+#include <poll.h>
+#endif
+
 /* *****************************************************************************
 The HTTP/1.1 Protocol Object
 ***************************************************************************** */
@@ -25,9 +30,17 @@ typedef struct http1pr_s {
   uintptr_t buf_len;
   uintptr_t max_header_size;
   uintptr_t header_size;
+  FIOBJ out;
+  int64_t stream_left;
   uint8_t close;
   uint8_t is_client;
   uint8_t stop;
+  uint8_t coalesce;
+  uint8_t streamed;
+  uint8_t streaming; /* response streaming: 1 == raw, 2 == chunked */
+  /* response parsers for other protocols (see `http1_response_parser_new`) */
+  const http1_response_hooks_s *hooks;
+  void *udata;
   uint8_t buf[];
 } http1pr_s;
 
@@ -47,18 +60,55 @@ inline static void h1_reset(http1pr_s *p) { p->header_size = 0; }
 
 static fio_str_info_s http1pr_status2str(uintptr_t status);
 
+/* writes any coalesced (pipelined) responses to the socket */
+static inline void http1_flush(http1pr_s *p) {
+  if (!p->out)
+    return;
+  fiobj_send_free(p->p.uuid, p->out);
+  p->out = FIOBJ_INVALID;
+}
+
+/* writes a response packet, coalescing pipelined responses when possible */
+static inline void http1_write_packet(http1pr_s *p, FIOBJ packet) {
+  if (!p->coalesce) {
+    http1_flush(p);
+    fiobj_send_free(p->p.uuid, packet);
+    return;
+  }
+  if (!p->out) {
+    p->out = packet;
+    return;
+  }
+  fio_str_info_s s = fiobj_obj2cstr(packet);
+  if (fiobj_obj2cstr(p->out).len + s.len > HTTP_COALESCE_LIMIT) {
+    http1_flush(p);
+    p->out = packet;
+    return;
+  }
+  fiobj_str_write(p->out, s.data, s.len);
+  fiobj_free(packet);
+}
+
 /* cleanup an HTTP/1.1 handler object */
 static inline void http1_after_finish(http_s *h) {
   http1pr_s *p = handle2pr(h);
+  if (h == &p->request && p->stream_left > 0 && !(p->stop & 2)) {
+    /* a streamed body wasn't consumed, the connection can't be reused */
+    p->stream_left = -1;
+    p->close = 1;
+  }
   p->stop = p->stop & (~1UL);
+  p->streaming = 0;
   if (h != &p->request) {
     http_s_destroy(h, 0);
     fio_free(h);
   } else {
     http_s_clear(h, p->p.settings->log);
   }
-  if (p->close)
+  if (p->close) {
+    http1_flush(p);
     fio_close(p->p.uuid);
+  }
 }
 
 /* *****************************************************************************
@@ -182,16 +232,42 @@ static int http1_send_body(http_s *h, void *data, uintptr_t length) {
     return -1;
   }
   fiobj_str_write(packet, data, length);
-  fiobj_send_free((handle2pr(h)->p.uuid), packet);
+  http1_write_packet(handle2pr(h), packet);
   http1_after_finish(h);
   return 0;
 }
-/** Should send existing headers and file */
-static int http1_sendfile(http_s *h, int fd, uintptr_t length,
-                          uintptr_t offset) {
+/** Should send existing headers and data, calling `dealloc` when done */
+static int http1_send_body_nocopy(http_s *h, void *data, uintptr_t length,
+                                  void (*dealloc)(void *)) {
+  http1pr_s *p = handle2pr(h);
   FIOBJ packet = headers2str(h, 0);
   if (!packet) {
+    dealloc(data);
+    http1_after_finish(h);
+    return -1;
+  }
+  /* headers must precede the body, so coalesced responses are sent first */
+  http1_write_packet(p, packet);
+  http1_flush(p);
+  fio_write2(p->p.uuid, .data.buffer = data, .length = length,
+             .after.dealloc = dealloc);
+  http1_after_finish(h);
+  return 0;
+}
+/** closes a file descriptor using the (optional) `close_fd` callback */
+static inline void http1_close_fd(void (*close_fd)(intptr_t), int fd) {
+  if (close_fd)
+    close_fd(fd);
+  else
     close(fd);
+}
+/** Should send existing headers and file, calling `close_fd` when done */
+static int http1_sendfile_notify(http_s *h, int fd, uintptr_t length,
+                                 uintptr_t offset,
+                                 void (*close_fd)(intptr_t fd)) {
+  FIOBJ packet = headers2str(h, 0);
+  if (!packet) {
+    http1_close_fd(close_fd, fd);
     http1_after_finish(h);
     return -1;
   }
@@ -202,28 +278,92 @@ static int http1_sendfile(http_s *h, int fd, uintptr_t length,
     s = fiobj_obj2cstr(packet);
     intptr_t i = pread(fd, s.data + s.len, length, offset);
     if (i < 0) {
-      close(fd);
-      fiobj_send_free((handle2pr(h)->p.uuid), packet);
+      http1_close_fd(close_fd, fd);
+      http1_write_packet(handle2pr(h), packet);
+      http1_flush(handle2pr(h));
       fio_close((handle2pr(h)->p.uuid));
       return -1;
     }
-    close(fd);
+    http1_close_fd(close_fd, fd);
     fiobj_str_resize(packet, s.len + i);
-    fiobj_send_free((handle2pr(h)->p.uuid), packet);
+    http1_write_packet(handle2pr(h), packet);
     http1_after_finish(h);
     return 0;
   }
-  fiobj_send_free((handle2pr(h)->p.uuid), packet);
-  fio_sendfile((handle2pr(h)->p.uuid), fd, offset, length);
+  http1_write_packet(handle2pr(h), packet);
+  http1_flush(handle2pr(h));
+  fio_write2((handle2pr(h)->p.uuid), .data.fd = fd, .length = length,
+             .offset = offset, .is_fd = 1, .after.close = close_fd);
   http1_after_finish(h);
   return 0;
 }
+/** Should send existing headers and file */
+static int http1_sendfile(http_s *h, int fd, uintptr_t length,
+                          uintptr_t offset) {
+  return http1_sendfile_notify(h, fd, length, offset, NULL);
+}
+
+/** Should send existing headers and data and prepare for streaming */
+static int http1_stream(http_s *h, void *data, uintptr_t length) {
+  http1pr_s *p = handle2pr(h);
+  FIOBJ packet;
+  if (!p->streaming) {
+    static uint64_t cl_hash = 0;
+    if (!cl_hash)
+      cl_hash = fiobj_hash_string("content-length", 14);
+    fio_str_info_s v = fiobj_obj2cstr(h->version);
+    if (fiobj_hash_get2(h->private_data.out_headers, cl_hash)) {
+      p->streaming = 1;
+    } else if (v.len > 7 && v.data[5] == '1' && v.data[7] == '1') {
+      http_set_header(h, HTTP_HEADER_TRANSFER_ENCODING,
+                      fiobj_dup(HTTP_HVALUE_CHUNKED_ENCODING));
+      p->streaming = 2;
+    } else {
+      /* HTTP/1.0 - the end of the connection marks the end of the body */
+      http_set_header(h, HTTP_HEADER_CONNECTION, fiobj_dup(HTTP_HVALUE_CLOSE));
+      p->streaming = 1;
+    }
+    packet = headers2str(h, length + 16);
+    if (!packet)
+      return -1;
+  } else {
+    packet = fiobj_str_buf(length + 16);
+  }
+  if (length) {
+    if (p->streaming == 2) {
+      /* chunk size, in hex (no `0x` prefix) */
+      char buf[24];
+      size_t len = 0;
+      for (int shift = 60; shift >= 0; shift -= 4) {
+        uint8_t n = (length >> shift) & 15;
+        if (len || n || !shift)
+          buf[len++] = "0123456789ABCDEF"[n];
+      }
+      buf[len++] = '\r';
+      buf[len++] = '\n';
+      fiobj_str_write(packet, buf, len);
+    }
+    fiobj_str_write(packet, data, length);
+    if (p->streaming == 2)
+      fiobj_str_write(packet, "\r\n", 2);
+  }
+  /* streamed data isn't coalesced */
+  http1_flush(p);
+  fiobj_send_free(p->p.uuid, packet);
+  return (int)fio_pending(p->p.uuid);
+}
 
 /** Should send existing headers or complete streaming */
 static void htt1p_finish(http_s *h) {
+  if (handle2pr(h)->streaming) {
+    if (handle2pr(h)->streaming == 2)
+      fiobj_send_free(handle2pr(h)->p.uuid, fiobj_str_new("0\r\n\r\n", 5));
+    http1_after_finish(h);
+    return;
+  }
   FIOBJ packet = headers2str(h, 0);
   if (packet)
-    fiobj_send_free((handle2pr(h)->p.uuid), packet);
+    http1_write_packet(handle2pr(h), packet);
   else {
     // fprintf(stderr, "WARNING: invalid call to `htt1p_finish`\n");
   }
@@ -251,6 +391,7 @@ static int http1_push_file(http_s *h, FIOBJ filename, FIOBJ mime_type) {
  */
 static void http1_on_pause(http_s *h, http_fio_protocol_s *pr) {
   ((http1pr_s *)pr)->stop = 1;
+  http1_flush((http1pr_s *)pr);
   fio_suspend(pr->uuid);
   (void)h;
 }
@@ -279,6 +420,7 @@ static intptr_t http1_hijack(http_s *h, fio_str_info_s *leftover) {
   }
 
   handle2pr(h)->stop = 3;
+  http1_flush(handle2pr(h));
   intptr_t uuid = handle2pr(h)->p.uuid;
   fio_attach(uuid, NULL);
   return uuid;
@@ -297,6 +439,7 @@ static void http1_websocket_client_on_upgrade(http_s *h, char *proto,
   set->udata = NULL;
   http_finish(h);
   p->stop = 1;
+  http1_flush(p);
   websocket_attach(uuid, set, args, p->parser.state.next,
                    p->buf_len - (intptr_t)(p->parser.state.next - p->buf));
   fio_free(args);
@@ -358,6 +501,7 @@ static int http1_http2websocket_server(http_s *h, websocket_settings_s *args) {
   http_settings_s *set = handle2pr(h)->p.settings;
   http_finish(h);
   pr->stop = 1;
+  http1_flush(pr);
   websocket_attach(uuid, set, args, pr->parser.state.next,
                    pr->buf_len - (intptr_t)(pr->parser.state.next - pr->buf));
   return 0;
@@ -472,6 +616,7 @@ static int http1_upgrade2sse(http_s *h, http_sse_s *sse) {
                   fiobj_str_new("identity", 8));
   handle2pr(h)->stop = 1;
   htt1p_finish(h); /* avoid the enforced content length in http_finish */
+  http1_flush(handle2pr(h));
 
   /* switch protocol to SSE */
   http1_sse_fio_protocol_s *sse_pr = fio_malloc(sizeof(*sse_pr));
@@ -527,9 +672,95 @@ static int http1_sse_close(http_sse_s *sse) {
 Virtual Table Decleration
 ***************************************************************************** */
 
+/* *****************************************************************************
+Streamed request bodies
+***************************************************************************** */
+
+/**
+ * Reads a streamed request body directly from the socket.
+ *
+ * While the client lags behind, the calling thread blocks on the socket (up to
+ * the connection's timeout). The GVL is released by the caller, so other Ruby
+ * threads keep running.
+ */
+static ssize_t http1_body_read(http_s *h, void *buffer, size_t length) {
+  http1pr_s *p = handle2pr(h);
+  if (h != &p->request || p->stream_left <= 0)
+    return 0;
+  if (!length)
+    return p->stream_left;
+  if ((int64_t)length > p->stream_left)
+    length = p->stream_left;
+  const int64_t timeout = (int64_t)p->p.settings->timeout * 1000;
+  int64_t started = -1;
+  for (;;) {
+    /* the connection is locked or suspended (paused), no one competes */
+    ssize_t i = fio_read(p->p.uuid, buffer, length);
+    if (i > 0) {
+      p->stream_left -= i;
+      return i;
+    }
+    if (i < 0)
+      return -1;
+#ifndef __MINGW32__
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    const int64_t ms = ((int64_t)now.tv_sec * 1000) + (now.tv_nsec / 1000000);
+    if (started == -1)
+      started = ms;
+    if (ms - started >= timeout)
+      return -1;
+    struct pollfd pfd = {.fd = fio_uuid2fd(p->p.uuid), .events = POLLIN};
+    const int r = poll(&pfd, 1, (int)(timeout - (ms - started)));
+    if (r == -1 && errno == EINTR)
+      continue;
+    if (r < 0)
+      return -1;
+#else
+    return -1;
+#endif
+  }
+}
+
+/**
+ * Handles a request before its body was received, the handler reads the body
+ * on demand using `http_body_read` (the TCP window provides backpressure).
+ */
+static int http1_stream_request(http1_parser_s *parser, char *data,
+                                size_t data_len) {
+  http1pr_s *p = parser2http(parser);
+  http_s *h = &http1_pr2handle(p);
+  h->body = fiobj_data_newstr();
+  fiobj_data_write(h->body, data, data_len);
+  p->stream_left = parser->state.content_length - data_len;
+  p->streamed = 1;
+  http_on_request_handler______internal(h, p->p.settings);
+  /* the parser should skip the data consumed directly from the socket */
+  parser->state.read = parser->state.content_length - data_len;
+  if ((p->stop & 1) && p->request.method) {
+    /* paused: the body can be read once resumed (reviewed when finished) */
+    return 0;
+  }
+  if (p->request.method && !p->stop)
+    http_finish(&p->request);
+  if (p->stream_left && !(p->stop & 2)) {
+    /* the body wasn't consumed, the connection can't be reused */
+    p->stream_left = 0;
+    p->close = 1;
+    http1_flush(p);
+    fio_close(p->p.uuid);
+    return -1;
+  }
+  p->stream_left = 0;
+  return 0;
+}
+
 struct http_vtable_s HTTP1_VTABLE = {
     .http_send_body = http1_send_body,
+    .http_send_body_nocopy = http1_send_body_nocopy,
     .http_sendfile = http1_sendfile,
+    .http_sendfile_notify = http1_sendfile_notify,
+    .http_stream = http1_stream,
     .http_finish = htt1p_finish,
     .http_push_data = http1_push_data,
     .http_push_file = http1_push_file,
@@ -540,6 +771,7 @@ struct http_vtable_s HTTP1_VTABLE = {
     .http_upgrade2sse = http1_upgrade2sse,
     .http_sse_write = http1_sse_write,
     .http_sse_close = http1_sse_close,
+    .http_body_read = http1_body_read,
 };
 
 void *http1_vtable(void) { return (void *)&HTTP1_VTABLE; }
@@ -551,6 +783,22 @@ Parser Callbacks
 /** called when a request was received. */
 static int http1_on_request(http1_parser_s *parser) {
   http1pr_s *p = parser2http(parser);
+  if (p->hooks)
+    return -1;
+  if (p->streamed) {
+    /* already handled by `http1_stream_request` */
+    p->streamed = 0;
+    h1_reset(p);
+    return fio_is_closed(p->p.uuid);
+  }
+  if (p->request.multipart) {
+    size_t error = http_multipart_finish(&p->request);
+    if (error) {
+      http_send_error(&p->request, error);
+      h1_reset(p);
+      return fio_is_closed(p->p.uuid);
+    }
+  }
   http_on_request_handler______internal(&http1_pr2handle(p), p->p.settings);
   if (p->request.method && !p->stop)
     http_finish(&p->request);
@@ -560,6 +808,10 @@ static int http1_on_request(http1_parser_s *parser) {
 /** called when a response was received. */
 static int http1_on_response(http1_parser_s *parser) {
   http1pr_s *p = parser2http(parser);
+  if (p->hooks)
+    return p->hooks->on_response(
+        p->udata, !!(parser->state.reserved &
+                     (HTTP1_P_FLAG_CLENGTH | HTTP1_P_FLAG_CHUNKED)));
   http_on_response_handler______internal(&http1_pr2handle(p), p->p.settings);
   if (p->request.status_str && !p->stop)
     http_finish(&p->request);
@@ -569,6 +821,8 @@ static int http1_on_response(http1_parser_s *parser) {
 /** called when a request method is parsed. */
 static int http1_on_method(http1_parser_s *parser, char *method,
                            size_t method_len) {
+  if (parser2http(parser)->hooks)
+    return -1;
   http1_pr2handle(parser2http(parser)).method =
       fiobj_str_new(method, method_len);
   parser2http(parser)->header_size += method_len;
@@ -579,6 +833,9 @@ static int http1_on_method(http1_parser_s *parser, char *method,
  * without the prefixed numerical status indicator.*/
 static int http1_on_status(http1_parser_s *parser, size_t status,
                            char *status_str, size_t len) {
+  if (parser2http(parser)->hooks)
+    return parser2http(parser)->hooks->on_status(parser2http(parser)->udata,
+                                                 status);
   http1_pr2handle(parser2http(parser)).status_str =
       fiobj_str_new(status_str, len);
   http1_pr2handle(parser2http(parser)).status = status;
@@ -588,6 +845,8 @@ static int http1_on_status(http1_parser_s *parser, size_t status,
 
 /** called when a request path (excluding query) is parsed. */
 static int http1_on_path(http1_parser_s *parser, char *path, size_t len) {
+  if (parser2http(parser)->hooks)
+    return -1;
   http1_pr2handle(parser2http(parser)).path = fiobj_str_new(path, len);
   parser2http(parser)->header_size += len;
   return 0;
@@ -595,12 +854,17 @@ static int http1_on_path(http1_parser_s *parser, char *path, size_t len) {
 
 /** called when a request path (excluding query) is parsed. */
 static int http1_on_query(http1_parser_s *parser, char *query, size_t len) {
+  if (parser2http(parser)->hooks)
+    return -1;
   http1_pr2handle(parser2http(parser)).query = fiobj_str_new(query, len);
   parser2http(parser)->header_size += len;
   return 0;
 }
 /** called when a the HTTP/1.x version is parsed. */
 static int http1_on_version(http1_parser_s *parser, char *version, size_t len) {
+  if (parser2http(parser)->hooks)
+    return parser2http(parser)->hooks->on_version(parser2http(parser)->udata,
+                                                  version, len);
   http1_pr2handle(parser2http(parser)).version = fiobj_str_new(version, len);
   parser2http(parser)->header_size += len;
 /* start counting - occurs on the first line of both requests and responses */
@@ -617,6 +881,9 @@ static int http1_on_header(http1_parser_s *parser, char *name, size_t name_len,
                            char *data, size_t data_len) {
   FIOBJ sym;
   FIOBJ obj;
+  if (parser2http(parser)->hooks)
+    return parser2http(parser)->hooks->on_header(
+        parser2http(parser)->udata, name, name_len, data, data_len);
   if (!http1_pr2handle(parser2http(parser)).headers) {
     FIO_LOG_ERROR("(http1 parse ordering error) missing HashMap for header "
                   "%s: %s",
@@ -645,6 +912,9 @@ static int http1_on_header(http1_parser_s *parser, char *name, size_t name_len,
 /** called when a body chunk is parsed. */
 static int http1_on_body_chunk(http1_parser_s *parser, char *data,
                                size_t data_len) {
+  if (parser2http(parser)->hooks)
+    return parser2http(parser)->hooks->on_body_chunk(
+        parser2http(parser)->udata, data, data_len);
   if (parser->state.content_length >
           (ssize_t)parser2http(parser)->p.settings->max_body_size ||
       parser->state.read >
@@ -652,13 +922,45 @@ static int http1_on_body_chunk(http1_parser_s *parser, char *data,
     http_send_error(&http1_pr2handle(parser2http(parser)), 413);
     return -1; /* test every time, in case of chunked data */
   }
+  if (http1_pr2handle(parser2http(parser)).multipart ||
+      (!parser->state.read &&
+       parser2http(parser)->p.settings->parse_multipart &&
+       !parser2http(parser)->is_client &&
+       !http_multipart_start(&http1_pr2handle(parser2http(parser))))) {
+    /* the body is parsed while it's received (and isn't kept) */
+    size_t error = http_multipart_write(&http1_pr2handle(parser2http(parser)),
+                                        data, data_len);
+    if (error) {
+      http_send_error(&http1_pr2handle(parser2http(parser)), error);
+      return -1;
+    }
+    return 0;
+  }
+  const ssize_t max_memory =
+      (ssize_t)parser2http(parser)->p.settings->max_body_memory;
   if (!parser->state.read) {
-    if (parser->state.content_length > 0 &&
-        parser->state.content_length <= HTTP_MAX_HEADER_LENGTH) {
+#ifndef __MINGW32__
+    if (parser->state.content_length > max_memory &&
+        parser2http(parser)->p.settings->stream_body &&
+        !parser2http(parser)->is_client)
+      return http1_stream_request(parser, data, data_len);
+#endif
+    if (parser->state.content_length <= max_memory) {
+      /* chunked bodies start in memory */
       http1_pr2handle(parser2http(parser)).body = fiobj_data_newstr();
     } else {
       http1_pr2handle(parser2http(parser)).body = fiobj_data_newtmpfile();
     }
+  } else if (parser->state.content_length <= 0 &&
+             parser->state.read <= max_memory &&
+             parser->state.read + (ssize_t)data_len > max_memory) {
+    /* a chunked body outgrew the memory limit, move it to a temporary file */
+    FIOBJ body = fiobj_data_newtmpfile();
+    FIOBJ old = http1_pr2handle(parser2http(parser)).body;
+    fio_str_info_s s = fiobj_data_pread(old, 0, fiobj_data_len(old));
+    fiobj_data_write(body, s.data, s.len);
+    fiobj_free(old);
+    http1_pr2handle(parser2http(parser)).body = body;
   }
   fiobj_data_write(http1_pr2handle(parser2http(parser)).body, data, data_len);
   return 0;
@@ -666,9 +968,12 @@ static int http1_on_body_chunk(http1_parser_s *parser, char *data,
 
 /** called when a protocol error occurred. */
 static int http1_on_error(http1_parser_s *parser) {
+  if (parser2http(parser)->hooks)
+    return parser2http(parser)->hooks->on_error(parser2http(parser)->udata);
   if (parser2http(parser)->close)
     return -1;
   FIO_LOG_DEBUG("HTTP parser error.");
+  http1_flush(parser2http(parser));
   fio_close(parser2http(parser)->p.uuid);
   return -1;
 }
@@ -683,14 +988,18 @@ static inline void http1_consume_data(intptr_t uuid, http1pr_s *p) {
   }
   ssize_t i = 0;
   size_t org_len = p->buf_len;
-  int pipeline_limit = 8;
+  int pipeline_limit = p->p.settings->pipeline;
   if (!p->buf_len)
     return;
+  /* coalesce responses to pipelined requests into a single write */
+  p->coalesce = 1;
   do {
     i = http1_parse(&p->parser, p->buf + (org_len - p->buf_len), p->buf_len);
     p->buf_len -= i;
     --pipeline_limit;
   } while (i && p->buf_len && pipeline_limit && !p->stop);
+  p->coalesce = 0;
+  http1_flush(p);
 
   if (p->buf_len && org_len != p->buf_len) {
     memmove(p->buf, p->buf + (org_len - p->buf_len), p->buf_len);
@@ -818,10 +1127,45 @@ void http1_destroy(fio_protocol_s *pr) {
   http1pr_s *p = (http1pr_s *)pr;
   http1_pr2handle(p).status = 0;
   http_s_destroy(&http1_pr2handle(p), 0);
+  fiobj_free(p->out);
   fio_free(p); // occasional Windows crash bug
   // FIO_LOG_DEBUG("Deallocated HTTP/1.1 protocol at. %p", (void *)p);
 }
 
+/* *****************************************************************************
+Parsing Responses for Other Protocols
+***************************************************************************** */
+
+/** Creates a response parser, the hooks are called with `udata`. */
+http1_response_parser_s *
+http1_response_parser_new(const http1_response_hooks_s *hooks, void *udata) {
+  http1pr_s *p = fio_malloc(sizeof(*p));
+  FIO_ASSERT_ALLOC(p);
+  *p = (http1pr_s){.hooks = hooks, .udata = udata};
+  return p;
+}
+
+/** Frees a response parser. */
+void http1_response_parser_free(http1_response_parser_s *parser) {
+  fio_free(parser);
+}
+
+/** Parses (part of) a response, returning the number of bytes consumed. */
+size_t http1_response_parse(http1_response_parser_s *parser, void *buffer,
+                            size_t length) {
+  return http1_parse(&parser->parser, buffer, length);
+}
+
+/** Returns non-zero once the current response's headers were parsed. */
+int http1_response_headers_complete(http1_response_parser_s *parser) {
+  return !!(parser->parser.state.reserved & HTTP1_P_FLAG_HEADER_COMPLETE);
+}
+
+/** Resets the parser's state (i.e., after a response without a body). */
+void http1_response_parser_reset(http1_response_parser_s *parser) {
+  parser->parser = (http1_parser_s)HTTP1_PARSER_INIT;
+}
+
 /* *****************************************************************************
 Protocol Data
 ***************************************************************************** */
@@ -26,4 +26,52 @@ void http1_destroy(fio_protocol_s *);
 /** returns the HTTP/1.1 protocol's VTable. */
 void *http1_vtable(void);
 
+/* *****************************************************************************
+Parsing Responses for Other Protocols (i.e., client connection pools)
+***************************************************************************** */
+
+/** An HTTP/1.x response parser that reports to an `http1_response_hooks_s`. */
+typedef struct http1pr_s http1_response_parser_s;
+
+/** Response parsing callbacks, returning -1 stops the parser (error). */
+typedef struct {
+  /**
+   * Called when a response was received. `sized` is zero when the response
+   * didn't state its length (the body ends when the connection closes).
+   */
+  int (*on_response)(void *udata, int sized);
+  /** called when the response status is parsed. */
+  int (*on_status)(void *udata, size_t status);
+  /** called when the HTTP/1.x version is parsed. */
+  int (*on_version)(void *udata, char *version, size_t len);
+  /** called when a header is parsed. */
+  int (*on_header)(void *udata, char *name, size_t name_len, char *data,
+                   size_t data_len);
+  /** called when a body chunk is parsed. */
+  int (*on_body_chunk)(void *udata, char *data, size_t len);
+  /** called when a protocol error occurred. */
+  int (*on_error)(void *udata);
+} http1_response_hooks_s;
+
+/** Creates a response parser, the hooks are called with `udata`. */
+http1_response_parser_s *
+http1_response_parser_new(const http1_response_hooks_s *hooks, void *udata);
+
+/** Frees a response parser. */
+void http1_response_parser_free(http1_response_parser_s *parser);
+
+/**
+ * Parses (part of) a response, returning the number of bytes consumed.
+ *
+ * Parsing stops after each response, the reminder should be resubmitted.
+ */
+size_t http1_response_parse(http1_response_parser_s *parser, void *buffer,
+                            size_t length);
+
+/** Returns non-zero once the current response's headers were parsed. */
+int http1_response_headers_complete(http1_response_parser_s *parser);
+
+/** Resets the parser's state (i.e., after a response without a body). */
+void http1_response_parser_reset(http1_response_parser_s *parser);
+
 #endif
@@ -42,10 +42,15 @@ void http_on_request_handler______internal(http_s *h,
           fiobj_hash_get2(h->headers, fiobj_obj2hash(HTTP_HEADER_ACCEPT)),
           HTTP_HVALUE_SSE_MIME))
     goto eventsource;
+  if (settings->on_route && !settings->on_route(h))
+    return;
   if (settings->public_folder &&
       (fiobj_obj2cstr(h->method).len != 4 || strncasecmp("post", fiobj_obj2cstr(h->method).data, 4))) {
     fio_str_info_s path_str = fiobj_obj2cstr(h->path);
-    if (!http_sendfile2(h, settings->public_folder,
+    if (!http_public_index_test(settings->public_folder,
+                                settings->public_folder_length, path_str.data,
+                                path_str.len) &&
+        !http_sendfile2(h, settings->public_folder,
                         settings->public_folder_length, path_str.data,
                         path_str.len)) {
       return;
@@ -127,11 +132,16 @@ FIOBJ HTTP_HEADER_LAST_MODIFIED;
 FIOBJ HTTP_HEADER_ORIGIN;
 FIOBJ HTTP_HEADER_SET_COOKIE;
 FIOBJ HTTP_HEADER_UPGRADE;
+FIOBJ HTTP_HEADER_TRANSFER_ENCODING;
+FIOBJ HTTP_HEADER_VARY;
 FIOBJ HTTP_HEADER_WS_SEC_CLIENT_KEY;
 FIOBJ HTTP_HEADER_WS_SEC_KEY;
+FIOBJ HTTP_HVALUE_ACCEPT_ENCODING;
 FIOBJ HTTP_HVALUE_BYTES;
+FIOBJ HTTP_HVALUE_CHUNKED_ENCODING;
 FIOBJ HTTP_HVALUE_CLOSE;
 FIOBJ HTTP_HVALUE_CONTENT_TYPE_DEFAULT;
+FIOBJ HTTP_HVALUE_DEFLATE;
 FIOBJ HTTP_HVALUE_GZIP;
 FIOBJ HTTP_HVALUE_KEEP_ALIVE;
 FIOBJ HTTP_HVALUE_MAX_AGE;
@@ -173,11 +183,16 @@ static void http_lib_cleanup(void *ignr_) {
   HTTPLIB_RESET(HTTP_HEADER_ORIGIN);
   HTTPLIB_RESET(HTTP_HEADER_SET_COOKIE);
   HTTPLIB_RESET(HTTP_HEADER_UPGRADE);
+  HTTPLIB_RESET(HTTP_HEADER_TRANSFER_ENCODING);
+  HTTPLIB_RESET(HTTP_HEADER_VARY);
   HTTPLIB_RESET(HTTP_HEADER_WS_SEC_CLIENT_KEY);
   HTTPLIB_RESET(HTTP_HEADER_WS_SEC_KEY);
+  HTTPLIB_RESET(HTTP_HVALUE_ACCEPT_ENCODING);
   HTTPLIB_RESET(HTTP_HVALUE_BYTES);
+  HTTPLIB_RESET(HTTP_HVALUE_CHUNKED_ENCODING);
   HTTPLIB_RESET(HTTP_HVALUE_CLOSE);
   HTTPLIB_RESET(HTTP_HVALUE_CONTENT_TYPE_DEFAULT);
+  HTTPLIB_RESET(HTTP_HVALUE_DEFLATE);
   HTTPLIB_RESET(HTTP_HVALUE_GZIP);
   HTTPLIB_RESET(HTTP_HVALUE_KEEP_ALIVE);
   HTTPLIB_RESET(HTTP_HVALUE_MAX_AGE);
@@ -214,12 +229,17 @@ static void http_lib_init(void *ignr_) {
   HTTP_HEADER_ORIGIN = fiobj_str_new("origin", 6);
   HTTP_HEADER_SET_COOKIE = fiobj_str_new("set-cookie", 10);
   HTTP_HEADER_UPGRADE = fiobj_str_new("upgrade", 7);
+  HTTP_HEADER_TRANSFER_ENCODING = fiobj_str_new("transfer-encoding", 17);
+  HTTP_HEADER_VARY = fiobj_str_new("vary", 4);
   HTTP_HEADER_WS_SEC_CLIENT_KEY = fiobj_str_new("sec-websocket-key", 17);
   HTTP_HEADER_WS_SEC_KEY = fiobj_str_new("sec-websocket-accept", 20);
+  HTTP_HVALUE_ACCEPT_ENCODING = fiobj_str_new("accept-encoding", 15);
   HTTP_HVALUE_BYTES = fiobj_str_new("bytes", 5);
+  HTTP_HVALUE_CHUNKED_ENCODING = fiobj_str_new("chunked", 7);
   HTTP_HVALUE_CLOSE = fiobj_str_new("close", 5);
   HTTP_HVALUE_CONTENT_TYPE_DEFAULT =
       fiobj_str_new("application/octet-stream", 24);
+  HTTP_HVALUE_DEFLATE = fiobj_str_new("deflate", 7);
   HTTP_HVALUE_GZIP = fiobj_str_new("gzip", 4);
   HTTP_HVALUE_KEEP_ALIVE = fiobj_str_new("keep-alive", 10);
   HTTP_HVALUE_MAX_AGE = fiobj_str_new("max-age=3600", 12);
@@ -245,11 +265,16 @@ static void http_lib_init(void *ignr_) {
   fiobj_obj2hash(HTTP_HEADER_ORIGIN);
   fiobj_obj2hash(HTTP_HEADER_SET_COOKIE);
   fiobj_obj2hash(HTTP_HEADER_UPGRADE);
+  fiobj_obj2hash(HTTP_HEADER_TRANSFER_ENCODING);
+  fiobj_obj2hash(HTTP_HEADER_VARY);
   fiobj_obj2hash(HTTP_HEADER_WS_SEC_CLIENT_KEY);
   fiobj_obj2hash(HTTP_HEADER_WS_SEC_KEY);
+  fiobj_obj2hash(HTTP_HVALUE_ACCEPT_ENCODING);
   fiobj_obj2hash(HTTP_HVALUE_BYTES);
+  fiobj_obj2hash(HTTP_HVALUE_CHUNKED_ENCODING);
   fiobj_obj2hash(HTTP_HVALUE_CLOSE);
   fiobj_obj2hash(HTTP_HVALUE_CONTENT_TYPE_DEFAULT);
+  fiobj_obj2hash(HTTP_HVALUE_DEFLATE);
   fiobj_obj2hash(HTTP_HVALUE_GZIP);
   fiobj_obj2hash(HTTP_HVALUE_KEEP_ALIVE);
   fiobj_obj2hash(HTTP_HVALUE_MAX_AGE);
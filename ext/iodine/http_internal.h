@@ -30,9 +30,16 @@ typedef struct http_vtable_s http_vtable_s;
 struct http_vtable_s {
   /** Should send existing headers and data */
   int (*const http_send_body)(http_s *h, void *data, uintptr_t length);
+  /** Should send existing headers and data, calling `dealloc` when done */
+  int (*const http_send_body_nocopy)(http_s *h, void *data, uintptr_t length,
+                                     void (*dealloc)(void *));
   /** Should send existing headers and file */
   int (*const http_sendfile)(http_s *h, int fd, uintptr_t length,
                              uintptr_t offset);
+  /** Should send existing headers and file, calling `close_fd` when done */
+  int (*const http_sendfile_notify)(http_s *h, int fd, uintptr_t length,
+                                    uintptr_t offset,
+                                    void (*close_fd)(intptr_t fd));
   /** Should send existing headers and data and prepare for streaming */
   int (*const http_stream)(http_s *h, void *data, uintptr_t length);
   /** Should send existing headers or complete streaming */
@@ -58,6 +65,8 @@ struct http_vtable_s {
   int (*http_sse_write)(http_sse_s *sse, FIOBJ str);
   /** Closes an EventSource (SSE) connection. */
   int (*http_sse_close)(http_sse_s *sse);
+  /** Reads a streamed request body from the connection. */
+  ssize_t (*http_body_read)(http_s *h, void *buffer, size_t length);
 };
 
 struct http_fio_protocol_s {
@@ -73,11 +82,16 @@ Constants that shouldn't be accessed by the users (`fiobj_dup` required).
 ***************************************************************************** */
 
 extern FIOBJ HTTP_HEADER_ACCEPT_RANGES;
+extern FIOBJ HTTP_HEADER_TRANSFER_ENCODING;
+extern FIOBJ HTTP_HEADER_VARY;
 extern FIOBJ HTTP_HEADER_WS_SEC_CLIENT_KEY;
 extern FIOBJ HTTP_HEADER_WS_SEC_KEY;
+extern FIOBJ HTTP_HVALUE_ACCEPT_ENCODING;
 extern FIOBJ HTTP_HVALUE_BYTES;
+extern FIOBJ HTTP_HVALUE_CHUNKED_ENCODING;
 extern FIOBJ HTTP_HVALUE_CLOSE;
 extern FIOBJ HTTP_HVALUE_CONTENT_TYPE_DEFAULT;
+extern FIOBJ HTTP_HVALUE_DEFLATE;
 extern FIOBJ HTTP_HVALUE_GZIP;
 extern FIOBJ HTTP_HVALUE_KEEP_ALIVE;
 extern FIOBJ HTTP_HVALUE_MAX_AGE;
@@ -107,6 +121,19 @@ static inline void http_s_new(http_s *h, http_fio_protocol_s *owner,
   };
 }
 
+/**
+ * Starts parsing a `multipart/form-data` request body while it's received.
+ *
+ * Returns -1 if the request's body isn't `multipart/form-data`.
+ */
+int http_multipart_start(http_s *h);
+/** Parses body data. Returns 0 or an HTTP error status code. */
+size_t http_multipart_write(http_s *h, char *data, size_t len);
+/** Completes parsing the body. Returns 0 or an HTTP error status code. */
+size_t http_multipart_finish(http_s *h);
+/** Frees the parser and the parts (closing the temporary files). */
+void http_multipart_free(http_s *h);
+
 static inline void http_s_destroy(http_s *h, uint8_t log) {
   if (log && h->status && !h->status_str) {
     http_write_log(h);
@@ -121,6 +148,8 @@ static inline void http_s_destroy(http_s *h, uint8_t log) {
   fiobj_free(h->cookies);
   fiobj_free(h->body);
   fiobj_free(h->params);
+  if (h->multipart)
+    http_multipart_free(h);
 
   *h = (http_s){
     .private_data.vtbl = h->private_data.vtbl,
@@ -148,6 +177,14 @@ void http_on_request_handler______internal(http_s *h,
 
 void http_on_response_handler______internal(http_s *h,
                                             http_settings_s *settings);
+
+/**
+ * Tests the public folder's index for the requested (URL encoded) path.
+ *
+ * Returns -1 if the file is known to be missing or 0 if the file might exist.
+ */
+int http_public_index_test(const char *folder, size_t folder_len,
+                           const char *path, size_t path_len);
 int http_send_error2(size_t error, intptr_t uuid, http_settings_s *settings);
 
 /* *****************************************************************************
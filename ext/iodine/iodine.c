@@ -38,21 +38,36 @@ ID iodine_to_s_id;
 static VALUE address_sym;
 static VALUE app_sym;
 static VALUE body_sym;
+static VALUE cache_sym;
+static VALUE cache_vary_sym;
+static VALUE compress_sym;
 static VALUE cookies_sym;
+static VALUE fiber_sym;
+static VALUE gvl_batch_sym;
 static VALUE handler_sym;
 static VALUE headers_sym;
 static VALUE log_sym;
+static VALUE log_format_sym;
+static VALUE log_path_sym;
 static VALUE max_body_sym;
+static VALUE max_body_memory_sym;
 static VALUE max_clients_sym;
 static VALUE max_headers_sym;
 static VALUE max_msg_sym;
+static VALUE max_concurrent_sym;
+static VALUE max_wait_sym;
 static VALUE method_sym;
+static VALUE multipart_sym;
 static VALUE path_sym;
 static VALUE ping_sym;
+static VALUE pipeline_sym;
 static VALUE port_sym;
 static VALUE public_sym;
+static VALUE ractors_sym;
 static VALUE service_sym;
+static VALUE stream_input_sym;
 static VALUE timeout_sym;
+static VALUE timings_sym;
 static VALUE tls_sym;
 static VALUE url_sym;
 
@@ -406,10 +421,39 @@ static VALUE iodine_cli_parse(VALUE self) {
       FIO_CLI_INT("-keep-alive -k -tout HTTP keep-alive timeout in seconds "
                   "(0..255). Default: 40s"),
       FIO_CLI_BOOL("-log -v HTTP request logging."),
+      FIO_CLI_STRING("-log-path HTTP request log destination (a file name or "
+                     "syslog[:<socket>]). Default: stderr"),
+      FIO_CLI_STRING("-log-format HTTP request log format (common / json). "
+                     "Default: common"),
       FIO_CLI_INT(
           "-max-body -maxbd HTTP upload limit in Mega-Bytes. Default: 50Mb"),
+      FIO_CLI_INT("-max-body-memory -maxbm HTTP upload size kept in memory "
+                  "(in Kb), larger uploads are buffered. Default: 64Kb"),
+      FIO_CLI_BOOL("-stream-input handle large uploads before they're "
+                   "received (rack.input reads from the socket)."),
+      FIO_CLI_BOOL("-multipart parse multipart/form-data uploads while they're "
+                   "received (iodine.params)."),
+      FIO_CLI_INT("-gvl-batch Rack requests handled per GVL acquisition "
+                  "(2..255). Default: disabled"),
+      FIO_CLI_BOOL("-fiber run Rack requests in fibers (Ruby 3.0+)."),
+      FIO_CLI_INT("-ractors run Rack requests in a pool of Ractors "
+                  "(experimental, Ruby 3.0+). Default: disabled"),
       FIO_CLI_INT("-max-header -maxhd header limit per HTTP request in Kb. "
                   "Default: 32Kb."),
+      FIO_CLI_INT("-pipeline pipelined HTTP/1.x requests handled per read "
+                  "(1..255). Default: 8"),
+      FIO_CLI_INT("-compress minimal response size (in bytes) for gzip / "
+                  "deflate compression. Default: disabled"),
+      FIO_CLI_BOOL("-timings time request phases (iodine.timings, "
+                   "Iodine::HTTP.timing_stats)."),
+      FIO_CLI_INT("-max-concurrent concurrent Rack requests (per worker) "
+                  "before new requests are refused (503). Default: disabled"),
+      FIO_CLI_INT("-max-wait time (ms) a request may wait before it's "
+                  "refused (503). Default: disabled"),
+      FIO_CLI_INT("-cache cacheable Rack responses kept in memory (per "
+                  "worker). Default: disabled"),
+      FIO_CLI_STRING("-cache-vary request headers added to the response "
+                     "cache key (comma separated)."),
       FIO_CLI_PRINT_HEADER("WebSocket Settings:"),
       FIO_CLI_INT("-max-msg -maxms incoming WebSocket message limit in Kb. "
                   "Default: 250Kb"),
@@ -460,6 +504,14 @@ static VALUE iodine_cli_parse(VALUE self) {
   if (fio_cli_get_bool("-v")) {
     rb_hash_aset(defaults, log_sym, Qtrue);
   }
+  if (fio_cli_get("-log-path")) {
+    rb_hash_aset(defaults, log_path_sym,
+                 rb_str_new_cstr(fio_cli_get("-log-path")));
+  }
+  if (fio_cli_get("-log-format")) {
+    rb_hash_aset(defaults, log_format_sym,
+                 rb_str_new_cstr(fio_cli_get("-log-format")));
+  }
   if (fio_cli_get_bool("-warmup")) {
     rb_hash_aset(defaults, ID2SYM(rb_intern("warmup_")), Qtrue);
   }
@@ -511,6 +563,23 @@ static VALUE iodine_cli_parse(VALUE self) {
     rb_hash_aset(defaults, max_body_sym,
                  INT2NUM((fio_cli_get_i("-max-body") /* * 1024 * 1024 */)));
   }
+  if (fio_cli_get("-maxbm")) {
+    rb_hash_aset(defaults, max_body_memory_sym,
+                 INT2NUM((fio_cli_get_i("-maxbm") /* * 1024 */)));
+  }
+  if (fio_cli_get_bool("-stream-input")) {
+    rb_hash_aset(defaults, stream_input_sym, Qtrue);
+  }
+  if (fio_cli_get("-gvl-batch")) {
+    rb_hash_aset(defaults, gvl_batch_sym,
+                 INT2NUM(fio_cli_get_i("-gvl-batch")));
+  }
+  if (fio_cli_get_bool("-fiber")) {
+    rb_hash_aset(defaults, fiber_sym, Qtrue);
+  }
+  if (fio_cli_get("-ractors")) {
+    rb_hash_aset(defaults, ractors_sym, INT2NUM(fio_cli_get_i("-ractors")));
+  }
   if (fio_cli_get("-maxms")) {
     rb_hash_aset(defaults, max_msg_sym,
                  INT2NUM((fio_cli_get_i("-maxms") /* * 1024 */)));
@@ -519,6 +588,32 @@ static VALUE iodine_cli_parse(VALUE self) {
     rb_hash_aset(defaults, max_headers_sym,
                  INT2NUM((fio_cli_get_i("-maxhd") /* * 1024 */)));
   }
+  if (fio_cli_get("-pipeline")) {
+    rb_hash_aset(defaults, pipeline_sym, INT2NUM(fio_cli_get_i("-pipeline")));
+  }
+  if (fio_cli_get("-compress")) {
+    rb_hash_aset(defaults, compress_sym, INT2NUM(fio_cli_get_i("-compress")));
+  }
+  if (fio_cli_get_bool("-multipart")) {
+    rb_hash_aset(defaults, multipart_sym, Qtrue);
+  }
+  if (fio_cli_get_bool("-timings")) {
+    rb_hash_aset(defaults, timings_sym, Qtrue);
+  }
+  if (fio_cli_get("-max-concurrent")) {
+    rb_hash_aset(defaults, max_concurrent_sym,
+                 INT2NUM(fio_cli_get_i("-max-concurrent")));
+  }
+  if (fio_cli_get("-max-wait")) {
+    rb_hash_aset(defaults, max_wait_sym, INT2NUM(fio_cli_get_i("-max-wait")));
+  }
+  if (fio_cli_get("-cache")) {
+    rb_hash_aset(defaults, cache_sym, INT2NUM(fio_cli_get_i("-cache")));
+  }
+  if (fio_cli_get("-cache-vary")) {
+    rb_hash_aset(defaults, cache_vary_sym,
+                 rb_str_new_cstr(fio_cli_get("-cache-vary")));
+  }
 #ifndef __MINGW32__
   if (fio_cli_get_bool("-tls") || fio_cli_get("-key") || fio_cli_get("-cert")) {
     VALUE rbtls = IodineCaller.call(IodineTLSClass, rb_intern2("new", 3));
@@ -660,11 +755,26 @@ Supported Settigs:
 - `:body` (HTTP client)
 - `:tls`
 - `:log` (HTTP only)
+- `:log_path` (HTTP server only)
+- `:log_format` (HTTP server only)
 - `:public` (public folder, HTTP server only)
 - `:timeout` (HTTP only)
 - `:ping` (`:raw` clients and WebSockets only)
 - `:max_headers` (HTTP only)
 - `:max_body` (HTTP only)
+- `:max_body_memory` (HTTP server only)
+- `:stream_input` (HTTP server only)
+- `:multipart` (HTTP server only)
+- `:gvl_batch` (HTTP server only)
+- `:fiber` (HTTP server only)
+- `:ractors` (HTTP server only)
+- `:pipeline` (HTTP only)
+- `:compress` (HTTP server only)
+- `:timings` (HTTP server only)
+- `:max_concurrent` (HTTP server only)
+- `:max_wait` (HTTP server only)
+- `:cache` (HTTP server only)
+- `:cache_vary` (HTTP server only)
 - `:max_msg` (WebSockets only)
 
 */
@@ -675,21 +785,36 @@ FIO_FUNC iodine_connection_args_s iodine_connect_args(VALUE s, uint8_t is_srv) {
   VALUE address = rb_hash_aref(s, address_sym);
   VALUE app = rb_hash_aref(s, app_sym);
   VALUE body = rb_hash_aref(s, body_sym);
+  VALUE cache = rb_hash_aref(s, cache_sym);
+  VALUE cache_vary = rb_hash_aref(s, cache_vary_sym);
+  VALUE compress = rb_hash_aref(s, compress_sym);
   VALUE cookies = rb_hash_aref(s, cookies_sym);
+  VALUE fiber = rb_hash_aref(s, fiber_sym);
+  VALUE gvl_batch = rb_hash_aref(s, gvl_batch_sym);
   VALUE handler = rb_hash_aref(s, handler_sym);
   VALUE headers = rb_hash_aref(s, headers_sym);
   VALUE log = rb_hash_aref(s, log_sym);
+  VALUE log_format = rb_hash_aref(s, log_format_sym);
+  VALUE log_path = rb_hash_aref(s, log_path_sym);
   VALUE max_body = rb_hash_aref(s, max_body_sym);
+  VALUE max_body_memory = rb_hash_aref(s, max_body_memory_sym);
   VALUE max_clients = rb_hash_aref(s, max_clients_sym);
   VALUE max_headers = rb_hash_aref(s, max_headers_sym);
   VALUE max_msg = rb_hash_aref(s, max_msg_sym);
+  VALUE max_concurrent = rb_hash_aref(s, max_concurrent_sym);
+  VALUE max_wait = rb_hash_aref(s, max_wait_sym);
   VALUE method = rb_hash_aref(s, method_sym);
+  VALUE multipart = rb_hash_aref(s, multipart_sym);
   VALUE path = rb_hash_aref(s, path_sym);
   VALUE ping = rb_hash_aref(s, ping_sym);
+  VALUE pipeline = rb_hash_aref(s, pipeline_sym);
   VALUE port = rb_hash_aref(s, port_sym);
   VALUE r_public = rb_hash_aref(s, public_sym);
+  VALUE ractors = rb_hash_aref(s, ractors_sym);
   VALUE service = rb_hash_aref(s, service_sym);
+  VALUE stream_input = rb_hash_aref(s, stream_input_sym);
   VALUE timeout = rb_hash_aref(s, timeout_sym);
+  VALUE timings = rb_hash_aref(s, timings_sym);
 #ifndef __MINGW32__
   VALUE tls = rb_hash_aref(s, tls_sym);
 #endif
@@ -701,6 +826,12 @@ FIO_FUNC iodine_connection_args_s iodine_connect_args(VALUE s, uint8_t is_srv) {
     address = rb_hash_aref(iodine_default_args, address_sym);
   if (app == Qnil)
     app = rb_hash_aref(iodine_default_args, app_sym);
+  if (cache == Qnil)
+    cache = rb_hash_aref(iodine_default_args, cache_sym);
+  if (cache_vary == Qnil)
+    cache_vary = rb_hash_aref(iodine_default_args, cache_vary_sym);
+  if (compress == Qnil)
+    compress = rb_hash_aref(iodine_default_args, compress_sym);
   if (cookies == Qnil)
     cookies = rb_hash_aref(iodine_default_args, cookies_sym);
   if (handler == Qnil)
@@ -709,20 +840,34 @@ FIO_FUNC iodine_connection_args_s iodine_connect_args(VALUE s, uint8_t is_srv) {
     headers = rb_hash_aref(iodine_default_args, headers_sym);
   if (log == Qnil)
     log = rb_hash_aref(iodine_default_args, log_sym);
+  if (log_format == Qnil)
+    log_format = rb_hash_aref(iodine_default_args, log_format_sym);
+  if (log_path == Qnil)
+    log_path = rb_hash_aref(iodine_default_args, log_path_sym);
   if (max_body == Qnil)
     max_body = rb_hash_aref(iodine_default_args, max_body_sym);
+  if (max_body_memory == Qnil)
+    max_body_memory = rb_hash_aref(iodine_default_args, max_body_memory_sym);
   if (max_clients == Qnil)
     max_clients = rb_hash_aref(iodine_default_args, max_clients_sym);
   if (max_headers == Qnil)
     max_headers = rb_hash_aref(iodine_default_args, max_headers_sym);
   if (max_msg == Qnil)
     max_msg = rb_hash_aref(iodine_default_args, max_msg_sym);
+  if (max_concurrent == Qnil)
+    max_concurrent = rb_hash_aref(iodine_default_args, max_concurrent_sym);
+  if (max_wait == Qnil)
+    max_wait = rb_hash_aref(iodine_default_args, max_wait_sym);
   if (method == Qnil)
     method = rb_hash_aref(iodine_default_args, method_sym);
+  if (multipart == Qnil)
+    multipart = rb_hash_aref(iodine_default_args, multipart_sym);
   if (path == Qnil)
     path = rb_hash_aref(iodine_default_args, path_sym);
   if (ping == Qnil)
     ping = rb_hash_aref(iodine_default_args, ping_sym);
+  if (pipeline == Qnil)
+    pipeline = rb_hash_aref(iodine_default_args, pipeline_sym);
   if (port == Qnil)
     port = rb_hash_aref(iodine_default_args, port_sym);
   if (r_public == Qnil) {
@@ -730,8 +875,18 @@ FIO_FUNC iodine_connection_args_s iodine_connect_args(VALUE s, uint8_t is_srv) {
   }
   // if (service == Qnil) // not supported by default settings...
   //   service = rb_hash_aref(iodine_default_args, service_sym);
+  if (stream_input == Qnil)
+    stream_input = rb_hash_aref(iodine_default_args, stream_input_sym);
+  if (gvl_batch == Qnil)
+    gvl_batch = rb_hash_aref(iodine_default_args, gvl_batch_sym);
+  if (fiber == Qnil)
+    fiber = rb_hash_aref(iodine_default_args, fiber_sym);
+  if (ractors == Qnil)
+    ractors = rb_hash_aref(iodine_default_args, ractors_sym);
   if (timeout == Qnil)
     timeout = rb_hash_aref(iodine_default_args, timeout_sym);
+  if (timings == Qnil)
+    timings = rb_hash_aref(iodine_default_args, timings_sym);
 #ifndef __MINGW32__
   if (tls == Qnil)
     tls = rb_hash_aref(iodine_default_args, tls_sym);
@@ -765,6 +920,21 @@ FIO_FUNC iodine_connection_args_s iodine_connect_args(VALUE s, uint8_t is_srv) {
   if (body != Qnil && RB_TYPE_P(body, T_STRING)) {
     r.body = IODINE_RSTRINFO(body);
   }
+  if (cache == Qtrue) {
+    r.cache = 1024;
+  } else if (cache != Qnil && RB_TYPE_P(cache, T_FIXNUM) &&
+             FIX2LONG(cache) > 0) {
+    r.cache = FIX2ULONG(cache);
+  }
+  if (cache_vary != Qnil && RB_TYPE_P(cache_vary, T_STRING)) {
+    r.cache_vary = IODINE_RSTRINFO(cache_vary);
+  }
+  if (compress == Qtrue) {
+    r.compress = 1024;
+  } else if (compress != Qnil && RB_TYPE_P(compress, T_FIXNUM) &&
+             FIX2LONG(compress) > 0) {
+    r.compress = FIX2ULONG(compress);
+  }
   if (cookies != Qnil && RB_TYPE_P(cookies, T_HASH)) {
     r.cookies = fiobj_hash_new2(rb_hash_size(cookies));
     rb_hash_foreach(cookies, for_each_cookie, r.cookies);
@@ -776,9 +946,41 @@ FIO_FUNC iodine_connection_args_s iodine_connect_args(VALUE s, uint8_t is_srv) {
   if (log != Qnil && log != Qfalse) {
     r.log = 1;
   }
+  if (log_path != Qnil && RB_TYPE_P(log_path, T_STRING)) {
+    r.log_path = IODINE_RSTRINFO(log_path);
+    r.log = 1;
+  }
+  if (log_format != Qnil) {
+    if (RB_TYPE_P(log_format, T_SYMBOL))
+      log_format = rb_sym2str(log_format);
+    if (RB_TYPE_P(log_format, T_STRING) && RSTRING_LEN(log_format) == 4 &&
+        !strncasecmp(RSTRING_PTR(log_format), "json", 4)) {
+      r.log_format = 1;
+      r.log = 1;
+    } else if (!RB_TYPE_P(log_format, T_STRING) ||
+               RSTRING_LEN(log_format) != 6 ||
+               strncasecmp(RSTRING_PTR(log_format), "common", 6)) {
+      rb_raise(rb_eArgError, ":log_format should be :common or :json.");
+    }
+  }
+  if (stream_input != Qnil && stream_input != Qfalse) {
+    r.stream_input = 1;
+  }
+  if (multipart != Qnil && multipart != Qfalse) {
+    r.multipart = 1;
+  }
+  if (fiber != Qnil && fiber != Qfalse) {
+    r.fiber = 1;
+  }
+  if (timings != Qnil && timings != Qfalse) {
+    r.timings = 1;
+  }
   if (max_body != Qnil && RB_TYPE_P(max_body, T_FIXNUM)) {
     r.max_body = FIX2ULONG(max_body) * 1024 * 1024;
   }
+  if (max_body_memory != Qnil && RB_TYPE_P(max_body_memory, T_FIXNUM)) {
+    r.max_body_memory = FIX2ULONG(max_body_memory) * 1024;
+  }
   if (max_clients != Qnil && RB_TYPE_P(max_clients, T_FIXNUM)) {
     r.max_clients = FIX2ULONG(max_clients);
   }
@@ -788,6 +990,14 @@ FIO_FUNC iodine_connection_args_s iodine_connect_args(VALUE s, uint8_t is_srv) {
   if (max_msg != Qnil && RB_TYPE_P(max_msg, T_FIXNUM)) {
     r.max_msg = FIX2ULONG(max_msg) * 1024;
   }
+  if (max_concurrent != Qnil && RB_TYPE_P(max_concurrent, T_FIXNUM) &&
+      FIX2LONG(max_concurrent) > 0) {
+    r.max_concurrent = FIX2ULONG(max_concurrent);
+  }
+  if (max_wait != Qnil && RB_TYPE_P(max_wait, T_FIXNUM) &&
+      FIX2LONG(max_wait) > 0) {
+    r.max_wait = FIX2ULONG(max_wait);
+  }
   if (method != Qnil && RB_TYPE_P(method, T_STRING)) {
     r.method = IODINE_RSTRINFO(method);
   }
@@ -800,6 +1010,26 @@ FIO_FUNC iodine_connection_args_s iodine_connect_args(VALUE s, uint8_t is_srv) {
     else
       r.ping = FIX2ULONG(ping);
   }
+  if (gvl_batch != Qnil && RB_TYPE_P(gvl_batch, T_FIXNUM) &&
+      FIX2LONG(gvl_batch) > 1) {
+    if (FIX2ULONG(gvl_batch) > 255)
+      FIO_LOG_WARNING(":gvl_batch value over 255 will be silently ignored.");
+    else
+      r.gvl_batch = FIX2ULONG(gvl_batch);
+  }
+  if (ractors != Qnil && RB_TYPE_P(ractors, T_FIXNUM) &&
+      FIX2LONG(ractors) > 0) {
+    if (FIX2ULONG(ractors) > 255)
+      FIO_LOG_WARNING(":ractors value over 255 will be silently ignored.");
+    else
+      r.ractors = FIX2ULONG(ractors);
+  }
+  if (pipeline != Qnil && RB_TYPE_P(pipeline, T_FIXNUM)) {
+    if (FIX2ULONG(pipeline) > 255)
+      FIO_LOG_WARNING(":pipeline value over 255 will be silently ignored.");
+    else
+      r.pipeline = FIX2ULONG(pipeline);
+  }
   if (port != Qnil) {
     if (RB_TYPE_P(port, T_STRING)) {
       char *tmp = RSTRING_PTR(port);
@@ -1022,10 +1252,25 @@ Supported Settigs:
 | `:handler` | (deprecated: `:app`) see details below. |
 | `:address` | an IP address or a unix socket address. Only relevant if `:url` is missing. |
 | `:log` |  (HTTP only) request logging. For global verbosity see {Iodine.verbosity} |
+| `:log_path` | (HTTP server only) the request log destination: a file name (lines are appended), `"syslog"` or `"syslog:<socket path>"`. Lines are buffered per thread and written by a background thread ({Iodine::HTTP.log_stats} counts dropped lines). Process wide, the last listener setting it applies. Implies `:log`. Default: `stderr`. |
+| `:log_format` | (HTTP server only) the request log format, `:common` or `:json` (one JSON object per line, including the forwarded client IP and, with `:timings`, the request phase durations). Process wide. Implies `:log`. Default: `:common`. |
 | `:max_body` | (HTTP only) maximum upload size allowed per request before disconnection (in Mb). |
+| `:max_body_memory` | (HTTP server only) uploads up to this size (in Kb) are kept in memory, larger uploads are buffered in an anonymous temporary file. Default: 64Kb. |
+| `:stream_input` | (HTTP server only) if `true`, uploads bigger than `:max_body_memory` are handled as soon as their headers arrive and `rack.input` reads the body directly from the socket (it can't be rewound). |
+| `:multipart` | (HTTP server only) if `true`, `multipart/form-data` request bodies are parsed (in C) while they're received: uploaded files are written to anonymous temporary files and form fields are kept in memory. The `env` contains the parsed `iodine.params` Hash (Rack's nested format, files are Hashes with a `:tempfile`), which `Rack::Request#POST` uses without parsing the body. `rack.input` is empty for these requests. Ignored by `:ractors`. Default: false. |
+| `:gvl_batch` | (HTTP server only) the number of Rack requests (2..255) a thread holding the GVL might handle for other threads before releasing the GVL. Each listener uses its own value (listeners sharing an app use the highest value). Default: disabled. |
+| `:fiber` | (HTTP server only) if `true`, Rack requests run within non-blocking fibers managed by an {Iodine::Scheduler} (Ruby 3.0+), so blocking IO and `sleep` don't block a worker thread. Overrides `:stream_input`, `:gvl_batch` and `:cache`. |
+| `:ractors` | (HTTP server only, experimental) the number of Ractors (per worker) handling Rack requests in parallel (Ruby 3.0+). The application must be Ractor shareable (see `Ractor.make_shareable`); `rack.input` is a `StringIO`, hijacking and upgrades aren't supported and response bodies must contain Strings. Overrides `:stream_input`, `:gvl_batch`, `:fiber`, `:cache` and `:multipart`. Default: disabled. |
 | `:max_headers` |  (HTTP only) maximum total header length allowed per request (in Kb). |
 | `:max_msg` |  (WebSockets only) maximum message size pre message (in Kb). |
 | `:ping` |  (`:raw` clients and WebSockets only) ping interval (in seconds). Up to 255 seconds. |
+| `:pipeline` |  (HTTP only) pipelined HTTP/1.x requests handled per read cycle (responses are written together). Up to 255. Default: 8. |
+| `:compress` | (HTTP server only) minimal response size (in bytes) for gzip / deflate compression of compressible content types, or `true` (1Kb). Default: disabled. |
+| `:timings` | (HTTP server only) if `true`, the time spent by Rack requests in each phase (queue, GVL, application, body and write) is collected by {Iodine::HTTP.timing_stats} and the `env` contains an `iodine.timings` Hash (`:received_at`, `:queue`, `:gvl` and, if an `X-Request-Start` header exists, `:proxy` - in milliseconds). Collection is process wide once any listener sets it. Default: false. |
+| `:max_concurrent` | (HTTP server only) a concurrency cap - the number of Rack requests (per worker) handled by the application at the same time (running, waiting for the GVL or paused by `:fiber` / `:ractors`) before new requests are refused with a 503 response (with a `retry-after` header) without entering the GVL. Requests waiting for a worker thread aren't counted (use `:max_wait`), so the cap is only reached if it's lower than the number of threads or when requests are paused. The lowest value set by any listener applies. Default: disabled. |
+| `:max_wait` | (HTTP server only) the time (in milliseconds) a request may wait before it's handled. Requests waiting longer are refused with a 503 response, without entering the GVL. The lowest value set by any listener applies. Default: disabled. |
+| `:cache` | (HTTP server only) the number of cacheable Rack responses (`GET` responses with a `max-age` / `s-maxage` Cache-Control directive) kept in memory by each worker and served without calling the application, or `true` (1024). Concurrent requests for a missing resource call the application once. Requests with cookies or an Authorization header aren't cached. Ignored by `:fiber` and `:ractors`. Default: disabled. |
+| `:cache_vary` | (HTTP server only) a comma separated String of request header names added to the `:cache` key (responses may only `Vary` by these headers). The `:cache` settings apply to the `:handler`, even if it listens on a number of ports. |
 | `:port` | port number to listen to either a String or Number) |
 | `:public` | (HTTP server only) public folder for static file service. |
 | `:service` | (`:raw` / `:tls` / `:ws` / `:wss` / `:http` / `:https` ) a supported service this socket will listen to. |
@@ -1335,21 +1580,36 @@ void Init_iodine_ext(void) {
   IODINE_MAKE_SYM(address);
   IODINE_MAKE_SYM(app);
   IODINE_MAKE_SYM(body);
+  IODINE_MAKE_SYM(cache);
+  IODINE_MAKE_SYM(cache_vary);
+  IODINE_MAKE_SYM(compress);
   IODINE_MAKE_SYM(cookies);
+  IODINE_MAKE_SYM(fiber);
+  IODINE_MAKE_SYM(gvl_batch);
   IODINE_MAKE_SYM(handler);
   IODINE_MAKE_SYM(headers);
   IODINE_MAKE_SYM(log);
+  IODINE_MAKE_SYM(log_format);
+  IODINE_MAKE_SYM(log_path);
   IODINE_MAKE_SYM(max_body);
+  IODINE_MAKE_SYM(max_body_memory);
   IODINE_MAKE_SYM(max_clients);
   IODINE_MAKE_SYM(max_headers);
   IODINE_MAKE_SYM(max_msg);
+  IODINE_MAKE_SYM(max_concurrent);
+  IODINE_MAKE_SYM(max_wait);
   IODINE_MAKE_SYM(method);
+  IODINE_MAKE_SYM(multipart);
   IODINE_MAKE_SYM(path);
   IODINE_MAKE_SYM(ping);
+  IODINE_MAKE_SYM(pipeline);
   IODINE_MAKE_SYM(port);
   IODINE_MAKE_SYM(public);
+  IODINE_MAKE_SYM(ractors);
   IODINE_MAKE_SYM(service);
+  IODINE_MAKE_SYM(stream_input);
   IODINE_MAKE_SYM(timeout);
+  IODINE_MAKE_SYM(timings);
   IODINE_MAKE_SYM(tls);
   IODINE_MAKE_SYM(url);
 
@@ -1401,6 +1661,12 @@ void Init_iodine_ext(void) {
   // initialize concurrency related methods
   iodine_defer_initialize();
 
+  // initialize the fiber scheduler
+  iodine_scheduler_init();
+
+  // initialize the Ractor request mode
+  iodine_ractor_init();
+
   // initialize the connection class
   iodine_connection_init();
 
@@ -1410,6 +1676,13 @@ void Init_iodine_ext(void) {
   // initialize the HTTP module
   iodine_init_http();
 
+  // initialize the fast routes (Iodine::Router)
+  iodine_router_init();
+  iodine_cache_init();
+
+  // initialize the HTTP client (Iodine::HTTP::Client)
+  iodine_http_client_init();
+
 #ifndef __MINGW32__
   // initialize SSL/TLS support module
   iodine_init_tls();
@@ -15,6 +15,8 @@ typedef struct {
   fio_str_info_s body;
   fio_str_info_s public;
   fio_str_info_s url;
+  fio_str_info_s cache_vary;
+  fio_str_info_s log_path;
 #ifndef __MINGW32__
   fio_tls_s *tls;
 #endif
@@ -23,11 +25,24 @@ typedef struct {
   FIOBJ cookies;
   size_t max_headers;
   size_t max_body;
+  size_t max_body_memory;
   intptr_t max_clients;
   size_t max_msg;
+  size_t compress;
+  size_t cache;
+  size_t max_concurrent;
+  size_t max_wait;
   uint8_t timeout;
   uint8_t ping;
   uint8_t log;
+  uint8_t log_format;
+  uint8_t pipeline;
+  uint8_t stream_input;
+  uint8_t multipart;
+  uint8_t gvl_batch;
+  uint8_t fiber;
+  uint8_t ractors;
+  uint8_t timings;
   enum {
     IODINE_SERVICE_RAW,
     IODINE_SERVICE_HTTP,
@@ -35,15 +50,21 @@ typedef struct {
   } service;
 } iodine_connection_args_s;
 
+#include "iodine_cache.h"
 #include "iodine_caller.h"
 #include "iodine_connection.h"
 #include "iodine_defer.h"
 #include "iodine_helpers.h"
 #include "iodine_http.h"
+#include "iodine_http_client.h"
 #include "iodine_json.h"
 #include "iodine_mustache.h"
+#include "iodine_proxy.h"
 #include "iodine_pubsub.h"
 #include "iodine_rack_io.h"
+#include "iodine_ractor.h"
+#include "iodine_router.h"
+#include "iodine_scheduler.h"
 #include "iodine_store.h"
 #include "iodine_tcp.h"
 #include "iodine_tls.h"
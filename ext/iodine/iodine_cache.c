@@ -0,0 +1,681 @@
+/*
+Copyright: Boaz Segev, 2016-2019
+License: MIT
+
+Feel free to copy, use and enjoy according to the license provided.
+*/
+#define FIO_INCLUDE_LINKED_LIST
+#include "iodine_cache.h"
+
+#include <ctype.h>
+#include <string.h>
+#include <strings.h>
+
+/*
+The HTTP response micro-cache (the `:cache` listener option).
+
+Cacheable Rack responses (`GET` requests, responses with a `max-age` /
+`s-maxage` Cache-Control directive) are kept in C and served on the IO thread,
+without building a Rack `env` or entering the GVL.
+
+When a resource isn't cached, the first request (the "leader") is passed to the
+application while concurrent requests for the same resource are paused until
+the leader's response is available ("single-flight").
+
+The cache is per worker process and limited both by the number of entries (the
+`:cache` value) and by memory (`IODINE_CACHE_MEMORY_LIMIT`). The least recently
+used entries are evicted first.
+*/
+
+#ifndef IODINE_CACHE_BODY_LIMIT
+/** Responses with larger bodies aren't cached. */
+#define IODINE_CACHE_BODY_LIMIT (1024 * 512)
+#endif
+
+#ifndef IODINE_CACHE_MEMORY_LIMIT
+/** The maximum number of body bytes cached by each worker process. */
+#define IODINE_CACHE_MEMORY_LIMIT (1024 * 1024 * 64)
+#endif
+
+#ifndef IODINE_CACHE_PASS_TTL
+/**
+ * The number of milliseconds during which requests for an uncacheable
+ * resource are passed directly to the application (no coalescing).
+ */
+#define IODINE_CACHE_PASS_TTL 2000
+#endif
+
+/* *****************************************************************************
+Types and storage
+***************************************************************************** */
+
+/* per application settings */
+typedef struct iodine_cache_config_s iodine_cache_config_s;
+struct iodine_cache_config_s {
+  iodine_cache_config_s *next;
+  /* the Rack application */
+  VALUE handler;
+  /* an Array of (lower case) request header names added to the cache key */
+  FIOBJ vary;
+};
+
+typedef enum {
+  IODINE_CACHE_PENDING, /* a leader request is handled by the application */
+  IODINE_CACHE_FRESH,   /* a cached response */
+  IODINE_CACHE_PASS,    /* the resource isn't cacheable */
+} iodine_cache_state_e;
+
+struct iodine_cache_entry_s {
+  /* LRU node (pending entries aren't listed and can't be evicted) */
+  fio_ls_embd_s node;
+  /* the paused requests waiting for the leader's response */
+  fio_ls_s waiters;
+  /* the key (application, scheme, host, path, query and vary header values) */
+  FIOBJ key;
+  /* the response headers: an Array of name / value pairs */
+  FIOBJ headers;
+  /* the response body */
+  FIOBJ body;
+  iodine_cache_config_s *config;
+  /* milliseconds */
+  int64_t stored_at;
+  int64_t expires_at;
+  /* the number of paused requests that might still access the entry */
+  size_t ref;
+  uint16_t status;
+  uint8_t state;
+  /* set while the entry is in the map */
+  uint8_t linked;
+};
+
+#define FIO_SET_NAME iodine_cache_map
+#define FIO_SET_OBJ_TYPE iodine_cache_entry_s *
+#define FIO_SET_OBJ_COMPARE(e1, e2) fiobj_iseq((e1)->key, (e2)->key)
+#include <fio.h>
+
+static struct {
+  iodine_cache_map_s map;
+  fio_ls_embd_s lru;
+  iodine_cache_config_s *configs;
+  size_t limit;
+  size_t memory;
+  size_t hits;
+  size_t misses;
+  size_t coalesced;
+  size_t passes;
+  size_t stored;
+  fio_lock_i lock;
+} iodine_cache = {
+    .map = FIO_SET_INIT,
+    .lru = FIO_LS_INIT(iodine_cache.lru),
+    .lock = FIO_LOCK_INIT,
+};
+
+static inline int64_t iodine_cache_now(void) {
+  struct timespec t = fio_last_tick();
+  return ((int64_t)t.tv_sec * 1000) + (t.tv_nsec / 1000000);
+}
+
+static void iodine_cache_entry_free(iodine_cache_entry_s *e) {
+  fiobj_free(e->key);
+  fiobj_free(e->headers);
+  fiobj_free(e->body);
+  fio_free(e);
+}
+
+/* removes an entry from the cache, freeing it unless it's still referenced */
+static void iodine_cache_unlink_unsafe(iodine_cache_entry_s *e) {
+  if (!e->linked)
+    return;
+  e->linked = 0;
+  iodine_cache_map_remove(&iodine_cache.map, fiobj_obj2hash(e->key), e, NULL);
+  if (e->state != IODINE_CACHE_PENDING)
+    fio_ls_embd_remove(&e->node);
+  if (e->body)
+    iodine_cache.memory -= fiobj_obj2cstr(e->body).len;
+  if (!e->ref)
+    iodine_cache_entry_free(e);
+}
+
+/* evicts the least recently used entries while the cache is over budget */
+static void iodine_cache_evict_unsafe(void) {
+  while ((iodine_cache_map_count(&iodine_cache.map) > iodine_cache.limit ||
+          iodine_cache.memory > IODINE_CACHE_MEMORY_LIMIT) &&
+         !fio_ls_embd_is_empty(&iodine_cache.lru)) {
+    iodine_cache_unlink_unsafe(
+        FIO_LS_EMBD_OBJ(iodine_cache_entry_s, node, iodine_cache.lru.next));
+  }
+}
+
+/* returns the settings for the application, if the cache is enabled */
+static iodine_cache_config_s *iodine_cache_config(VALUE handler) {
+  iodine_cache_config_s *c = iodine_cache.configs;
+  while (c && c->handler != handler)
+    c = c->next;
+  return c;
+}
+
+/* *****************************************************************************
+The cache key
+***************************************************************************** */
+
+/* writes a request header's value (or values) to the key */
+static void iodine_cache_key_header(FIOBJ key, http_s *h, FIOBJ name) {
+  FIOBJ val = fiobj_hash_get2(h->headers, fiobj_obj2hash(name));
+  fiobj_str_write(key, "\n", 1);
+  if (!val)
+    return;
+  if (!FIOBJ_TYPE_IS(val, FIOBJ_T_ARRAY)) {
+    fiobj_str_join(key, val);
+    return;
+  }
+  for (size_t i = 0, count = fiobj_ary_count(val); i < count; ++i) {
+    if (i)
+      fiobj_str_write(key, ",", 1);
+    fiobj_str_join(key, fiobj_ary_index(val, i));
+  }
+}
+
+/* writes the request's scheme (as reported by `rack.url_scheme`) to the key */
+static void iodine_cache_key_scheme(FIOBJ key, http_s *h) {
+  static uint64_t xforward_hash = 0;
+  static uint64_t forward_hash = 0;
+  if (!xforward_hash) {
+    xforward_hash = fiobj_hash_string("x-forwarded-proto", 17);
+    forward_hash = fiobj_hash_string("forwarded", 9);
+  }
+  FIOBJ val;
+  fiobj_str_write(key, "\n", 1);
+  if ((val = fiobj_hash_get2(h->headers, xforward_hash))) {
+    if (FIOBJ_TYPE_IS(val, FIOBJ_T_ARRAY))
+      val = fiobj_ary_index(val, 0);
+    fiobj_str_join(key, val);
+    return;
+  }
+  if ((val = fiobj_hash_get2(h->headers, forward_hash))) {
+    /* only the `proto` parameter, `for` differs between clients */
+    if (FIOBJ_TYPE_IS(val, FIOBJ_T_ARRAY))
+      val = fiobj_ary_index(val, 0);
+    fio_str_info_s f = fiobj_obj2cstr(val);
+    for (size_t i = 0; i + 6 <= f.len; ++i) {
+      if (strncasecmp(f.data + i, "proto=", 6))
+        continue;
+      size_t end = i + 6;
+      while (end < f.len && f.data[end] != ';' && f.data[end] != ',')
+        ++end;
+      fiobj_str_write(key, f.data + i + 6, end - (i + 6));
+      return;
+    }
+  }
+  if (http_settings(h)->tls)
+    fiobj_str_write(key, "https", 5);
+}
+
+/* creates a new key for the request */
+static FIOBJ iodine_cache_key(http_s *h, iodine_cache_config_s *c) {
+  FIOBJ key = fiobj_str_buf(128);
+  fiobj_str_write(key, (char *)&c->handler, sizeof(c->handler));
+  iodine_cache_key_scheme(key, h);
+  iodine_cache_key_header(key, h, HTTP_HEADER_HOST);
+  fiobj_str_write(key, "\n", 1);
+  fiobj_str_join(key, h->path);
+  if (h->query) {
+    fiobj_str_write(key, "?", 1);
+    fiobj_str_join(key, h->query);
+  }
+  for (size_t i = 0, count = fiobj_ary_count(c->vary); i < count; ++i)
+    iodine_cache_key_header(key, h, fiobj_ary_index(c->vary, i));
+  return key;
+}
+
+/* *****************************************************************************
+Cache hits and coalesced requests
+***************************************************************************** */
+
+/* sends a cached response (the headers and body are consumed) */
+static void iodine_cache_send(http_s *h, uint16_t status, FIOBJ headers,
+                              FIOBJ body, int64_t age, uint8_t head) {
+  h->status = status;
+  for (size_t i = 0, count = fiobj_ary_count(headers); i + 1 < count; i += 2) {
+    http_set_header(h, fiobj_ary_index(headers, i),
+                    fiobj_dup(fiobj_ary_index(headers, i + 1)));
+  }
+  if (age >= 1000)
+    http_set_header2(h, (fio_str_info_s){.data = (char *)"age", .len = 3},
+                     fiobj_obj2cstr(fiobj_num_tmp(age / 1000)));
+  fio_str_info_s b = fiobj_obj2cstr(body);
+  if (head) {
+    http_set_header(h, HTTP_HEADER_CONTENT_LENGTH, fiobj_num_new(b.len));
+    http_finish(h);
+  } else {
+    http_send_body(h, b.data, b.len);
+  }
+  fiobj_free(headers);
+  fiobj_free(body);
+}
+
+/* the request is handled again once the leader's response is available */
+static void iodine_cache_resume(http_s *h) { http_settings(h)->on_request(h); }
+
+/* a request paused while waiting for the leader's response */
+static void iodine_cache_wait(http_pause_handle_s *p) {
+  iodine_cache_entry_s *e = http_paused_udata_get(p);
+  http_paused_udata_set(p, (void *)e->config->handler);
+  fio_lock(&iodine_cache.lock);
+  if (e->state == IODINE_CACHE_PENDING) {
+    fio_ls_push(&e->waiters, p);
+    --e->ref;
+    fio_unlock(&iodine_cache.lock);
+    return;
+  }
+  if (!--e->ref && !e->linked)
+    iodine_cache_entry_free(e);
+  fio_unlock(&iodine_cache.lock);
+  http_resume(p, iodine_cache_resume, NULL);
+}
+
+/**
+ * Answers the request from the cache, if possible (called without the GVL).
+ *
+ * Returns 0 if the request was handled (a cached response was sent or the
+ * request was paused until a concurrent request for the same resource is
+ * complete). Otherwise returns -1 and the request should be handled normally.
+ *
+ * If `leader` is set, the response must be reported to the cache using
+ * `iodine_cache_response`.
+ */
+int iodine_cache_request(http_s *h, iodine_cache_entry_s **leader) {
+  *leader = NULL;
+  if (!iodine_cache.configs)
+    return -1;
+  iodine_cache_config_s *c = iodine_cache_config((VALUE)h->udata);
+  if (!c)
+    return -1;
+  fio_str_info_s method = fiobj_obj2cstr(h->method);
+  uint8_t head = 0;
+  if (method.len == 4 && !memcmp(method.data, "HEAD", 4))
+    head = 1;
+  else if (method.len != 3 || memcmp(method.data, "GET", 3))
+    return -1;
+  /* personalized requests are always handled by the application */
+  if (fiobj_hash_get2(h->headers, fiobj_obj2hash(HTTP_HEADER_COOKIE)) ||
+      fiobj_hash_get2(h->headers, fiobj_hash_string("authorization", 13)))
+    return -1;
+
+  iodine_cache_entry_s tmp = {.key = iodine_cache_key(h, c)};
+  const uint64_t hash = fiobj_obj2hash(tmp.key);
+  const int64_t now = iodine_cache_now();
+  fio_lock(&iodine_cache.lock);
+  iodine_cache_entry_s *e = iodine_cache_map_find(&iodine_cache.map, hash, &tmp);
+  if (e && e->state != IODINE_CACHE_PENDING && e->expires_at <= now) {
+    iodine_cache_unlink_unsafe(e);
+    e = NULL;
+  }
+  if (e && e->state == IODINE_CACHE_FRESH) {
+    ++iodine_cache.hits;
+    fio_ls_embd_remove(&e->node);
+    fio_ls_embd_push(&iodine_cache.lru, &e->node);
+    const uint16_t status = e->status;
+    FIOBJ headers = fiobj_dup(e->headers);
+    FIOBJ body = fiobj_dup(e->body);
+    const int64_t age = now - e->stored_at;
+    fio_unlock(&iodine_cache.lock);
+    fiobj_free(tmp.key);
+    iodine_cache_send(h, status, headers, body, age, head);
+    return 0;
+  }
+  if (e && e->state == IODINE_CACHE_PASS) {
+    ++iodine_cache.passes;
+    goto pass;
+  }
+  if (head) /* HEAD requests are answered from cache, but don't fill it */
+    goto pass;
+  if (e) {
+    /* a leader is already handling the same request, wait for it */
+    ++iodine_cache.coalesced;
+    ++e->ref;
+    fio_unlock(&iodine_cache.lock);
+    fiobj_free(tmp.key);
+    h->udata = e;
+    http_pause(h, iodine_cache_wait);
+    return 0;
+  }
+  ++iodine_cache.misses;
+  e = fio_malloc(sizeof(*e));
+  FIO_ASSERT_ALLOC(e);
+  *e = (iodine_cache_entry_s){
+      .waiters = FIO_LS_INIT(e->waiters),
+      .key = tmp.key,
+      .config = c,
+      .state = IODINE_CACHE_PENDING,
+      .linked = 1,
+  };
+  iodine_cache_map_insert(&iodine_cache.map, hash, e);
+  iodine_cache_evict_unsafe();
+  fio_unlock(&iodine_cache.lock);
+  *leader = e;
+  return -1;
+pass:
+  fio_unlock(&iodine_cache.lock);
+  fiobj_free(tmp.key);
+  return -1;
+}
+
+/* *****************************************************************************
+Storing responses
+***************************************************************************** */
+
+/* tests if the comma separated `list` contains `token` (case insensitive) */
+static int iodine_cache_list_has(fio_str_info_s list, const char *token,
+                                 size_t len) {
+  char *pos = list.data;
+  char *end = list.data + list.len;
+  while (pos < end) {
+    while (pos < end && (*pos == ' ' || *pos == ','))
+      ++pos;
+    char *start = pos;
+    while (pos < end && *pos != ',' && *pos != '=' && *pos != ' ')
+      ++pos;
+    if ((size_t)(pos - start) == len && !strncasecmp(start, token, len))
+      return 1;
+    while (pos < end && *pos != ',')
+      ++pos;
+  }
+  return 0;
+}
+
+/* returns the value of a Cache-Control directive (i.e. `max-age=`) or -1 */
+static int64_t iodine_cache_list_value(fio_str_info_s list, const char *token,
+                                       size_t len) {
+  char *pos = list.data;
+  char *end = list.data + list.len;
+  while (pos + len < end) {
+    if (!strncasecmp(pos, token, len) &&
+        (pos == list.data || pos[-1] == ' ' || pos[-1] == ',')) {
+      char *num = pos + len;
+      if (num >= end || !isdigit(*num))
+        return -1;
+      return (int64_t)fio_atol(&num);
+    }
+    ++pos;
+  }
+  return -1;
+}
+
+/* returns the response's time to live (in milliseconds), 0 if uncacheable */
+static int64_t iodine_cache_ttl(http_s *h, iodine_cache_config_s *c) {
+  switch (h->status) {
+  case 200: /* fall through */
+  case 203: /* fall through */
+  case 300: /* fall through */
+  case 301: /* fall through */
+  case 404: /* fall through */
+  case 410:
+    break;
+  default:
+    return 0;
+  }
+  FIOBJ out = h->private_data.out_headers;
+  if (fiobj_hash_get2(out, fiobj_obj2hash(HTTP_HEADER_SET_COOKIE)))
+    return 0;
+  FIOBJ tmp = fiobj_hash_get2(out, fiobj_obj2hash(HTTP_HEADER_CACHE_CONTROL));
+  if (!tmp || !FIOBJ_TYPE_IS(tmp, FIOBJ_T_STRING))
+    return 0;
+  fio_str_info_s cc = fiobj_obj2cstr(tmp);
+  if (iodine_cache_list_has(cc, "private", 7) ||
+      iodine_cache_list_has(cc, "no-store", 8) ||
+      iodine_cache_list_has(cc, "no-cache", 8))
+    return 0;
+  int64_t ttl = iodine_cache_list_value(cc, "s-maxage=", 9);
+  if (ttl < 0)
+    ttl = iodine_cache_list_value(cc, "max-age=", 8);
+  if (ttl <= 0)
+    return 0;
+  tmp = fiobj_hash_get2(out, fiobj_hash_string("vary", 4));
+  if (tmp) {
+    /* responses may only vary by headers that are part of the key */
+    if (!FIOBJ_TYPE_IS(tmp, FIOBJ_T_STRING))
+      return 0;
+    fio_str_info_s vary = fiobj_obj2cstr(tmp);
+    char *pos = vary.data;
+    char *end = vary.data + vary.len;
+    while (pos < end) {
+      while (pos < end && (*pos == ' ' || *pos == ','))
+        ++pos;
+      char *start = pos;
+      while (pos < end && *pos != ',' && *pos != ' ')
+        ++pos;
+      const size_t len = pos - start;
+      if (!len)
+        continue;
+      /* uncompressed responses are compressed by iodine for each request */
+      if (len == 15 && !strncasecmp(start, "accept-encoding", 15) &&
+          !fiobj_hash_get2(out, fiobj_hash_string("content-encoding", 16)))
+        continue;
+      size_t i = 0;
+      const size_t count = fiobj_ary_count(c->vary);
+      for (; i < count; ++i) {
+        fio_str_info_s name = fiobj_obj2cstr(fiobj_ary_index(c->vary, i));
+        if (name.len == len && !strncasecmp(name.data, start, len))
+          break;
+      }
+      if (i == count)
+        return 0; /* also covers `Vary: *` */
+    }
+  }
+  return ttl * 1000;
+}
+
+/* collects the response headers (except those set per response) */
+static int iodine_cache_collect_header(FIOBJ value, void *headers_) {
+  FIOBJ headers = (FIOBJ)headers_;
+  FIOBJ name = fiobj_hash_key_in_loop();
+  fio_str_info_s n = fiobj_obj2cstr(name);
+  if ((n.len == 4 && !memcmp(n.data, "date", 4)) ||
+      (n.len == 3 && !memcmp(n.data, "age", 3)) ||
+      (n.len == 14 && !memcmp(n.data, "content-length", 14)))
+    return 0;
+  if (FIOBJ_TYPE_IS(value, FIOBJ_T_ARRAY)) {
+    for (size_t i = 0, count = fiobj_ary_count(value); i < count; ++i) {
+      fiobj_ary_push(headers, fiobj_dup(name));
+      fiobj_ary_push(headers, fiobj_dup(fiobj_ary_index(value, i)));
+    }
+    return 0;
+  }
+  fiobj_ary_push(headers, fiobj_dup(name));
+  fiobj_ary_push(headers, fiobj_dup(value));
+  return 0;
+}
+
+/* resumes the paused requests, the caller holds a reference to the entry */
+static void iodine_cache_resume_waiters(iodine_cache_entry_s *e) {
+  while (!fio_ls_is_empty(&e->waiters))
+    http_resume(fio_ls_shift(&e->waiters), iodine_cache_resume, NULL);
+  fio_lock(&iodine_cache.lock);
+  if (!--e->ref && !e->linked)
+    iodine_cache_entry_free(e);
+  fio_unlock(&iodine_cache.lock);
+}
+
+/**
+ * Reports a "leader" request's response (before it's sent), caching it when
+ * possible and resuming any requests waiting for the response.
+ *
+ * `body` should point to the complete response body, or be NULL if the body
+ * isn't available (streamed, a file, an error, etc').
+ */
+void iodine_cache_response(iodine_cache_entry_s *e, http_s *h,
+                           fio_str_info_s *body) {
+  int64_t ttl = 0;
+  FIOBJ headers = FIOBJ_INVALID;
+  FIOBJ b = FIOBJ_INVALID;
+  if (body && body->len <= IODINE_CACHE_BODY_LIMIT)
+    ttl = iodine_cache_ttl(h, e->config);
+  if (ttl) {
+    headers = fiobj_ary_new2(16);
+    fiobj_each1(h->private_data.out_headers, 0, iodine_cache_collect_header,
+                (void *)headers);
+    b = fiobj_str_new(body->data, body->len);
+  }
+  const int64_t now = iodine_cache_now();
+  fio_lock(&iodine_cache.lock);
+  if (ttl) {
+    ++iodine_cache.stored;
+    e->state = IODINE_CACHE_FRESH;
+    e->status = (uint16_t)h->status;
+    e->headers = headers;
+    e->body = b;
+    e->stored_at = now;
+    e->expires_at = now + ttl;
+    if (e->linked)
+      iodine_cache.memory += body->len;
+  } else {
+    e->state = IODINE_CACHE_PASS;
+    e->expires_at = now + IODINE_CACHE_PASS_TTL;
+  }
+  /* unlinked entries were removed from the cache while the leader was busy */
+  if (e->linked) {
+    fio_ls_embd_push(&iodine_cache.lru, &e->node);
+    iodine_cache_evict_unsafe();
+  }
+  /* no more waiters are added once the entry isn't pending */
+  ++e->ref;
+  fio_unlock(&iodine_cache.lock);
+  iodine_cache_resume_waiters(e);
+}
+
+/**
+ * Cancels a "leader" request that won't be handled by the application (i.e.,
+ * load shedding), resuming any requests waiting for the response.
+ */
+void iodine_cache_cancel(iodine_cache_entry_s *e) {
+  fio_lock(&iodine_cache.lock);
+  ++e->ref;
+  iodine_cache_unlink_unsafe(e);
+  e->state = IODINE_CACHE_PASS;
+  fio_unlock(&iodine_cache.lock);
+  iodine_cache_resume_waiters(e);
+}
+
+/* *****************************************************************************
+Setup
+***************************************************************************** */
+
+/**
+ * Enables the response cache for the Rack application `handler` (`:cache`).
+ *
+ * `limit` is the number of cached responses (per worker) and `vary` is a comma
+ * separated list of request header names that are added to the cache key.
+ *
+ * Must be called while holding the GVL.
+ */
+void iodine_cache_listen(VALUE handler, size_t limit, fio_str_info_s vary) {
+  iodine_cache_config_s *c = iodine_cache_config(handler);
+  if (!c) {
+    /* settings are never freed, since paused requests may point to them */
+    c = malloc(sizeof(*c));
+    FIO_ASSERT_ALLOC(c);
+    *c = (iodine_cache_config_s){.next = iodine_cache.configs,
+                                 .handler = handler,
+                                 .vary = fiobj_ary_new()};
+    iodine_cache.configs = c;
+  }
+  char *pos = vary.data;
+  char *end = vary.data + vary.len;
+  while (pos < end) {
+    while (pos < end && (*pos == ' ' || *pos == ','))
+      ++pos;
+    char *start = pos;
+    while (pos < end && *pos != ',' && *pos != ' ')
+      ++pos;
+    if (pos == start)
+      continue;
+    FIOBJ name = fiobj_str_new(start, pos - start);
+    fio_str_info_s n = fiobj_obj2cstr(name);
+    for (size_t i = 0; i < n.len; ++i)
+      n.data[i] = tolower(n.data[i]);
+    fiobj_ary_push(c->vary, name);
+  }
+  if (iodine_cache.limit < limit)
+    iodine_cache.limit = limit;
+}
+
+/* removes all the entries (pending entries are freed once handled) */
+static void iodine_cache_clear_unsafe(void) {
+  FIO_SET_FOR_LOOP(&iodine_cache.map, pos) {
+    iodine_cache_entry_s *e = pos->obj;
+    if (!pos->hash || !e)
+      continue;
+    e->linked = 0;
+    if (e->state != IODINE_CACHE_PENDING)
+      fio_ls_embd_remove(&e->node);
+    if (!e->ref)
+      iodine_cache_entry_free(e);
+  }
+  iodine_cache_map_free(&iodine_cache.map);
+  iodine_cache.map = (iodine_cache_map_s)FIO_SET_INIT;
+  iodine_cache.memory = 0;
+}
+
+/* child processes start with an empty cache */
+static void iodine_cache_on_fork(void *ignr_) {
+  iodine_cache.lock = FIO_LOCK_INIT;
+  iodine_cache_clear_unsafe();
+  iodine_cache.hits = iodine_cache.misses = iodine_cache.coalesced =
+      iodine_cache.passes = iodine_cache.stored = 0;
+  (void)ignr_;
+}
+
+static void iodine_cache_on_exit(void *ignr_) {
+  fio_lock(&iodine_cache.lock);
+  iodine_cache_clear_unsafe();
+  fio_unlock(&iodine_cache.lock);
+  (void)ignr_;
+}
+
+// clang-format off
+/**
+Returns a Hash with the response cache statistics for the current process (worker).
+
+The response cache is enabled using the `:cache` option for {Iodine.listen}.
+
+The Hash contains the following keys:
+
+entries:: the number of cached responses (including uncacheable resources).
+memory:: the number of bytes used by cached response bodies.
+hits:: the number of requests answered from the cache.
+misses:: the number of requests passed to the application to fill the cache.
+coalesced:: the number of requests that waited for a concurrent request's response.
+passes:: the number of requests for uncacheable resources.
+stored:: the number of responses stored in the cache.
+*/
+static VALUE iodine_cache_stats(VALUE self) {
+  // clang-format on
+  VALUE h = rb_hash_new();
+  fio_lock(&iodine_cache.lock);
+  const size_t entries = iodine_cache_map_count(&iodine_cache.map);
+  const size_t memory = iodine_cache.memory;
+  const size_t hits = iodine_cache.hits;
+  const size_t misses = iodine_cache.misses;
+  const size_t coalesced = iodine_cache.coalesced;
+  const size_t passes = iodine_cache.passes;
+  const size_t stored = iodine_cache.stored;
+  fio_unlock(&iodine_cache.lock);
+  rb_hash_aset(h, ID2SYM(rb_intern2("entries", 7)), SIZET2NUM(entries));
+  rb_hash_aset(h, ID2SYM(rb_intern2("memory", 6)), SIZET2NUM(memory));
+  rb_hash_aset(h, ID2SYM(rb_intern2("hits", 4)), SIZET2NUM(hits));
+  rb_hash_aset(h, ID2SYM(rb_intern2("misses", 6)), SIZET2NUM(misses));
+  rb_hash_aset(h, ID2SYM(rb_intern2("coalesced", 9)), SIZET2NUM(coalesced));
+  rb_hash_aset(h, ID2SYM(rb_intern2("passes", 6)), SIZET2NUM(passes));
+  rb_hash_aset(h, ID2SYM(rb_intern2("stored", 6)), SIZET2NUM(stored));
+  return h;
+  (void)self;
+}
+
+/** Initializes the HTTP response cache (`:cache`). */
+void iodine_cache_init(void) {
+  fio_state_callback_add(FIO_CALL_IN_CHILD, iodine_cache_on_fork, NULL);
+  fio_state_callback_add(FIO_CALL_AT_EXIT, iodine_cache_on_exit, NULL);
+  VALUE tmp = rb_define_module_under(IodineModule, "HTTP");
+  rb_define_module_function(tmp, "response_cache_stats", iodine_cache_stats, 0);
+}
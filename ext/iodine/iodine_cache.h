@@ -0,0 +1,52 @@
+#ifndef H_IODINE_CACHE_H
+#define H_IODINE_CACHE_H
+
+#include "iodine.h"
+
+#include "http.h"
+
+/** A cached response (or a response being computed by a "leader" request). */
+typedef struct iodine_cache_entry_s iodine_cache_entry_s;
+
+/** Initializes the HTTP response cache (`:cache`). */
+void iodine_cache_init(void);
+
+/**
+ * Enables the response cache for the Rack application `handler` (`:cache`).
+ *
+ * `limit` is the number of cached responses (per worker) and `vary` is a comma
+ * separated list of request header names that are added to the cache key.
+ *
+ * Must be called while holding the GVL.
+ */
+void iodine_cache_listen(VALUE handler, size_t limit, fio_str_info_s vary);
+
+/**
+ * Answers the request from the cache, if possible (called without the GVL).
+ *
+ * Returns 0 if the request was handled (a cached response was sent or the
+ * request was paused until a concurrent request for the same resource is
+ * complete). Otherwise returns -1 and the request should be handled normally.
+ *
+ * If `leader` is set, the response must be reported to the cache using
+ * `iodine_cache_response`.
+ */
+int iodine_cache_request(http_s *h, iodine_cache_entry_s **leader);
+
+/**
+ * Reports a "leader" request's response (before it's sent), caching it when
+ * possible and resuming any requests waiting for the response.
+ *
+ * `body` should point to the complete response body, or be NULL if the body
+ * isn't available (streamed, a file, an error, etc').
+ */
+void iodine_cache_response(iodine_cache_entry_s *e, http_s *h,
+                           fio_str_info_s *body);
+
+/**
+ * Cancels a "leader" request that won't be handled by the application (i.e.,
+ * load shedding), resuming any requests waiting for the response.
+ */
+void iodine_cache_cancel(iodine_cache_entry_s *e);
+
+#endif
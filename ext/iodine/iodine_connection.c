@@ -441,9 +441,14 @@ static void iodine_on_pubsub(fio_msg_s *msg) {
       }
       return;
     }
-    case IODINE_CONNECTION_SSE:
-      http_sse_write(data->info.arg, .data = msg->msg);
+    case IODINE_CONNECTION_SSE: {
+      FIOBJ s = (FIOBJ)fio_message_metadata(msg, HTTP_SSE_OPTIMIZE_PUBSUB);
+      if (s)
+        http_sse_write_formatted(data->info.arg, fiobj_dup(s));
+      else
+        http_sse_write(data->info.arg, .data = msg->msg);
       return;
+    }
     default:
       fio_write(data->info.uuid, msg->msg.data, msg->msg.len);
       return;
@@ -476,6 +481,8 @@ static void iodine_on_unsubscribe(void *udata1, void *udata2) {
   case Qnil:
     if (data && data->info.type == IODINE_CONNECTION_WEBSOCKET) {
       websocket_optimize4broadcasts(WEBSOCKET_OPTIMIZE_PUBSUB, 0);
+    } else if (data && data->info.type == IODINE_CONNECTION_SSE) {
+      http_sse_optimize4broadcasts(0);
     }
     break;
   case Qtrue:
@@ -627,6 +634,8 @@ static VALUE iodine_pubsub_subscribe(int argc, VALUE *argv, VALUE self) {
                                            ? WEBSOCKET_OPTIMIZE_PUBSUB_BINARY
                                            : WEBSOCKET_OPTIMIZE_PUBSUB),
                                       1);
+      else if (c->info.type == IODINE_CONNECTION_SSE)
+        http_sse_optimize4broadcasts(1);
       if (args.binary) {
         args.block = Qtrue;
       }
@@ -16,6 +16,46 @@ Add all sorts of useless stuff here.
 static ID iodine_to_i_func_id;
 static rb_encoding *IodineUTF8Encoding;
 
+/* *****************************************************************************
+Latency histograms
+***************************************************************************** */
+
+/* histogram bucket upper bounds, in microseconds (the last bucket is +Inf) */
+static const int64_t iodine_histogram_bounds[IODINE_HISTOGRAM_BUCKETS] = {
+    100,    250,    500,    1000,    2500,    5000,    10000,
+    25000,  50000,  100000, 250000,  500000,  1000000, 2500000,
+};
+
+void iodine_histogram_add(iodine_histogram_s *hist, int64_t us) {
+  if (us < 0)
+    us = 0;
+  size_t i = 0;
+  while (i < IODINE_HISTOGRAM_BUCKETS && us > iodine_histogram_bounds[i])
+    ++i;
+  fio_atomic_add(hist->buckets + i, 1);
+  fio_atomic_add(&hist->sum, (size_t)us);
+  fio_atomic_add(&hist->count, 1);
+}
+
+VALUE iodine_histogram2rb(iodine_histogram_s *hist) {
+  VALUE h = rb_hash_new();
+  VALUE buckets = rb_hash_new();
+  size_t total = 0;
+  for (size_t i = 0; i <= IODINE_HISTOGRAM_BUCKETS; ++i) {
+    total += hist->buckets[i];
+    rb_hash_aset(buckets,
+                 (i < IODINE_HISTOGRAM_BUCKETS
+                      ? DBL2NUM((double)iodine_histogram_bounds[i] / 1000.0)
+                      : DBL2NUM(HUGE_VAL)),
+                 SIZET2NUM(total));
+  }
+  rb_hash_aset(h, ID2SYM(rb_intern2("count", 5)), SIZET2NUM(hist->count));
+  rb_hash_aset(h, ID2SYM(rb_intern2("sum", 3)),
+               DBL2NUM((double)hist->sum / 1000.0));
+  rb_hash_aset(h, ID2SYM(rb_intern2("buckets", 7)), buckets);
+  return h;
+}
+
 /* *****************************************************************************
 URL Decoding
 ***************************************************************************** */
@@ -209,12 +249,327 @@ static VALUE iodine_rfc2109(VALUE self, VALUE rtm) {
   (void)self;
 }
 
+/* *****************************************************************************
+Query Parsing
+***************************************************************************** */
+
+/*
+The Rack `parse_query` and `parse_nested_query` rules (Rack 3), using the same
+URL decoder as the HTTP parser. `http_add2hash` isn't used since it converts
+values (numbers, `true`, etc') and collects repeated keys in Arrays.
+*/
+
+#ifndef IODINE_QUERY_DEPTH_LIMIT
+/** The default nesting limit for `parse_nested_query` (Rack's default). */
+#define IODINE_QUERY_DEPTH_LIMIT 32
+#endif
+
+static ID iodine_call_func_id;
+static ID iodine_param_depth_limit_id;
+static ID iodine_bytesize_limit_id;
+static ID iodine_params_limit_id;
+
+typedef struct {
+  /* a custom unescaper (`parse_query` block) or Qnil */
+  VALUE unescaper;
+  size_t depth_limit;
+  /* separator characters */
+  uint8_t sep[256];
+} iodine_qs_s;
+
+/* returns Rack's error class (if Rack is loaded) or the fallback class */
+static VALUE iodine_qs_error_class(const char *name, VALUE fallback) {
+  ID rack = rb_intern("Rack");
+  ID qp = rb_intern("QueryParser");
+  ID err = rb_intern(name);
+  if (!rb_const_defined_at(rb_cObject, rack))
+    return fallback;
+  VALUE tmp = rb_const_get_at(rb_cObject, rack);
+  if (!RB_TYPE_P(tmp, T_MODULE) || !rb_const_defined_at(tmp, qp))
+    return fallback;
+  tmp = rb_const_get_at(tmp, qp);
+  if (!RB_TYPE_P(tmp, T_CLASS) || !rb_const_defined_at(tmp, err))
+    return fallback;
+  return rb_const_get_at(tmp, err);
+}
+
+/* URL decodes a query String component (Rack's `unescape`) */
+static VALUE iodine_qs_unescape(iodine_qs_s *q, const char *s, size_t len) {
+  VALUE str;
+  if (q->unescaper != Qnil) {
+    str = rb_enc_str_new(s, len, IodineUTF8Encoding);
+    return rb_funcallv(q->unescaper, iodine_call_func_id, 1, &str);
+  }
+  str = rb_str_buf_new(len);
+  /* `http_decode_url` might read past a trailing '%' */
+  ssize_t l = -1;
+  if ((!len || s[len - 1] != '%') && (len < 2 || s[len - 2] != '%'))
+    l = http_decode_url(RSTRING_PTR(str), s, len);
+  if (l < 0)
+    rb_raise(iodine_qs_error_class("InvalidParameterError", rb_eArgError),
+             "invalid %%-encoding (%.*s)", (int)len, s);
+  rb_str_set_len(str, l);
+  rb_enc_associate(str, IodineUTF8Encoding);
+  return str;
+}
+
+static inline VALUE iodine_qs_key(const char *s, size_t len) {
+  return rb_enc_str_new(s, len, IodineUTF8Encoding);
+}
+
+/* Rack's `params_hash_has_key?` */
+static int iodine_qs_has_key(VALUE h, const char *key, size_t len) {
+  for (size_t i = 0; i + 1 < len; ++i) {
+    if (key[i] == '[' && key[i + 1] == ']')
+      return 0;
+  }
+  const char *end = key + len;
+  while (key < end) {
+    while (key < end && (*key == '[' || *key == ']'))
+      ++key;
+    const char *part = key;
+    while (key < end && *key != '[' && *key != ']')
+      ++key;
+    if (part == key)
+      break;
+    if (!RB_TYPE_P(h, T_HASH))
+      return 0;
+    h = rb_hash_lookup2(h, iodine_qs_key(part, key - part), Qundef);
+    if (h == Qundef)
+      return 0;
+  }
+  return 1;
+}
+
+/* returns `params[k] ||= []` */
+static VALUE iodine_qs_ary(VALUE params, VALUE key) {
+  VALUE ary = rb_hash_lookup2(params, key, Qnil);
+  if (ary == Qnil) {
+    ary = rb_ary_new();
+    rb_hash_aset(params, key, ary);
+  } else if (!RB_TYPE_P(ary, T_ARRAY)) {
+    rb_raise(iodine_qs_error_class("ParameterTypeError", rb_eTypeError),
+             "expected Array (got %s) for param `%" PRIsVALUE "'",
+             rb_obj_classname(ary), key);
+  }
+  return ary;
+}
+
+/* Rack's `normalize_params`, `name` is NULL for a missing name */
+static VALUE iodine_qs_normalize(iodine_qs_s *q, VALUE params, const char *name,
+                                 size_t len, VALUE v, size_t depth) {
+  const char *k = name, *after = NULL, *tmp;
+  size_t klen = len, alen = 0;
+  if (depth >= q->depth_limit)
+    rb_raise(iodine_qs_error_class("ParamsTooDeepError", rb_eRangeError),
+             "exceeded available parameter key space");
+  if (!name) {
+    klen = 0;
+  } else if (!depth) {
+    /* don't treat "[" at the start of the name specially */
+    if (len > 1 && (tmp = memchr(name + 1, '[', len - 1))) {
+      klen = tmp - name;
+      after = tmp;
+      alen = len - klen;
+    }
+  } else if (len >= 2 && name[0] == '[' && name[1] == ']') {
+    /* Array nesting */
+    klen = 2;
+    after = name + 2;
+    alen = len - 2;
+  } else if (len >= 2 && name[0] == '[' &&
+             (tmp = memchr(name + 1, ']', len - 1))) {
+    /* Hash nesting, the key is within the brackets */
+    k = name + 1;
+    klen = tmp - k;
+    after = tmp + 1;
+    alen = len - (after - name);
+  }
+  if (!klen)
+    return Qnil;
+
+  if (!alen) {
+    if (depth && klen == 2 && k[0] == '[' && k[1] == ']')
+      return rb_ary_new_from_values(1, &v);
+    rb_hash_aset(params, iodine_qs_key(k, klen), v);
+  } else if (alen == 1 && after[0] == '[') {
+    rb_hash_aset(params, iodine_qs_key(name, len), v);
+  } else if (alen == 2 && after[0] == '[' && after[1] == ']') {
+    rb_ary_push(iodine_qs_ary(params, iodine_qs_key(k, klen)), v);
+  } else if (after[0] == '[' && after[1] == ']') {
+    /* "name[][key]" is a Hash within an Array */
+    const char *child = after + 2;
+    size_t clen = alen - 2;
+    if (alen > 4 && after[2] == '[' && after[alen - 1] == ']' &&
+        !memchr(after + 3, '[', alen - 4) && !memchr(after + 3, ']', alen - 4)) {
+      child = after + 3;
+      clen = alen - 4;
+    }
+    VALUE ary = iodine_qs_ary(params, iodine_qs_key(k, klen));
+    VALUE last = (RARRAY_LEN(ary) ? rb_ary_entry(ary, -1) : Qnil);
+    if (RB_TYPE_P(last, T_HASH) && !iodine_qs_has_key(last, child, clen))
+      iodine_qs_normalize(q, last, child, clen, v, depth + 1);
+    else
+      rb_ary_push(ary, iodine_qs_normalize(q, rb_hash_new(), child, clen, v,
+                                           depth + 1));
+  } else {
+    VALUE key = iodine_qs_key(k, klen);
+    VALUE child = rb_hash_lookup2(params, key, Qnil);
+    if (child == Qnil) {
+      child = rb_hash_new();
+    } else if (!RB_TYPE_P(child, T_HASH)) {
+      rb_raise(iodine_qs_error_class("ParameterTypeError", rb_eTypeError),
+               "expected Hash (got %s) for param `%" PRIsVALUE "'",
+               rb_obj_classname(child), key);
+    }
+    rb_hash_aset(params, key,
+                 iodine_qs_normalize(q, child, after, alen, v, depth + 1));
+  }
+  return params;
+}
+
+/* collects the arguments and the `Rack::QueryParser` limits (if any) */
+static VALUE iodine_qs_init(iodine_qs_s *q, int argc, VALUE *argv,
+                            VALUE self) {
+  if (argc < 1 || argc > 2)
+    rb_raise(rb_eArgError,
+             "wrong number of arguments (given %d, expected 1..2).", argc);
+  VALUE qs = argv[0];
+  VALUE sep = (argc == 2 ? argv[1] : Qnil);
+  memset(q->sep, 0, sizeof(q->sep));
+  q->unescaper = Qnil;
+  q->depth_limit = IODINE_QUERY_DEPTH_LIMIT;
+  if (sep != Qnil) {
+    Check_Type(sep, T_STRING);
+    for (long i = 0; i < RSTRING_LEN(sep); ++i)
+      q->sep[(uint8_t)RSTRING_PTR(sep)[i]] = 1;
+  } else {
+    q->sep['&'] = 1;
+  }
+  if (qs == Qnil)
+    return qs;
+  Check_Type(qs, T_STRING);
+  if (RB_TYPE_P(self, T_MODULE) || RB_TYPE_P(self, T_CLASS))
+    return qs;
+  /* a patched `Rack::QueryParser` instance */
+  VALUE tmp = rb_attr_get(self, iodine_param_depth_limit_id);
+  if (RB_TYPE_P(tmp, T_FIXNUM))
+    q->depth_limit = FIX2ULONG(tmp);
+  tmp = rb_attr_get(self, iodine_bytesize_limit_id);
+  if (RB_TYPE_P(tmp, T_FIXNUM) && RSTRING_LEN(qs) > FIX2LONG(tmp))
+    rb_raise(iodine_qs_error_class("QueryLimitError", rb_eRangeError),
+             "total query size (%ld) exceeds limit (%ld)", RSTRING_LEN(qs),
+             FIX2LONG(tmp));
+  tmp = rb_attr_get(self, iodine_params_limit_id);
+  if (RB_TYPE_P(tmp, T_FIXNUM)) {
+    long count = 0;
+    for (long i = 0; i < RSTRING_LEN(qs); ++i)
+      count += q->sep[(uint8_t)RSTRING_PTR(qs)[i]];
+    if (count >= FIX2LONG(tmp))
+      rb_raise(iodine_qs_error_class("QueryLimitError", rb_eRangeError),
+               "total number of query parameters (%ld) exceeds limit (%ld)",
+               count + 1, FIX2LONG(tmp));
+  }
+  return qs;
+}
+
+/* splits the query String, calling `task` for each "name=value" pair */
+static VALUE iodine_qs_parse(iodine_qs_s *q, VALUE qs,
+                             void (*task)(iodine_qs_s *, VALUE, VALUE, VALUE)) {
+  VALUE params = rb_hash_new();
+  if (qs == Qnil || !RSTRING_LEN(qs))
+    return params;
+  const char *pos = RSTRING_PTR(qs);
+  const char *end = pos + RSTRING_LEN(qs);
+  while (pos < end) {
+    const char *start = pos;
+    while (pos < end && !q->sep[(uint8_t)*pos])
+      ++pos;
+    if (pos > start) {
+      const char *eq = memchr(start, '=', pos - start);
+      VALUE name = iodine_qs_unescape(q, start, (eq ? eq : pos) - start);
+      VALUE value = (eq ? iodine_qs_unescape(q, eq + 1, pos - (eq + 1)) : Qnil);
+      task(q, params, name, value);
+    }
+    if (pos < end)
+      ++pos;
+    /* Rack ignores spaces following a separator */
+    while (pos < end && *pos == ' ')
+      ++pos;
+  }
+  RB_GC_GUARD(qs);
+  return params;
+}
+
+static void iodine_qs_add(iodine_qs_s *q, VALUE params, VALUE k, VALUE v) {
+  VALUE cur = rb_hash_lookup2(params, k, Qnil);
+  if (cur == Qnil)
+    rb_hash_aset(params, k, v);
+  else if (RB_TYPE_P(cur, T_ARRAY))
+    rb_ary_push(cur, v);
+  else
+    rb_hash_aset(params, k, rb_assoc_new(cur, v));
+  (void)q;
+}
+
+static void iodine_qs_add_nested(iodine_qs_s *q, VALUE params, VALUE k,
+                                 VALUE v) {
+  iodine_qs_normalize(q, params, RSTRING_PTR(k), RSTRING_LEN(k), v, 0);
+  RB_GC_GUARD(k);
+}
+
+/* used by the `multipart/form-data` parser (`:multipart`) */
+void iodine_rack_normalize_params(VALUE params, VALUE name, VALUE value) {
+  iodine_qs_s q = {.unescaper = Qnil,
+                   .depth_limit = IODINE_QUERY_DEPTH_LIMIT};
+  iodine_qs_normalize(&q, params, RSTRING_PTR(name), RSTRING_LEN(name), value,
+                      0);
+  RB_GC_GUARD(name);
+}
+
+/**
+Parses a query String (i.e., `"a=1&b=2&b=3"`) into a Hash, matching
+`Rack::Utils.parse_query`. Repeated keys are collected in an Array.
+
+    Iodine::Rack::Utils.parse_query("a=1&b=2&b=3") # => {"a"=>"1", "b"=>["2", "3"]}
+
+Accepts an optional String with the separator characters (default: `"&"`) and
+an optional block that unescapes each key and value.
+*/
+static VALUE iodine_parse_query(int argc, VALUE *argv, VALUE self) {
+  iodine_qs_s q;
+  VALUE qs = iodine_qs_init(&q, argc, argv, self);
+  if (rb_block_given_p())
+    q.unescaper = rb_block_proc();
+  return iodine_qs_parse(&q, qs, iodine_qs_add);
+}
+
+/**
+Parses a query String with nested parameters (i.e., `"a[b]=1&c[]=2"`) into a
+Hash, matching `Rack::Utils.parse_nested_query`.
+
+    Iodine::Rack::Utils.parse_nested_query("a[b]=1&c[]=2&c[]=3")
+    # => {"a"=>{"b"=>"1"}, "c"=>["2", "3"]}
+
+Accepts an optional String with the separator characters (default: `"&"`).
+Nesting is limited to 32 levels (or a patched `Rack::QueryParser`'s limit).
+*/
+static VALUE iodine_parse_nested_query(int argc, VALUE *argv, VALUE self) {
+  iodine_qs_s q;
+  VALUE qs = iodine_qs_init(&q, argc, argv, self);
+  return iodine_qs_parse(&q, qs, iodine_qs_add_nested);
+}
+
 /* *****************************************************************************
 Ruby Initialization
 ***************************************************************************** */
 
 void iodine_init_helpers(void) {
   iodine_to_i_func_id = rb_intern("to_i");
+  iodine_call_func_id = rb_intern("call");
+  iodine_param_depth_limit_id = rb_intern("@param_depth_limit");
+  iodine_bytesize_limit_id = rb_intern("@bytesize_limit");
+  iodine_params_limit_id = rb_intern("@params_limit");
   IodineUTF8Encoding = rb_enc_find("UTF-8");
   VALUE tmp = rb_define_module_under(IodineModule, "Rack");
   // clang-format off
@@ -251,6 +606,7 @@ Results:
         Patched.rfc2822  0.691304   0.003330   0.694634 (  0.701172)
         Patched.rfc2109  0.685029   0.001956   0.686985 (  0.687607)
 
+{Iodine.patch_rack} also replaces `parse_query` and `parse_nested_query` (in `Rack::Utils` and `Rack::QueryParser`, used by `Rack::Request`) with native versions. See `bin/query_bench.rb` for a benchmark.
   */
   tmp = rb_define_module_under(tmp, "Utils");
   // clang-format on
@@ -261,6 +617,9 @@ Results:
   rb_define_module_function(tmp, "time2str", date_str, -1);
   rb_define_module_function(tmp, "rfc2109", iodine_rfc2109, 1);
   rb_define_module_function(tmp, "rfc2822", iodine_rfc2822, 1);
+  rb_define_module_function(tmp, "parse_query", iodine_parse_query, -1);
+  rb_define_module_function(tmp, "parse_nested_query",
+                            iodine_parse_nested_query, -1);
 
   /*
 The monkey-patched methods are in this module, allowing Iodine::Rack::Utils to
@@ -278,5 +637,19 @@ include non-patched methods as well.
   rb_define_singleton_method(tmp, "unescape_path", path_decode, 1);
   rb_define_singleton_method(tmp, "rfc2109", iodine_rfc2109, 1);
   rb_define_singleton_method(tmp, "rfc2822", iodine_rfc2822, 1);
+  rb_define_method(tmp, "parse_query", iodine_parse_query, -1);
+  rb_define_method(tmp, "parse_nested_query", iodine_parse_nested_query, -1);
+  rb_define_singleton_method(tmp, "parse_query", iodine_parse_query, -1);
+  rb_define_singleton_method(tmp, "parse_nested_query",
+                             iodine_parse_nested_query, -1);
+
+  /*
+The `Rack::QueryParser` methods (used by `Rack::Request`), respecting the
+parser's limits.
+  */
+  tmp = rb_define_module_under(IodineBaseModule, "MonkeyPatch");
+  tmp = rb_define_module_under(tmp, "RackQueryParser");
+  rb_define_method(tmp, "parse_query", iodine_parse_query, -1);
+  rb_define_method(tmp, "parse_nested_query", iodine_parse_nested_query, -1);
   // rb_define_module_function(IodineUtils, "time2str", date_str, -1);
 }
@@ -7,6 +7,38 @@ License: MIT
 Feel free to copy, use and enjoy according to the license provided.
 */
 
+#include "ruby.h"
+
+#include <stdint.h>
+
 void iodine_init_helpers(void);
 
+/** The number of (finite) latency histogram buckets. */
+#define IODINE_HISTOGRAM_BUCKETS 14
+
+/** A latency histogram (see `iodine_histogram_add`). */
+typedef struct {
+  volatile size_t count;
+  volatile size_t sum; /* microseconds */
+  volatile size_t buckets[IODINE_HISTOGRAM_BUCKETS + 1];
+} iodine_histogram_s;
+
+/** Adds a duration (in microseconds) to the histogram (thread safe). */
+void iodine_histogram_add(iodine_histogram_s *hist, int64_t us);
+
+/**
+ * Converts a histogram to a Ruby Hash with the `:count`, the `:sum` (in
+ * milliseconds) and the cumulative `:buckets` (keyed by their upper bound, in
+ * milliseconds).
+ */
+VALUE iodine_histogram2rb(iodine_histogram_s *hist);
+
+/**
+ * Adds `value` to the `params` Hash using Rack's nested parameter rules (i.e.,
+ * `"user[name]"`), as `Rack::Utils.parse_nested_query` would.
+ *
+ * Raises Rack's exceptions (or `TypeError` / `RangeError`) on error.
+ */
+void iodine_rack_normalize_params(VALUE params, VALUE name, VALUE value);
+
 #endif
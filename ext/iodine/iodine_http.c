@@ -10,16 +10,22 @@ Feel free to copy, use and enjoy according to the license provided.
 
 #include <ruby/encoding.h>
 #include <ruby/io.h>
+#include <ruby/version.h>
 // #include "iodine_websockets.h"
 
 #ifndef __MINGW32__
 #include <arpa/inet.h>
 #endif
 #include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #ifndef __MINGW32__
 #include <sys/socket.h>
+#include <sys/stat.h>
 #endif
 
 /* *****************************************************************************
@@ -44,18 +50,13 @@ static VALUE RACK_UPGRADE_SSE;
 static VALUE RACK_UPGRADE_WEBSOCKET;
 static VALUE UPGRADE_TCP;
 
-static VALUE HTTP_ACCEPT;
-static VALUE HTTP_USER_AGENT;
-static VALUE HTTP_ACCEPT_ENCODING;
-static VALUE HTTP_ACCEPT_LANGUAGE;
-static VALUE HTTP_CONNECTION;
-static VALUE HTTP_HOST;
-
 static VALUE hijack_func_sym;
 static ID close_method_id;
 static ID each_method_id;
 static ID attach_method_id;
 static ID iodine_call_proc_id;
+static ID to_ary_method_id;
+static ID to_path_method_id;
 
 static VALUE env_template_no_upgrade;
 static VALUE env_template_websockets;
@@ -96,10 +97,17 @@ rack_declare(CONTENT_LENGTH);
 rack_declare(CONTENT_TYPE);
 rack_declare(R_URL_SCHEME);          // rack.url_scheme
 rack_declare(R_INPUT);               // rack.input
+rack_declare(R_HIJACK_Q);            // rack.hijack?
 rack_declare(XSENDFILE);             // for X-Sendfile support
 rack_declare(XSENDFILE_TYPE);        // for X-Sendfile support
 rack_declare(XSENDFILE_TYPE_HEADER); // for X-Sendfile support
 rack_declare(CONTENT_LENGTH_HEADER); // for X-Sendfile support
+rack_declare(IODINE_R_TIMINGS);      // iodine.timings (see `:timings`)
+rack_declare(IODINE_R_PARAMS);       // iodine.params (see `:multipart`)
+rack_declare(R_FORM_HASH);           // rack.request.form_hash
+rack_declare(R_FORM_INPUT);          // rack.request.form_input
+rack_declare(R_FORM_ERROR);          // rack.request.form_error
+rack_declare(R_TEMPFILES);           // rack.tempfiles
 
 /* used internally to handle requests */
 typedef struct {
@@ -108,7 +116,9 @@ typedef struct {
   enum iodine_http_response_type_enum {
     IODINE_HTTP_NONE,
     IODINE_HTTP_SENDBODY,
+    IODINE_HTTP_SENDSTRING,
     IODINE_HTTP_XSENDFILE,
+    IODINE_HTTP_SENDFILE,
     IODINE_HTTP_EMPTY,
     IODINE_HTTP_ERROR,
   } type;
@@ -117,6 +127,21 @@ typedef struct {
     IODINE_UPGRADE_WEBSOCKET,
     IODINE_UPGRADE_SSE,
   } upgrade;
+  /* the response should be reported to the response cache (see `:cache`) */
+  iodine_cache_entry_s *cache;
+  /* request phase timestamps (microseconds, see `:timings`) */
+  struct {
+    int64_t received; /* the request's first line was received */
+    int64_t ready;    /* the request was dispatched to the Rack handler */
+    int64_t gvl;      /* the GVL was acquired */
+    int64_t app;      /* the application returned */
+    int64_t body;     /* the response body was collected */
+    int64_t proxy;    /* upstream proxy queue time (`X-Request-Start`) or -1 */
+  } timings;
+  /* listed while the request waits for the GVL (see `:max_wait`) */
+  struct iodine_admission_wait_s *wait;
+  /* set when the request phases are timed (see `:timings`) */
+  uint8_t timed;
 } iodine_http_request_handle_s;
 
 /* *****************************************************************************
@@ -255,57 +280,216 @@ Copying data from the C request to the Rack's ENV
 
 #define to_upper(c) (((c) >= 'a' && (c) <= 'z') ? ((c) & ~32) : (c))
 
-static int iodine_copy2env_task(FIOBJ o, void *env_) {
-  VALUE env = (VALUE)env_;
-  FIOBJ name = fiobj_hash_key_in_loop();
+/* *****************************************************************************
+Rack env key (and common header value) cache
+***************************************************************************** */
+
+#ifndef IODINE_HTTP_ENV_KEY_LIMIT
+/* the maximum number of header names cached (per worker) */
+#define IODINE_HTTP_ENV_KEY_LIMIT 512
+#endif
+#ifndef IODINE_HTTP_ENV_VALUE_LIMIT
+/* the maximum number of header values cached (per worker, LRU eviction) */
+#define IODINE_HTTP_ENV_VALUE_LIMIT 1024
+#endif
+#ifndef IODINE_HTTP_ENV_VALUE_MAX_LEN
+/* longer header values aren't cached */
+#define IODINE_HTTP_ENV_VALUE_MAX_LEN 256
+#endif
+
+typedef struct {
+  VALUE key;
+  /* the header's values are likely to repeat (i.e., `accept`) */
+  uint8_t intern_value;
+} iodine_env_key_s;
+
+#define FIO_SET_NAME iodine_env_keys
+#define FIO_SET_KEY_TYPE FIOBJ
+#define FIO_SET_KEY_COPY(dest, key) ((dest) = fiobj_str_copy((key)))
+#define FIO_SET_KEY_DESTROY(key) fiobj_free((key))
+#define FIO_SET_KEY_COMPARE(k1, k2) fiobj_iseq((k1), (k2))
+#define FIO_SET_OBJ_TYPE iodine_env_key_s
+#define FIO_SET_OBJ_COMPARE(o1, o2) ((o1).key == (o2).key)
+#include <fio.h>
+
+#define FIO_INCLUDE_LINKED_LIST
+#include <fio.h>
+
+/* a cached header value, the least recently used values are evicted */
+typedef struct {
+  fio_ls_embd_s node;
+  FIOBJ value;
+  VALUE str;
+} iodine_env_value_s;
+
+#define FIO_SET_NAME iodine_env_values
+#define FIO_SET_OBJ_TYPE iodine_env_value_s *
+#define FIO_SET_OBJ_COMPARE(o1, o2) fiobj_iseq((o1)->value, (o2)->value)
+#include <fio.h>
+
+/* both caches are only accessed while holding the GVL */
+static iodine_env_keys_s iodine_env_key_cache = FIO_SET_INIT;
+static struct {
+  iodine_env_values_s map;
+  fio_ls_embd_s lru;
+} iodine_env_value_cache = {
+    .map = FIO_SET_INIT,
+    .lru = FIO_LS_INIT(iodine_env_value_cache.lru),
+};
+
+/* header names with values that are likely to repeat across requests */
+static const char *iodine_env_repeating_headers[] = {
+    "accept",         "accept-encoding", "accept-language",
+    "cache-control",  "connection",      "dnt",
+    "host",           "pragma",          "sec-fetch-dest",
+    "sec-fetch-mode", "sec-fetch-site",  "sec-fetch-user",
+    "upgrade",        "upgrade-insecure-requests",
+    "user-agent",     NULL};
+
+/* returns a frozen, deduplicated (fstring), binary String */
+static inline VALUE iodine_env_intern(const char *data, size_t len) {
+#if RUBY_API_VERSION_MAJOR >= 3
+  return rb_enc_interned_str(data, len, IodineBinaryEncoding);
+#else
+  VALUE str = rb_enc_str_new(data, len, IodineBinaryEncoding);
+  return rb_funcall(rb_obj_freeze(str), rb_intern2("-@", 2), 0);
+#endif
+}
+
+/* returns the (cached) Rack env key for the header name */
+static iodine_env_key_s iodine_env_key(FIOBJ name) {
+  const uint64_t hash = fiobj_obj2hash(name);
+  iodine_env_key_s k =
+      iodine_env_keys_find(&iodine_env_key_cache, hash, name);
+  if (k.key)
+    return k;
   fio_str_info_s tmp = fiobj_obj2cstr(name);
-  VALUE hname = (VALUE)0;
-  /* test for common header names, using pre-allocated memory */
-  if (tmp.len == 6 && !memcmp("accept", tmp.data, 6)) {
-    hname = HTTP_ACCEPT;
-  } else if (tmp.len == 10 && !memcmp("user-agent", tmp.data, 10)) {
-    hname = HTTP_USER_AGENT;
-  } else if (tmp.len == 15 && !memcmp("accept-encoding", tmp.data, 15)) {
-    hname = HTTP_ACCEPT_ENCODING;
-  } else if (tmp.len == 15 && !memcmp("accept-language", tmp.data, 15)) {
-    hname = HTTP_ACCEPT_LANGUAGE;
-  } else if (tmp.len == 10 && !memcmp("connection", tmp.data, 10)) {
-    hname = HTTP_CONNECTION;
-  } else if (tmp.len == 4 && !memcmp("host", tmp.data, 4)) {
-    hname = HTTP_HOST;
-  } else if (tmp.len > 123) {
-    char *buf = fio_malloc(tmp.len + 5);
-    memcpy(buf, "HTTP_", 5);
-    for (size_t i = 0; i < tmp.len; ++i) {
-      buf[i + 5] = (tmp.data[i] == '-') ? '_' : to_upper(tmp.data[i]);
+  char stack_buf[128];
+  char *buf = stack_buf;
+  if (tmp.len > 123)
+    buf = fio_malloc(tmp.len + 5);
+  memcpy(buf, "HTTP_", 5);
+  for (size_t i = 0; i < tmp.len; ++i) {
+    buf[i + 5] = (tmp.data[i] == '-') ? '_' : to_upper(tmp.data[i]);
+  }
+  if (iodine_env_keys_count(&iodine_env_key_cache) >=
+      IODINE_HTTP_ENV_KEY_LIMIT) {
+    /* the cache is full (header name flooding?), don't cache the key */
+    k.key = rb_enc_str_new(buf, tmp.len + 5, IodineBinaryEncoding);
+    goto finish;
+  }
+  k.key = iodine_env_intern(buf, tmp.len + 5);
+  for (size_t i = 0; iodine_env_repeating_headers[i]; ++i) {
+    if (strlen(iodine_env_repeating_headers[i]) == tmp.len &&
+        !memcmp(iodine_env_repeating_headers[i], tmp.data, tmp.len)) {
+      k.intern_value = 1;
+      break;
     }
-    hname = rb_enc_str_new(buf, tmp.len + 5, IodineBinaryEncoding);
+  }
+  IodineStore.add(k.key);
+  iodine_env_keys_insert(&iodine_env_key_cache, hash, name, k, NULL);
+finish:
+  if (buf != stack_buf)
     fio_free(buf);
-  } else {
-    char buf[128];
-    memcpy(buf, "HTTP_", 5);
-    for (size_t i = 0; i < tmp.len; ++i) {
-      buf[i + 5] = (tmp.data[i] == '-') ? '_' : to_upper(tmp.data[i]);
-    }
-    hname = rb_enc_str_new(buf, tmp.len + 5, IodineBinaryEncoding);
+  return k;
+}
+
+/* evicts the least recently used header value */
+static void iodine_env_value_evict(void) {
+  iodine_env_value_s *e = FIO_LS_EMBD_OBJ(iodine_env_value_s, node,
+                                          iodine_env_value_cache.lru.prev);
+  iodine_env_values_remove(&iodine_env_value_cache.map,
+                           fiobj_obj2hash(e->value), e, NULL);
+  fio_ls_embd_remove(&e->node);
+  IodineStore.remove(e->str);
+  fiobj_free(e->value);
+  fio_free(e);
+}
+
+/*
+ * Returns a Ruby String for the header value (cached when `intern` is set).
+ *
+ * Cached values are shared (copy on write) by an unfrozen String, so the
+ * application may modify the value.
+ */
+static inline VALUE iodine_env_value(FIOBJ value, uint8_t intern) {
+  fio_str_info_s tmp = fiobj_obj2cstr(value);
+  if (!intern || tmp.len > IODINE_HTTP_ENV_VALUE_MAX_LEN)
+    return rb_enc_str_new(tmp.data, tmp.len, IodineBinaryEncoding);
+  const uint64_t hash = fiobj_obj2hash(value);
+  iodine_env_value_s find = {.value = value};
+  iodine_env_value_s *e =
+      iodine_env_values_find(&iodine_env_value_cache.map, hash, &find);
+  if (e) {
+    /* mark as most recently used */
+    fio_ls_embd_remove(&e->node);
+    fio_ls_embd_push(&iodine_env_value_cache.lru, &e->node);
+    return rb_str_dup(e->str);
   }
+  if (iodine_env_values_count(&iodine_env_value_cache.map) >=
+      IODINE_HTTP_ENV_VALUE_LIMIT)
+    iodine_env_value_evict();
+  e = fio_malloc(sizeof(*e));
+  FIO_ASSERT_ALLOC(e);
+  *e = (iodine_env_value_s){
+      .value = fiobj_str_copy(value),
+      .str = iodine_env_intern(tmp.data, tmp.len),
+  };
+  IodineStore.add(e->str);
+  iodine_env_values_insert(&iodine_env_value_cache.map, hash, e);
+  fio_ls_embd_push(&iodine_env_value_cache.lru, &e->node);
+  return rb_str_dup(e->str);
+}
 
-  if (FIOBJ_TYPE_IS(o, FIOBJ_T_STRING)) {
-    tmp = fiobj_obj2cstr(o);
-    rb_hash_aset(env, hname,
-                 rb_enc_str_new(tmp.data, tmp.len, IodineBinaryEncoding));
+/* returns the env value for a header (a String or an Array of Strings) */
+static VALUE iodine_env_header_value(FIOBJ o, uint8_t intern) {
+  if (FIOBJ_TYPE_IS(o, FIOBJ_T_STRING))
+    return iodine_env_value(o, intern);
+  /* it's an array */
+  size_t count = fiobj_ary_count(o);
+  VALUE ary = rb_ary_new2(count);
+  for (size_t i = 0; i < count; ++i) {
+    rb_ary_push(ary, iodine_env_value(fiobj_ary_index(o, i), intern));
+  }
+  return ary;
+}
 
+static int iodine_copy2env_task(FIOBJ o, void *env_) {
+  VALUE env = (VALUE)env_;
+  iodine_env_key_s name = iodine_env_key(fiobj_hash_key_in_loop());
+  rb_hash_aset(env, name.key, iodine_env_header_value(o, name.intern_value));
+  return 0;
+}
+
+/* sets the REMOTE_ADDR (support for Ruby web-console) */
+static void iodine_env_set_remote_addr(VALUE env, http_s *h) {
+  fio_str_info_s peer = http_peer_addr(h);
+  if (peer.len) {
+    rb_hash_aset(env, REMOTE_ADDR, rb_str_new(peer.data, peer.len));
+  }
+}
+
+/* handles the HOST header, including the possible host:#### format */
+static void iodine_env_set_server_name(VALUE env, http_s *h) {
+  static uint64_t host_hash = 0;
+  if (!host_hash)
+    host_hash = fiobj_hash_string("host", 4);
+  fio_str_info_s tmp = fiobj_obj2cstr(fiobj_hash_get2(h->headers, host_hash));
+  char *pos = tmp.data;
+  while (*pos && *pos != ':')
+    pos++;
+  if (*pos == 0) {
+    rb_hash_aset(env, SERVER_NAME,
+                 rb_enc_str_new(tmp.data, tmp.len, IodineBinaryEncoding));
   } else {
-    /* it's an array */
-    size_t count = fiobj_ary_count(o);
-    VALUE ary = rb_ary_new2(count);
-    rb_hash_aset(env, hname, ary);
-    for (size_t i = 0; i < count; ++i) {
-      tmp = fiobj_obj2cstr(fiobj_ary_index(o, i));
-      rb_ary_push(ary, rb_enc_str_new(tmp.data, tmp.len, IodineBinaryEncoding));
-    }
+    rb_hash_aset(
+        env, SERVER_NAME,
+        rb_enc_str_new(tmp.data, pos - tmp.data, IodineBinaryEncoding));
+    ++pos;
+    rb_hash_aset(
+        env, SERVER_PORT,
+        rb_enc_str_new(pos, tmp.len - (pos - tmp.data), IodineBinaryEncoding));
   }
-  return 0;
 }
 
 static inline VALUE copy2env(iodine_http_request_handle_s *handle) {
@@ -351,33 +535,8 @@ static inline VALUE copy2env(iodine_http_request_handle_s *handle) {
     rb_hash_aset(env, HTTP_VERSION, hname);
   }
 
-  { // Support for Ruby web-console.
-    fio_str_info_s peer = http_peer_addr(h);
-    if (peer.len) {
-      rb_hash_aset(env, REMOTE_ADDR, rb_str_new(peer.data, peer.len));
-    }
-  }
-
-  /* handle the HOST header, including the possible host:#### format*/
-  static uint64_t host_hash = 0;
-  if (!host_hash)
-    host_hash = fiobj_hash_string("host", 4);
-  tmp = fiobj_obj2cstr(fiobj_hash_get2(h->headers, host_hash));
-  pos = tmp.data;
-  while (*pos && *pos != ':')
-    pos++;
-  if (*pos == 0) {
-    rb_hash_aset(env, SERVER_NAME,
-                 rb_enc_str_new(tmp.data, tmp.len, IodineBinaryEncoding));
-  } else {
-    rb_hash_aset(
-        env, SERVER_NAME,
-        rb_enc_str_new(tmp.data, pos - tmp.data, IodineBinaryEncoding));
-    ++pos;
-    rb_hash_aset(
-        env, SERVER_PORT,
-        rb_enc_str_new(pos, tmp.len - (pos - tmp.data), IodineBinaryEncoding));
-  }
+  iodine_env_set_remote_addr(env, h);
+  iodine_env_set_server_name(env, h);
 
   /* remove special headers */
   {
@@ -546,9 +705,400 @@ static VALUE for_each_body_string(VALUE str, VALUE body_, int argc,
   (void)argv;
 }
 
+/* *****************************************************************************
+Zero-copy String bodies
+***************************************************************************** */
+
+#ifndef IODINE_HTTP_NOCOPY_MIN
+/* String bodies smaller than this are copied (copying is cheaper) */
+#define IODINE_HTTP_NOCOPY_MIN 16384
+#endif
+
+/* frozen Strings pinned while their bytes are being sent, by data pointer */
+typedef struct {
+  VALUE str;
+  size_t count;
+} iodine_pin_s;
+
+#define FIO_SET_NAME iodine_pinned
+#define FIO_SET_KEY_TYPE const char *
+#define FIO_SET_OBJ_TYPE iodine_pin_s
+#define FIO_SET_OBJ_COMPARE(o1, o2) ((o1).str == (o2).str)
+#include <fio.h>
+
+static fio_lock_i iodine_pinned_lock = FIO_LOCK_INIT;
+static iodine_pinned_s iodine_pinned_strings = FIO_SET_INIT;
+
+/* Pins a String (must be called within the GVL), returning the pinned String */
+static VALUE iodine_http_pin(VALUE str) {
+  if (!OBJ_FROZEN(str)) {
+    /* shares the buffer, later changes to `str` will copy it (copy on write) */
+    str = rb_str_new_frozen(str);
+  }
+  const char *data = RSTRING_PTR(str);
+  const uint64_t hash = (uint64_t)(uintptr_t)data;
+  fio_lock(&iodine_pinned_lock);
+  iodine_pin_s pin = iodine_pinned_find(&iodine_pinned_strings, hash, data);
+  if (!pin.str)
+    pin.str = str;
+  ++pin.count;
+  iodine_pinned_insert(&iodine_pinned_strings, hash, data, pin, NULL);
+  fio_unlock(&iodine_pinned_lock);
+  IodineStore.add(pin.str);
+  return str;
+}
+
+/* Releases a pinned String (any thread), used as the packet's `dealloc` */
+static void iodine_http_unpin(void *data) {
+  const uint64_t hash = (uint64_t)(uintptr_t)data;
+  fio_lock(&iodine_pinned_lock);
+  iodine_pin_s pin = iodine_pinned_find(&iodine_pinned_strings, hash, data);
+  if (pin.count > 1) {
+    --pin.count;
+    iodine_pinned_insert(&iodine_pinned_strings, hash, data, pin, NULL);
+  } else {
+    iodine_pinned_remove(&iodine_pinned_strings, hash, data, NULL);
+  }
+  fio_unlock(&iodine_pinned_lock);
+  /* the store is thread safe, releasing doesn't require the GVL */
+  IodineStore.remove(pin.str);
+}
+
+/* Sends a pinned String (outside the GVL) */
+static void iodine_http_send_pinned(http_s *h, VALUE str) {
+  http_send_body_nocopy(h, RSTRING_PTR(str), RSTRING_LEN(str),
+                        iodine_http_unpin);
+}
+
+/* *****************************************************************************
+File bodies (`to_path`)
+***************************************************************************** */
+
+/* file bodies kept alive (and open) while their file is being sent, by fd */
+typedef struct {
+  VALUE body;
+  size_t length;
+} iodine_file_body_s;
+
+#define FIO_SET_NAME iodine_file_bodies
+#define FIO_SET_KEY_TYPE intptr_t
+#define FIO_SET_OBJ_TYPE iodine_file_body_s
+#define FIO_SET_OBJ_COMPARE(o1, o2) ((o1).body == (o2).body)
+#include <fio.h>
+
+static fio_lock_i iodine_file_bodies_lock = FIO_LOCK_INIT;
+static iodine_file_bodies_s iodine_file_bodies = FIO_SET_INIT;
+
+/* Opens the file named by the body's `to_path` (GVL), returns the fd or -1 */
+static int iodine_http_file_body_open(VALUE body) {
+  VALUE path = IodineCaller.call(body, to_path_method_id);
+  if (TYPE(path) != T_STRING || !RSTRING_LEN(path) ||
+      memchr(RSTRING_PTR(path), 0, RSTRING_LEN(path)))
+    return -1;
+  int fd = open(RSTRING_PTR(path), O_RDONLY | O_CLOEXEC);
+  if (fd == -1)
+    return -1;
+  struct stat st;
+  if (fstat(fd, &st) || !S_ISREG(st.st_mode)) {
+    close(fd);
+    return -1;
+  }
+  fio_lock(&iodine_file_bodies_lock);
+  iodine_file_bodies_insert(
+      &iodine_file_bodies, (uint64_t)fd, fd,
+      (iodine_file_body_s){.body = body, .length = (size_t)st.st_size}, NULL);
+  fio_unlock(&iodine_file_bodies_lock);
+  IodineStore.add(body);
+  return fd;
+}
+
+/* Calls the body's `close` (Rack requires this once the body was sent) */
+static void iodine_http_file_body_close_task(void *body_, void *ignr) {
+  VALUE body = (VALUE)body_;
+  if (rb_respond_to(body, close_method_id))
+    IodineCaller.call(body, close_method_id);
+  IodineStore.remove(body);
+  (void)ignr;
+}
+
+/* Closes the file once it was sent (any thread, including the IO thread) */
+static void iodine_http_file_body_sent(intptr_t fd) {
+  fio_lock(&iodine_file_bodies_lock);
+  iodine_file_body_s b =
+      iodine_file_bodies_find(&iodine_file_bodies, (uint64_t)fd, fd);
+  iodine_file_bodies_remove(&iodine_file_bodies, (uint64_t)fd, fd, NULL);
+  fio_unlock(&iodine_file_bodies_lock);
+  close((int)fd);
+  if (b.body)
+    fio_defer(iodine_http_file_body_close_task, (void *)b.body, NULL);
+}
+
+/* Sends a file body (outside the GVL), the app's headers are left as is */
+static void iodine_http_send_file_body(http_s *h, int fd) {
+  fio_lock(&iodine_file_bodies_lock);
+  iodine_file_body_s b =
+      iodine_file_bodies_find(&iodine_file_bodies, (uint64_t)fd, fd);
+  fio_unlock(&iodine_file_bodies_lock);
+  size_t length = b.length;
+  FIOBJ cl = fiobj_hash_get2(h->private_data.out_headers,
+                             fiobj_obj2hash(HTTP_HEADER_CONTENT_LENGTH));
+  if (cl) {
+    /* an explicit (shorter) `content-length` limits the data sent */
+    int64_t l = fiobj_obj2num(cl);
+    if (l >= 0 && (size_t)l <= length)
+      length = (size_t)l;
+    else
+      fiobj_hash_delete2(h->private_data.out_headers,
+                         fiobj_obj2hash(HTTP_HEADER_CONTENT_LENGTH));
+  }
+  fio_str_info_s method = fiobj_obj2cstr(h->method);
+  if (method.len == 4 && !strncasecmp(method.data, "head", 4)) {
+    if (!cl)
+      http_set_header(h, HTTP_HEADER_CONTENT_LENGTH, fiobj_num_new(length));
+    iodine_http_file_body_sent(fd);
+    http_finish(h);
+    return;
+  }
+  http_sendfile_notify(h, fd, length, 0, iodine_http_file_body_sent);
+}
+
+/* *****************************************************************************
+Streaming response bodies
+***************************************************************************** */
+
+#ifndef IODINE_HTTP_STREAM_PENDING
+/* a streaming Ruby thread waits while more packets are waiting to be sent */
+#define IODINE_HTTP_STREAM_PENDING 16
+#endif
+
+static VALUE IodineRackStreamClass;
+
+typedef struct {
+  http_s *h;
+  VALUE input;
+  size_t wait_for;
+  /* the connection was lost */
+  uint8_t error;
+  /* the body raised an exception */
+  uint8_t failed;
+  /* data was sent (the response headers were sent) */
+  uint8_t started;
+} iodine_http_stream_s;
+
+static void iodine_http_stream_mark(void *s_) {
+  iodine_http_stream_s *s = s_;
+  if (s->input)
+    rb_gc_mark(s->input);
+}
+
+static size_t iodine_http_stream_size(const void *s_) {
+  return sizeof(iodine_http_stream_s);
+  (void)s_;
+}
+
+static const rb_data_type_t iodine_http_stream_data_type = {
+    .wrap_struct_name = "IodineRackStreamData",
+    .function =
+        {
+            .dmark = iodine_http_stream_mark,
+            .dfree = RUBY_DEFAULT_FREE,
+            .dsize = iodine_http_stream_size,
+        },
+    .data = NULL,
+    .flags = RUBY_TYPED_FREE_IMMEDIATELY,
+};
+
+static VALUE iodine_http_stream_alloc_c(VALUE klass) {
+  iodine_http_stream_s *s;
+  return TypedData_Make_Struct(klass, iodine_http_stream_s,
+                               &iodine_http_stream_data_type, s);
+}
+
+static inline iodine_http_stream_s *iodine_http_stream_get(VALUE self) {
+  iodine_http_stream_s *s;
+  TypedData_Get_Struct(self, iodine_http_stream_s,
+                       &iodine_http_stream_data_type, s);
+  return s;
+}
+
+static void *iodine_http_stream_wait_no_gvl(void *s_) {
+  iodine_http_stream_s *s = s_;
+  if (http_stream_wait(s->h, s->wait_for))
+    s->error = 1;
+  return NULL;
+}
+
+/* sends a chunk, blocking (outside the GVL) while the client lags behind */
+static int iodine_http_stream_write(iodine_http_stream_s *s, VALUE str) {
+  if (!s->h || s->error)
+    return -1;
+  if (TYPE(str) != T_STRING) {
+    FIO_LOG_ERROR("(Iodine) response body not a String\n");
+    return -1;
+  }
+  if (!RSTRING_LEN(str))
+    return 0;
+  int pending = http_stream(s->h, RSTRING_PTR(str), RSTRING_LEN(str));
+  s->started = 1;
+  if (pending < 0) {
+    s->error = 1;
+    return -1;
+  }
+  if (pending > IODINE_HTTP_STREAM_PENDING) {
+    s->wait_for = IODINE_HTTP_STREAM_PENDING;
+    IodineCaller.leaveGVL(iodine_http_stream_wait_no_gvl, s);
+  }
+  return s->error ? -1 : 0;
+}
+
+/* completes the response (the `http_s` handle is no longer valid) */
+static void iodine_http_stream_finish(iodine_http_stream_s *s) {
+  if (!s->h)
+    return;
+  if (s->failed && !s->started) {
+    /* nothing was sent yet, so the client can get a proper error response */
+    http_send_error(s->h, 500);
+  } else if (s->failed || s->error) {
+    /* the response is incomplete, the client must know it's broken */
+    if (!s->error) {
+      s->wait_for = 0;
+      IodineCaller.leaveGVL(iodine_http_stream_wait_no_gvl, s);
+    }
+    http_stream_abort(s->h);
+  } else {
+    http_finish(s->h);
+  }
+  s->h = NULL;
+}
+
+// streams each chunk of an `each` body
+static VALUE for_each_body_stream(VALUE str, VALUE s_, int argc, VALUE *argv) {
+  iodine_http_stream_write((iodine_http_stream_s *)s_, str);
+  return Qtrue;
+  (void)argc;
+  (void)argv;
+}
+
+static inline void iodine_http_stream_closed_error(void) {
+  rb_raise(rb_eIOError, "closed stream");
+}
+
+/**
+Writes the Strings to the response, returning the number of bytes written.
+
+The data is sent immediately (the call blocks while the client lags behind).
+*/
+static VALUE iodine_http_stream_write_rb(int argc, VALUE *argv, VALUE self) {
+  iodine_http_stream_s *s = iodine_http_stream_get(self);
+  size_t total = 0;
+  if (!s->h)
+    iodine_http_stream_closed_error();
+  for (int i = 0; i < argc; ++i) {
+    VALUE str = argv[i];
+    if (TYPE(str) != T_STRING)
+      str = rb_obj_as_string(str);
+    if (iodine_http_stream_write(s, str))
+      rb_raise(rb_eIOError, "connection lost");
+    total += RSTRING_LEN(str);
+  }
+  return SIZET2NUM(total);
+}
+
+/** Writes the String to the response, returning the stream. */
+static VALUE iodine_http_stream_push(VALUE self, VALUE str) {
+  iodine_http_stream_write_rb(1, &str, self);
+  return self;
+}
+
+/** Waits until all the data was handed to the network layer. */
+static VALUE iodine_http_stream_flush(VALUE self) {
+  iodine_http_stream_s *s = iodine_http_stream_get(self);
+  if (!s->h)
+    iodine_http_stream_closed_error();
+  s->wait_for = 0;
+  IodineCaller.leaveGVL(iodine_http_stream_wait_no_gvl, s);
+  if (s->error)
+    rb_raise(rb_eIOError, "connection lost");
+  return self;
+}
+
+/** Reads from the request's body (`rack.input`). */
+static VALUE iodine_http_stream_read(int argc, VALUE *argv, VALUE self) {
+  iodine_http_stream_s *s = iodine_http_stream_get(self);
+  if (!s->input || s->input == Qnil)
+    return (argc > 0 && argv[0] != Qnil) ? Qnil : rb_str_buf_new(0);
+  return rb_funcallv(s->input, rb_intern2("read", 4), argc, argv);
+}
+
+/** Completes the response. */
+static VALUE iodine_http_stream_close(VALUE self) {
+  iodine_http_stream_finish(iodine_http_stream_get(self));
+  return Qnil;
+}
+
+/** Does nothing (the request's body is managed by the server). */
+static VALUE iodine_http_stream_close_read(VALUE self) {
+  return Qnil;
+  (void)self;
+}
+
+/** Returns `true` once the response was completed. */
+static VALUE iodine_http_stream_is_closed(VALUE self) {
+  return iodine_http_stream_get(self)->h ? Qfalse : Qtrue;
+}
+
+typedef struct {
+  VALUE body;
+  VALUE stream;
+} iodine_http_stream_call_s;
+
+/* iterates an `each` body or calls a Rack 3 streaming body (protected) */
+static VALUE iodine_http_stream_perform(VALUE c_) {
+  iodine_http_stream_call_s *c = (iodine_http_stream_call_s *)c_;
+  if (rb_respond_to(c->body, each_method_id))
+    return rb_block_call(c->body, each_method_id, 0, NULL,
+                         (rb_block_call_func_t)for_each_body_stream,
+                         (VALUE)iodine_http_stream_get(c->stream));
+  return rb_funcallv(c->body, iodine_call_proc_id, 1, &c->stream);
+}
+
+/* streams a response body, the response is complete when this returns */
+static void iodine_http_stream_body(iodine_http_request_handle_s *handle,
+                                    VALUE body, VALUE env) {
+  VALUE stream = iodine_http_stream_alloc_c(IodineRackStreamClass);
+  iodine_http_stream_s *s = iodine_http_stream_get(stream);
+  IodineStore.add(stream);
+  s->h = handle->h;
+  s->input = rb_hash_aref(env, IODINE_R_INPUT);
+  iodine_http_stream_call_s c = {.body = body, .stream = stream};
+  int state = 0;
+  rb_protect(iodine_http_stream_perform, (VALUE)&c, &state);
+  if (state) {
+    /* the response can't be completed (a partial body isn't a response) */
+    VALUE exc = rb_errinfo();
+    rb_set_errinfo(Qnil);
+    if (exc != Qnil) {
+      VALUE msg = rb_protect(rb_obj_as_string, exc, &state);
+      if (!state && RB_TYPE_P(msg, T_STRING))
+        FIO_LOG_ERROR("Iodine caught an exception while streaming a response "
+                      "body - %.*s: %.*s",
+                      (int)RSTRING_LEN(rb_class_name(rb_obj_class(exc))),
+                      RSTRING_PTR(rb_class_name(rb_obj_class(exc))),
+                      (int)RSTRING_LEN(msg), RSTRING_PTR(msg));
+      rb_set_errinfo(Qnil);
+    }
+    s->failed = 1;
+  }
+  if (rb_respond_to(body, each_method_id) &&
+      rb_respond_to(body, close_method_id))
+    IodineCaller.call(body, close_method_id);
+  iodine_http_stream_finish(s);
+  IodineStore.remove(stream);
+  handle->type = IODINE_HTTP_NONE;
+}
+
 static inline int ruby2c_response_send(iodine_http_request_handle_s *handle,
                                        VALUE rbresponse, VALUE env) {
-  (void)(env);
   VALUE body = rb_ary_entry(rbresponse, 2);
   if (handle->h->status < 200 || handle->h->status == 204 ||
       handle->h->status == 304) {
@@ -568,14 +1118,35 @@ static inline int ruby2c_response_send(iodine_http_request_handle_s *handle,
     }
   }
 
+  if (handle->h->status != 206 && TYPE(body) != T_STRING &&
+      TYPE(body) != T_ARRAY && rb_respond_to(body, to_path_method_id)) {
+    // a file body (i.e., `File`, `Tempfile`, `Rack::Files`), sent from an fd
+    int fd = iodine_http_file_body_open(body);
+    if (fd != -1) {
+      /* the body is closed once the file was sent */
+      handle->body = (FIOBJ)fd;
+      handle->type = IODINE_HTTP_SENDFILE;
+      return 0;
+    }
+  }
   if (TYPE(body) == T_STRING) {
     // fprintf(stderr, "Review body as String\n");
     handle->type = IODINE_HTTP_NONE;
-    if (RSTRING_LEN(body)) {
+    if (RSTRING_LEN(body) >= IODINE_HTTP_NOCOPY_MIN) {
+      /* the body is sent directly from the (pinned) Ruby String */
+      handle->body = (FIOBJ)iodine_http_pin(body);
+      handle->type = IODINE_HTTP_SENDSTRING;
+    } else if (RSTRING_LEN(body)) {
       handle->body = fiobj_str_new(RSTRING_PTR(body), RSTRING_LEN(body));
       handle->type = IODINE_HTTP_SENDBODY;
     }
     return 0;
+  } else if (TYPE(body) != T_ARRAY && !rb_respond_to(body, to_ary_method_id) &&
+             (rb_respond_to(body, each_method_id) ||
+              rb_respond_to(body, iodine_call_proc_id))) {
+    // enumerable (not buffered) bodies and Rack 3 streaming bodies
+    iodine_http_stream_body(handle, body, env);
+    return 0;
   } else if (rb_respond_to(body, each_method_id)) {
     // fprintf(stderr, "Review body as for-each ...\n");
     handle->body = fiobj_str_buf(1);
@@ -657,23 +1228,12 @@ upgraded:
 Handling HTTP requests
 ***************************************************************************** */
 
-static inline void *iodine_handle_request_in_GVL(void *handle_) {
-  iodine_http_request_handle_s *handle = handle_;
-  VALUE rbresponse = 0;
-  VALUE env = 0;
+/* handles the value returned by the Rack application (releasing the `env`) */
+static inline void
+iodine_handle_response_in_GVL(iodine_http_request_handle_s *handle, VALUE env,
+                              VALUE rbresponse) {
   http_s *h = handle->h;
-  if (!h->udata)
-    goto err_not_found;
-
-  // create / register env variable
-  env = copy2env(handle);
-  // create rack.io
-  VALUE tmp = IodineRackIO.create(h, env);
-  // pass env variable to handler
-  rbresponse =
-      IodineCaller.call2((VALUE)h->udata, iodine_call_proc_id, 1, &env);
-  // close rack.io
-  IodineRackIO.close(tmp);
+  VALUE tmp;
   // test handler's return value
   if (rbresponse == 0 || rbresponse == Qnil || TYPE(rbresponse) != T_ARRAY)
     goto internal_error;
@@ -728,31 +1288,301 @@ static inline void *iodine_handle_request_in_GVL(void *handle_) {
 finish:
   IodineStore.remove(rbresponse);
   IodineStore.remove(env);
-  return NULL;
+  return;
 
 external_done:
   IodineStore.remove(rbresponse);
   IodineStore.remove(env);
   handle->type = IODINE_HTTP_NONE;
-  return NULL;
-
-err_not_found:
-  IodineStore.remove(rbresponse);
-  IodineStore.remove(env);
-  h->status = 404;
-  handle->type = IODINE_HTTP_ERROR;
-  return NULL;
+  return;
 
 internal_error:
   IodineStore.remove(rbresponse);
   IodineStore.remove(env);
   h->status = 500;
   handle->type = IODINE_HTTP_ERROR;
+}
+
+/* *****************************************************************************
+Request timings (`:timings`)
+
+The time spent by each request in each phase is added to per worker histograms
+(see `Iodine::HTTP.timing_stats`) and the phases known before the application
+is called are reported in the `env` (`iodine.timings`). Requests that are
+paused (`:fiber` and `:ractors`) aren't timed.
+***************************************************************************** */
+
+static struct {
+  iodine_histogram_s proxy; /* upstream proxy queue (`X-Request-Start`) */
+  iodine_histogram_s queue; /* request received => dispatched */
+  iodine_histogram_s gvl;   /* dispatched => GVL acquired */
+  iodine_histogram_s app;   /* GVL acquired => application returned */
+  iodine_histogram_s body;  /* application returned => body collected */
+  iodine_histogram_s write; /* body collected => response handed to the IO */
+  iodine_histogram_s total; /* request received => response handed to the IO */
+  uint8_t enabled;
+} iodine_timings;
+
+static inline int64_t iodine_time_us(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_REALTIME, &t);
+  return ((int64_t)t.tv_sec * 1000000) + (t.tv_nsec / 1000);
+}
+
+static inline int64_t iodine_received_us(http_s *h) {
+  return ((int64_t)h->received_at.tv_sec * 1000000) +
+         (h->received_at.tv_nsec / 1000);
+}
+
+/**
+ * Returns the time (in microseconds) a request waited for an upstream proxy,
+ * using the `X-Request-Start` header (`t=` seconds, milliseconds or
+ * microseconds since the epoch), or -1.
+ */
+static int64_t iodine_timing_proxy(http_s *h) {
+  static uint64_t hash = 0;
+  if (!hash)
+    hash = fiobj_hash_string("x-request-start", 15);
+  FIOBJ tmp = fiobj_hash_get2(h->headers, hash);
+  if (!tmp || !FIOBJ_TYPE_IS(tmp, FIOBJ_T_STRING))
+    return -1;
+  char *pos = fiobj_obj2cstr(tmp).data;
+  if (pos[0] == 't' && pos[1] == '=')
+    pos += 2;
+  if (!isdigit(*pos))
+    return -1;
+  int64_t start = fio_atol(&pos);
+  /* fractions are collected as millionths of the unit */
+  int64_t fraction = 0;
+  if (*pos == '.') {
+    ++pos;
+    for (int64_t scale = 100000; scale && isdigit(*pos); scale /= 10, ++pos)
+      fraction += (*pos - '0') * scale;
+  }
+  if (start >= 1000000000000000LL) {
+    /* microseconds */
+  } else if (start >= 1000000000000LL) {
+    start = (start * 1000) + (fraction / 1000);
+  } else if (start >= 1000000000LL) {
+    start = (start * 1000000) + fraction;
+  } else {
+    return -1;
+  }
+  start = iodine_received_us(h) - start;
+  return (start < 0 ? 0 : start);
+}
+
+/* adds the `iodine.timings` Hash to the env */
+static void iodine_timings_env(iodine_http_request_handle_s *handle,
+                               VALUE env) {
+  static VALUE sym_received_at, sym_queue, sym_gvl, sym_proxy;
+  if (!sym_received_at) {
+    sym_received_at = ID2SYM(rb_intern("received_at"));
+    sym_queue = ID2SYM(rb_intern("queue"));
+    sym_gvl = ID2SYM(rb_intern("gvl"));
+    sym_proxy = ID2SYM(rb_intern("proxy"));
+  }
+  const int64_t received = handle->timings.received;
+  VALUE t = rb_hash_new();
+  rb_hash_aset(t, sym_received_at, DBL2NUM((double)received / 1000000.0));
+  rb_hash_aset(t, sym_queue,
+               DBL2NUM((double)(handle->timings.ready - received) / 1000.0));
+  rb_hash_aset(
+      t, sym_gvl,
+      DBL2NUM((double)(handle->timings.gvl - handle->timings.ready) / 1000.0));
+  if (handle->timings.proxy >= 0)
+    rb_hash_aset(t, sym_proxy, DBL2NUM((double)handle->timings.proxy / 1000.0));
+  rb_hash_aset(env, IODINE_R_TIMINGS, t);
+}
+
+/* adds a complete request's timings to the histograms */
+static void iodine_timings_record(iodine_http_request_handle_s *handle) {
+  if (!handle->timings.body)
+    return; /* the application wasn't called (i.e., the GVL wasn't acquired) */
+  const int64_t done = iodine_time_us();
+  const int64_t received = handle->timings.received;
+  if (handle->timings.proxy >= 0)
+    iodine_histogram_add(&iodine_timings.proxy, handle->timings.proxy);
+  iodine_histogram_add(&iodine_timings.queue,
+                       handle->timings.ready - received);
+  iodine_histogram_add(&iodine_timings.gvl,
+                       handle->timings.gvl - handle->timings.ready);
+  iodine_histogram_add(&iodine_timings.app,
+                       handle->timings.app - handle->timings.gvl);
+  iodine_histogram_add(&iodine_timings.body,
+                       handle->timings.body - handle->timings.app);
+  iodine_histogram_add(&iodine_timings.write, done - handle->timings.body);
+  iodine_histogram_add(&iodine_timings.total, done - received);
+}
+
+/* copies the phases to the request, for the access log (`:log_format`) */
+static void iodine_timings_phases(iodine_http_request_handle_s *handle) {
+#define IODINE_PHASE(a, b)                                                     \
+  ((handle->timings.b - handle->timings.a) > (int64_t)UINT32_MAX               \
+       ? UINT32_MAX                                                            \
+       : (uint32_t)(handle->timings.b - handle->timings.a))
+  handle->h->phases.queue = IODINE_PHASE(received, ready);
+  handle->h->phases.gvl = IODINE_PHASE(ready, gvl);
+  handle->h->phases.app = IODINE_PHASE(gvl, app);
+  handle->h->phases.body = IODINE_PHASE(app, body);
+#undef IODINE_PHASE
+}
+
+/* *****************************************************************************
+Multipart form data (`:multipart`)
+
+The request's `multipart/form-data` body is parsed by the IO thread while it's
+received (see `http_multipart_parts`). Uploaded files are written to named
+temporary files (removed with the request, unless the application moved them),
+so the Rack `params` only require the GVL to create Ruby objects.
+***************************************************************************** */
+
+static inline VALUE iodine_fiobj2str(FIOBJ o) {
+  fio_str_info_s s = fiobj_obj2cstr(o);
+  return rb_enc_str_new(s.data, s.len, IodineUTF8Encoding);
+}
+
+/* returns a Rack uploaded file Hash (`:tempfile`, `:filename`, etc') */
+static VALUE iodine_multipart_file(http_multipart_part_s *part, VALUE env) {
+  static VALUE sym_filename, sym_type, sym_name, sym_tempfile, sym_head;
+  if (!sym_filename) {
+    sym_filename = ID2SYM(rb_intern2("filename", 8));
+    sym_type = ID2SYM(rb_intern2("type", 4));
+    sym_name = ID2SYM(rb_intern2("name", 4));
+    sym_tempfile = ID2SYM(rb_intern2("tempfile", 8));
+    sym_head = ID2SYM(rb_intern2("head", 4));
+  }
+  int fd = rb_cloexec_dup(part->fd);
+  if (fd == -1)
+    rb_sys_fail("(iodine) couldn't open an uploaded file");
+  rb_update_max_fd(fd);
+  VALUE file = rb_io_fdopen(fd, O_RDWR, fiobj_obj2cstr(part->path).data);
+  rb_io_binmode(file);
+  VALUE tmp = rb_hash_lookup2(env, R_TEMPFILES, Qnil);
+  if (tmp == Qnil) {
+    tmp = rb_ary_new();
+    rb_hash_aset(env, R_TEMPFILES, tmp);
+  }
+  rb_ary_push(tmp, file);
+
+  /* the part's (normalized) head */
+  fio_str_info_s name = fiobj_obj2cstr(part->name);
+  fio_str_info_s filename = fiobj_obj2cstr(part->filename);
+  fio_str_info_s type = {.len = 0};
+  if (part->type)
+    type = fiobj_obj2cstr(part->type);
+  VALUE head = rb_sprintf(
+      "Content-Disposition: form-data; name=\"%.*s\"; filename=\"%.*s\"\r\n",
+      (int)name.len, name.data, (int)filename.len, filename.data);
+  if (type.len)
+    rb_str_catf(head, "Content-Type: %.*s\r\n", (int)type.len, type.data);
+
+  VALUE h = rb_hash_new();
+  rb_hash_aset(h, sym_filename, iodine_fiobj2str(part->filename));
+  rb_hash_aset(h, sym_type, (type.len ? iodine_fiobj2str(part->type) : Qnil));
+  rb_hash_aset(h, sym_name, iodine_fiobj2str(part->name));
+  rb_hash_aset(h, sym_tempfile, file);
+  rb_hash_aset(h, sym_head, head);
+  return h;
+}
+
+typedef struct {
+  http_s *h;
+  VALUE env;
+  VALUE params;
+} iodine_multipart_s;
+
+static VALUE iodine_multipart_params_task(VALUE m_) {
+  iodine_multipart_s *m = (iodine_multipart_s *)m_;
+  for (http_multipart_part_s *part = http_multipart_parts(m->h); part;
+       part = part->next) {
+    VALUE value = (part->fd == -1 ? iodine_fiobj2str(part->value)
+                                  : iodine_multipart_file(part, m->env));
+    iodine_rack_normalize_params(m->params, iodine_fiobj2str(part->name),
+                                 value);
+  }
+  return Qnil;
+}
+
+/* adds the `multipart/form-data` params to the env (Rack's form hash) */
+static void iodine_multipart2env(http_s *h, VALUE env, VALUE rack_io) {
+  iodine_multipart_s m = {.h = h, .env = env, .params = rb_hash_new()};
+  int state = 0;
+  rb_protect(iodine_multipart_params_task, (VALUE)&m, &state);
+  if (state) {
+    /* `Rack::Request#POST` raises the error */
+    rb_hash_aset(env, R_FORM_ERROR, rb_errinfo());
+    rb_set_errinfo(Qnil);
+    return;
+  }
+  rb_hash_aset(env, IODINE_R_PARAMS, m.params);
+  /* `Rack::Request#POST` uses the form hash when the input didn't change */
+  rb_hash_aset(env, R_FORM_HASH, m.params);
+  rb_hash_aset(env, R_FORM_INPUT, rack_io);
+  RB_GC_GUARD(m.params);
+}
+
+static inline void iodine_admission_enter(struct iodine_admission_wait_s *wait);
+
+static inline void *iodine_handle_request_in_GVL(void *handle_) {
+  iodine_http_request_handle_s *handle = handle_;
+  http_s *h = handle->h;
+  iodine_admission_enter(handle->wait);
+  if (!h->udata) {
+    h->status = 404;
+    handle->type = IODINE_HTTP_ERROR;
+    return NULL;
+  }
+  if (handle->timed)
+    handle->timings.gvl = iodine_time_us();
+  // create / register env variable
+  VALUE env = copy2env(handle);
+  if (handle->timed)
+    iodine_timings_env(handle, env);
+  // create rack.io
+  VALUE tmp = IodineRackIO.create(h, env);
+  if (h->multipart)
+    iodine_multipart2env(h, env, tmp);
+  // pass env variable to handler
+  VALUE rbresponse =
+      IodineCaller.call2((VALUE)h->udata, iodine_call_proc_id, 1, &env);
+  // close rack.io
+  IodineRackIO.close(tmp);
+  if (handle->timed)
+    handle->timings.app = iodine_time_us();
+  iodine_handle_response_in_GVL(handle, env, rbresponse);
+  if (handle->timed) {
+    handle->timings.body = iodine_time_us();
+    iodine_timings_phases(handle);
+  }
   return NULL;
 }
 
+/* reports a leader request's response to the response cache */
+static void iodine_cache_handle_response(iodine_http_request_handle_s *handle) {
+  fio_str_info_s body = {.data = NULL};
+  switch (handle->type) {
+  case IODINE_HTTP_SENDBODY:
+    body = fiobj_obj2cstr(handle->body);
+    break;
+  case IODINE_HTTP_SENDSTRING:
+    body.data = RSTRING_PTR((VALUE)handle->body);
+    body.len = RSTRING_LEN((VALUE)handle->body);
+    break;
+  case IODINE_HTTP_EMPTY:
+    body.data = (char *)"";
+    break;
+  default:
+    iodine_cache_response(handle->cache, handle->h, NULL);
+    return;
+  }
+  iodine_cache_response(handle->cache, handle->h, &body);
+}
+
 static inline void
 iodine_perform_handle_action(iodine_http_request_handle_s handle) {
+  if (handle.cache)
+    iodine_cache_handle_response(&handle);
   switch (handle.type) {
   case IODINE_HTTP_SENDBODY: {
     fio_str_info_s data = fiobj_obj2cstr(handle.body);
@@ -760,6 +1590,9 @@ iodine_perform_handle_action(iodine_http_request_handle_s handle) {
     fiobj_free(handle.body);
     break;
   }
+  case IODINE_HTTP_SENDSTRING:
+    iodine_http_send_pinned(handle.h, (VALUE)handle.body);
+    break;
   case IODINE_HTTP_XSENDFILE: {
     /* remove chunked content-encoding header, if any (Rack issue #1266) */
     if (fiobj_obj2cstr(
@@ -775,6 +1608,9 @@ iodine_perform_handle_action(iodine_http_request_handle_s handle) {
     fiobj_free(handle.body);
     break;
   }
+  case IODINE_HTTP_SENDFILE:
+    iodine_http_send_file_body(handle.h, (int)handle.body);
+    break;
   case IODINE_HTTP_EMPTY:
     http_finish(handle.h);
     fiobj_free(handle.body);
@@ -788,13 +1624,479 @@ iodine_perform_handle_action(iodine_http_request_handle_s handle) {
     break;
   }
 }
-static void on_rack_request(http_s *h) {
+/* *****************************************************************************
+Load shedding (`:max_concurrent` / `:max_wait`)
+
+Requests are refused (503 Service Unavailable, with a `retry-after` header)
+before entering the GVL when too many Rack requests are active (waiting for
+the GVL, handled by Ruby, or paused by `:fiber` / `:ractors`) or when a request
+waited too long before it was handled (the worker threads are falling behind).
+
+Requests are counted once a worker thread handles them, so `:max_concurrent`
+is a concurrency cap, not a queue length. Requests queued behind busy threads
+are only visible through their queue time (`:max_wait`).
+
+A request's queue time is measured when a worker thread picks it up, so the
+time spent waiting for the GVL would go unnoticed. With `:max_wait`, admitted
+requests are listed until they acquire the GVL, and a request is refused when
+the oldest listed request waited too long.
+***************************************************************************** */
+
+#ifndef IODINE_HTTP_RETRY_AFTER
+/** The `retry-after` value (in seconds) for refused requests. */
+#define IODINE_HTTP_RETRY_AFTER 1
+#endif
+
+/* an admitted request waiting for the GVL */
+typedef struct iodine_admission_wait_s {
+  fio_ls_embd_s node;
+  struct timespec received_at;
+} iodine_admission_wait_s;
+
+static struct {
+  /* Rack requests admitted and not yet answered */
+  volatile size_t active;
+  /* the number of refused requests */
+  volatile size_t shed;
+  /* the lowest value set by any listener applies (0 == disabled) */
+  size_t max_concurrent;
+  /* milliseconds, the lowest value set by any listener applies */
+  size_t max_wait;
+  /* admitted requests waiting for the GVL, oldest `received_at` first */
+  fio_ls_embd_s waiting;
+  fio_lock_i lock;
+} iodine_admission = {.waiting = FIO_LS_INIT(iodine_admission.waiting),
+                      .lock = FIO_LOCK_INIT};
+
+static FIOBJ iodine_retry_after_name;
+static FIOBJ iodine_retry_after_value;
+
+/* milliseconds since `t` (a CLOCK_REALTIME time) */
+static inline int64_t iodine_admission_elapsed(struct timespec *now,
+                                               struct timespec *t) {
+  return ((int64_t)(now->tv_sec - t->tv_sec) * 1000) +
+         ((now->tv_nsec - t->tv_nsec) / 1000000);
+}
+
+static inline int iodine_admission_before(struct timespec *a,
+                                          struct timespec *b) {
+  return a->tv_sec < b->tv_sec ||
+         (a->tv_sec == b->tv_sec && a->tv_nsec < b->tv_nsec);
+}
+
+/*
+ * Returns -1 (after sending a 503 response) if the request is refused.
+ *
+ * If `wait` is set, the admitted request is listed until it's passed to
+ * `iodine_admission_enter` (when it acquires the GVL).
+ */
+static int iodine_http_admit2(http_s *h, iodine_admission_wait_s *wait) {
+  const size_t active = fio_atomic_add(&iodine_admission.active, 1);
+  if (iodine_admission.max_concurrent &&
+      active > iodine_admission.max_concurrent)
+    goto refuse;
+  if (iodine_admission.max_wait) {
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    int64_t waited = iodine_admission_elapsed(&now, &h->received_at);
+    fio_lock(&iodine_admission.lock);
+    if (fio_ls_embd_any(&iodine_admission.waiting)) {
+      /* the GVL is the bottleneck when the oldest waiting request is late */
+      iodine_admission_wait_s *oldest = FIO_LS_EMBD_OBJ(
+          iodine_admission_wait_s, node, iodine_admission.waiting.next);
+      const int64_t tmp = iodine_admission_elapsed(&now, &oldest->received_at);
+      if (tmp > waited)
+        waited = tmp;
+    }
+    if (waited <= (int64_t)iodine_admission.max_wait && wait) {
+      /* requests are usually admitted in order, search from the tail */
+      fio_ls_embd_s *pos = iodine_admission.waiting.prev;
+      wait->received_at = h->received_at;
+      while (pos != &iodine_admission.waiting &&
+             iodine_admission_before(
+                 &h->received_at,
+                 &FIO_LS_EMBD_OBJ(iodine_admission_wait_s, node, pos)
+                      ->received_at))
+        pos = pos->prev;
+      fio_ls_embd_push(pos->next, &wait->node);
+    }
+    fio_unlock(&iodine_admission.lock);
+    if (waited > (int64_t)iodine_admission.max_wait)
+      goto refuse;
+  }
+  return 0;
+refuse:
+  fio_atomic_sub(&iodine_admission.active, 1);
+  fio_atomic_add(&iodine_admission.shed, 1);
+  http_set_header(h, iodine_retry_after_name,
+                  fiobj_dup(iodine_retry_after_value));
+  http_send_error(h, 503);
+  return -1;
+}
+
+/** Returns -1 (after sending a 503 response) if the request is refused. */
+int iodine_http_admit(http_s *h) { return iodine_http_admit2(h, NULL); }
+
+/* removes a request listed by `iodine_http_admit2` (it acquired the GVL) */
+static inline void iodine_admission_enter(iodine_admission_wait_s *wait) {
+  if (!wait || !wait->node.next || wait->node.next == &wait->node)
+    return;
+  fio_lock(&iodine_admission.lock);
+  fio_ls_embd_remove(&wait->node);
+  fio_unlock(&iodine_admission.lock);
+}
+
+/** Marks a request admitted by `iodine_http_admit` as complete. */
+void iodine_http_release(void) {
+  fio_atomic_sub(&iodine_admission.active, 1);
+}
+
+/* *****************************************************************************
+Handling a number of requests per GVL acquisition (`:gvl_batch`)
+
+A thread holding the GVL handles the Ruby side of requests queued by other
+threads before releasing the GVL. The queuing threads wait (outside the GVL)
+and send their own responses. The number of requests handled per GVL
+acquisition is limited (by the `:gvl_batch` value of the draining thread's
+listener), so other callbacks (WebSockets, timers...) aren't starved.
+***************************************************************************** */
+
+#ifndef IODINE_GVL_BATCH_WAIT
+/**
+ * The time (in milliseconds) a queued request waits before competing for the
+ * GVL (the active thread might be waiting for IO with the GVL released).
+ *
+ * A thread stops handling queued requests once this time has passed, so slow
+ * requests don't delay the requests queued after them.
+ */
+#define IODINE_GVL_BATCH_WAIT 2
+#endif
+
+typedef struct iodine_gvl_task_s {
+  iodine_http_request_handle_s *handle;
+  struct iodine_gvl_task_s *next;
+  /* the number of requests handled per GVL acquisition (`:gvl_batch`) */
+  size_t limit;
+  enum {
+    IODINE_GVL_TASK_QUEUED,
+    IODINE_GVL_TASK_ACTIVE,
+    IODINE_GVL_TASK_DONE,
+  } state;
+} iodine_gvl_task_s;
+
+static struct {
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  iodine_gvl_task_s *head;
+  iodine_gvl_task_s **tail;
+  /* the number of threads handling queued requests */
+  size_t active;
+} iodine_gvl_queue = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER,
+    .tail = &iodine_gvl_queue.head,
+};
+
+/* the `:gvl_batch` value of each handler (set before the server starts) */
+typedef struct iodine_gvl_batch_s {
+  struct iodine_gvl_batch_s *next;
+  VALUE handler;
+  size_t limit;
+} iodine_gvl_batch_s;
+
+static iodine_gvl_batch_s *iodine_gvl_batches;
+
+/* returns the handler's `:gvl_batch` value */
+static size_t iodine_gvl_batch_limit(VALUE handler) {
+  iodine_gvl_batch_s *b = iodine_gvl_batches;
+  while (b && b->handler != handler)
+    b = b->next;
+  return (b ? b->limit : 1);
+}
+
+/* sets the handler's `:gvl_batch` value (the highest value applies) */
+static void iodine_gvl_batch_listen(VALUE handler, size_t limit) {
+  iodine_gvl_batch_s *b = iodine_gvl_batches;
+  while (b && b->handler != handler)
+    b = b->next;
+  if (!b) {
+    /* never freed, since the value is read by running requests */
+    b = malloc(sizeof(*b));
+    FIO_ASSERT_ALLOC(b);
+    *b = (iodine_gvl_batch_s){.next = iodine_gvl_batches, .handler = handler};
+    iodine_gvl_batches = b;
+  }
+  if (limit > b->limit)
+    b->limit = limit;
+}
+
+/* call only while holding the lock */
+static iodine_gvl_task_s *iodine_gvl_queue_pop(void) {
+  iodine_gvl_task_s *t = iodine_gvl_queue.head;
+  if (!t)
+    return NULL;
+  iodine_gvl_queue.head = t->next;
+  if (!iodine_gvl_queue.head)
+    iodine_gvl_queue.tail = &iodine_gvl_queue.head;
+  t->state = IODINE_GVL_TASK_ACTIVE;
+  return t;
+}
+
+/* call only while holding the lock */
+static void iodine_gvl_queue_remove(iodine_gvl_task_s *t) {
+  iodine_gvl_task_s **pos = &iodine_gvl_queue.head;
+  while (*pos != t)
+    pos = &(*pos)->next;
+  *pos = t->next;
+  if (iodine_gvl_queue.tail == &t->next)
+    iodine_gvl_queue.tail = pos;
+  t->state = IODINE_GVL_TASK_ACTIVE;
+}
+
+/* milliseconds since `start` */
+static inline int64_t iodine_gvl_queue_elapsed(struct timespec *start) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return ((int64_t)(now.tv_sec - start->tv_sec) * 1000) +
+         ((now.tv_nsec - start->tv_nsec) / 1000000);
+}
+
+/* handles the thread's own request and then queued requests */
+static void *iodine_gvl_queue_drain_in_GVL(void *task_) {
+  iodine_gvl_task_s *task = task_;
+  size_t count = 1;
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  iodine_handle_request_in_GVL(task->handle);
+  pthread_mutex_lock(&iodine_gvl_queue.lock);
+  const size_t limit = task->limit;
+  while (count < limit &&
+         iodine_gvl_queue_elapsed(&start) < IODINE_GVL_BATCH_WAIT &&
+         (task = iodine_gvl_queue_pop())) {
+    pthread_mutex_unlock(&iodine_gvl_queue.lock);
+    iodine_handle_request_in_GVL(task->handle);
+    ++count;
+    pthread_mutex_lock(&iodine_gvl_queue.lock);
+    /* the task is on the waiting thread's stack, don't touch after this */
+    task->state = IODINE_GVL_TASK_DONE;
+    pthread_cond_broadcast(&iodine_gvl_queue.cond);
+  }
+  --iodine_gvl_queue.active;
+  if (iodine_gvl_queue.head && !iodine_gvl_queue.active) {
+    /* limit reached, a waiting thread will take over */
+    pthread_cond_broadcast(&iodine_gvl_queue.cond);
+  }
+  pthread_mutex_unlock(&iodine_gvl_queue.lock);
+  return NULL;
+}
+
+/* handles the Ruby side of the request, possibly using another thread */
+static void iodine_gvl_batch_request(iodine_http_request_handle_s *handle,
+                                     size_t limit) {
+  iodine_gvl_task_s task = {.handle = handle,
+                            .limit = limit,
+                            .state = IODINE_GVL_TASK_QUEUED};
+  pthread_mutex_lock(&iodine_gvl_queue.lock);
+  if (!iodine_gvl_queue.active)
+    goto drain;
+  *iodine_gvl_queue.tail = &task;
+  iodine_gvl_queue.tail = &task.next;
+  struct timespec deadline;
+  clock_gettime(CLOCK_REALTIME, &deadline);
+  deadline.tv_nsec += IODINE_GVL_BATCH_WAIT * 1000000L;
+  if (deadline.tv_nsec >= 1000000000L) {
+    deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+    deadline.tv_nsec %= 1000000000L;
+  }
+  for (;;) {
+    int timeout = 0;
+    if (task.state == IODINE_GVL_TASK_ACTIVE)
+      pthread_cond_wait(&iodine_gvl_queue.cond, &iodine_gvl_queue.lock);
+    else
+      timeout = (pthread_cond_timedwait(&iodine_gvl_queue.cond,
+                                        &iodine_gvl_queue.lock,
+                                        &deadline) == ETIMEDOUT);
+    if (task.state == IODINE_GVL_TASK_DONE) {
+      pthread_mutex_unlock(&iodine_gvl_queue.lock);
+      return;
+    }
+    if (task.state == IODINE_GVL_TASK_QUEUED &&
+        (timeout || !iodine_gvl_queue.active)) {
+      iodine_gvl_queue_remove(&task);
+      goto drain;
+    }
+  }
+drain:
+  ++iodine_gvl_queue.active;
+  pthread_mutex_unlock(&iodine_gvl_queue.lock);
+  IodineCaller.enterGVL(iodine_gvl_queue_drain_in_GVL, &task);
+}
+
+/* *****************************************************************************
+Handling requests within fibers (`:fiber`)
+
+The request is paused (the connection stops reading) while the application
+runs in a non-blocking fiber on the process wide Iodine::Scheduler thread, so
+blocking IO and `sleep` calls suspend the fiber instead of a worker thread.
+
+The response is handled once the request is resumed (within the connection's
+lock), as the `http_s` handle might be gone if the client disconnected.
+***************************************************************************** */
+
+typedef struct {
+  http_pause_handle_s *pause;
+  VALUE app;
+  VALUE env;
+  VALUE rack_io;
+  VALUE response;
+  /* a reference to the request body, for `rack.input` */
+  FIOBJ body;
+} iodine_fiber_request_s;
+
+static void iodine_fiber_request_free(iodine_fiber_request_s *r) {
+  fiobj_free(r->body);
+  fio_free(r);
+}
+
+/* sends the response (the request was resumed) */
+static void *iodine_fiber_request_finish_in_GVL(void *args_) {
+  void **args = args_;
+  iodine_fiber_request_s *r = args[0];
+  iodine_http_request_handle_s *handle = args[1];
+  IodineRackIO.close(r->rack_io);
+  iodine_handle_response_in_GVL(handle, r->env, r->response);
+  IodineStore.remove(r->response);
+  return NULL;
+}
+
+static void iodine_fiber_request_respond(http_s *h) {
+  iodine_fiber_request_s *r = h->udata;
+  iodine_http_request_handle_s handle = {.h = h};
+  void *args[2] = {r, &handle};
+  h->udata = (void *)r->app;
+  IodineCaller.enterGVL(iodine_fiber_request_finish_in_GVL, args);
+  iodine_perform_handle_action(handle);
+  iodine_fiber_request_free(r);
+  iodine_http_release();
+}
+
+/* releases the request's objects (the connection was lost) */
+static void *iodine_fiber_request_abort_in_GVL(void *r_) {
+  iodine_fiber_request_s *r = r_;
+  IodineRackIO.close(r->rack_io);
+  IodineStore.remove(r->response);
+  IodineStore.remove(r->env);
+  return NULL;
+}
+
+static void iodine_fiber_request_abort(void *r_) {
+  IodineCaller.enterGVL(iodine_fiber_request_abort_in_GVL, r_);
+  iodine_fiber_request_free(r_);
+  iodine_http_release();
+}
+
+/* runs within a fiber on the scheduler thread */
+static void iodine_fiber_request_call(void *r_) {
+  iodine_fiber_request_s *r = r_;
+  r->response = IodineCaller.call2(r->app, iodine_call_proc_id, 1, &r->env);
+  if (r->response)
+    IodineStore.add(r->response);
+  http_resume(r->pause, iodine_fiber_request_respond,
+              iodine_fiber_request_abort);
+}
+
+static void iodine_fiber_request_paused(http_pause_handle_s *pause) {
+  iodine_fiber_request_s *r = http_paused_udata_get(pause);
+  r->pause = pause;
+  iodine_scheduler_defer(iodine_fiber_request_call, r);
+}
+
+/* prepares the `env` and pauses the request (or handles a 404 error) */
+static void *iodine_fiber_request_in_GVL(void *handle_) {
+  iodine_http_request_handle_s *handle = handle_;
+  http_s *h = handle->h;
+  iodine_admission_enter(handle->wait);
+  if (!h->udata) {
+    h->status = 404;
+    handle->type = IODINE_HTTP_ERROR;
+    return NULL;
+  }
+  /* (re)starts the scheduler thread after forking */
+  iodine_scheduler_start();
+  iodine_fiber_request_s *r = fio_malloc(sizeof(*r));
+  FIO_ASSERT_ALLOC(r);
+  *r = (iodine_fiber_request_s){
+      .app = (VALUE)h->udata,
+      .body = fiobj_dup(h->body),
+  };
+  r->env = copy2env(handle);
+  r->rack_io = IodineRackIO.create(h, r->env);
+  if (h->multipart)
+    iodine_multipart2env(h, r->env, r->rack_io);
+  /* the socket can't be hijacked while the request is paused */
+  IodineRackIO.detach(r->rack_io);
+  rb_hash_aset(r->env, R_HIJACK_Q, Qfalse);
+  rb_hash_delete(r->env, IODINE_R_HIJACK);
+  h->udata = r;
+  http_pause(h, iodine_fiber_request_paused);
+  handle->type = IODINE_HTTP_NONE;
+  return NULL;
+}
+
+/* *****************************************************************************
+HTTP callbacks
+***************************************************************************** */
+
+static inline void iodine_on_rack_request(http_s *h, uint8_t batch) {
+  iodine_cache_entry_s *cache;
+  iodine_admission_wait_s wait = {.node = {.next = NULL}};
+  if (!iodine_cache_request(h, &cache))
+    return;
+  if (iodine_http_admit2(h, &wait)) {
+    if (cache)
+      iodine_cache_cancel(cache);
+    return;
+  }
   iodine_http_request_handle_s handle = (iodine_http_request_handle_s){
       .h = h,
       .upgrade = IODINE_UPGRADE_NONE,
+      .cache = cache,
+      .wait = &wait,
+      .timed = iodine_timings.enabled,
   };
-  IodineCaller.enterGVL((void *(*)(void *))iodine_handle_request_in_GVL,
-                        &handle);
+  if (handle.timed) {
+    handle.timings.received = iodine_received_us(h);
+    handle.timings.ready = iodine_time_us();
+    handle.timings.proxy = iodine_timing_proxy(h);
+  }
+  if (batch)
+    iodine_gvl_batch_request(&handle,
+                             iodine_gvl_batch_limit((VALUE)h->udata));
+  else
+    IodineCaller.enterGVL((void *(*)(void *))iodine_handle_request_in_GVL,
+                          &handle);
+  iodine_admission_enter(&wait);
+  iodine_perform_handle_action(handle);
+  iodine_http_release();
+  if (handle.timed)
+    iodine_timings_record(&handle);
+}
+
+static void on_rack_request(http_s *h) { iodine_on_rack_request(h, 0); }
+
+static void on_rack_request_batch(http_s *h) { iodine_on_rack_request(h, 1); }
+
+static void on_rack_request_fiber(http_s *h) {
+  iodine_admission_wait_s wait = {.node = {.next = NULL}};
+  if (iodine_http_admit2(h, &wait))
+    return;
+  iodine_http_request_handle_s handle =
+      (iodine_http_request_handle_s){.h = h, .wait = &wait};
+  IodineCaller.enterGVL(iodine_fiber_request_in_GVL, &handle);
+  iodine_admission_enter(&wait);
+  /* paused requests are released once the fiber's response is sent */
+  if (handle.type != IODINE_HTTP_NONE)
+    iodine_http_release();
   iodine_perform_handle_action(handle);
 }
 
@@ -928,6 +2230,21 @@ max_body:: The maximum body size for incoming HTTP messages in bytes. Default: ~
 max_headers:: The maximum total header length for incoming HTTP messages. Default: ~64Kib.
 max_msg:: The maximum Websocket message size allowed. Default: ~250Kib.
 ping:: The Websocket `ping` interval. Default: 40 seconds.
+pipeline:: Pipelined HTTP/1.x requests handled per read (responses are coalesced). Default: 8.
+compress:: Minimal response size for gzip / deflate compression (or `true` for 1Kb). Default: disabled.
+max_body_memory:: Uploads up to this size are kept in memory, larger uploads use an anonymous temporary file. Default: 64Kib.
+stream_input:: Handle large uploads before their body arrives, `rack.input` reads from the socket on demand. Default: false.
+multipart:: Parse `multipart/form-data` bodies while they're received, adding `iodine.params` to the `env` (the body isn't kept). Default: false.
+gvl_batch:: Rack requests (2..255) a thread holding the GVL might handle for other threads before releasing it. Default: disabled.
+fiber:: Run Rack requests within non-blocking fibers (Ruby 3.0+, see {Iodine::Scheduler}), ignoring `stream_input`, `gvl_batch` and `cache`. Default: false.
+ractors:: The number of Ractors (per worker) handling requests for a Ractor shareable `app` (experimental, Ruby 3.0+), ignoring `stream_input`, `gvl_batch`, `fiber`, `cache` and `multipart`. Default: disabled.
+cache:: The number of cacheable responses (`max-age` / `s-maxage`) kept in memory and served without calling the `app` (per worker). Default: disabled.
+cache_vary:: A comma separated list of request headers added to the `cache` key. Default: none.
+max_concurrent:: Rack requests (per worker) handled by the `app` at the same time (including requests waiting for the GVL or paused by `fiber` / `ractors`) before new requests are refused with a 503 response. Queued requests aren't counted, see `max_wait`. Default: disabled.
+max_wait:: The time (in milliseconds) a request may wait before it's handled. Late requests are refused with a 503 response, as are new requests while an admitted request waits longer than this for the GVL. Default: disabled.
+log_path:: The request log destination, a file name, `"syslog"` or `"syslog:<socket path>"` (process wide). Default: `stderr`.
+log_format:: The request log format, `:common` or `:json` (process wide). Default: `:common`.
+timings:: Time each request's phases, adding the `iodine.timings` Hash to the `env` (see {Iodine::HTTP.timing_stats}). Requests handled in `fiber` or `ractors` mode aren't timed. Default: false.
 
 Either the `app` or the `public` properties are required. If niether exists,
 the function will fail. If both exist, Iodine will serve static files as well
@@ -940,34 +2257,113 @@ the static files by saving a compressed version with the `gz` extension (i.e.
 `gzip` will only be served to clients tat support the `gzip` transfer
 encoding.
 
+When `compress` is set, compressible responses (text, JSON, JavaScript, SVG,
+etc') are compressed on the fly (unless a `gz` file exists). Compressed static
+files and responses with a public `cache-control` policy are cached, so the
+same content isn't compressed twice.
+
 Once HTTP/2 is supported (planned, but probably very far away), HTTP/2
 timeouts will be dynamically managed by Iodine. The `timeout` option is only
 relevant to HTTP/1.x connections.
 */
 intptr_t iodine_http_listen(iodine_connection_args_s args){
   // clang-format on
+/* resets an option that doesn't apply to the mode, warning if it was set */
+#define iodine_http_ignore_option(option, mode, name)                          \
+  do {                                                                         \
+    if ((option)) {                                                            \
+      FIO_LOG_WARNING("(listen) the `:" name "` option is ignored when "       \
+                      "`:" mode "` is set.");                                  \
+      (option) = 0;                                                            \
+    }                                                                          \
+  } while (0)
   if (args.public.data) {
     rb_hash_aset(env_template_no_upgrade, XSENDFILE_TYPE, XSENDFILE);
     rb_hash_aset(env_template_no_upgrade, XSENDFILE_TYPE_HEADER, XSENDFILE);
     support_xsendfile = 1;
   }
+  if (args.ractors) {
+    if (iodine_ractor_pool_add(args.handler, args.ractors) == -1) {
+      args.ractors = 0;
+    } else {
+      /* requests are copied and paused while the Ractor handles them */
+      iodine_http_ignore_option(args.stream_input, "ractors", "stream_input");
+      iodine_http_ignore_option(args.gvl_batch, "ractors", "gvl_batch");
+      iodine_http_ignore_option(args.fiber, "ractors", "fiber");
+      iodine_http_ignore_option(args.cache, "ractors", "cache");
+      iodine_http_ignore_option(args.multipart, "ractors", "multipart");
+    }
+  }
+  if (args.fiber) {
+    if (iodine_scheduler_start() == -1) {
+      FIO_LOG_WARNING("(listen) fiber schedulers require Ruby 3.0, ignoring "
+                      "the `:fiber` option.");
+      args.fiber = 0;
+    } else {
+      /* the connection can't be read while the request is paused */
+      iodine_http_ignore_option(args.stream_input, "fiber", "stream_input");
+      iodine_http_ignore_option(args.gvl_batch, "fiber", "gvl_batch");
+      iodine_http_ignore_option(args.cache, "fiber", "cache");
+    }
+  }
+  if (args.cache)
+    iodine_cache_listen(args.handler, args.cache, args.cache_vary);
+  if (args.timings)
+    iodine_timings.enabled = 1;
+  if (args.log_path.data || args.log_format) {
+    char path[1024];
+    if (args.log_path.len >= sizeof(path)) {
+      FIO_LOG_ERROR("(listen) the `:log_path` is too long.");
+      return -1;
+    }
+    if (args.log_path.data) {
+      memcpy(path, args.log_path.data, args.log_path.len);
+      path[args.log_path.len] = 0;
+    }
+    if (http_log_setup((args.log_path.data ? path : NULL),
+                       (http_log_format_e)args.log_format))
+      return -1;
+  }
+  if (args.max_concurrent &&
+      (!iodine_admission.max_concurrent ||
+       args.max_concurrent < iodine_admission.max_concurrent))
+    iodine_admission.max_concurrent = args.max_concurrent;
+  if (args.max_wait && (!iodine_admission.max_wait ||
+                        args.max_wait < iodine_admission.max_wait))
+    iodine_admission.max_wait = args.max_wait;
+  if (args.gvl_batch)
+    iodine_gvl_batch_listen(args.handler, args.gvl_batch);
+  void (*on_request)(http_s *) =
+      (args.gvl_batch ? on_rack_request_batch : on_rack_request);
+  if (args.fiber)
+    on_request = on_rack_request_fiber;
+  if (args.ractors)
+    on_request = iodine_ractor_on_request;
   IodineStore.add(args.handler);
 #ifdef __MINGW32__
   intptr_t uuid = http_listen(
-      args.port.data, args.address.data, .on_request = on_rack_request,
-      .on_upgrade = on_rack_upgrade, .udata = (void *)args.handler,
+      args.port.data, args.address.data, .on_request = on_request,
+      .on_route = iodine_router_on_route, .on_upgrade = on_rack_upgrade,
+      .udata = (void *)args.handler,
       .timeout = args.timeout, .ws_timeout = args.ping,
       .ws_max_msg_size = args.max_msg, .max_header_size = args.max_headers,
       .on_finish = free_iodine_http, .log = args.log,
-      .max_body_size = args.max_body, .public_folder = args.public.data);
+      .max_body_size = args.max_body, .public_folder = args.public.data,
+      .pipeline = args.pipeline, .compress = args.compress,
+      .max_body_memory = args.max_body_memory,
+      .stream_body = args.stream_input, .parse_multipart = args.multipart);
 #else
   intptr_t uuid = http_listen(
-      args.port.data, args.address.data, .on_request = on_rack_request,
-      .on_upgrade = on_rack_upgrade, .udata = (void *)args.handler,
+      args.port.data, args.address.data, .on_request = on_request,
+      .on_route = iodine_router_on_route, .on_upgrade = on_rack_upgrade,
+      .udata = (void *)args.handler,
       .tls = args.tls, .timeout = args.timeout, .ws_timeout = args.ping,
       .ws_max_msg_size = args.max_msg, .max_header_size = args.max_headers,
       .on_finish = free_iodine_http, .log = args.log,
-      .max_body_size = args.max_body, .public_folder = args.public.data);
+      .max_body_size = args.max_body, .public_folder = args.public.data,
+      .pipeline = args.pipeline, .compress = args.compress,
+      .max_body_memory = args.max_body_memory,
+      .stream_body = args.stream_input, .parse_multipart = args.multipart);
 #endif
   if (uuid == -1)
     return uuid;
@@ -983,6 +2379,7 @@ intptr_t iodine_http_listen(iodine_connection_args_s args){
   }
 
   return uuid;
+#undef iodine_http_ignore_option
 }
 
 /* *****************************************************************************
@@ -1115,6 +2512,125 @@ intptr_t iodine_ws_connect(iodine_connection_args_s args) {
   return uuid;
 }
 
+/* *****************************************************************************
+HTTP statistics
+***************************************************************************** */
+
+// clang-format off
+/**
+Returns a Hash with the static file cache statistics for the current process (worker).
+
+Static files served from the `:public` folder are cached per worker. Small files are kept in memory and sent along with the response headers, other files keep an open file descriptor.
+
+The Hash contains the following keys:
+
+files:: the number of cached files (including known missing `gz` variants).
+files_limit:: the maximum number of cached files.
+memory:: the number of bytes used for small files kept in memory.
+memory_limit:: the maximum number of bytes used for small files.
+hits:: the number of lookups answered by the cache.
+misses:: the number of lookups that required file system access.
+*/
+static VALUE iodine_http_static_cache_stats(VALUE self) {
+  // clang-format on
+  http_sendfile_cache_stats_s stats;
+  http_sendfile_cache_stats(&stats);
+  VALUE h = rb_hash_new();
+  rb_hash_aset(h, ID2SYM(rb_intern2("files", 5)), SIZET2NUM(stats.files));
+  rb_hash_aset(h, ID2SYM(rb_intern2("files_limit", 11)),
+               SIZET2NUM(stats.files_limit));
+  rb_hash_aset(h, ID2SYM(rb_intern2("memory", 6)), SIZET2NUM(stats.memory));
+  rb_hash_aset(h, ID2SYM(rb_intern2("memory_limit", 12)),
+               SIZET2NUM(stats.memory_limit));
+  rb_hash_aset(h, ID2SYM(rb_intern2("hits", 4)), SIZET2NUM(stats.hits));
+  rb_hash_aset(h, ID2SYM(rb_intern2("misses", 6)), SIZET2NUM(stats.misses));
+  return h;
+  (void)self;
+}
+
+// clang-format off
+/**
+Returns a Hash with the load shedding statistics for the current process (worker).
+
+Load shedding is enabled using the `:max_concurrent` and `:max_wait` options for {Iodine.listen}. Refused requests receive a 503 response with a `retry-after` header, without entering the GVL.
+
+The Hash contains the following keys:
+
+active:: the number of Rack requests currently handled by the application (including requests waiting for the GVL or paused).
+shed:: the number of requests refused since the process started.
+max_concurrent:: the `:max_concurrent` cap (0 if disabled).
+max_wait:: the `:max_wait` limit in milliseconds (0 if disabled).
+*/
+static VALUE iodine_http_admission_stats(VALUE self) {
+  // clang-format on
+  VALUE h = rb_hash_new();
+  rb_hash_aset(h, ID2SYM(rb_intern2("active", 6)),
+               SIZET2NUM(iodine_admission.active));
+  rb_hash_aset(h, ID2SYM(rb_intern2("shed", 4)),
+               SIZET2NUM(iodine_admission.shed));
+  rb_hash_aset(h, ID2SYM(rb_intern2("max_concurrent", 14)),
+               SIZET2NUM(iodine_admission.max_concurrent));
+  rb_hash_aset(h, ID2SYM(rb_intern2("max_wait", 8)),
+               SIZET2NUM(iodine_admission.max_wait));
+  return h;
+  (void)self;
+}
+
+// clang-format off
+/**
+Returns a Hash with request timing histograms for the current process (worker).
+
+Request timings are collected when the `:timings` option is set for {Iodine.listen} (requests handled in `:fiber` or `:ractors` mode aren't timed). Each phase is reported as a Hash with the `:count` of requests, the `:sum` of the phase's durations (in milliseconds) and the cumulative `:buckets` (the number of requests that took up to `key` milliseconds, the last key is `Float::INFINITY`).
+
+The Hash contains the following phases:
+
+proxy:: the time a request waited for an upstream proxy (requests with an `X-Request-Start` header).
+queue:: the time between receiving the request and dispatching it to the Rack handler (including the upload).
+gvl:: the time spent waiting for the GVL.
+app:: the time spent by the application (including the `env` creation).
+body:: the time spent collecting the response body (within the GVL).
+write:: the time spent sending the response to the IO layer (without waiting for the client).
+total:: the time between receiving the request and the response being sent to the IO layer.
+*/
+static VALUE iodine_http_timing_stats(VALUE self) {
+  // clang-format on
+  VALUE h = rb_hash_new();
+  rb_hash_aset(h, ID2SYM(rb_intern2("proxy", 5)),
+               iodine_histogram2rb(&iodine_timings.proxy));
+  rb_hash_aset(h, ID2SYM(rb_intern2("queue", 5)),
+               iodine_histogram2rb(&iodine_timings.queue));
+  rb_hash_aset(h, ID2SYM(rb_intern2("gvl", 3)),
+               iodine_histogram2rb(&iodine_timings.gvl));
+  rb_hash_aset(h, ID2SYM(rb_intern2("app", 3)),
+               iodine_histogram2rb(&iodine_timings.app));
+  rb_hash_aset(h, ID2SYM(rb_intern2("body", 4)),
+               iodine_histogram2rb(&iodine_timings.body));
+  rb_hash_aset(h, ID2SYM(rb_intern2("write", 5)),
+               iodine_histogram2rb(&iodine_timings.write));
+  rb_hash_aset(h, ID2SYM(rb_intern2("total", 5)),
+               iodine_histogram2rb(&iodine_timings.total));
+  return h;
+  (void)self;
+}
+
+// clang-format off
+/**
+Returns a Hash with the request log statistics for the current process (worker).
+
+lines:: the number of log lines buffered.
+dropped:: the number of log lines dropped because a thread's log buffer was full (the log destination is too slow).
+*/
+static VALUE iodine_http_log_stats(VALUE self) {
+  // clang-format on
+  http_log_stats_s stats;
+  http_log_stats(&stats);
+  VALUE h = rb_hash_new();
+  rb_hash_aset(h, ID2SYM(rb_intern2("lines", 5)), SIZET2NUM(stats.lines));
+  rb_hash_aset(h, ID2SYM(rb_intern2("dropped", 7)), SIZET2NUM(stats.dropped));
+  return h;
+  (void)self;
+}
+
 /* *****************************************************************************
 Initialization
 ***************************************************************************** */
@@ -1132,18 +2648,12 @@ void iodine_init_http(void) {
   rack_autoset(HTTP_VERSION);
   rack_autoset(REMOTE_ADDR);
 
-  rack_autoset(HTTP_ACCEPT);
-  rack_autoset(HTTP_USER_AGENT);
-  rack_autoset(HTTP_ACCEPT_ENCODING);
-  rack_autoset(HTTP_ACCEPT_LANGUAGE);
-  rack_autoset(HTTP_CONNECTION);
-  rack_autoset(HTTP_HOST);
-
   rack_set(HTTP_SCHEME, "http");
   rack_set(HTTPS_SCHEME, "https");
   rack_set(QUERY_ESTRING, "");
   rack_set(R_URL_SCHEME, "rack.url_scheme");
   rack_set(R_INPUT, "rack.input");
+  rack_set(R_HIJACK_Q, "rack.hijack?");
   rack_set(XSENDFILE, "X-Sendfile");
   rack_set(XSENDFILE_TYPE, "sendfile.type");
   rack_set(XSENDFILE_TYPE_HEADER, "HTTP_X_SENDFILE_TYPE");
@@ -1153,6 +2663,12 @@ void iodine_init_http(void) {
   rack_set(IODINE_R_HIJACK_IO, "rack.hijack_io");
   rack_set(IODINE_R_HIJACK, "rack.hijack");
   rack_set(IODINE_R_HIJACK_CB, "iodine.hijack_cb");
+  rack_set(IODINE_R_TIMINGS, "iodine.timings");
+  rack_set(IODINE_R_PARAMS, "iodine.params");
+  rack_set(R_FORM_HASH, "rack.request.form_hash");
+  rack_set(R_FORM_INPUT, "rack.request.form_input");
+  rack_set(R_FORM_ERROR, "rack.request.form_error");
+  rack_set(R_TEMPFILES, "rack.tempfiles");
 
   rack_set(RACK_UPGRADE, "rack.upgrade");
   rack_set(RACK_UPGRADE_Q, "rack.upgrade?");
@@ -1164,6 +2680,8 @@ void iodine_init_http(void) {
   hijack_func_sym = ID2SYM(rb_intern("_hijack"));
   close_method_id = rb_intern("close");
   each_method_id = rb_intern("each");
+  to_ary_method_id = rb_intern("to_ary");
+  to_path_method_id = rb_intern("to_path");
   attach_method_id = rb_intern("attach_fd");
   iodine_call_proc_id = rb_intern("call");
 
@@ -1178,4 +2696,36 @@ void iodine_init_http(void) {
     rb_global_variable(&IODINE_R_INPUT_DEFAULT);
   }
   initialize_env_template();
+
+  /* the prebuilt `retry-after` header, for load shedding */
+  iodine_retry_after_name = fiobj_str_new("retry-after", 11);
+  iodine_retry_after_value = fiobj_num_new(IODINE_HTTP_RETRY_AFTER);
+
+  /* Iodine::Base::RackStream - Rack 3 streaming bodies */
+  IodineRackStreamClass =
+      rb_define_class_under(IodineBaseModule, "RackStream", rb_cObject);
+  rb_undef_alloc_func(IodineRackStreamClass);
+  rb_define_method(IodineRackStreamClass, "write", iodine_http_stream_write_rb,
+                   -1);
+  rb_define_method(IodineRackStreamClass, "<<", iodine_http_stream_push, 1);
+  rb_define_method(IodineRackStreamClass, "flush", iodine_http_stream_flush, 0);
+  rb_define_method(IodineRackStreamClass, "read", iodine_http_stream_read, -1);
+  rb_define_method(IodineRackStreamClass, "close", iodine_http_stream_close, 0);
+  rb_define_method(IodineRackStreamClass, "close_write",
+                   iodine_http_stream_close, 0);
+  rb_define_method(IodineRackStreamClass, "close_read",
+                   iodine_http_stream_close_read, 0);
+  rb_define_method(IodineRackStreamClass, "closed?",
+                   iodine_http_stream_is_closed, 0);
+
+  /* Iodine::HTTP */
+  VALUE IodineHTTPModule = rb_define_module_under(IodineModule, "HTTP");
+  rb_define_module_function(IodineHTTPModule, "static_cache_stats",
+                            iodine_http_static_cache_stats, 0);
+  rb_define_module_function(IodineHTTPModule, "admission_stats",
+                            iodine_http_admission_stats, 0);
+  rb_define_module_function(IodineHTTPModule, "timing_stats",
+                            iodine_http_timing_stats, 0);
+  rb_define_module_function(IodineHTTPModule, "log_stats",
+                            iodine_http_log_stats, 0);
 }
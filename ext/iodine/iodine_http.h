@@ -8,6 +8,8 @@ Feel free to copy, use and enjoy according to the license provided.
 */
 #include "iodine.h"
 
+#include "http.h"
+
 /* these three are used also by rb-rack-io.c */
 extern VALUE IODINE_R_INPUT;
 extern VALUE IODINE_R_INPUT_DEFAULT;
@@ -17,6 +19,17 @@ extern VALUE IODINE_R_HIJACK_CB;
 void iodine_init_http(void);
 
 intptr_t iodine_http_listen(iodine_connection_args_s args);
+
+/**
+ * Load shedding (`:max_concurrent` / `:max_wait`), called before a Rack request
+ * enters the GVL.
+ *
+ * Returns -1 (after sending a 503 response) if the request is refused.
+ * Otherwise `iodine_http_release` must be called once the response was sent.
+ */
+int iodine_http_admit(http_s *h);
+/** Marks a request admitted by `iodine_http_admit` as complete. */
+void iodine_http_release(void);
 // intptr_t iodine_http_connect(iodine_connection_args_s args); // not yet...
 intptr_t iodine_ws_connect(iodine_connection_args_s args);
 
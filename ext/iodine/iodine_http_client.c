@@ -0,0 +1,1562 @@
+/*
+Copyright: Boaz Segev, 2016-2019
+License: MIT
+
+Feel free to copy, use and enjoy according to the license provided.
+*/
+#define FIO_INCLUDE_LINKED_LIST
+#include "iodine_http_client.h"
+
+#include "fiobj4fio.h"
+#include "http1.h"
+
+#include <ruby/version.h>
+
+#include <ctype.h>
+#include <strings.h>
+#include <time.h>
+
+/*
+The Iodine::HTTP::Client class, an HTTP/1.1 client for calling upstream
+services.
+
+Each client keeps a pool of keep-alive connections to its origin. Requests are
+serialized and written by the calling thread and responses are parsed by the
+reactor, so the GVL is only held while a response is handed to Ruby (a waiting
+thread / fiber or a callback block).
+
+Idempotent requests can be pipelined (`:pipeline`) once all the pool's
+connections are busy. Idempotent requests are retried once if their connection
+closed before their response arrived (i.e., a keep-alive connection closed by
+the server).
+
+Request timeouts are enforced by a timer that reviews all the clients while
+requests are pending (every `IODINE_HTTP_CLIENT_TICK` milliseconds).
+*/
+
+#ifndef IODINE_HTTP_CLIENT_BUFFER
+/** Each connection's read buffer (limits the response headers' length). */
+#define IODINE_HTTP_CLIENT_BUFFER (1024 * 16)
+#endif
+
+#ifndef IODINE_HTTP_CLIENT_TICK
+/** The interval (in milliseconds) at which request timeouts are enforced. */
+#define IODINE_HTTP_CLIENT_TICK 50
+#endif
+
+static VALUE IodineHTTPClientClass;
+static VALUE IodineHTTPClientError;
+static VALUE IodineHTTPClientTimeoutError;
+static VALUE IodineQueueClass;
+
+static ID call_id;
+static ID new_id;
+static ID pop_id;
+static ID push_id;
+
+static VALUE body_sym;
+static VALUE headers_sym;
+static VALUE keep_alive_sym;
+static VALUE max_body_sym;
+static VALUE pipeline_sym;
+static VALUE pool_sym;
+static VALUE timeout_sym;
+static VALUE tls_sym;
+
+/* *****************************************************************************
+Types and storage
+***************************************************************************** */
+
+typedef iodine_http_client_s iodine_hc_pool_s;
+
+typedef struct {
+  /* a pool's queue, a connection's in-flight list or a completion list */
+  fio_ls_embd_s node;
+  iodine_hc_pool_s *pool;
+  /* the serialized request (kept for retries) */
+  FIOBJ data;
+  /* C requests: the request body, sent after `data` (or FIOBJ_INVALID) */
+  FIOBJ upload;
+  /* the response headers: an Array of name / value pairs */
+  FIOBJ headers;
+  FIOBJ body;
+  /* a Thread::Queue (a waiting thread / fiber) or a Proc (kept in the store) */
+  VALUE handler;
+  /* C requests: callbacks replace the handler (the response is streamed) */
+  const iodine_http_client_hooks_s *hooks;
+  void *udata;
+  /* microseconds */
+  int64_t started;
+  int64_t deadline;
+  int64_t timeout;
+  uint16_t status;
+  uint8_t error;
+  /* HEAD requests have no response body */
+  uint8_t head;
+  uint8_t idempotent;
+  uint8_t retried;
+  /* C requests: `on_head` was called */
+  uint8_t notified;
+} iodine_hc_request_s;
+
+typedef struct {
+  fio_protocol_s pr;
+  http1_response_parser_s *parser;
+  /* the pool's connection list */
+  fio_ls_embd_s node;
+  /* requests written to the connection, waiting for a response (FIFO) */
+  fio_ls_embd_s inflight;
+  /* responses received by `on_data`, waiting to be handed to Ruby */
+  fio_ls_embd_s done;
+  iodine_hc_pool_s *pool;
+  /* the request whose response is being parsed (only used by `on_data`) */
+  iodine_hc_request_s *current;
+  intptr_t uuid;
+  /* in-flight requests (all / non-idempotent) */
+  size_t count;
+  size_t unsafe;
+  /* responses received */
+  size_t served;
+  /* buffered bytes */
+  size_t len;
+  uint8_t connected;
+  /* no more requests should be sent (`connection: close`) */
+  volatile uint8_t closing;
+  /* a request timed out (or the response was invalid), ignore any data */
+  volatile uint8_t broken;
+  /* the response body ends when the connection closes (no length) */
+  uint8_t until_close;
+  /* a C request asked to stop reading (see `on_body`) */
+  uint8_t throttled;
+  uint8_t error;
+  char buf[IODINE_HTTP_CLIENT_BUFFER + 1];
+} iodine_hc_conn_s;
+
+struct iodine_http_client_s {
+  /* all the pools (reviewed by the timeout timer) */
+  fio_ls_embd_s node;
+  fio_ls_embd_s conns;
+  /* requests waiting for a connection */
+  fio_ls_embd_s queue;
+  /* the serialized `host` header */
+  FIOBJ host;
+  /* the default headers: an Array of (lower case) name / header pairs */
+  FIOBJ headers;
+  /* the origin, for error messages */
+  FIOBJ origin;
+  char *address;
+  char *port;
+  fio_tls_s *tls;
+  size_t ref;
+  /* the maximum number of connections */
+  size_t limit;
+  /* the maximum number of in-flight requests per connection */
+  size_t pipeline;
+  /* milliseconds */
+  size_t timeout;
+  size_t max_body;
+  size_t queued;
+  size_t inflight;
+  /* statistics */
+  size_t requests;
+  size_t responses;
+  size_t errors;
+  size_t timeouts;
+  size_t retries;
+  size_t connects;
+  size_t reused;
+  size_t pipelined;
+  iodine_histogram_s latency;
+  /* seconds */
+  uint8_t keep_alive;
+  uint8_t closed;
+  fio_lock_i lock;
+};
+
+static struct {
+  fio_ls_embd_s pools;
+  /* requests queued or in-flight (all pools) */
+  size_t pending;
+  uint8_t timer;
+  fio_lock_i lock;
+} iodine_hc = {
+    .pools = FIO_LS_INIT(iodine_hc.pools),
+    .lock = FIO_LOCK_INIT,
+};
+
+static inline int64_t iodine_hc_now(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return ((int64_t)t.tv_sec * 1000000) + (t.tv_nsec / 1000);
+}
+
+static void iodine_hc_pool_free(iodine_hc_pool_s *p) {
+  if (fio_atomic_sub(&p->ref, 1))
+    return;
+  fio_lock(&iodine_hc.lock);
+  fio_ls_embd_remove(&p->node);
+  fio_unlock(&iodine_hc.lock);
+  fiobj_free(p->host);
+  fiobj_free(p->headers);
+  fiobj_free(p->origin);
+  fio_free(p->address);
+  fio_free(p->port);
+#ifndef __MINGW32__
+  if (p->tls)
+    fio_tls_destroy(p->tls);
+#endif
+  fio_free(p);
+}
+
+/* *****************************************************************************
+Handing responses to Ruby (or to C hooks)
+***************************************************************************** */
+
+static void iodine_hc_request_free(iodine_hc_request_s *r) {
+  fiobj_free(r->data);
+  fiobj_free(r->upload);
+  fiobj_free(r->headers);
+  fiobj_free(r->body);
+  if (!r->hooks)
+    IodineStore.remove(r->handler);
+  fio_atomic_sub(&iodine_hc.pending, 1);
+  iodine_hc_pool_free(r->pool);
+  fio_free(r);
+}
+
+static VALUE iodine_hc_response2rb(iodine_hc_request_s *r) {
+  VALUE headers = rb_hash_new();
+  const size_t count = fiobj_ary_count(r->headers);
+  for (size_t i = 0; i + 1 < count; i += 2) {
+    fio_str_info_s n = fiobj_obj2cstr(fiobj_ary_index(r->headers, i));
+    fio_str_info_s v = fiobj_obj2cstr(fiobj_ary_index(r->headers, i + 1));
+    VALUE name = rb_utf8_str_new(n.data, n.len);
+    VALUE value = rb_utf8_str_new(v.data, v.len);
+    VALUE old = rb_hash_lookup2(headers, name, Qundef);
+    if (old == Qundef)
+      rb_hash_aset(headers, name, value);
+    else if (RB_TYPE_P(old, T_ARRAY))
+      rb_ary_push(old, value);
+    else
+      rb_hash_aset(headers, name, rb_ary_new_from_args(2, old, value));
+  }
+  fio_str_info_s b = fiobj_obj2cstr(r->body);
+  return rb_ary_new_from_args(3, INT2FIX(r->status), headers,
+                              rb_str_new(b.data, b.len));
+}
+
+static VALUE iodine_hc_error2rb(iodine_hc_request_s *r) {
+  fio_str_info_s o = fiobj_obj2cstr(r->pool->origin);
+  switch ((iodine_http_client_error_e)r->error) {
+  case IODINE_HTTP_CLIENT_E_TIMEOUT:
+    return rb_exc_new_str(IodineHTTPClientTimeoutError,
+                          rb_sprintf("(iodine) request to %.*s timed out",
+                                     (int)o.len, o.data));
+  case IODINE_HTTP_CLIENT_E_CONNECT:
+    return rb_exc_new_str(IodineHTTPClientError,
+                          rb_sprintf("(iodine) couldn't connect to %.*s",
+                                     (int)o.len, o.data));
+  case IODINE_HTTP_CLIENT_E_PROTOCOL:
+    return rb_exc_new_str(IodineHTTPClientError,
+                          rb_sprintf("(iodine) invalid HTTP response from %.*s",
+                                     (int)o.len, o.data));
+  case IODINE_HTTP_CLIENT_E_TOO_LARGE:
+    return rb_exc_new_str(IodineHTTPClientError,
+                          rb_sprintf("(iodine) response from %.*s too large",
+                                     (int)o.len, o.data));
+  case IODINE_HTTP_CLIENT_E_SHUTDOWN:
+    return rb_exc_new_str(IodineHTTPClientError,
+                          rb_sprintf("(iodine) client for %.*s closed",
+                                     (int)o.len, o.data));
+  case IODINE_HTTP_CLIENT_E_CLOSED: /* fallthrough */
+  case IODINE_HTTP_CLIENT_OK:
+    break;
+  }
+  return rb_exc_new_str(
+      IodineHTTPClientError,
+      rb_sprintf("(iodine) connection to %.*s closed before a response",
+                 (int)o.len, o.data));
+}
+
+/* C requests: reports the response headers (once) */
+static inline void iodine_hc_notify_head(iodine_hc_request_s *r) {
+  if (r->notified)
+    return;
+  r->notified = 1;
+  r->hooks->on_head(r->udata, r->status, r->headers);
+}
+
+/* C requests: reports the end of the response (or the error), freeing it */
+static void iodine_hc_notify_done(iodine_hc_request_s *r) {
+  if (!r->error)
+    iodine_hc_notify_head(r);
+  r->hooks->on_done(r->udata, r->error);
+  iodine_hc_request_free(r);
+}
+
+/* hands a list of complete (or failed) requests to Ruby, freeing them */
+static void *iodine_hc_complete_in_GVL(void *list_) {
+  fio_ls_embd_s *list = list_;
+  while (fio_ls_embd_any(list)) {
+    iodine_hc_request_s *r =
+        FIO_LS_EMBD_OBJ(iodine_hc_request_s, node, fio_ls_embd_shift(list));
+    if (r->hooks) {
+      iodine_hc_notify_done(r);
+      continue;
+    }
+    VALUE res = (r->error ? Qnil : iodine_hc_response2rb(r));
+    VALUE err = (r->error ? iodine_hc_error2rb(r) : Qnil);
+    if (rb_obj_is_proc(r->handler) == Qtrue) {
+      VALUE argv[2] = {res, err};
+      IodineCaller.call2(r->handler, call_id, 2, argv);
+    } else {
+      VALUE value = (r->error ? err : res);
+      IodineCaller.call2(r->handler, push_id, 1, &value);
+    }
+    iodine_hc_request_free(r);
+  }
+  return NULL;
+}
+
+/* hands a list of requests to Ruby (called without the GVL) */
+static void iodine_hc_complete(fio_ls_embd_s *list) {
+  fio_ls_embd_s ruby = FIO_LS_INIT(ruby);
+  while (fio_ls_embd_any(list)) {
+    iodine_hc_request_s *r =
+        FIO_LS_EMBD_OBJ(iodine_hc_request_s, node, fio_ls_embd_shift(list));
+    if (r->hooks)
+      iodine_hc_notify_done(r);
+    else
+      fio_ls_embd_push(&ruby, &r->node);
+  }
+  if (fio_ls_embd_any(&ruby))
+    IodineCaller.enterGVL(iodine_hc_complete_in_GVL, &ruby);
+}
+
+/* *****************************************************************************
+Connections
+***************************************************************************** */
+
+static void iodine_hc_on_data(intptr_t uuid, fio_protocol_s *pr);
+static void iodine_hc_on_close(intptr_t uuid, fio_protocol_s *pr);
+static const http1_response_hooks_s IODINE_HC_PARSER_HOOKS;
+static void iodine_hc_ping(intptr_t uuid, fio_protocol_s *pr);
+static uint8_t iodine_hc_on_shutdown(intptr_t uuid, fio_protocol_s *pr);
+static void iodine_hc_on_connect(intptr_t uuid, void *c_);
+static void iodine_hc_on_fail(intptr_t uuid, void *c_);
+
+/* writes a queued request to a connection */
+static void iodine_hc_send_unsafe(iodine_hc_pool_s *p, iodine_hc_conn_s *c,
+                                  iodine_hc_request_s *r) {
+  fio_ls_embd_remove(&r->node);
+  --p->queued;
+  if (c->served || c->count)
+    ++p->reused;
+  if (c->count)
+    ++p->pipelined;
+  fio_ls_embd_push(&c->inflight, &r->node);
+  ++c->count;
+  ++p->inflight;
+  if (!r->idempotent)
+    ++c->unsafe;
+  fiobj_send_free(c->uuid, fiobj_dup(r->data));
+  if (r->upload) {
+    /* file based bodies are sent using `sendfile` (read in chunks for TLS) */
+    const int fd = fiobj_data_fd(r->upload);
+    const int dup_fd = (fd == -1 ? -1 : dup(fd));
+    if (dup_fd == -1)
+      fiobj_send_free(c->uuid, fiobj_dup(r->upload));
+    else
+      fio_sendfile(c->uuid, dup_fd, 0, fiobj_data_len(r->upload));
+  }
+}
+
+/* connects on a reactor thread, the address is resolved outside the lock */
+static void iodine_hc_connect_task(void *c_, void *ignr_) {
+  iodine_hc_conn_s *c = c_;
+  iodine_hc_pool_s *p = c->pool;
+  const size_t timeout = (p->timeout + 999) / 1000;
+  /* connection failures are always reported by `iodine_hc_on_fail` */
+  fio_connect(.address = p->address, .port = p->port,
+              .on_connect = iodine_hc_on_connect, .on_fail = iodine_hc_on_fail,
+              .udata = c, .timeout = (uint8_t)(timeout > 255 ? 255 : timeout)
+#ifndef __MINGW32__
+                              ,
+              .tls = p->tls
+#endif
+  );
+  (void)ignr_;
+}
+
+/* opens a new connection (the connection is listed before it's connected) */
+static void iodine_hc_connect_unsafe(iodine_hc_pool_s *p) {
+  iodine_hc_conn_s *c = fio_malloc(sizeof(*c));
+  FIO_ASSERT_ALLOC(c);
+  *c = (iodine_hc_conn_s){
+      .pr =
+          {
+              .on_data = iodine_hc_on_data,
+              .on_shutdown = iodine_hc_on_shutdown,
+              .on_close = iodine_hc_on_close,
+              .ping = iodine_hc_ping,
+          },
+      .inflight = FIO_LS_INIT(c->inflight),
+      .done = FIO_LS_INIT(c->done),
+      .pool = p,
+      .uuid = -1,
+  };
+  c->parser = http1_response_parser_new(&IODINE_HC_PARSER_HOOKS, c);
+  fio_atomic_add(&p->ref, 1);
+  fio_ls_embd_push(&p->conns, &c->node);
+  /* `fio_connect` might block (DNS), so it's never called with a lock held */
+  fio_defer(iodine_hc_connect_task, c, NULL);
+}
+
+/*
+Assigns queued requests to connections (must be called with the pool locked).
+
+Idle connections are preferred, then new connections. Requests are pipelined
+only when the pool is full.
+*/
+static void iodine_hc_dispatch_unsafe(iodine_hc_pool_s *p) {
+  while (fio_ls_embd_any(&p->queue)) {
+    iodine_hc_request_s *r =
+        FIO_LS_EMBD_OBJ(iodine_hc_request_s, node, p->queue.next);
+    iodine_hc_conn_s *c = NULL;
+    size_t total = 0;
+    FIO_LS_EMBD_FOR(&p->conns, pos) {
+      iodine_hc_conn_s *t = FIO_LS_EMBD_OBJ(iodine_hc_conn_s, node, pos);
+      ++total;
+      if (!t->connected || t->closing || t->broken)
+        continue;
+      if (!t->count) {
+        c = t;
+        break;
+      }
+      if (r->idempotent && !t->unsafe && t->count < p->pipeline &&
+          (!c || t->count < c->count))
+        c = t;
+    }
+    if (!c || (c->count && total < p->limit))
+      break;
+    iodine_hc_send_unsafe(p, c, r);
+  }
+  if (fio_ls_embd_any(&p->queue)) {
+    /* open connections for the requests that weren't assigned */
+    size_t total = 0, pending = 0;
+    FIO_LS_EMBD_FOR(&p->conns, pos) {
+      ++total;
+      pending += !FIO_LS_EMBD_OBJ(iodine_hc_conn_s, node, pos)->connected;
+    }
+    while (total < p->limit && pending < p->queued) {
+      iodine_hc_connect_unsafe(p);
+      ++total;
+      ++pending;
+    }
+  } else if (p->closed) {
+    /* a closed client doesn't keep idle connections */
+    FIO_LS_EMBD_FOR(&p->conns, pos) {
+      iodine_hc_conn_s *t = FIO_LS_EMBD_OBJ(iodine_hc_conn_s, node, pos);
+      if (t->connected && !t->count)
+        fio_close(t->uuid);
+    }
+  }
+}
+
+static void iodine_hc_on_connect(intptr_t uuid, void *c_) {
+  iodine_hc_conn_s *c = c_;
+  iodine_hc_pool_s *p = c->pool;
+  c->uuid = uuid;
+  fio_attach(uuid, &c->pr);
+  fio_timeout_set(uuid, p->keep_alive);
+  fio_lock(&p->lock);
+  c->connected = 1;
+  ++p->connects;
+  iodine_hc_dispatch_unsafe(p);
+  fio_unlock(&p->lock);
+}
+
+/* handles a failed connection on a reactor thread (never on the caller's) */
+static void iodine_hc_on_fail_task(void *c_, void *ignr_) {
+  iodine_hc_conn_s *c = c_;
+  iodine_hc_pool_s *p = c->pool;
+  fio_ls_embd_s done = FIO_LS_INIT(done);
+  fio_lock(&p->lock);
+  fio_ls_embd_remove(&c->node);
+  size_t others = 0;
+  FIO_LS_EMBD_FOR(&p->conns, pos) { ++others; }
+  if (!others) {
+    /* nothing else will handle the queue */
+    while (fio_ls_embd_any(&p->queue)) {
+      iodine_hc_request_s *r = FIO_LS_EMBD_OBJ(iodine_hc_request_s, node,
+                                               fio_ls_embd_shift(&p->queue));
+      --p->queued;
+      ++p->errors;
+      r->error = IODINE_HTTP_CLIENT_E_CONNECT;
+      fio_ls_embd_push(&done, &r->node);
+    }
+  }
+  fio_unlock(&p->lock);
+  if (fio_ls_embd_any(&done))
+    FIO_LOG_WARNING("(HTTP client) couldn't connect to %s:%s", p->address,
+                    p->port);
+  iodine_hc_complete(&done);
+  iodine_hc_pool_free(p);
+  http1_response_parser_free(c->parser);
+  fio_free(c);
+  (void)ignr_;
+}
+
+static void iodine_hc_on_fail(intptr_t uuid, void *c_) {
+  fio_defer(iodine_hc_on_fail_task, c_, NULL);
+  (void)uuid;
+}
+
+static void iodine_hc_on_close(intptr_t uuid, fio_protocol_s *pr) {
+  iodine_hc_conn_s *c = (iodine_hc_conn_s *)pr;
+  iodine_hc_pool_s *p = c->pool;
+  fio_ls_embd_s done = FIO_LS_INIT(done);
+  fio_lock(&p->lock);
+  fio_ls_embd_remove(&c->node);
+  /* retries are placed at the head of the queue, in their original order */
+  while (fio_ls_embd_any(&c->inflight)) {
+    iodine_hc_request_s *r = FIO_LS_EMBD_OBJ(iodine_hc_request_s, node,
+                                             fio_ls_embd_pop(&c->inflight));
+    --p->inflight;
+    if (r->error) {
+      fio_ls_embd_unshift(&done, &r->node);
+    } else if (r == c->current && c->until_close) {
+      ++p->responses;
+      iodine_histogram_add(&p->latency, iodine_hc_now() - r->started);
+      fio_ls_embd_unshift(&done, &r->node);
+    } else if (r->idempotent && !r->retried && !p->closed &&
+               (r != c->current || !r->status)) {
+      r->retried = 1;
+      ++p->retries;
+      ++p->queued;
+      fiobj_free(r->headers);
+      fiobj_free(r->body);
+      r->headers = fiobj_ary_new();
+      r->body = fiobj_str_buf(0);
+      r->status = 0;
+      fio_ls_embd_unshift(&p->queue, &r->node);
+    } else {
+      r->error = IODINE_HTTP_CLIENT_E_CLOSED;
+      ++p->errors;
+      fio_ls_embd_unshift(&done, &r->node);
+    }
+  }
+  iodine_hc_dispatch_unsafe(p);
+  fio_unlock(&p->lock);
+  iodine_hc_complete(&c->done);
+  iodine_hc_complete(&done);
+  iodine_hc_pool_free(p);
+  http1_response_parser_free(c->parser);
+  fio_free(c);
+  (void)uuid;
+}
+
+/* closes idle connections once the keep-alive timeout expired */
+static void iodine_hc_ping(intptr_t uuid, fio_protocol_s *pr) {
+  iodine_hc_conn_s *c = (iodine_hc_conn_s *)pr;
+  fio_lock(&c->pool->lock);
+  const size_t count = c->count;
+  fio_unlock(&c->pool->lock);
+  if (count)
+    fio_touch(uuid); /* request timeouts are reviewed by a timer */
+  else
+    fio_close(uuid);
+}
+
+static uint8_t iodine_hc_on_shutdown(intptr_t uuid, fio_protocol_s *pr) {
+  return 0;
+  (void)uuid;
+  (void)pr;
+}
+
+/* *****************************************************************************
+Parsing responses
+***************************************************************************** */
+
+/* responses that never have a body */
+static inline int iodine_hc_no_body(iodine_hc_request_s *r) {
+  return r->head || r->status < 200 || r->status == 204 || r->status == 304;
+}
+
+/* a response was received, moves it to the completion list */
+static void iodine_hc_response_done(iodine_hc_conn_s *c) {
+  iodine_hc_request_s *r = c->current;
+  iodine_hc_pool_s *p = c->pool;
+  c->current = NULL;
+  fio_lock(&p->lock);
+  if (r->error) {
+    /* timed out, the connection is closing and `on_close` reports it */
+    c->broken = 1;
+    fio_unlock(&p->lock);
+    return;
+  }
+  fio_ls_embd_remove(&r->node);
+  --c->count;
+  --p->inflight;
+  if (!r->idempotent)
+    --c->unsafe;
+  ++c->served;
+  ++p->responses;
+  fio_unlock(&p->lock);
+  iodine_histogram_add(&p->latency, iodine_hc_now() - r->started);
+  fio_ls_embd_push(&c->done, &r->node);
+}
+
+/* discards an informational (1xx) response, returns -1 on error */
+static int iodine_hc_informational(iodine_hc_conn_s *c) {
+  if (c->current->status == 101) {
+    c->error = IODINE_HTTP_CLIENT_E_PROTOCOL;
+    return -1;
+  }
+  fiobj_free(c->current->headers);
+  c->current->headers = fiobj_ary_new();
+  c->current->status = 0;
+  return 0;
+}
+
+static int iodine_hc_on_response(void *c_, int sized) {
+  iodine_hc_conn_s *c = c_;
+  if (!c->current)
+    return -1;
+  if (c->current->status < 200)
+    return iodine_hc_informational(c);
+  if (!sized && !iodine_hc_no_body(c->current)) {
+    /* the body ends when the server closes the connection */
+    c->until_close = 1;
+    c->closing = 1;
+    return 0;
+  }
+  iodine_hc_response_done(c);
+  return 0;
+}
+
+static int iodine_hc_on_status(void *c_, size_t status) {
+  iodine_hc_conn_s *c = c_;
+  if (!c->current || status < 100 || status > 999)
+    return -1;
+  c->current->status = (uint16_t)status;
+  return 0;
+}
+
+static int iodine_hc_on_version(void *c_, char *version, size_t len) {
+  /* HTTP/1.0 connections aren't reused */
+  if (len != 8 || version[7] != '1')
+    ((iodine_hc_conn_s *)c_)->closing = 1;
+  return 0;
+}
+
+static int iodine_hc_on_header(void *c_, char *name, size_t name_len,
+                               char *data, size_t data_len) {
+  iodine_hc_conn_s *c = c_;
+  if (!c->current)
+    return -1;
+  if (name_len == 10 && !memcmp(name, "connection", 10) && data_len &&
+      (data[0] | 32) == 'c')
+    c->closing = 1;
+  fiobj_ary_push(c->current->headers, fiobj_str_new(name, name_len));
+  fiobj_ary_push(c->current->headers, fiobj_str_new(data, data_len));
+  return 0;
+}
+
+/* collects (or streams) a part of the response body, returns -1 on error */
+static int iodine_hc_body(iodine_hc_conn_s *c, char *data, size_t len) {
+  iodine_hc_request_s *r = c->current;
+  if (r->hooks) {
+    iodine_hc_notify_head(r);
+    /* C requests time out when the response stalls */
+    r->deadline = iodine_hc_now() + r->timeout;
+    if (r->hooks->on_body(r->udata, c->uuid, data, len))
+      c->throttled = 1;
+    return 0;
+  }
+  if (fiobj_obj2cstr(r->body).len + len > c->pool->max_body) {
+    c->error = IODINE_HTTP_CLIENT_E_TOO_LARGE;
+    return -1;
+  }
+  fiobj_str_write(r->body, data, len);
+  return 0;
+}
+
+static int iodine_hc_on_body_chunk(void *c_, char *data, size_t len) {
+  iodine_hc_conn_s *c = c_;
+  if (!c->current)
+    return -1;
+  return iodine_hc_body(c, data, len);
+}
+
+static int iodine_hc_on_error(void *c_) {
+  iodine_hc_conn_s *c = c_;
+  if (!c->error)
+    c->error = IODINE_HTTP_CLIENT_E_PROTOCOL;
+  return -1;
+}
+
+/* the response parser is http1.c's, reporting to the connection */
+static const http1_response_hooks_s IODINE_HC_PARSER_HOOKS = {
+    .on_response = iodine_hc_on_response,
+    .on_status = iodine_hc_on_status,
+    .on_version = iodine_hc_on_version,
+    .on_header = iodine_hc_on_header,
+    .on_body_chunk = iodine_hc_on_body_chunk,
+    .on_error = iodine_hc_on_error,
+};
+
+/* returns the length of the response headers (or 0 if incomplete) */
+static size_t iodine_hc_headers_length(char *data, size_t len) {
+  char *pos = data;
+  char *end = data + len;
+  while ((pos = memchr(pos, '\n', end - pos))) {
+    ++pos;
+    if (pos < end && *pos == '\r')
+      ++pos;
+    if (pos >= end)
+      return 0;
+    if (*pos == '\n')
+      return (pos + 1) - data;
+  }
+  return 0;
+}
+
+/* parses the buffered data, returns -1 on error */
+static int iodine_hc_consume(iodine_hc_conn_s *c) {
+  iodine_hc_pool_s *p = c->pool;
+  size_t pos = 0;
+  while (pos < c->len) {
+    if (c->until_close) {
+      if (iodine_hc_body(c, c->buf + pos, c->len - pos))
+        return -1;
+      pos = c->len;
+      break;
+    }
+    if (!c->current) {
+      fio_lock(&p->lock);
+      if (fio_ls_embd_any(&c->inflight))
+        c->current =
+            FIO_LS_EMBD_OBJ(iodine_hc_request_s, node, c->inflight.next);
+      fio_unlock(&p->lock);
+      if (!c->current) {
+        /* data without a request */
+        c->error = IODINE_HTTP_CLIENT_E_PROTOCOL;
+        return -1;
+      }
+    }
+    size_t limit = c->len - pos;
+    if (!http1_response_headers_complete(c->parser)) {
+      /* stop after the headers, since the response might not have a body */
+      size_t tmp = iodine_hc_headers_length(c->buf + pos, limit);
+      if (tmp)
+        limit = tmp;
+    }
+    size_t consumed = http1_response_parse(c->parser, c->buf + pos, limit);
+    if (c->error)
+      return -1;
+    pos += consumed;
+    if (c->current &&
+        http1_response_headers_complete(c->parser) &&
+        iodine_hc_no_body(c->current)) {
+      http1_response_parser_reset(c->parser);
+      if (c->current->status < 200) {
+        /* informational responses precede the final response */
+        if (iodine_hc_informational(c))
+          return -1;
+        continue;
+      }
+      iodine_hc_response_done(c);
+      continue;
+    }
+    if (!consumed)
+      break;
+  }
+  if (pos < c->len)
+    memmove(c->buf, c->buf + pos, c->len - pos);
+  c->len -= pos;
+  return 0;
+}
+
+static void iodine_hc_on_data(intptr_t uuid, fio_protocol_s *pr) {
+  iodine_hc_conn_s *c = (iodine_hc_conn_s *)pr;
+  iodine_hc_pool_s *p = c->pool;
+  ssize_t i;
+  while ((i = fio_read(uuid, c->buf + c->len,
+                       IODINE_HTTP_CLIENT_BUFFER - c->len)) > 0) {
+    if (c->broken)
+      continue;
+    c->len += i;
+    if (iodine_hc_consume(c) || c->len == IODINE_HTTP_CLIENT_BUFFER) {
+      /* the response (or its headers) is invalid, fail it and close */
+      fio_lock(&p->lock);
+      c->broken = 1;
+      if (c->current && !c->current->error) {
+        c->current->error = (c->error ? c->error : IODINE_HTTP_CLIENT_E_PROTOCOL);
+        ++p->errors;
+      }
+      fio_unlock(&p->lock);
+      c->len = 0;
+      fio_close(uuid);
+      break;
+    }
+    if (c->throttled) {
+      /* a resume (`fio_force_event`) waits for `on_data` to return */
+      c->throttled = 0;
+      fio_suspend(uuid);
+      break;
+    }
+  }
+  if (fio_ls_embd_any(&c->done)) {
+    fio_lock(&p->lock);
+    if (c->closing && !c->until_close)
+      fio_close(uuid);
+    iodine_hc_dispatch_unsafe(p);
+    fio_unlock(&p->lock);
+    iodine_hc_complete(&c->done);
+  }
+}
+
+/* *****************************************************************************
+Timeouts
+***************************************************************************** */
+
+static void iodine_hc_review(void *ignr_);
+
+/* starts the timeout timer, unless it's running (requires the global lock) */
+static void iodine_hc_review_schedule_unsafe(void) {
+  if (iodine_hc.timer)
+    return;
+  iodine_hc.timer = 1;
+  fio_run_every(IODINE_HTTP_CLIENT_TICK, 1, iodine_hc_review, NULL, NULL);
+}
+
+/* fails requests that timed out (closing their connections) */
+static void iodine_hc_review(void *ignr_) {
+  fio_ls_embd_s done = FIO_LS_INIT(done);
+  size_t expired = 0;
+  const int64_t now = iodine_hc_now();
+  fio_lock(&iodine_hc.lock);
+  iodine_hc.timer = 0;
+  FIO_LS_EMBD_FOR(&iodine_hc.pools, ppos) {
+    iodine_hc_pool_s *p = FIO_LS_EMBD_OBJ(iodine_hc_pool_s, node, ppos);
+    fio_lock(&p->lock);
+    fio_ls_embd_s *pos = p->queue.next;
+    while (pos != &p->queue) {
+      iodine_hc_request_s *r = FIO_LS_EMBD_OBJ(iodine_hc_request_s, node, pos);
+      pos = pos->next;
+      if (r->deadline > now)
+        continue;
+      fio_ls_embd_remove(&r->node);
+      --p->queued;
+      ++p->errors;
+      ++p->timeouts;
+      r->error = IODINE_HTTP_CLIENT_E_TIMEOUT;
+      fio_ls_embd_push(&done, &r->node);
+      ++expired;
+    }
+    FIO_LS_EMBD_FOR(&p->conns, cpos) {
+      iodine_hc_conn_s *c = FIO_LS_EMBD_OBJ(iodine_hc_conn_s, node, cpos);
+      FIO_LS_EMBD_FOR(&c->inflight, rpos) {
+        iodine_hc_request_s *r =
+            FIO_LS_EMBD_OBJ(iodine_hc_request_s, node, rpos);
+        if (r->error || r->deadline > now)
+          continue;
+        /* the connection can't be reused (responses are ordered) */
+        ++p->errors;
+        ++p->timeouts;
+        r->error = IODINE_HTTP_CLIENT_E_TIMEOUT;
+        c->broken = 1;
+        fio_close(c->uuid);
+      }
+    }
+    fio_unlock(&p->lock);
+  }
+  /* requests in `done` are still pending (until they're freed) */
+  if (iodine_hc.pending > expired)
+    iodine_hc_review_schedule_unsafe();
+  fio_unlock(&iodine_hc.lock);
+  iodine_hc_complete(&done);
+  (void)ignr_;
+}
+
+/* *****************************************************************************
+Serializing requests (within the GVL)
+***************************************************************************** */
+
+static inline int iodine_hc_is_token(const char *s, size_t len) {
+  if (!len)
+    return 0;
+  for (size_t i = 0; i < len; ++i) {
+    const uint8_t c = (uint8_t)s[i];
+    if (c <= 32 || c >= 127 || !(isalnum(c) || strchr("!#$%&'*+-.^_`|~", c)))
+      return 0;
+  }
+  return 1;
+}
+
+static inline int iodine_hc_is_value(const char *s, size_t len) {
+  for (size_t i = 0; i < len; ++i) {
+    if (s[i] == '\r' || s[i] == '\n' || s[i] == 0)
+      return 0;
+  }
+  return 1;
+}
+
+typedef struct {
+  VALUE dest;
+  /* a Hash, collecting the (lower case) header names, or Qnil */
+  VALUE names;
+  /* collects name / header pairs (the default headers), or FIOBJ_INVALID */
+  FIOBJ defaults;
+  uint8_t has_host;
+} iodine_hc_headers_s;
+
+static void iodine_hc_write_header(VALUE dest, VALUE name, VALUE value) {
+  value = rb_obj_as_string(value);
+  if (!iodine_hc_is_value(RSTRING_PTR(value), RSTRING_LEN(value)))
+    rb_raise(rb_eArgError, "(iodine) invalid value for the %" PRIsVALUE
+                           " header.", name);
+  rb_str_buf_append(dest, name);
+  rb_str_cat(dest, ": ", 2);
+  rb_str_buf_append(dest, value);
+  rb_str_cat(dest, "\r\n", 2);
+}
+
+static int iodine_hc_headers_task(VALUE name, VALUE value, VALUE h_) {
+  iodine_hc_headers_s *h = (iodine_hc_headers_s *)h_;
+  if (SYMBOL_P(name))
+    name = rb_sym2str(name);
+  Check_Type(name, T_STRING);
+  const char *n = RSTRING_PTR(name);
+  const size_t len = RSTRING_LEN(name);
+  if (!iodine_hc_is_token(n, len))
+    rb_raise(rb_eArgError, "(iodine) invalid header name %" PRIsVALUE, name);
+  /* the content length is set by the client */
+  if ((len == 14 && !strncasecmp(n, "content-length", 14)) ||
+      (len == 17 && !strncasecmp(n, "transfer-encoding", 17)))
+    return ST_CONTINUE;
+  if (len == 4 && !strncasecmp(n, "host", 4))
+    h->has_host = 1;
+  VALUE dest = h->dest;
+  if (h->defaults != FIOBJ_INVALID)
+    dest = rb_str_buf_new(len + 32);
+  if (RB_TYPE_P(value, T_ARRAY)) {
+    for (long i = 0; i < RARRAY_LEN(value); ++i)
+      iodine_hc_write_header(dest, name, rb_ary_entry(value, i));
+  } else {
+    iodine_hc_write_header(dest, name, value);
+  }
+  if (h->names != Qnil)
+    rb_hash_aset(h->names, rb_funcall2(name, rb_intern2("downcase", 8), 0, NULL),
+                 Qtrue);
+  if (h->defaults != FIOBJ_INVALID) {
+    FIOBJ key = fiobj_str_new(n, len);
+    fio_str_info_s k = fiobj_obj2cstr(key);
+    for (size_t i = 0; i < k.len; ++i)
+      k.data[i] = tolower((uint8_t)k.data[i]);
+    fiobj_ary_push(h->defaults, key);
+    fiobj_ary_push(h->defaults,
+                   fiobj_str_new(RSTRING_PTR(dest), RSTRING_LEN(dest)));
+    RB_GC_GUARD(dest);
+  }
+  return ST_CONTINUE;
+}
+
+/* serializes the headers in a Hash, returns 1 if a `host` was set */
+static uint8_t iodine_hc_write_headers(iodine_hc_headers_s *h, VALUE headers) {
+  if (headers == Qnil)
+    return 0;
+  Check_Type(headers, T_HASH);
+  rb_hash_foreach(headers, iodine_hc_headers_task, (VALUE)h);
+  return h->has_host;
+}
+
+/* *****************************************************************************
+Creating pools
+***************************************************************************** */
+
+/* creates a pool with the default settings, returns NULL if `url` is invalid */
+static iodine_hc_pool_s *iodine_hc_pool_new(const char *url, size_t len,
+                                            fio_tls_s *tls) {
+  fio_url_s u = fio_url_parse(url, len);
+  uint8_t is_secure = 0;
+  if (u.scheme.len == 5 && !strncasecmp(u.scheme.data, "https", 5))
+    is_secure = 1;
+  else if (u.scheme.len &&
+           (u.scheme.len != 4 || strncasecmp(u.scheme.data, "http", 4)))
+    return NULL;
+  if (!u.host.len)
+    return NULL;
+  iodine_hc_pool_s *p = fio_malloc(sizeof(*p));
+  FIO_ASSERT_ALLOC(p);
+  *p = (iodine_hc_pool_s){
+      .conns = FIO_LS_INIT(p->conns),
+      .queue = FIO_LS_INIT(p->queue),
+      .headers = fiobj_ary_new(),
+      .ref = 1,
+      .limit = 8,
+      .pipeline = 1,
+      .timeout = 30000,
+      .max_body = ((size_t)1 << 26),
+      .keep_alive = 10,
+      .lock = FIO_LOCK_INIT,
+  };
+  p->address = fio_malloc(u.host.len + 1);
+  FIO_ASSERT_ALLOC(p->address);
+  memcpy(p->address, u.host.data, u.host.len);
+  p->address[u.host.len] = 0;
+  if (u.port.len) {
+    p->port = fio_malloc(u.port.len + 1);
+    FIO_ASSERT_ALLOC(p->port);
+    memcpy(p->port, u.port.data, u.port.len);
+    p->port[u.port.len] = 0;
+  } else {
+    const char *port = (is_secure ? "443" : "80");
+    p->port = fio_malloc(strlen(port) + 1);
+    FIO_ASSERT_ALLOC(p->port);
+    memcpy(p->port, port, strlen(port) + 1);
+  }
+  p->host = fiobj_str_buf(u.host.len + u.port.len + 9);
+  fiobj_str_write(p->host, "host: ", 6);
+  fiobj_str_write(p->host, u.host.data, u.host.len);
+  if (u.port.len) {
+    fiobj_str_write(p->host, ":", 1);
+    fiobj_str_write(p->host, u.port.data, u.port.len);
+  }
+  fiobj_str_write(p->host, "\r\n", 2);
+  p->origin = fiobj_str_buf(u.host.len + u.port.len + 9);
+  fiobj_str_write(p->origin, (is_secure ? "https://" : "http://"),
+                  (is_secure ? 8 : 7));
+  fiobj_str_write(p->origin, p->address, u.host.len);
+  fiobj_str_write(p->origin, ":", 1);
+  fiobj_str_write(p->origin, p->port, strlen(p->port));
+#ifndef __MINGW32__
+  if (tls) {
+    fio_tls_dup(tls);
+    p->tls = tls;
+  } else if (is_secure) {
+    /* the peer is verified using the system's trusted certificates */
+    p->tls = fio_tls_new(NULL, NULL, NULL, NULL);
+    fio_tls_verify_host(p->tls, p->address);
+  }
+#else
+  if (is_secure)
+    FIO_LOG_WARNING("(HTTP client) TLS isn't supported on this platform.");
+  (void)tls;
+#endif
+  fio_lock(&iodine_hc.lock);
+  fio_ls_embd_push(&iodine_hc.pools, &p->node);
+  fio_unlock(&iodine_hc.lock);
+  return p;
+}
+
+/* queues a request (the pool reference is taken by the caller) */
+static int iodine_hc_enqueue(iodine_hc_pool_s *p, iodine_hc_request_s *r) {
+  fio_lock(&p->lock);
+  if (p->closed) {
+    fio_unlock(&p->lock);
+    return -1;
+  }
+  fio_atomic_add(&p->ref, 1);
+  fio_atomic_add(&iodine_hc.pending, 1);
+  ++p->requests;
+  ++p->queued;
+  fio_ls_embd_push(&p->queue, &r->node);
+  iodine_hc_dispatch_unsafe(p);
+  fio_unlock(&p->lock);
+  fio_lock(&iodine_hc.lock);
+  iodine_hc_review_schedule_unsafe();
+  fio_unlock(&iodine_hc.lock);
+  return 0;
+}
+
+/* marks the pool as closed, closing idle connections */
+static void iodine_hc_pool_close(iodine_hc_pool_s *p) {
+  fio_lock(&p->lock);
+  p->closed = 1;
+  iodine_hc_dispatch_unsafe(p);
+  fio_unlock(&p->lock);
+}
+
+/* *****************************************************************************
+Ruby object
+***************************************************************************** */
+
+static void iodine_hc_data_free(void *p_) {
+  iodine_hc_pool_s **pp = p_;
+  iodine_hc_pool_s *p = pp[0];
+  if (p) {
+    /* pending requests are still handled, idle connections are closed */
+    iodine_hc_pool_close(p);
+    iodine_hc_pool_free(p);
+  }
+  free(pp);
+}
+
+static size_t iodine_hc_data_size(const void *p_) {
+  return sizeof(iodine_hc_pool_s *) + sizeof(iodine_hc_pool_s);
+  (void)p_;
+}
+
+static const rb_data_type_t iodine_hc_data_type = {
+    .wrap_struct_name = "IodineHTTPClientData",
+    .function =
+        {
+            .dmark = NULL,
+            .dfree = iodine_hc_data_free,
+            .dsize = iodine_hc_data_size,
+        },
+    .data = NULL,
+    // .flags = RUBY_TYPED_FREE_IMMEDIATELY,
+};
+
+static VALUE iodine_hc_data_alloc_c(VALUE klass) {
+  iodine_hc_pool_s **pp = malloc(sizeof(*pp));
+  FIO_ASSERT_ALLOC(pp);
+  pp[0] = NULL;
+  return TypedData_Wrap_Struct(klass, &iodine_hc_data_type, pp);
+}
+
+static inline iodine_hc_pool_s *iodine_hc2c(VALUE self) {
+  iodine_hc_pool_s **pp;
+  TypedData_Get_Struct(self, iodine_hc_pool_s *, &iodine_hc_data_type, pp);
+  if (!pp[0])
+    rb_raise(rb_eTypeError, "(iodine) HTTP client wasn't initialized.");
+  return pp[0];
+}
+
+static size_t iodine_hc_size_option(VALUE opt, VALUE sym, size_t def,
+                                    size_t min, size_t max) {
+  VALUE tmp = (opt == Qnil ? Qnil : rb_hash_aref(opt, sym));
+  if (tmp == Qnil)
+    return def;
+  Check_Type(tmp, T_FIXNUM);
+  const long long n = NUM2LL(tmp);
+  if (n < (long long)min || (unsigned long long)n > max)
+    rb_raise(rb_eRangeError, "(iodine) %" PRIsVALUE " out of range.", sym);
+  return (size_t)n;
+}
+
+// clang-format off
+/**
+Creates a new HTTP/1.1 client for the origin in `url` (`http://` or `https://`).
+
+Each client keeps a pool of keep-alive connections to its origin, managed by the iodine reactor (requests are only sent while iodine is running).
+
+The following (optional) settings are supported:
+
+pool:: The maximum number of connections. Default: 8.
+pipeline:: The maximum number of idempotent requests sent through a connection before their responses arrived (HTTP/1.1 pipelining). Requests are pipelined only when all the connections are busy. Default: 1 (no pipelining).
+timeout:: The request timeout in milliseconds (including the time waiting for a connection). Default: 30,000.
+keep_alive:: The number of seconds an idle connection is kept open. Default: 10.
+max_body:: The maximum response body size in bytes. Default: ~64Mib.
+headers:: A Hash of headers sent with every request (unless the request sets a header with the same name).
+tls:: An {Iodine::TLS} object for `https` connections, used as is. When missing, a default client context is created that sends the host name (SNI) and verifies the server's certificate (and host name) using the system's trusted certificates.
+
+    CLIENT = Iodine::HTTP::Client.new("http://localhost:3000", pool: 4, timeout: 2_000)
+*/
+static VALUE iodine_hc_initialize(int argc, VALUE *argv, VALUE self) {
+  // clang-format on
+  VALUE url, opt;
+  rb_scan_args(argc, argv, "11", &url, &opt);
+  Check_Type(url, T_STRING);
+  if (opt != Qnil)
+    Check_Type(opt, T_HASH);
+  iodine_hc_pool_s **pp;
+  TypedData_Get_Struct(self, iodine_hc_pool_s *, &iodine_hc_data_type, pp);
+  if (pp[0])
+    rb_raise(rb_eRuntimeError, "(iodine) HTTP client already initialized.");
+
+  const size_t limit = iodine_hc_size_option(opt, pool_sym, 8, 1, 4096);
+  const size_t pipeline = iodine_hc_size_option(opt, pipeline_sym, 1, 1, 1024);
+  const size_t timeout =
+      iodine_hc_size_option(opt, timeout_sym, 30000, 1, ((size_t)1 << 31));
+  const size_t keep_alive =
+      iodine_hc_size_option(opt, keep_alive_sym, 10, 1, 255);
+  const size_t max_body = iodine_hc_size_option(
+      opt, max_body_sym, ((size_t)1 << 26), 0, ((size_t)1 << 40));
+  VALUE headers = (opt == Qnil ? Qnil : rb_hash_aref(opt, headers_sym));
+  VALUE tls = (opt == Qnil ? Qnil : rb_hash_aref(opt, tls_sym));
+  fio_tls_s *tls_c = NULL;
+#ifndef __MINGW32__
+  if (tls != Qnil)
+    tls_c = iodine_tls2c(tls);
+#else
+  if (tls != Qnil)
+    FIO_LOG_WARNING("(HTTP client) TLS isn't supported on this platform.");
+#endif
+  VALUE dest = rb_str_buf_new(0);
+  iodine_hc_headers_s defaults = {.dest = dest, .names = Qnil};
+  /* validate the headers before allocating the pool */
+  const uint8_t has_host = iodine_hc_write_headers(&defaults, headers);
+
+  iodine_hc_pool_s *p =
+      iodine_hc_pool_new(RSTRING_PTR(url), RSTRING_LEN(url), tls_c);
+  if (!p)
+    rb_raise(rb_eArgError,
+             "(iodine) HTTP client URLs must be http or https (with a host).");
+  p->limit = limit;
+  p->pipeline = pipeline;
+  p->timeout = timeout;
+  p->max_body = max_body;
+  p->keep_alive = (uint8_t)keep_alive;
+  defaults = (iodine_hc_headers_s){
+      .dest = dest, .names = Qnil, .defaults = p->headers};
+  iodine_hc_write_headers(&defaults, headers);
+  if (has_host)
+    fiobj_str_resize(p->host, 0);
+  RB_GC_GUARD(dest);
+  pp[0] = p;
+  return self;
+}
+
+static VALUE iodine_hc_pop(VALUE queue, size_t timeout) {
+#if RUBY_API_VERSION_MAJOR > 3 ||                                              \
+    (RUBY_API_VERSION_MAJOR == 3 && RUBY_API_VERSION_MINOR >= 2)
+  /* a safety net, the request's timeout is enforced by the reactor */
+  VALUE opt = rb_hash_new();
+  rb_hash_aset(opt, timeout_sym, DBL2NUM(((double)timeout / 1000.0) + 1.0));
+  return rb_funcallv_kw(queue, pop_id, 1, &opt, RB_PASS_KEYWORDS);
+#else
+  return rb_funcall2(queue, pop_id, 0, NULL);
+  (void)timeout;
+#endif
+}
+
+// clang-format off
+/**
+Sends an HTTP request, returning the response (`[status, headers, body]`).
+
+    status, headers, body = CLIENT.request("GET", "/users/1", headers: { "accept" => "application/json" })
+
+The `method` is a String (or Symbol) and the `path` should include the query (if any). The following (optional) settings are supported:
+
+headers:: A Hash of request headers (values may be Arrays). The `content-length` is always set by the client.
+body:: The request body (a String).
+timeout:: The request's timeout in milliseconds (overrides the client's timeout).
+
+Response headers are returned as a Hash with lower case names (repeated headers are collected into an Array).
+
+Without a block, the calling thread (or fiber, when a `Fiber.scheduler` is set, i.e., the `:fiber` HTTP option) waits for the response and an {Iodine::HTTP::Client::Error} (or {Iodine::HTTP::Client::TimeoutError}) is raised on failure. Waiting requires an iodine worker thread to be available, so when called from within a Rack application without `:fiber`, {Iodine.threads} should be greater than 1.
+
+With a block, the method returns immediately and the block is called by an iodine thread with the response (or `nil`) and the error (or `nil`):
+
+    CLIENT.request(:get, "/users/1") do |response, error|
+      # ...
+    end
+*/
+static VALUE iodine_hc_request(int argc, VALUE *argv, VALUE self) {
+  // clang-format on
+  VALUE method, path, opt, block;
+  rb_scan_args(argc, argv, "21&", &method, &path, &opt, &block);
+  iodine_hc_pool_s *p = iodine_hc2c(self);
+  if (SYMBOL_P(method))
+    method = rb_sym2str(method);
+  Check_Type(method, T_STRING);
+  Check_Type(path, T_STRING);
+  if (opt != Qnil)
+    Check_Type(opt, T_HASH);
+  if (!fio_is_running())
+    rb_raise(IodineHTTPClientError, "(iodine) iodine isn't running.");
+
+  /* validate the request line */
+  method = rb_funcall2(method, rb_intern2("upcase", 6), 0, NULL);
+  const char *m = RSTRING_PTR(method);
+  const size_t m_len = RSTRING_LEN(method);
+  if (!iodine_hc_is_token(m, m_len))
+    rb_raise(rb_eArgError, "(iodine) invalid HTTP method.");
+  const char *pth = RSTRING_PTR(path);
+  const size_t p_len = RSTRING_LEN(path);
+  if (!p_len || (pth[0] != '/' && (p_len != 1 || pth[0] != '*')))
+    rb_raise(rb_eArgError, "(iodine) the path must start with a '/'.");
+  for (size_t i = 0; i < p_len; ++i) {
+    if ((uint8_t)pth[i] <= 32 || (uint8_t)pth[i] == 127)
+      rb_raise(rb_eArgError, "(iodine) invalid character in the path.");
+  }
+  const uint8_t head = (m_len == 4 && !memcmp(m, "HEAD", 4));
+  const uint8_t idempotent =
+      (head || (m_len == 3 && (!memcmp(m, "GET", 3) || !memcmp(m, "PUT", 3))) ||
+       (m_len == 6 && !memcmp(m, "DELETE", 6)) ||
+       (m_len == 7 && !memcmp(m, "OPTIONS", 7)) ||
+       (m_len == 5 && !memcmp(m, "TRACE", 5)));
+
+  /* serialize the request */
+  VALUE headers = (opt == Qnil ? Qnil : rb_hash_aref(opt, headers_sym));
+  VALUE body = (opt == Qnil ? Qnil : rb_hash_aref(opt, body_sym));
+  const size_t timeout = iodine_hc_size_option(opt, timeout_sym, p->timeout, 1,
+                                               ((size_t)1 << 31));
+  if (body != Qnil)
+    StringValue(body);
+  VALUE dest = rb_str_buf_new(256 + (body == Qnil ? 0 : RSTRING_LEN(body)));
+  rb_str_buf_append(dest, method);
+  rb_str_cat(dest, " ", 1);
+  rb_str_buf_append(dest, path);
+  rb_str_cat(dest, " HTTP/1.1\r\n", 11);
+  const size_t defaults = fiobj_ary_count(p->headers);
+  iodine_hc_headers_s h = {
+      .dest = dest,
+      .names = (defaults ? rb_hash_new() : Qnil),
+      .defaults = FIOBJ_INVALID,
+  };
+  fio_str_info_s tmp;
+  if (!iodine_hc_write_headers(&h, headers)) {
+    tmp = fiobj_obj2cstr(p->host);
+    rb_str_cat(dest, tmp.data, tmp.len);
+  }
+  /* default headers are replaced by request headers with the same name */
+  for (size_t i = 0; i + 1 < defaults; i += 2) {
+    tmp = fiobj_obj2cstr(fiobj_ary_index(p->headers, i));
+    if (h.names != Qnil && RHASH_SIZE(h.names) &&
+        rb_hash_lookup2(h.names, rb_str_new(tmp.data, tmp.len), Qnil) != Qnil)
+      continue;
+    tmp = fiobj_obj2cstr(fiobj_ary_index(p->headers, i + 1));
+    rb_str_cat(dest, tmp.data, tmp.len);
+  }
+  RB_GC_GUARD(h.names);
+  if (body != Qnil || (m_len == 4 && !memcmp(m, "POST", 4)) ||
+      (m_len == 3 && !memcmp(m, "PUT", 3)) ||
+      (m_len == 5 && !memcmp(m, "PATCH", 5))) {
+    rb_str_catf(dest, "content-length: %ld\r\n",
+                (body == Qnil ? 0L : RSTRING_LEN(body)));
+  }
+  rb_str_cat(dest, "\r\n", 2);
+  if (body != Qnil)
+    rb_str_buf_append(dest, body);
+
+  VALUE handler = block;
+  if (handler == Qnil)
+    handler = rb_funcall2(IodineQueueClass, new_id, 0, NULL);
+  iodine_hc_request_s *r = fio_malloc(sizeof(*r));
+  FIO_ASSERT_ALLOC(r);
+  *r = (iodine_hc_request_s){
+      .node = FIO_LS_INIT(r->node),
+      .pool = p,
+      .data = fiobj_str_new(RSTRING_PTR(dest), RSTRING_LEN(dest)),
+      .headers = fiobj_ary_new(),
+      .body = fiobj_str_buf(0),
+      .handler = IodineStore.add(handler),
+      .started = iodine_hc_now(),
+      .timeout = (int64_t)timeout * 1000,
+      .head = head,
+      .idempotent = idempotent,
+  };
+  r->deadline = r->started + r->timeout;
+  RB_GC_GUARD(dest);
+
+  if (iodine_hc_enqueue(p, r)) {
+    fiobj_free(r->data);
+    fiobj_free(r->headers);
+    fiobj_free(r->body);
+    IodineStore.remove(handler);
+    fio_free(r);
+    rb_raise(IodineHTTPClientError, "(iodine) HTTP client closed.");
+  }
+
+  if (block != Qnil)
+    return Qnil;
+  VALUE result = iodine_hc_pop(handler, timeout);
+  RB_GC_GUARD(handler);
+  if (result == Qnil)
+    rb_raise(IodineHTTPClientTimeoutError, "(iodine) request timed out.");
+  if (rb_obj_is_kind_of(result, rb_eException))
+    rb_exc_raise(result);
+  return result;
+}
+
+// clang-format off
+/**
+Closes the client's connections (once their responses arrived). Queued requests fail and new requests raise an exception.
+*/
+static VALUE iodine_hc_close(VALUE self) {
+  // clang-format on
+  iodine_hc_pool_s *p = iodine_hc2c(self);
+  fio_ls_embd_s done = FIO_LS_INIT(done);
+  fio_lock(&p->lock);
+  p->closed = 1;
+  while (fio_ls_embd_any(&p->queue)) {
+    iodine_hc_request_s *r = FIO_LS_EMBD_OBJ(iodine_hc_request_s, node,
+                                             fio_ls_embd_shift(&p->queue));
+    --p->queued;
+    ++p->errors;
+    r->error = IODINE_HTTP_CLIENT_E_SHUTDOWN;
+    fio_ls_embd_push(&done, &r->node);
+  }
+  iodine_hc_dispatch_unsafe(p);
+  fio_unlock(&p->lock);
+  iodine_hc_complete_in_GVL(&done);
+  return self;
+}
+
+// clang-format off
+/**
+Returns a Hash with the client's statistics (for the current process).
+
+connections:: the number of open (or opening) connections.
+idle:: the number of connections without in-flight requests.
+queued:: the number of requests waiting for a connection.
+in_flight:: the number of requests sent, waiting for their response.
+requests:: the number of requests made.
+responses:: the number of responses received.
+errors:: the number of failed requests (including timeouts).
+timeouts:: the number of requests that timed out.
+retries:: the number of requests sent again after their connection closed.
+connects:: the number of connections established.
+reused:: the number of requests sent through a previously used (keep-alive) connection.
+pipelined:: the number of requests sent before the previous response arrived.
+latency:: a response time histogram (see {Iodine::HTTP.timing_stats}), in milliseconds.
+*/
+static VALUE iodine_hc_stats(VALUE self) {
+  // clang-format on
+  return iodine_http_client_stats(iodine_hc2c(self));
+}
+
+/* *****************************************************************************
+C API
+***************************************************************************** */
+
+/** Creates a connection pool for the origin in `url`, or returns NULL. */
+iodine_http_client_s *iodine_http_client_new(const char *url, size_t len,
+                                             size_t limit, size_t timeout) {
+  iodine_hc_pool_s *p = iodine_hc_pool_new(url, len, NULL);
+  if (!p)
+    return NULL;
+  p->limit = (limit ? limit : 1);
+  p->timeout = (timeout ? timeout : 1);
+  return p;
+}
+
+/** Closes the pool (pending requests are completed first) and releases it. */
+void iodine_http_client_free(iodine_http_client_s *client) {
+  if (!client)
+    return;
+  iodine_hc_pool_close(client);
+  iodine_hc_pool_free(client);
+}
+
+/** Sends a serialized request, taking ownership of `request` and `body`. */
+int iodine_http_client_send(iodine_http_client_s *client, FIOBJ request,
+                            FIOBJ body, uint8_t idempotent, uint8_t head,
+                            const iodine_http_client_hooks_s *hooks,
+                            void *udata) {
+  iodine_hc_request_s *r = fio_malloc(sizeof(*r));
+  FIO_ASSERT_ALLOC(r);
+  *r = (iodine_hc_request_s){
+      .node = FIO_LS_INIT(r->node),
+      .pool = client,
+      .data = request,
+      .upload = body,
+      .headers = fiobj_ary_new(),
+      .hooks = hooks,
+      .udata = udata,
+      .started = iodine_hc_now(),
+      .timeout = (int64_t)client->timeout * 1000,
+      .head = head,
+      .idempotent = idempotent,
+  };
+  r->deadline = r->started + r->timeout;
+  if (iodine_hc_enqueue(client, r)) {
+    fiobj_free(r->data);
+    fiobj_free(r->upload);
+    fiobj_free(r->headers);
+    fio_free(r);
+    return -1;
+  }
+  return 0;
+}
+
+/** Returns the number of requests queued or in flight. */
+size_t iodine_http_client_load(iodine_http_client_s *client) {
+  return client->queued + client->inflight;
+}
+
+/** Returns the pool's statistics (see `Client#stats`), requires the GVL. */
+VALUE iodine_http_client_stats(iodine_http_client_s *p) {
+  size_t connections = 0, idle = 0;
+  fio_lock(&p->lock);
+  FIO_LS_EMBD_FOR(&p->conns, pos) {
+    iodine_hc_conn_s *c = FIO_LS_EMBD_OBJ(iodine_hc_conn_s, node, pos);
+    ++connections;
+    idle += (c->connected && !c->count);
+  }
+  const size_t queued = p->queued;
+  const size_t inflight = p->inflight;
+  const size_t requests = p->requests;
+  const size_t responses = p->responses;
+  const size_t errors = p->errors;
+  const size_t timeouts = p->timeouts;
+  const size_t retries = p->retries;
+  const size_t connects = p->connects;
+  const size_t reused = p->reused;
+  const size_t pipelined = p->pipelined;
+  fio_unlock(&p->lock);
+  VALUE h = rb_hash_new();
+  rb_hash_aset(h, ID2SYM(rb_intern2("connections", 11)),
+               SIZET2NUM(connections));
+  rb_hash_aset(h, ID2SYM(rb_intern2("idle", 4)), SIZET2NUM(idle));
+  rb_hash_aset(h, ID2SYM(rb_intern2("queued", 6)), SIZET2NUM(queued));
+  rb_hash_aset(h, ID2SYM(rb_intern2("in_flight", 9)), SIZET2NUM(inflight));
+  rb_hash_aset(h, ID2SYM(rb_intern2("requests", 8)), SIZET2NUM(requests));
+  rb_hash_aset(h, ID2SYM(rb_intern2("responses", 9)), SIZET2NUM(responses));
+  rb_hash_aset(h, ID2SYM(rb_intern2("errors", 6)), SIZET2NUM(errors));
+  rb_hash_aset(h, ID2SYM(rb_intern2("timeouts", 8)), SIZET2NUM(timeouts));
+  rb_hash_aset(h, ID2SYM(rb_intern2("retries", 7)), SIZET2NUM(retries));
+  rb_hash_aset(h, ID2SYM(rb_intern2("connects", 8)), SIZET2NUM(connects));
+  rb_hash_aset(h, ID2SYM(rb_intern2("reused", 6)), SIZET2NUM(reused));
+  rb_hash_aset(h, ID2SYM(rb_intern2("pipelined", 9)), SIZET2NUM(pipelined));
+  rb_hash_aset(h, ID2SYM(rb_intern2("latency", 7)),
+               iodine_histogram2rb(&p->latency));
+  return h;
+}
+
+/* *****************************************************************************
+Initialization
+***************************************************************************** */
+
+/* connections are closed by facil.io, child processes start with fresh stats */
+static void iodine_hc_on_fork(void *ignr_) {
+  iodine_hc.lock = FIO_LOCK_INIT;
+  iodine_hc.timer = 0;
+  FIO_LS_EMBD_FOR(&iodine_hc.pools, pos) {
+    iodine_hc_pool_s *p = FIO_LS_EMBD_OBJ(iodine_hc_pool_s, node, pos);
+    p->lock = FIO_LOCK_INIT;
+    p->requests = p->responses = p->errors = p->timeouts = p->retries =
+        p->connects = p->reused = p->pipelined = 0;
+    p->latency = (iodine_histogram_s){.count = 0};
+  }
+  (void)ignr_;
+}
+
+/** Initializes the HTTP client (`Iodine::HTTP::Client`). */
+void iodine_http_client_init(void) {
+  call_id = rb_intern2("call", 4);
+  new_id = rb_intern2("new", 3);
+  pop_id = rb_intern2("pop", 3);
+  push_id = rb_intern2("push", 4);
+  body_sym = ID2SYM(rb_intern2("body", 4));
+  headers_sym = ID2SYM(rb_intern2("headers", 7));
+  keep_alive_sym = ID2SYM(rb_intern2("keep_alive", 10));
+  max_body_sym = ID2SYM(rb_intern2("max_body", 8));
+  pipeline_sym = ID2SYM(rb_intern2("pipeline", 8));
+  pool_sym = ID2SYM(rb_intern2("pool", 4));
+  timeout_sym = ID2SYM(rb_intern2("timeout", 7));
+  tls_sym = ID2SYM(rb_intern2("tls", 3));
+  IodineQueueClass = rb_path2class("Thread::Queue");
+
+  fio_state_callback_add(FIO_CALL_IN_CHILD, iodine_hc_on_fork, NULL);
+
+  VALUE http = rb_define_module_under(IodineModule, "HTTP");
+  IodineHTTPClientClass = rb_define_class_under(http, "Client", rb_cObject);
+  rb_define_alloc_func(IodineHTTPClientClass, iodine_hc_data_alloc_c);
+  rb_define_method(IodineHTTPClientClass, "initialize", iodine_hc_initialize,
+                   -1);
+  rb_define_method(IodineHTTPClientClass, "request", iodine_hc_request, -1);
+  rb_define_method(IodineHTTPClientClass, "close", iodine_hc_close, 0);
+  rb_define_method(IodineHTTPClientClass, "stats", iodine_hc_stats, 0);
+  /** Raised when a request fails. */
+  IodineHTTPClientError =
+      rb_define_class_under(IodineHTTPClientClass, "Error", rb_eIOError);
+  /** Raised when a request times out. */
+  IodineHTTPClientTimeoutError = rb_define_class_under(
+      IodineHTTPClientClass, "TimeoutError", IodineHTTPClientError);
+}
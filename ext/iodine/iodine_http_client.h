@@ -0,0 +1,85 @@
+#ifndef H_IODINE_HTTP_CLIENT_H
+#define H_IODINE_HTTP_CLIENT_H
+
+#include "iodine.h"
+
+/** Initializes the HTTP client (`Iodine::HTTP::Client`). */
+void iodine_http_client_init(void);
+
+/* *****************************************************************************
+C API (used by the reverse proxy)
+***************************************************************************** */
+
+/** A pool of keep-alive connections to an HTTP/1.1 origin. */
+typedef struct iodine_http_client_s iodine_http_client_s;
+
+/** The reasons a request might fail (`0` marks success). */
+typedef enum {
+  IODINE_HTTP_CLIENT_OK,
+  IODINE_HTTP_CLIENT_E_TIMEOUT,
+  IODINE_HTTP_CLIENT_E_CONNECT,
+  IODINE_HTTP_CLIENT_E_CLOSED,
+  IODINE_HTTP_CLIENT_E_PROTOCOL,
+  IODINE_HTTP_CLIENT_E_TOO_LARGE,
+  IODINE_HTTP_CLIENT_E_SHUTDOWN,
+} iodine_http_client_error_e;
+
+/**
+ * Callbacks for requests sent from C, called by the reactor (without the GVL).
+ *
+ * Responses are streamed: `on_head` is called once the response headers were
+ * received, `on_body` for each part of the body (the body isn't collected) and
+ * `on_done` once the response is complete or failed (`on_done` is always
+ * called, and is the last callback).
+ */
+typedef struct {
+  /** `headers` is an Array of (lower case) name / value pairs. */
+  void (*on_head)(void *udata, size_t status, FIOBJ headers);
+  /**
+   * If `on_body` returns non-zero, the connection (`uuid`) is suspended until
+   * `fio_force_event(uuid, FIO_EVENT_ON_DATA)` is called (possibly before
+   * `on_body` returns).
+   */
+  int (*on_body)(void *udata, intptr_t uuid, char *data, size_t len);
+  /** `error` is an `iodine_http_client_error_e` value. */
+  void (*on_done)(void *udata, int error);
+} iodine_http_client_hooks_s;
+
+/**
+ * Creates a connection pool for the origin in `url` (`http://` or `https://`).
+ *
+ * `limit` is the maximum number of connections and `timeout` is the request
+ * timeout in milliseconds (for C requests, the time allowed between parts of
+ * the response).
+ *
+ * Returns NULL if the URL is invalid.
+ */
+iodine_http_client_s *iodine_http_client_new(const char *url, size_t len,
+                                             size_t limit, size_t timeout);
+
+/**
+ * Closes the pool (pending requests are completed first) and releases it.
+ */
+void iodine_http_client_free(iodine_http_client_s *client);
+
+/**
+ * Sends a serialized request (`request` includes the headers and, possibly,
+ * the body), taking ownership of `request` and `body`.
+ *
+ * `body` (or FIOBJ_INVALID) is sent after the `request`. File based data
+ * objects (`fiobj_data_newtmpfile`) are sent using `sendfile` when possible.
+ *
+ * Returns -1 if the pool was closed (the hooks aren't called).
+ */
+int iodine_http_client_send(iodine_http_client_s *client, FIOBJ request,
+                            FIOBJ body, uint8_t idempotent, uint8_t head,
+                            const iodine_http_client_hooks_s *hooks,
+                            void *udata);
+
+/** Returns the number of requests queued or in flight. */
+size_t iodine_http_client_load(iodine_http_client_s *client);
+
+/** Returns the pool's statistics (see `Client#stats`), requires the GVL. */
+VALUE iodine_http_client_stats(iodine_http_client_s *client);
+
+#endif
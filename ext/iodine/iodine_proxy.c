@@ -0,0 +1,709 @@
+/*
+Copyright: Boaz Segev, 2016-2019
+License: MIT
+
+Feel free to copy, use and enjoy according to the license provided.
+*/
+#include "iodine_proxy.h"
+
+#include "http_internal.h"
+#include "iodine_http_client.h"
+
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+/*
+The reverse proxy (`Iodine::Router.proxy`).
+
+Proxy routes forward requests to a list of upstream origins, each with its own
+pool of keep-alive connections (see `iodine_http_client.h`). Everything happens
+on the IO threads, Ruby isn't involved.
+
+The client's request is paused while the upstream handles it. The upstream's
+response is streamed back as it arrives: each part of the body is buffered and
+the client's request is resumed to send it. When the client lags behind (or
+the buffer is full), the upstream connection is suspended until the client's
+socket drains.
+
+Request bodies stored in temporary files (large uploads) are forwarded using
+`sendfile` when the upstream doesn't use TLS. Bodies that are still streamed
+from the client (`stream_body`) are refused, since reading them would block the
+IO thread.
+
+Upstreams are selected using round-robin or least-connections. Connection
+errors and timeouts are counted (passive health checks) and an upstream that
+failed `max_fails` times in a row is skipped for `fail_timeout` seconds. A
+suspended upstream that times out is waiting for the client, so it isn't
+counted as a failure.
+*/
+
+#ifndef IODINE_PROXY_BUFFER
+/** Buffered response bytes (per request) before the upstream is suspended. */
+#define IODINE_PROXY_BUFFER (1024 * 256)
+#endif
+
+#ifndef IODINE_PROXY_PENDING
+/** Outgoing packets waiting in the client's socket before it's considered slow. */
+#define IODINE_PROXY_PENDING 16
+#endif
+
+#ifndef IODINE_PROXY_TICK
+/** The interval (in milliseconds) at which slow clients are reviewed. */
+#define IODINE_PROXY_TICK 10
+#endif
+
+/* *****************************************************************************
+Types
+***************************************************************************** */
+
+typedef struct {
+  iodine_http_client_s *client;
+  FIOBJ url;
+  /* consecutive failures */
+  volatile size_t fails;
+  /* the time (in milliseconds) until which the upstream is skipped */
+  volatile int64_t down_until;
+  /* the number of times the upstream was marked as down */
+  volatile size_t ejections;
+} iodine_proxy_upstream_s;
+
+struct iodine_proxy_s {
+  iodine_proxy_upstream_s *upstreams;
+  size_t count;
+  /* round-robin position */
+  volatile size_t next;
+  size_t max_fails;
+  /* milliseconds */
+  int64_t fail_timeout;
+  uint8_t least_conn;
+  uint8_t strip_prefix;
+};
+
+typedef struct {
+  iodine_proxy_s *proxy;
+  iodine_proxy_upstream_s *upstream;
+  /* the paused client request, NULL while it's being resumed (or handled) */
+  http_pause_handle_s *handle;
+  /* the request's `udata`, restored whenever the request is resumed */
+  void *udata;
+  /* the serialized request (and body), kept for retries */
+  FIOBJ request;
+  FIOBJ upload;
+  /* the upstream response headers: an Array of name / value pairs */
+  FIOBJ headers;
+  /* response data waiting to be sent to the client */
+  FIOBJ body;
+  /* the client's socket */
+  intptr_t client;
+  /* a suspended upstream connection, or -1 */
+  intptr_t throttled;
+  volatile size_t ref;
+  /* the number of upstreams that refused the connection */
+  size_t tries;
+  uint16_t status;
+  uint8_t error;
+  uint8_t head;
+  uint8_t idempotent;
+  /* the request was sent to the upstream's pool */
+  uint8_t forwarded;
+  /* the response headers were received */
+  uint8_t ready;
+  /* the response is complete (or failed) */
+  uint8_t done;
+  /* the response headers were sent (only accessed by the client's thread) */
+  uint8_t sent;
+  /* the client disconnected */
+  uint8_t gone;
+  /* a timer is waiting for the client's socket to drain */
+  uint8_t draining;
+  fio_lock_i lock;
+} iodine_proxy_req_s;
+
+static inline int64_t iodine_proxy_now(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return ((int64_t)t.tv_sec * 1000) + (t.tv_nsec / 1000000);
+}
+
+static void iodine_proxy_req_free(iodine_proxy_req_s *pr) {
+  if (fio_atomic_sub(&pr->ref, 1))
+    return;
+  fiobj_free(pr->request);
+  fiobj_free(pr->upload);
+  fiobj_free(pr->headers);
+  fiobj_free(pr->body);
+  fio_free(pr);
+}
+
+/* headers that describe a single connection and aren't forwarded */
+static inline int iodine_proxy_hop_by_hop(fio_str_info_s n) {
+  switch (n.len) {
+  case 2:
+    return !memcmp(n.data, "te", 2);
+  case 7:
+    return !memcmp(n.data, "trailer", 7) || !memcmp(n.data, "upgrade", 7);
+  case 10:
+    return !memcmp(n.data, "connection", 10) ||
+           !memcmp(n.data, "keep-alive", 10);
+  case 16:
+    return !memcmp(n.data, "proxy-connection", 16);
+  case 17:
+    return !memcmp(n.data, "transfer-encoding", 17);
+  }
+  return 0;
+}
+
+/* *****************************************************************************
+Sending the response to the client
+***************************************************************************** */
+
+static void iodine_proxy_write(http_s *h);
+static void iodine_proxy_gone(void *pr_);
+static void iodine_proxy_on_pause(http_pause_handle_s *handle);
+
+/* resumes the client's request if there's anything to send */
+static void iodine_proxy_flush(iodine_proxy_req_s *pr) {
+  http_pause_handle_s *handle = NULL;
+  fio_lock(&pr->lock);
+  if (pr->handle && (pr->body || pr->done || (pr->ready && !pr->sent))) {
+    handle = pr->handle;
+    pr->handle = NULL;
+  }
+  fio_unlock(&pr->lock);
+  if (handle)
+    http_resume(handle, iodine_proxy_write, iodine_proxy_gone);
+}
+
+/* a slow client's socket is reviewed until it drains */
+static void iodine_proxy_drain(void *pr_);
+
+/* resumes a suspended upstream once the client is ready for more data */
+static void iodine_proxy_unthrottle(iodine_proxy_req_s *pr) {
+  intptr_t uuid = -1;
+  uint8_t wait = 0;
+  fio_lock(&pr->lock);
+  if (pr->throttled != -1 && !pr->body) {
+    if (pr->gone || fio_pending(pr->client) <= IODINE_PROXY_PENDING) {
+      uuid = pr->throttled;
+      pr->throttled = -1;
+    } else if (!pr->draining) {
+      pr->draining = 1;
+      fio_atomic_add(&pr->ref, 1);
+      wait = 1;
+    }
+  }
+  fio_unlock(&pr->lock);
+  if (uuid != -1)
+    fio_force_event(uuid, FIO_EVENT_ON_DATA);
+  if (wait)
+    fio_run_every(IODINE_PROXY_TICK, 1, iodine_proxy_drain, pr, NULL);
+}
+
+static void iodine_proxy_drain(void *pr_) {
+  iodine_proxy_req_s *pr = pr_;
+  fio_lock(&pr->lock);
+  pr->draining = 0;
+  fio_unlock(&pr->lock);
+  iodine_proxy_unthrottle(pr);
+  iodine_proxy_req_free(pr);
+}
+
+/* the client disconnected while the request was paused */
+static void iodine_proxy_gone(void *pr_) {
+  iodine_proxy_req_s *pr = pr_;
+  fio_lock(&pr->lock);
+  pr->gone = 1;
+  fiobj_free(pr->body);
+  pr->body = FIOBJ_INVALID;
+  fio_unlock(&pr->lock);
+  /* the upstream response is read (and ignored) until it's complete */
+  iodine_proxy_unthrottle(pr);
+  iodine_proxy_req_free(pr);
+}
+
+/* sends the response headers and any available data (the request resumed) */
+static void iodine_proxy_write(http_s *h) {
+  iodine_proxy_req_s *pr = h->udata;
+  h->udata = pr->udata;
+  fio_lock(&pr->lock);
+  FIOBJ body = pr->body;
+  pr->body = FIOBJ_INVALID;
+  const uint8_t ready = pr->ready;
+  const uint8_t done = pr->done;
+  const uint8_t error = pr->error;
+  fio_unlock(&pr->lock);
+  if (!pr->sent) {
+    if (!ready) {
+      /* the upstream failed before responding */
+      fiobj_free(body);
+      http_send_error(h, (error == IODINE_HTTP_CLIENT_E_TIMEOUT ? 504 : 502));
+      iodine_proxy_req_free(pr);
+      return;
+    }
+    pr->sent = 1;
+    h->status = pr->status;
+    for (size_t i = 0, count = fiobj_ary_count(pr->headers); i + 1 < count;
+         i += 2) {
+      FIOBJ name = fiobj_ary_index(pr->headers, i);
+      if (iodine_proxy_hop_by_hop(fiobj_obj2cstr(name)))
+        continue;
+      http_set_header(h, name, fiobj_dup(fiobj_ary_index(pr->headers, i + 1)));
+    }
+  }
+  if (body) {
+    fio_str_info_s b = fiobj_obj2cstr(body);
+    http_stream(h, b.data, b.len);
+    fiobj_free(body);
+  }
+  if (done) {
+    if (error) {
+      /* the response is incomplete, the client must know it's broken */
+      fio_force_close(http_hijack(h, NULL));
+    }
+    http_finish(h);
+    iodine_proxy_req_free(pr);
+    return;
+  }
+  iodine_proxy_unthrottle(pr);
+  h->udata = pr;
+  http_pause(h, iodine_proxy_on_pause);
+}
+
+/* *****************************************************************************
+Upstream callbacks (called by the reactor, on the upstream's connection)
+***************************************************************************** */
+
+static void iodine_proxy_on_head(void *pr_, size_t status, FIOBJ headers) {
+  iodine_proxy_req_s *pr = pr_;
+  fio_lock(&pr->lock);
+  pr->status = (uint16_t)status;
+  pr->headers = fiobj_dup(headers);
+  pr->ready = 1;
+  fio_unlock(&pr->lock);
+  iodine_proxy_flush(pr);
+}
+
+static int iodine_proxy_on_body(void *pr_, intptr_t uuid, char *data,
+                                size_t len) {
+  iodine_proxy_req_s *pr = pr_;
+  int throttle = 0;
+  fio_lock(&pr->lock);
+  if (!pr->gone) {
+    if (!pr->body)
+      pr->body = fiobj_str_buf(len);
+    fiobj_str_write(pr->body, data, len);
+    if (fiobj_obj2cstr(pr->body).len >= IODINE_PROXY_BUFFER ||
+        fio_pending(pr->client) > IODINE_PROXY_PENDING) {
+      pr->throttled = uuid;
+      throttle = 1;
+    }
+  }
+  fio_unlock(&pr->lock);
+  iodine_proxy_flush(pr);
+  return throttle;
+}
+
+static iodine_proxy_upstream_s *iodine_proxy_pick(iodine_proxy_s *p,
+                                                  iodine_proxy_upstream_s *avoid);
+static int iodine_proxy_forward(iodine_proxy_req_s *pr);
+
+static void iodine_proxy_on_done(void *pr_, int error) {
+  iodine_proxy_req_s *pr = pr_;
+  iodine_proxy_upstream_s *u = pr->upstream;
+  /* a suspended upstream timing out is waiting for a slow client */
+  fio_lock(&pr->lock);
+  const uint8_t throttled = (pr->throttled != -1);
+  fio_unlock(&pr->lock);
+  /* passive health checks */
+  switch ((iodine_http_client_error_e)error) {
+  case IODINE_HTTP_CLIENT_OK:
+    u->fails = 0;
+    break;
+  case IODINE_HTTP_CLIENT_E_TIMEOUT:
+    if (throttled)
+      break;
+    /* fallthrough */
+  case IODINE_HTTP_CLIENT_E_CONNECT: /* fallthrough */
+  case IODINE_HTTP_CLIENT_E_CLOSED:  /* fallthrough */
+  case IODINE_HTTP_CLIENT_E_PROTOCOL: /* fallthrough */
+    if (pr->proxy->max_fails &&
+        fio_atomic_add(&u->fails, 1) >= pr->proxy->max_fails) {
+      u->fails = 0;
+      u->down_until = iodine_proxy_now() + pr->proxy->fail_timeout;
+      fio_atomic_add(&u->ejections, 1);
+      fio_str_info_s url = fiobj_obj2cstr(u->url);
+      FIO_LOG_WARNING("(proxy) upstream %s is down for %lld ms.", url.data,
+                      (long long)pr->proxy->fail_timeout);
+    }
+    break;
+  case IODINE_HTTP_CLIENT_E_TOO_LARGE: /* fallthrough */
+  case IODINE_HTTP_CLIENT_E_SHUTDOWN:
+    break;
+  }
+  if (error == IODINE_HTTP_CLIENT_E_CONNECT && !pr->gone &&
+      ++pr->tries < pr->proxy->count) {
+    /* nothing was sent, try the next upstream */
+    pr->upstream = iodine_proxy_pick(pr->proxy, u);
+    if (!iodine_proxy_forward(pr))
+      return;
+  }
+  fio_lock(&pr->lock);
+  pr->done = 1;
+  pr->error = (uint8_t)error;
+  fio_unlock(&pr->lock);
+  iodine_proxy_flush(pr);
+  iodine_proxy_req_free(pr);
+}
+
+static const iodine_http_client_hooks_s IODINE_PROXY_HOOKS = {
+    .on_head = iodine_proxy_on_head,
+    .on_body = iodine_proxy_on_body,
+    .on_done = iodine_proxy_on_done,
+};
+
+/* sends the request to the selected upstream */
+static int iodine_proxy_forward(iodine_proxy_req_s *pr) {
+  return iodine_http_client_send(
+      pr->upstream->client, fiobj_dup(pr->request), fiobj_dup(pr->upload),
+      pr->idempotent, pr->head, &IODINE_PROXY_HOOKS, pr);
+}
+
+/* the request was paused, send it upstream (on the first pause) */
+static void iodine_proxy_on_pause(http_pause_handle_s *handle) {
+  iodine_proxy_req_s *pr = http_paused_udata_get(handle);
+  fio_lock(&pr->lock);
+  pr->handle = handle;
+  const uint8_t forward = !pr->forwarded;
+  pr->forwarded = 1;
+  fio_unlock(&pr->lock);
+  if (forward && iodine_proxy_forward(pr)) {
+    /* the pool was closed (the server is shutting down) */
+    iodine_proxy_on_done(pr, IODINE_HTTP_CLIENT_E_SHUTDOWN);
+    return;
+  }
+  iodine_proxy_flush(pr);
+}
+
+/* *****************************************************************************
+Forwarding requests
+***************************************************************************** */
+
+/* selects an upstream, skipping upstreams marked as down (and `avoid`) */
+static iodine_proxy_upstream_s *iodine_proxy_pick(iodine_proxy_s *p,
+                                                  iodine_proxy_upstream_s *avoid) {
+  const int64_t now = iodine_proxy_now();
+  const size_t start = fio_atomic_add(&p->next, 1);
+  iodine_proxy_upstream_s *best = NULL;
+  for (size_t i = 0; i < p->count; ++i) {
+    iodine_proxy_upstream_s *u = p->upstreams + ((start + i) % p->count);
+    if (u == avoid || u->down_until > now)
+      continue;
+    if (!p->least_conn)
+      return u;
+    if (!best || iodine_http_client_load(u->client) <
+                     iodine_http_client_load(best->client))
+      best = u;
+  }
+  if (!best) /* all the upstreams are down, try anyway */
+    best = p->upstreams +
+           ((avoid ? (size_t)(avoid - p->upstreams) + 1 : start) % p->count);
+  return best;
+}
+
+typedef struct {
+  FIOBJ dest;
+  /* the client's `x-forwarded-for` header */
+  FIOBJ forwarded;
+  /* the client's `connection` header, listing more hop-by-hop headers */
+  FIOBJ connection;
+} iodine_proxy_serialize_s;
+
+/* tests if a `connection` header value lists the header (RFC 7230 6.1) */
+static int iodine_proxy_connection_lists(fio_str_info_s v, fio_str_info_s n) {
+  const char *end = v.data + v.len;
+  const char *pos = v.data;
+  while (pos < end) {
+    while (pos < end && (*pos == ' ' || *pos == '\t' || *pos == ','))
+      ++pos;
+    const char *token = pos;
+    while (pos < end && *pos != ',' && *pos != ' ' && *pos != '\t')
+      ++pos;
+    if ((size_t)(pos - token) == n.len && !strncasecmp(token, n.data, n.len))
+      return 1;
+  }
+  return 0;
+}
+
+/* tests if the header is listed by any of the `connection` header values */
+static int iodine_proxy_connection_header(FIOBJ connection, fio_str_info_s n) {
+  if (!connection)
+    return 0;
+  if (!FIOBJ_TYPE_IS(connection, FIOBJ_T_ARRAY))
+    return iodine_proxy_connection_lists(fiobj_obj2cstr(connection), n);
+  const size_t count = fiobj_ary_count(connection);
+  for (size_t i = 0; i < count; ++i) {
+    if (iodine_proxy_connection_lists(
+            fiobj_obj2cstr(fiobj_ary_index(connection, i)), n))
+      return 1;
+  }
+  return 0;
+}
+
+static int iodine_proxy_header_task(FIOBJ value, void *s_) {
+  iodine_proxy_serialize_s *s = s_;
+  FIOBJ name = fiobj_hash_key_in_loop();
+  fio_str_info_s n = fiobj_obj2cstr(name);
+  if (iodine_proxy_hop_by_hop(n) ||
+      iodine_proxy_connection_header(s->connection, n) ||
+      (n.len == 14 && !memcmp(n.data, "content-length", 14)) ||
+      (n.len == 6 && !memcmp(n.data, "expect", 6)))
+    return 0;
+  if (n.len == 15 && !memcmp(n.data, "x-forwarded-for", 15)) {
+    s->forwarded = value;
+    return 0;
+  }
+  const size_t count =
+      (FIOBJ_TYPE_IS(value, FIOBJ_T_ARRAY) ? fiobj_ary_count(value) : 1);
+  for (size_t i = 0; i < count; ++i) {
+    fio_str_info_s v = fiobj_obj2cstr(
+        FIOBJ_TYPE_IS(value, FIOBJ_T_ARRAY) ? fiobj_ary_index(value, i)
+                                            : value);
+    fiobj_str_write(s->dest, n.data, n.len);
+    fiobj_str_write(s->dest, ": ", 2);
+    fiobj_str_write(s->dest, v.data, v.len);
+    fiobj_str_write(s->dest, "\r\n", 2);
+  }
+  return 0;
+}
+
+/**
+ * Forwards the request to an upstream (called from an IO thread, without the
+ * GVL). Returns -1 if the request should be handled normally.
+ */
+int iodine_proxy_request(iodine_proxy_s *proxy, http_s *h, size_t prefix_len) {
+  static uint64_t cl_hash = 0;
+  static uint64_t te_hash = 0;
+  static uint64_t connection_hash = 0;
+  if (!cl_hash) {
+    cl_hash = fiobj_hash_string("content-length", 14);
+    te_hash = fiobj_hash_string("transfer-encoding", 17);
+    connection_hash = fiobj_hash_string("connection", 10);
+  }
+  intptr_t body_len = 0;
+  if (h->body && http_body_read(h, NULL, 0) > 0) {
+    /* a streamed body (`stream_body`) would be read by blocking the IO thread */
+    http_send_error(h, 413);
+    return 0;
+  }
+  if (h->body) {
+    body_len = fiobj_data_len(h->body);
+  } else if (fiobj_hash_get2(h->headers, te_hash) ||
+             (fiobj_hash_get2(h->headers, cl_hash) &&
+              fiobj_obj2num(fiobj_hash_get2(h->headers, cl_hash)))) {
+    /* the body was consumed (`:multipart`) or is streamed (`stream_body`) */
+    return -1;
+  }
+  fio_str_info_s method = fiobj_obj2cstr(h->method);
+  fio_str_info_s path = fiobj_obj2cstr(h->path);
+  fio_str_info_s query = {.len = 0};
+  if (h->query)
+    query = fiobj_obj2cstr(h->query);
+  if (proxy->strip_prefix) {
+    path.data += prefix_len;
+    path.len -= prefix_len;
+  }
+
+  iodine_proxy_serialize_s s = {
+      .dest = fiobj_str_buf(method.len + path.len + query.len + 512),
+      .connection = fiobj_hash_get2(h->headers, connection_hash)};
+  fiobj_str_write(s.dest, method.data, method.len);
+  fiobj_str_write(s.dest, " ", 1);
+  if (!path.len || path.data[0] != '/')
+    fiobj_str_write(s.dest, "/", 1);
+  fiobj_str_write(s.dest, path.data, path.len);
+  if (query.len) {
+    fiobj_str_write(s.dest, "?", 1);
+    fiobj_str_write(s.dest, query.data, query.len);
+  }
+  fiobj_str_write(s.dest, " HTTP/1.1\r\n", 11);
+  fiobj_each1(h->headers, 0, iodine_proxy_header_task, &s);
+  {
+    /* append the client's address to the (joined) `x-forwarded-for` list */
+    fio_str_info_s peer = http_peer_addr(h);
+    const size_t count =
+        (!s.forwarded ? 0
+                      : FIOBJ_TYPE_IS(s.forwarded, FIOBJ_T_ARRAY)
+                            ? fiobj_ary_count(s.forwarded)
+                            : 1);
+    uint8_t listed = 0;
+    for (size_t i = 0; i < count; ++i) {
+      fio_str_info_s prev = fiobj_obj2cstr(
+          FIOBJ_TYPE_IS(s.forwarded, FIOBJ_T_ARRAY)
+              ? fiobj_ary_index(s.forwarded, i)
+              : s.forwarded);
+      if (!prev.len)
+        continue;
+      fiobj_str_write(s.dest, (listed ? ", " : "x-forwarded-for: "),
+                      (listed ? 2 : 17));
+      fiobj_str_write(s.dest, prev.data, prev.len);
+      listed = 1;
+    }
+    if (peer.len) {
+      fiobj_str_write(s.dest, (listed ? ", " : "x-forwarded-for: "),
+                      (listed ? 2 : 17));
+      fiobj_str_write(s.dest, peer.data, peer.len);
+      listed = 1;
+    }
+    if (listed)
+      fiobj_str_write(s.dest, "\r\n", 2);
+  }
+  const uint8_t has_body =
+      (body_len > 0 || (method.len == 4 && !memcmp(method.data, "POST", 4)) ||
+       (method.len == 3 && !memcmp(method.data, "PUT", 3)) ||
+       (method.len == 5 && !memcmp(method.data, "PATCH", 5)));
+  if (has_body)
+    fiobj_str_printf(s.dest, "content-length: %lld\r\n", (long long)body_len);
+  fiobj_str_write(s.dest, "\r\n", 2);
+  FIOBJ upload = FIOBJ_INVALID;
+  if (body_len > 0) {
+    if (fiobj_data_fd(h->body) == -1) {
+      fio_str_info_s b = fiobj_data_pread(h->body, 0, body_len);
+      fiobj_str_write(s.dest, b.data, b.len);
+    } else {
+      upload = fiobj_dup(h->body); /* sent using `sendfile` */
+    }
+  }
+
+  iodine_proxy_req_s *pr = fio_malloc(sizeof(*pr));
+  FIO_ASSERT_ALLOC(pr);
+  *pr = (iodine_proxy_req_s){
+      .proxy = proxy,
+      .upstream = iodine_proxy_pick(proxy, NULL),
+      .udata = h->udata,
+      .request = s.dest,
+      .upload = upload,
+      .client = http2protocol(h)->uuid,
+      .throttled = -1,
+      /* one for the client and one for the upstream */
+      .ref = 2,
+      .head = (method.len == 4 && !memcmp(method.data, "HEAD", 4)),
+      .lock = FIO_LOCK_INIT,
+  };
+  pr->idempotent =
+      (pr->head ||
+       (method.len == 3 &&
+        (!memcmp(method.data, "GET", 3) || !memcmp(method.data, "PUT", 3))) ||
+       (method.len == 6 && !memcmp(method.data, "DELETE", 6)) ||
+       (method.len == 7 && !memcmp(method.data, "OPTIONS", 7)));
+  h->udata = pr;
+  http_pause(h, iodine_proxy_on_pause);
+  return 0;
+}
+
+/* *****************************************************************************
+Creating proxies
+***************************************************************************** */
+
+/** Frees the proxy (should only be called while the server isn't running). */
+void iodine_proxy_free(iodine_proxy_s *proxy) {
+  if (!proxy)
+    return;
+  for (size_t i = 0; i < proxy->count; ++i) {
+    iodine_http_client_free(proxy->upstreams[i].client);
+    fiobj_free(proxy->upstreams[i].url);
+  }
+  free(proxy->upstreams);
+  free(proxy);
+}
+
+static size_t iodine_proxy_size_option(VALUE opt, const char *name,
+                                       size_t def, size_t min, size_t max) {
+  VALUE tmp = (opt == Qnil ? Qnil
+                           : rb_hash_aref(opt, ID2SYM(rb_intern(name))));
+  if (tmp == Qnil)
+    return def;
+  Check_Type(tmp, T_FIXNUM);
+  const long long n = NUM2LL(tmp);
+  if (n < (long long)min || (unsigned long long)n > max)
+    rb_raise(rb_eRangeError, "(iodine) proxy option :%s out of range.", name);
+  return (size_t)n;
+}
+
+/**
+ * Creates a reverse proxy for `upstreams` (a URL String or an Array of URLs).
+ * Must be called while holding the GVL, raises an exception on error.
+ */
+iodine_proxy_s *iodine_proxy_new(VALUE upstreams, VALUE opt) {
+  if (RB_TYPE_P(upstreams, T_STRING))
+    upstreams = rb_ary_new_from_args(1, upstreams);
+  Check_Type(upstreams, T_ARRAY);
+  if (!RARRAY_LEN(upstreams))
+    rb_raise(rb_eArgError, "(iodine) a proxy requires at least one upstream.");
+  for (long i = 0; i < RARRAY_LEN(upstreams); ++i)
+    Check_Type(RARRAY_AREF(upstreams, i), T_STRING);
+  if (opt != Qnil)
+    Check_Type(opt, T_HASH);
+  const size_t limit = iodine_proxy_size_option(opt, "pool", 16, 1, 4096);
+  const size_t timeout =
+      iodine_proxy_size_option(opt, "timeout", 30000, 1, ((size_t)1 << 31));
+  const size_t max_fails =
+      iodine_proxy_size_option(opt, "max_fails", 3, 0, 1024);
+  const size_t fail_timeout =
+      iodine_proxy_size_option(opt, "fail_timeout", 10, 1, 86400);
+  uint8_t least_conn = 0;
+  uint8_t strip_prefix = 0;
+  if (opt != Qnil) {
+    VALUE tmp = rb_hash_aref(opt, ID2SYM(rb_intern("balance")));
+    if (tmp == ID2SYM(rb_intern("least_conn")))
+      least_conn = 1;
+    else if (tmp != Qnil && tmp != ID2SYM(rb_intern("round_robin")))
+      rb_raise(rb_eArgError,
+               "(iodine) proxy :balance must be :round_robin or :least_conn.");
+    tmp = rb_hash_aref(opt, ID2SYM(rb_intern("strip_prefix")));
+    strip_prefix = (tmp != Qnil && tmp != Qfalse);
+  }
+
+  iodine_proxy_s *p = malloc(sizeof(*p));
+  FIO_ASSERT_ALLOC(p);
+  *p = (iodine_proxy_s){
+      .count = (size_t)RARRAY_LEN(upstreams),
+      .max_fails = max_fails,
+      .fail_timeout = (int64_t)fail_timeout * 1000,
+      .least_conn = least_conn,
+      .strip_prefix = strip_prefix,
+  };
+  p->upstreams = calloc(p->count, sizeof(*p->upstreams));
+  FIO_ASSERT_ALLOC(p->upstreams);
+  for (size_t i = 0; i < p->count; ++i) {
+    VALUE url = RARRAY_AREF(upstreams, i);
+    p->upstreams[i].client = iodine_http_client_new(
+        RSTRING_PTR(url), RSTRING_LEN(url), limit, timeout);
+    if (!p->upstreams[i].client) {
+      iodine_proxy_free(p);
+      rb_raise(rb_eArgError, "(iodine) invalid upstream URL: %" PRIsVALUE,
+               url);
+    }
+    p->upstreams[i].url = fiobj_str_new(RSTRING_PTR(url), RSTRING_LEN(url));
+  }
+  return p;
+}
+
+/** Returns an Array with the upstreams' statistics (requires the GVL). */
+VALUE iodine_proxy_stats(iodine_proxy_s *proxy) {
+  VALUE ret = rb_ary_new2(proxy->count);
+  const int64_t now = iodine_proxy_now();
+  for (size_t i = 0; i < proxy->count; ++i) {
+    iodine_proxy_upstream_s *u = proxy->upstreams + i;
+    fio_str_info_s url = fiobj_obj2cstr(u->url);
+    VALUE h = iodine_http_client_stats(u->client);
+    rb_hash_aset(h, ID2SYM(rb_intern2("url", 3)),
+                 rb_str_new(url.data, url.len));
+    rb_hash_aset(h, ID2SYM(rb_intern2("down", 4)),
+                 (u->down_until > now ? Qtrue : Qfalse));
+    rb_hash_aset(h, ID2SYM(rb_intern2("ejections", 9)),
+                 SIZET2NUM(u->ejections));
+    rb_ary_push(ret, h);
+  }
+  return ret;
+}
@@ -0,0 +1,34 @@
+#ifndef H_IODINE_PROXY_H
+#define H_IODINE_PROXY_H
+
+#include "iodine.h"
+
+#include "http.h"
+
+/** A reverse proxy: a list of upstream origins (see `Iodine::Router.proxy`). */
+typedef struct iodine_proxy_s iodine_proxy_s;
+
+/**
+ * Creates a reverse proxy for `upstreams` (a URL String or an Array of URLs)
+ * using the options in the `opt` Hash (or `nil`).
+ *
+ * Must be called while holding the GVL, raises an exception on error.
+ */
+iodine_proxy_s *iodine_proxy_new(VALUE upstreams, VALUE opt);
+
+/** Frees the proxy (should only be called while the server isn't running). */
+void iodine_proxy_free(iodine_proxy_s *proxy);
+
+/**
+ * Forwards the request to an upstream (called from an IO thread, without the
+ * GVL). `prefix_len` is the length of the route's path prefix.
+ *
+ * Returns 0 if the request was handled (paused until the upstream responds) and
+ * -1 if it should be handled normally (i.e., its body was already consumed).
+ */
+int iodine_proxy_request(iodine_proxy_s *proxy, http_s *h, size_t prefix_len);
+
+/** Returns an Array with the upstreams' statistics (requires the GVL). */
+VALUE iodine_proxy_stats(iodine_proxy_s *proxy);
+
+#endif
@@ -44,6 +44,10 @@ rewindable object if the underlying input stream is not rewindable.
 
 close must never be called on the input stream.
 
+When the server's `stream_input` option is set, large request bodies are read
+directly from the socket, on demand. Streamed data isn't buffered, so `rewind`
+will only rewind the data buffered so far (i.e., the data read using `gets`).
+
 */
 
 /* *****************************************************************************
@@ -84,6 +88,77 @@ static inline FIOBJ get_data(VALUE self) {
   return (FIOBJ)NUM2ULL(i);
 }
 
+/* *****************************************************************************
+Streamed bodies
+*/
+
+#ifndef IODINE_RACK_IO_STREAM_CHUNK
+/* the amount of data read from the socket at a time */
+#define IODINE_RACK_IO_STREAM_CHUNK 65536
+#endif
+
+typedef struct {
+  http_s *h;
+  void *buffer;
+  size_t length;
+  ssize_t result;
+} iodine_rio_stream_read_s;
+
+static void *rio_stream_read_no_gvl(void *args_) {
+  iodine_rio_stream_read_s *args = args_;
+  args->result = http_body_read(args->h, args->buffer, args->length);
+  return NULL;
+}
+
+/* tests if there's streamed body data waiting to be read from the socket */
+static inline http_s *rio_stream_handle(VALUE self) {
+  http_s *h = get_handle(self);
+  if (!h || http_body_read(h, NULL, 0) <= 0)
+    return NULL;
+  return h;
+}
+
+/* reads up to `length` bytes of a streamed body (blocks outside the GVL) */
+static ssize_t rio_stream_read(http_s *h, void *buffer, size_t length) {
+  iodine_rio_stream_read_s args = {.h = h, .buffer = buffer, .length = length};
+  IodineCaller.leaveGVL(rio_stream_read_no_gvl, &args);
+  return args.result;
+}
+
+/* appends up to `length` streamed bytes (0 == all) to the String `buffer` */
+static size_t rio_stream_append(http_s *h, VALUE buffer, size_t length) {
+  size_t total = 0;
+  char *tmp = fio_malloc(IODINE_RACK_IO_STREAM_CHUNK);
+  FIO_ASSERT_ALLOC(tmp);
+  while (!length || total < length) {
+    size_t to_read = IODINE_RACK_IO_STREAM_CHUNK;
+    if (length && length - total < to_read)
+      to_read = length - total;
+    ssize_t i = rio_stream_read(h, tmp, to_read);
+    if (i <= 0)
+      break;
+    rb_str_cat(buffer, tmp, i);
+    total += i;
+  }
+  fio_free(tmp);
+  return total;
+}
+
+/* buffers the next chunk of a streamed body in the IO object (for `gets`) */
+static int rio_stream_buffer(http_s *h, FIOBJ io) {
+  char *tmp = fio_malloc(IODINE_RACK_IO_STREAM_CHUNK);
+  FIO_ASSERT_ALLOC(tmp);
+  ssize_t i = rio_stream_read(h, tmp, IODINE_RACK_IO_STREAM_CHUNK);
+  if (i > 0)
+    fiobj_data_write(io, tmp, i);
+  fio_free(tmp);
+  return (i > 0) ? 0 : -1;
+}
+
+/* *****************************************************************************
+IO API (continued)
+*/
+
 static VALUE rio_rewind(VALUE self) {
   FIOBJ io = get_data(self);
   if (!FIOBJ_TYPE_IS(io, FIOBJ_T_DATA))
@@ -101,7 +176,17 @@ static VALUE rio_gets(VALUE self) {
   FIOBJ io = get_data(self);
   if (!FIOBJ_TYPE_IS(io, FIOBJ_T_DATA))
     return Qnil;
+  intptr_t pos = fiobj_data_pos(io);
   fio_str_info_s line = fiobj_data_gets(io);
+  http_s *h;
+  while ((!line.len || line.data[line.len - 1] != '\n') &&
+         (h = rio_stream_handle(self))) {
+    /* incomplete line, buffer more of the streamed body and retry */
+    fiobj_data_seek(io, pos);
+    if (rio_stream_buffer(h, io))
+      break;
+    line = fiobj_data_gets(io);
+  }
   if (line.len) {
     VALUE buffer = rb_str_new(line.data, line.len);
     // make sure the buffer is binary encoded.
@@ -138,7 +223,10 @@ static VALUE rio_read(int argc, VALUE *argv, VALUE self) {
   }
   // return if we're at the EOF.
   fio_str_info_s buf = fiobj_data_read(io, len);
-  if (buf.len) {
+  http_s *h = NULL;
+  if (!len || (ssize_t)buf.len < len)
+    h = rio_stream_handle(self);
+  if (buf.len || h) {
     // create the buffer if we don't have one.
     if (buffer == Qnil) {
       // make sure the buffer is binary encoded.
@@ -151,7 +239,11 @@ static VALUE rio_read(int argc, VALUE *argv, VALUE self) {
       memcpy(RSTRING_PTR(buffer), buf.data, buf.len);
       rb_str_set_len(buffer, buf.len);
     }
-    return buffer;
+    // read the rest of a streamed body directly from the socket.
+    if (h)
+      buf.len += rio_stream_append(h, buffer, (len ? len - buf.len : 0));
+    if (buf.len)
+      return buffer;
   }
   return ret_nil ? Qnil : rb_str_buf_new(0);
 }
@@ -237,6 +329,10 @@ static void close_rack_io(VALUE rack_io) {
   set_handle(rack_io, NULL); /* this disables hijacking. */
 }
 
+static void detach_rack_io(VALUE rack_io) {
+  set_handle(rack_io, NULL); /* the handle might not outlive the IO object */
+}
+
 // initialize library
 static void init_rack_io(void) {
   IodineUTF8Encoding = rb_enc_find("UTF-8");
@@ -269,5 +365,6 @@ static void init_rack_io(void) {
 struct IodineRackIO IodineRackIO = {
     .create = new_rack_io,
     .close = close_rack_io,
+    .detach = detach_rack_io,
     .init = init_rack_io,
 };
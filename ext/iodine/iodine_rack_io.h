@@ -14,6 +14,8 @@ Feel free to copy, use and enjoy according to the license provided.
 extern struct IodineRackIO {
   VALUE (*create)(http_s *h, VALUE env);
   void (*close)(VALUE rack_io);
+  /** Disables hijacking and socket reads (the body remains readable). */
+  void (*detach)(VALUE rack_io);
   void (*init)(void);
 } IodineRackIO;
 
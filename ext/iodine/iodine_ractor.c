@@ -0,0 +1,651 @@
+/*
+Copyright: Boaz Segev, 2016-2019
+License: MIT
+
+Feel free to copy, use and enjoy according to the license provided.
+*/
+#include "iodine_ractor.h"
+
+#include <ruby/encoding.h>
+#include <ruby/thread.h>
+
+#include <ctype.h>
+#include <pthread.h>
+#include <unistd.h>
+
+/*
+The Ractor request mode (`:ractors`, experimental).
+
+Requests are paused and queued by the reactor (no GVL required), a pool of
+Ractors (per worker) pops the queue, builds the Rack `env` within the Ractor,
+calls the (shareable) application and converts the response to C data before
+resuming the request, so no Ruby objects are shared between Ractors except
+for the application and a number of frozen (shareable) Strings.
+
+The `env` is a simplified version of the usual Rack `env`: `rack.input` is a
+StringIO with the (already received) request body, hijacking and upgrades
+aren't supported and the response body must contain Strings.
+*/
+
+#ifdef HAVE_RB_EXT_RACTOR_SAFE
+#include <ruby/ractor.h>
+
+#ifndef IODINE_RACTOR_POOL_LIMIT
+/* the maximum number of HTTP listeners using Ractors */
+#define IODINE_RACTOR_POOL_LIMIT 8
+#endif
+
+static ID call_id;
+static ID close_id;
+static ID each_id;
+static ID new_id;
+static ID ractor_new_id;
+static ID shareable_id;
+static ID to_ary_id;
+static VALUE RactorClass;
+static VALUE StringIOClass;
+static rb_encoding *IodineBinaryEncoding;
+
+/* frozen (shareable) Strings and objects */
+static VALUE CONTENT_LENGTH;
+static VALUE CONTENT_TYPE;
+static VALUE HTTP_SCHEME;
+static VALUE HTTP_VERSION;
+static VALUE HTTPS_SCHEME;
+static VALUE PATH_INFO;
+static VALUE QUERY_STRING;
+static VALUE R_ERRORS;
+static VALUE R_HIJACK_Q;
+static VALUE R_INPUT;
+static VALUE R_MULTIPROCESS;
+static VALUE R_MULTITHREAD;
+static VALUE R_RUN_ONCE;
+static VALUE R_URL_SCHEME;
+static VALUE R_VERSION;
+static VALUE R_VERSION_VALUE;
+static VALUE REMOTE_ADDR;
+static VALUE REQUEST_METHOD;
+static VALUE SCRIPT_NAME;
+static VALUE SCRIPT_NAME_VALUE;
+static VALUE SERVER_NAME;
+static VALUE SERVER_PORT;
+static VALUE SERVER_PROTOCOL;
+
+/* *****************************************************************************
+Request queue
+***************************************************************************** */
+
+typedef struct iodine_ractor_pool_s iodine_ractor_pool_s;
+
+typedef struct iodine_ractor_request_s {
+  struct iodine_ractor_request_s *next;
+  iodine_ractor_pool_s *pool;
+  http_pause_handle_s *pause;
+  /* request data (copied before the request is paused) */
+  FIOBJ method;
+  FIOBJ path;
+  FIOBJ query;
+  FIOBJ version;
+  FIOBJ headers;
+  FIOBJ body;
+  FIOBJ peer;
+  uint8_t tls;
+  /* response data (set by the Ractor) */
+  size_t status;
+  /* an Array of header name / value pairs */
+  FIOBJ out_headers;
+  FIOBJ out_body;
+} iodine_ractor_request_s;
+
+struct iodine_ractor_pool_s {
+  VALUE app;
+  uint8_t count;
+  uint8_t stop;
+  /* the server is shutting down, new and queued requests are refused */
+  uint8_t draining;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  iodine_ractor_request_s *head;
+  iodine_ractor_request_s **tail;
+};
+
+static iodine_ractor_pool_s iodine_ractor_pools[IODINE_RACTOR_POOL_LIMIT];
+static size_t iodine_ractor_pool_count;
+
+static void iodine_ractor_request_free(iodine_ractor_request_s *r) {
+  fiobj_free(r->method);
+  fiobj_free(r->path);
+  fiobj_free(r->query);
+  fiobj_free(r->version);
+  fiobj_free(r->headers);
+  fiobj_free(r->body);
+  fiobj_free(r->peer);
+  fiobj_free(r->out_headers);
+  fiobj_free(r->out_body);
+  fio_free(r);
+}
+
+static void iodine_ractor_refuse(iodine_ractor_request_s *r);
+
+static void iodine_ractor_push(iodine_ractor_request_s *r) {
+  iodine_ractor_pool_s *pool = r->pool;
+  pthread_mutex_lock(&pool->lock);
+  if (pool->draining) {
+    pthread_mutex_unlock(&pool->lock);
+    iodine_ractor_refuse(r);
+    return;
+  }
+  *pool->tail = r;
+  pool->tail = &r->next;
+  pthread_cond_signal(&pool->cond);
+  pthread_mutex_unlock(&pool->lock);
+}
+
+typedef struct {
+  iodine_ractor_pool_s *pool;
+  iodine_ractor_request_s *r;
+  uint8_t interrupt;
+} iodine_ractor_pop_s;
+
+static void *iodine_ractor_pop_no_gvl(void *args_) {
+  iodine_ractor_pop_s *args = args_;
+  iodine_ractor_pool_s *pool = args->pool;
+  pthread_mutex_lock(&pool->lock);
+  while (!pool->head && !pool->stop && !args->interrupt)
+    pthread_cond_wait(&pool->cond, &pool->lock);
+  if (pool->head && !pool->stop) {
+    args->r = pool->head;
+    pool->head = args->r->next;
+    if (!pool->head)
+      pool->tail = &pool->head;
+  }
+  pthread_mutex_unlock(&pool->lock);
+  return NULL;
+}
+
+static void iodine_ractor_pop_ubf(void *args_) {
+  iodine_ractor_pop_s *args = args_;
+  pthread_mutex_lock(&args->pool->lock);
+  args->interrupt = 1;
+  pthread_cond_broadcast(&args->pool->cond);
+  pthread_mutex_unlock(&args->pool->lock);
+}
+
+/* *****************************************************************************
+Handling the request within a Ractor
+***************************************************************************** */
+
+static inline VALUE iodine_ractor_str(FIOBJ o) {
+  fio_str_info_s tmp = fiobj_obj2cstr(o);
+  return rb_enc_str_new(tmp.data, tmp.len, IodineBinaryEncoding);
+}
+
+static int iodine_ractor_env_header(FIOBJ o, void *env_) {
+  VALUE env = (VALUE)env_;
+  fio_str_info_s name = fiobj_obj2cstr(fiobj_hash_key_in_loop());
+  if ((name.len == 14 && !memcmp(name.data, "content-length", 14)) ||
+      (name.len == 12 && !memcmp(name.data, "content-type", 12)))
+    return 0;
+  char stack_buf[128];
+  char *buf = stack_buf;
+  if (name.len > 123)
+    buf = fio_malloc(name.len + 5);
+  memcpy(buf, "HTTP_", 5);
+  for (size_t i = 0; i < name.len; ++i)
+    buf[i + 5] = (name.data[i] == '-') ? '_' : toupper(name.data[i]);
+  VALUE key = rb_enc_interned_str(buf, name.len + 5, IodineBinaryEncoding);
+  if (buf != stack_buf)
+    fio_free(buf);
+  if (FIOBJ_TYPE_IS(o, FIOBJ_T_STRING)) {
+    rb_hash_aset(env, key, iodine_ractor_str(o));
+    return 0;
+  }
+  /* multiple values (an Array) */
+  size_t count = fiobj_ary_count(o);
+  VALUE ary = rb_ary_new2(count);
+  for (size_t i = 0; i < count; ++i)
+    rb_ary_push(ary, iodine_ractor_str(fiobj_ary_index(o, i)));
+  rb_hash_aset(env, key, ary);
+  return 0;
+}
+
+static FIOBJ iodine_ractor_header(iodine_ractor_request_s *r, const char *name,
+                                  size_t len) {
+  return fiobj_hash_get2(r->headers, fiobj_hash_string(name, len));
+}
+
+static VALUE iodine_ractor_env(iodine_ractor_request_s *r) {
+  VALUE env = rb_hash_new();
+  rb_hash_aset(env, REQUEST_METHOD, iodine_ractor_str(r->method));
+  rb_hash_aset(env, PATH_INFO, iodine_ractor_str(r->path));
+  rb_hash_aset(env, QUERY_STRING,
+               r->query ? iodine_ractor_str(r->query)
+                        : rb_enc_str_new("", 0, IodineBinaryEncoding));
+  rb_hash_aset(env, SCRIPT_NAME, SCRIPT_NAME_VALUE);
+  VALUE version = iodine_ractor_str(r->version);
+  rb_hash_aset(env, SERVER_PROTOCOL, version);
+  rb_hash_aset(env, HTTP_VERSION, version);
+  if (r->peer)
+    rb_hash_aset(env, REMOTE_ADDR, iodine_ractor_str(r->peer));
+
+  /* scheme */
+  VALUE scheme = r->tls ? HTTPS_SCHEME : HTTP_SCHEME;
+  FIOBJ tmp = iodine_ractor_header(r, "x-forwarded-proto", 17);
+  if (tmp) {
+    fio_str_info_s s = fiobj_obj2cstr(tmp);
+    scheme = (s.len >= 5 && !strncasecmp(s.data, "https", 5)) ? HTTPS_SCHEME
+                                                               : HTTP_SCHEME;
+  }
+  rb_hash_aset(env, R_URL_SCHEME, scheme);
+
+  /* SERVER_NAME and SERVER_PORT (the `host` header) */
+  {
+    fio_str_info_s host =
+        fiobj_obj2cstr(iodine_ractor_header(r, "host", 4));
+    char *pos = host.len ? memchr(host.data, ':', host.len) : NULL;
+    if (pos) {
+      rb_hash_aset(env, SERVER_NAME,
+                   rb_enc_str_new(host.data, pos - host.data,
+                                  IodineBinaryEncoding));
+      ++pos;
+      rb_hash_aset(env, SERVER_PORT,
+                   rb_enc_str_new(pos, host.len - (pos - host.data),
+                                  IodineBinaryEncoding));
+    } else {
+      rb_hash_aset(env, SERVER_NAME,
+                   rb_enc_str_new(host.data, host.len, IodineBinaryEncoding));
+      rb_hash_aset(env, SERVER_PORT,
+                   rb_enc_str_new_cstr((scheme == HTTPS_SCHEME ? "443" : "80"),
+                                       IodineBinaryEncoding));
+    }
+  }
+  if ((tmp = iodine_ractor_header(r, "content-length", 14)))
+    rb_hash_aset(env, CONTENT_LENGTH, iodine_ractor_str(tmp));
+  if ((tmp = iodine_ractor_header(r, "content-type", 12)))
+    rb_hash_aset(env, CONTENT_TYPE, iodine_ractor_str(tmp));
+  fiobj_each1(r->headers, 0, iodine_ractor_env_header, (void *)env);
+
+  /* Rack */
+  VALUE body = rb_enc_str_new("", 0, IodineBinaryEncoding);
+  if (r->body) {
+    fio_str_info_s data = fiobj_data_pread(r->body, 0, fiobj_data_len(r->body));
+    rb_str_cat(body, data.data, data.len);
+  }
+  rb_hash_aset(env, R_INPUT, rb_funcall(StringIOClass, new_id, 1, body));
+  rb_hash_aset(env, R_ERRORS, rb_gv_get("$stderr"));
+  rb_hash_aset(env, R_VERSION, R_VERSION_VALUE);
+  rb_hash_aset(env, R_MULTITHREAD, Qtrue);
+  rb_hash_aset(env, R_MULTIPROCESS, Qtrue);
+  rb_hash_aset(env, R_RUN_ONCE, Qfalse);
+  rb_hash_aset(env, R_HIJACK_Q, Qfalse);
+  return env;
+}
+
+static int iodine_ractor_response_header(VALUE key, VALUE val, VALUE r_) {
+  iodine_ractor_request_s *r = (iodine_ractor_request_s *)r_;
+  if (key == Qnil || val == Qnil)
+    return ST_CONTINUE;
+  if (RB_TYPE_P(val, T_ARRAY)) {
+    for (long i = 0; i < RARRAY_LEN(val); ++i)
+      iodine_ractor_response_header(key, RARRAY_AREF(val, i), r_);
+    return ST_CONTINUE;
+  }
+  key = rb_obj_as_string(key);
+  val = rb_obj_as_string(val);
+  FIOBJ name = fiobj_str_new(RSTRING_PTR(key), RSTRING_LEN(key));
+  fio_str_info_s tmp = fiobj_obj2cstr(name);
+  for (size_t i = 0; i < tmp.len; ++i)
+    tmp.data[i] = tolower(tmp.data[i]);
+  /* multiple values might be separated by a newline */
+  char *pos = RSTRING_PTR(val);
+  char *end = pos + RSTRING_LEN(val);
+  while (pos < end) {
+    char *start = pos;
+    pos = memchr(pos, '\n', end - pos);
+    if (!pos)
+      pos = end;
+    fiobj_ary_push(r->out_headers, fiobj_dup(name));
+    fiobj_ary_push(r->out_headers, fiobj_str_new(start, pos - start));
+    ++pos;
+  }
+  fiobj_free(name);
+  return ST_CONTINUE;
+}
+
+static VALUE iodine_ractor_response_body(RB_BLOCK_CALL_FUNC_ARGLIST(str, r_)) {
+  iodine_ractor_request_s *r = (iodine_ractor_request_s *)r_;
+  Check_Type(str, T_STRING);
+  fiobj_str_write(r->out_body, RSTRING_PTR(str), RSTRING_LEN(str));
+  return Qnil;
+}
+
+typedef struct {
+  VALUE app;
+  iodine_ractor_request_s *r;
+} iodine_ractor_perform_s;
+
+/* builds the env, calls the application and copies the response to C data */
+static VALUE iodine_ractor_perform(VALUE args_) {
+  iodine_ractor_perform_s *args = (iodine_ractor_perform_s *)args_;
+  iodine_ractor_request_s *r = args->r;
+  VALUE env = iodine_ractor_env(r);
+  VALUE response = rb_funcall(args->app, call_id, 1, env);
+  Check_Type(response, T_ARRAY);
+  VALUE tmp = rb_ary_entry(response, 0);
+  if (RB_TYPE_P(tmp, T_STRING)) {
+    char *data = RSTRING_PTR(tmp);
+    r->status = fio_atol(&data);
+  } else {
+    r->status = NUM2SIZET(tmp);
+  }
+  tmp = rb_ary_entry(response, 1);
+  Check_Type(tmp, T_HASH);
+  rb_hash_foreach(tmp, iodine_ractor_response_header, (VALUE)r);
+  tmp = rb_ary_entry(response, 2);
+  if (rb_respond_to(tmp, to_ary_id)) {
+    VALUE ary = rb_funcall(tmp, to_ary_id, 0);
+    Check_Type(ary, T_ARRAY);
+    for (long i = 0; i < RARRAY_LEN(ary); ++i)
+      iodine_ractor_response_body(RARRAY_AREF(ary, i), (VALUE)r, 0, NULL,
+                                  Qnil);
+  } else {
+    rb_block_call(tmp, each_id, 0, NULL, iodine_ractor_response_body,
+                  (VALUE)r);
+  }
+  if (rb_respond_to(tmp, close_id))
+    rb_funcall(tmp, close_id, 0);
+  return Qnil;
+}
+
+static void iodine_ractor_handle(VALUE app, iodine_ractor_request_s *r) {
+  iodine_ractor_perform_s args = {.app = app, .r = r};
+  int state = 0;
+  r->out_headers = fiobj_ary_new();
+  r->out_body = fiobj_str_buf(0);
+  rb_protect(iodine_ractor_perform, (VALUE)&args, &state);
+  if (!state)
+    return;
+  VALUE exc = rb_errinfo();
+  rb_set_errinfo(Qnil);
+  if (exc != Qnil) {
+    VALUE msg = rb_protect(rb_obj_as_string, exc, &state);
+    if (!state && RB_TYPE_P(msg, T_STRING))
+      FIO_LOG_ERROR("Iodine caught an exception in a Ractor - %.*s: %.*s",
+                    (int)RSTRING_LEN(rb_class_name(rb_obj_class(exc))),
+                    RSTRING_PTR(rb_class_name(rb_obj_class(exc))),
+                    (int)RSTRING_LEN(msg), RSTRING_PTR(msg));
+    rb_set_errinfo(Qnil);
+  }
+  r->status = 500;
+  fiobj_free(r->out_headers);
+  fiobj_free(r->out_body);
+  r->out_headers = FIOBJ_INVALID;
+  r->out_body = FIOBJ_INVALID;
+}
+
+/* *****************************************************************************
+Resuming the request (sending the response)
+***************************************************************************** */
+
+static void iodine_ractor_respond(http_s *h) {
+  iodine_ractor_request_s *r = h->udata;
+  h->udata = (void *)r->pool->app;
+  h->status = r->status;
+  if (!r->out_headers) {
+    http_send_error(h, r->status);
+    goto finish;
+  }
+  for (size_t i = 0, count = fiobj_ary_count(r->out_headers); i + 1 < count;
+       i += 2) {
+    http_set_header(h, fiobj_ary_index(r->out_headers, i),
+                    fiobj_dup(fiobj_ary_index(r->out_headers, i + 1)));
+  }
+  fio_str_info_s body = fiobj_obj2cstr(r->out_body);
+  if (body.len)
+    http_send_body(h, body.data, body.len);
+  else
+    http_finish(h);
+finish:
+  iodine_ractor_request_free(r);
+  iodine_http_release();
+}
+
+static void iodine_ractor_abort(void *r) {
+  iodine_ractor_request_free(r);
+  iodine_http_release();
+}
+
+/* answers a request that wasn't handled (shutdown) with a 503 response */
+static void iodine_ractor_refuse(iodine_ractor_request_s *r) {
+  r->status = 503;
+  http_resume(r->pause, iodine_ractor_respond, iodine_ractor_abort);
+}
+
+/**
+Serves requests for the Ractor pool until the reactor stops (used internally
+by the Ractors, see `Iodine::Base.ractor_new`).
+*/
+static VALUE iodine_ractor_serve(VALUE self, VALUE app, VALUE pool_id) {
+  iodine_ractor_pool_s *pool =
+      (iodine_ractor_pool_s *)(uintptr_t)NUM2ULL(pool_id);
+  for (;;) {
+    iodine_ractor_pop_s args = {.pool = pool};
+    rb_thread_call_without_gvl(iodine_ractor_pop_no_gvl, &args,
+                               iodine_ractor_pop_ubf, &args);
+    if (!args.r) {
+      if (pool->stop)
+        break;
+      rb_thread_check_ints();
+      continue;
+    }
+    iodine_ractor_handle(app, args.r);
+    http_resume(args.r->pause, iodine_ractor_respond, iodine_ractor_abort);
+  }
+  return Qnil;
+  (void)self;
+}
+
+/* *****************************************************************************
+HTTP callbacks
+***************************************************************************** */
+
+static void iodine_ractor_paused(http_pause_handle_s *pause) {
+  iodine_ractor_request_s *r = http_paused_udata_get(pause);
+  r->pause = pause;
+  iodine_ractor_push(r);
+}
+
+/** An `on_request` callback that handles requests using a Ractor pool. */
+void iodine_ractor_on_request(http_s *h) {
+  iodine_ractor_pool_s *pool = NULL;
+  for (size_t i = 0; i < iodine_ractor_pool_count; ++i) {
+    if (iodine_ractor_pools[i].app == (VALUE)h->udata) {
+      pool = iodine_ractor_pools + i;
+      break;
+    }
+  }
+  if (!pool) {
+    http_send_error(h, 404);
+    return;
+  }
+  if (iodine_http_admit(h))
+    return;
+  iodine_ractor_request_s *r = fio_malloc(sizeof(*r));
+  FIO_ASSERT_ALLOC(r);
+  fio_str_info_s peer = http_peer_addr(h);
+  *r = (iodine_ractor_request_s){
+      .pool = pool,
+      .method = fiobj_dup(h->method),
+      .path = fiobj_dup(h->path),
+      .query = fiobj_dup(h->query),
+      .version = fiobj_dup(h->version),
+      .headers = fiobj_dup(h->headers),
+      .body = fiobj_dup(h->body),
+      .peer = (peer.len ? fiobj_str_new(peer.data, peer.len) : FIOBJ_INVALID),
+      .tls = (http_settings(h)->tls != NULL),
+  };
+  h->udata = r;
+  http_pause(h, iodine_ractor_paused);
+}
+
+/* *****************************************************************************
+Starting and stopping the Ractors
+***************************************************************************** */
+
+static void iodine_ractor_on_start(void *ignr_);
+
+static void *iodine_ractor_start_in_GVL(void *ignr_) {
+  for (size_t i = 0; i < iodine_ractor_pool_count; ++i) {
+    iodine_ractor_pool_s *pool = iodine_ractor_pools + i;
+    pool->stop = 0;
+    pool->draining = 0;
+    VALUE args[2] = {pool->app, ULL2NUM((uintptr_t)pool)};
+    for (size_t j = 0; j < pool->count; ++j)
+      IodineCaller.call2(IodineBaseModule, ractor_new_id, 2, args);
+  }
+  return NULL;
+  (void)ignr_;
+}
+
+static void iodine_ractor_on_start(void *ignr_) {
+  IodineCaller.enterGVL(iodine_ractor_start_in_GVL, NULL);
+  (void)ignr_;
+}
+
+/* requests the Ractors didn't start handling won't be, answer them */
+static void iodine_ractor_on_shutdown(void *ignr_) {
+  for (size_t i = 0; i < iodine_ractor_pool_count; ++i) {
+    iodine_ractor_pool_s *pool = iodine_ractor_pools + i;
+    pthread_mutex_lock(&pool->lock);
+    pool->draining = 1;
+    iodine_ractor_request_s *r = pool->head;
+    pool->head = NULL;
+    pool->tail = &pool->head;
+    pthread_mutex_unlock(&pool->lock);
+    while (r) {
+      iodine_ractor_request_s *next = r->next;
+      iodine_ractor_refuse(r);
+      r = next;
+    }
+  }
+  (void)ignr_;
+}
+
+static void iodine_ractor_on_finish(void *ignr_) {
+  for (size_t i = 0; i < iodine_ractor_pool_count; ++i) {
+    iodine_ractor_pool_s *pool = iodine_ractor_pools + i;
+    pthread_mutex_lock(&pool->lock);
+    pool->stop = 1;
+    pthread_cond_broadcast(&pool->cond);
+    pthread_mutex_unlock(&pool->lock);
+  }
+  /* `on_start` callbacks are cleared once performed */
+  fio_state_callback_add(FIO_CALL_ON_START, iodine_ractor_on_start, NULL);
+  (void)ignr_;
+}
+
+/**
+ * Registers a Ractor pool for the (shareable) Rack `app` (`:ractors`).
+ */
+int iodine_ractor_pool_add(VALUE app, uint8_t count) {
+  if (rb_funcall(RactorClass, shareable_id, 1, app) != Qtrue) {
+    FIO_LOG_WARNING("(listen) the Rack application isn't Ractor shareable (see "
+                    "Ractor.make_shareable), ignoring the `:ractors` option.");
+    return -1;
+  }
+  if (iodine_ractor_pool_count == IODINE_RACTOR_POOL_LIMIT) {
+    FIO_LOG_WARNING("(listen) too many Ractor pools, ignoring the `:ractors` "
+                    "option.");
+    return -1;
+  }
+  iodine_ractor_pool_s *pool = iodine_ractor_pools + iodine_ractor_pool_count;
+  *pool = (iodine_ractor_pool_s){.app = app, .count = count};
+  pool->tail = &pool->head;
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->cond, NULL);
+  if (!iodine_ractor_pool_count++) {
+    fio_state_callback_add(FIO_CALL_ON_START, iodine_ractor_on_start, NULL);
+    fio_state_callback_add(FIO_CALL_ON_SHUTDOWN, iodine_ractor_on_shutdown,
+                           NULL);
+    fio_state_callback_add(FIO_CALL_ON_FINISH, iodine_ractor_on_finish, NULL);
+  }
+  return 0;
+}
+
+/* *****************************************************************************
+Initialization
+***************************************************************************** */
+
+void iodine_ractor_init(void) {
+  call_id = rb_intern2("call", 4);
+  close_id = rb_intern2("close", 5);
+  each_id = rb_intern2("each", 4);
+  new_id = rb_intern2("new", 3);
+  ractor_new_id = rb_intern2("ractor_new", 10);
+  shareable_id = rb_intern2("shareable?", 10);
+  to_ary_id = rb_intern2("to_ary", 6);
+  IodineBinaryEncoding = rb_enc_find("binary");
+  RactorClass = rb_const_get(rb_cObject, rb_intern2("Ractor", 6));
+  StringIOClass = rb_const_get(rb_cObject, rb_intern2("StringIO", 8));
+
+#define IODINE_RACTOR_KEY(name, str)                                           \
+  do {                                                                         \
+    name = rb_enc_interned_str_cstr(str, IodineBinaryEncoding);                \
+    rb_global_variable(&name);                                                 \
+  } while (0)
+  IODINE_RACTOR_KEY(CONTENT_LENGTH, "CONTENT_LENGTH");
+  IODINE_RACTOR_KEY(CONTENT_TYPE, "CONTENT_TYPE");
+  IODINE_RACTOR_KEY(HTTP_SCHEME, "http");
+  IODINE_RACTOR_KEY(HTTP_VERSION, "HTTP_VERSION");
+  IODINE_RACTOR_KEY(HTTPS_SCHEME, "https");
+  IODINE_RACTOR_KEY(PATH_INFO, "PATH_INFO");
+  IODINE_RACTOR_KEY(QUERY_STRING, "QUERY_STRING");
+  IODINE_RACTOR_KEY(R_ERRORS, "rack.errors");
+  IODINE_RACTOR_KEY(R_HIJACK_Q, "rack.hijack?");
+  IODINE_RACTOR_KEY(R_INPUT, "rack.input");
+  IODINE_RACTOR_KEY(R_MULTIPROCESS, "rack.multiprocess");
+  IODINE_RACTOR_KEY(R_MULTITHREAD, "rack.multithread");
+  IODINE_RACTOR_KEY(R_RUN_ONCE, "rack.run_once");
+  IODINE_RACTOR_KEY(R_URL_SCHEME, "rack.url_scheme");
+  IODINE_RACTOR_KEY(R_VERSION, "rack.version");
+  IODINE_RACTOR_KEY(REMOTE_ADDR, "REMOTE_ADDR");
+  IODINE_RACTOR_KEY(REQUEST_METHOD, "REQUEST_METHOD");
+  IODINE_RACTOR_KEY(SCRIPT_NAME, "SCRIPT_NAME");
+  IODINE_RACTOR_KEY(SERVER_NAME, "SERVER_NAME");
+  IODINE_RACTOR_KEY(SERVER_PORT, "SERVER_PORT");
+  IODINE_RACTOR_KEY(SERVER_PROTOCOL, "SERVER_PROTOCOL");
+  {
+    const char *sn = getenv("SCRIPT_NAME");
+    if (!sn || (sn[0] == '/' && sn[1] == 0))
+      sn = "";
+    IODINE_RACTOR_KEY(SCRIPT_NAME_VALUE, sn);
+  }
+#undef IODINE_RACTOR_KEY
+  R_VERSION_VALUE = rb_ractor_make_shareable(
+      rb_ary_new_from_args(2, INT2FIX(1), INT2FIX(3)));
+  rb_global_variable(&R_VERSION_VALUE);
+
+  /* the only method that might be called by a Ractor other than the main */
+  rb_ext_ractor_safe(true);
+  rb_define_module_function(IodineBaseModule, "ractor_serve",
+                            iodine_ractor_serve, 2);
+  rb_ext_ractor_safe(false);
+}
+
+#else /* HAVE_RB_EXT_RACTOR_SAFE */
+
+/* Ractors require Ruby 3.0 */
+
+void iodine_ractor_init(void) {}
+
+int iodine_ractor_pool_add(VALUE app, uint8_t count) {
+  FIO_LOG_WARNING("(listen) Ractors require Ruby 3.0, ignoring the `:ractors` "
+                  "option.");
+  return -1;
+  (void)app;
+  (void)count;
+}
+
+void iodine_ractor_on_request(http_s *h) { http_send_error(h, 500); }
+
+#endif
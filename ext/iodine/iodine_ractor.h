@@ -0,0 +1,26 @@
+#ifndef H_IODINE_RACTOR_H
+#define H_IODINE_RACTOR_H
+
+#include "iodine.h"
+
+#include "http.h"
+
+/** Initializes the Ractor request mode. */
+void iodine_ractor_init(void);
+
+/**
+ * Registers a Ractor pool for the (shareable) Rack `app` (`:ractors`).
+ *
+ * The Ractors are started once the reactor starts (in every worker).
+ *
+ * Returns -1 (after printing a warning) if Ractors aren't supported (Ruby < 3)
+ * or if the application isn't Ractor shareable.
+ *
+ * Must be called while holding the GVL.
+ */
+int iodine_ractor_pool_add(VALUE app, uint8_t count);
+
+/** An `on_request` callback that handles requests using a Ractor pool. */
+void iodine_ractor_on_request(http_s *h);
+
+#endif
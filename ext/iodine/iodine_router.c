@@ -0,0 +1,593 @@
+/*
+Copyright: Boaz Segev, 2016-2019
+License: MIT
+
+Feel free to copy, use and enjoy according to the license provided.
+*/
+#include "iodine_router.h"
+
+#include <ctype.h>
+#include <string.h>
+
+/*
+Fast routes (Iodine::Router).
+
+Routes are tested by the HTTP layer (on the IO thread) before the public folder
+and before the Rack application is called, so matching requests never build a
+Rack `env` or enter the GVL.
+
+Exact routes are found using a hash map (by path), prefix routes are tested in
+order (longest prefix first). Routes are process wide and should be set before
+the server starts, so no locks are required while handling requests.
+*/
+
+typedef struct iodine_route_s iodine_route_s;
+struct iodine_route_s {
+  /* another route for the same (exact) path, using another method */
+  iodine_route_s *next;
+  /* the route's name, used by `hits` (i.e., "GET /health") */
+  FIOBJ name;
+  /* the method, `FIOBJ_INVALID` matches any method */
+  FIOBJ method;
+  /* the path (or path prefix, without the trailing `*`) */
+  FIOBJ path;
+  /* static routes: the folder from which files are served */
+  FIOBJ folder;
+  /* prebuilt responses: an Array of header name / value pairs */
+  FIOBJ headers;
+  /* prebuilt responses: the response body */
+  FIOBJ body;
+  /* C handlers */
+  void (*handler)(http_s *h);
+  /* proxy routes: the upstreams */
+  iodine_proxy_s *proxy;
+  /* the number of requests handled by the route (per process) */
+  volatile uintptr_t hits;
+  /* prebuilt responses: the response status */
+  uint16_t status;
+  /* set for prefix routes */
+  uint8_t prefix;
+};
+
+#define FIO_SET_NAME iodine_route_map
+#define FIO_SET_OBJ_TYPE iodine_route_s *
+#define FIO_SET_OBJ_COMPARE(r1, r2) fiobj_iseq((r1)->path, (r2)->path)
+#include <fio.h>
+
+/* all the routes, by order of registration */
+static iodine_route_s **iodine_routes = NULL;
+static size_t iodine_routes_count = 0;
+/* prefix routes, longest prefix first */
+static iodine_route_s **iodine_route_prefixes = NULL;
+static size_t iodine_route_prefixes_count = 0;
+/* exact routes, by path */
+static iodine_route_map_s iodine_route_exact = FIO_SET_INIT;
+
+/* *****************************************************************************
+Handling requests
+***************************************************************************** */
+
+/* tests if the route accepts the request's method */
+static inline int iodine_route_method_match(iodine_route_s *r,
+                                            fio_str_info_s method) {
+  if (!r->method)
+    return 1;
+  fio_str_info_s m = fiobj_obj2cstr(r->method);
+  if (m.len == method.len && !memcmp(m.data, method.data, m.len))
+    return 1;
+  /* GET routes answer HEAD requests (without a body) */
+  return (method.len == 4 && !memcmp(method.data, "HEAD", 4) && m.len == 3 &&
+          !memcmp(m.data, "GET", 3));
+}
+
+/* performs the route, returns -1 if the request should be handled normally */
+static int iodine_route_perform(iodine_route_s *r, http_s *h,
+                                fio_str_info_s method) {
+  if (r->handler) {
+    fio_atomic_add(&r->hits, 1);
+    r->handler(h);
+    return 0;
+  }
+  if (r->folder) {
+    fio_str_info_s path = fiobj_obj2cstr(h->path);
+    fio_str_info_s folder = fiobj_obj2cstr(r->folder);
+    const size_t skip = fiobj_obj2cstr(r->path).len;
+    if (path.len > skip && path.data[skip] != '/')
+      return -1; /* "/assets" shouldn't match "/assets_old/file" */
+    if (http_sendfile2(h, folder.data, folder.len, path.data + skip,
+                       path.len - skip))
+      return -1; /* missing files are left to the application */
+    fio_atomic_add(&r->hits, 1);
+    return 0;
+  }
+  if (r->proxy) {
+    fio_str_info_s path = fiobj_obj2cstr(h->path);
+    const size_t skip = fiobj_obj2cstr(r->path).len;
+    if (path.len > skip && path.data[skip] != '/')
+      return -1;
+    if (iodine_proxy_request(r->proxy, h, skip))
+      return -1; /* the body was already consumed */
+    fio_atomic_add(&r->hits, 1);
+    return 0;
+  }
+  fio_atomic_add(&r->hits, 1);
+  h->status = r->status;
+  for (size_t i = 0, count = fiobj_ary_count(r->headers); i + 1 < count;
+       i += 2) {
+    http_set_header(h, fiobj_ary_index(r->headers, i),
+                    fiobj_dup(fiobj_ary_index(r->headers, i + 1)));
+  }
+  fio_str_info_s body = fiobj_obj2cstr(r->body);
+  if (method.len == 4 && !memcmp(method.data, "HEAD", 4)) {
+    http_set_header(h, HTTP_HEADER_CONTENT_LENGTH, fiobj_num_new(body.len));
+    http_finish(h);
+    return 0;
+  }
+  http_send_body(h, body.data, body.len);
+  return 0;
+}
+
+/**
+ * The HTTP `on_route` callback, handling requests that match a fast route.
+ *
+ * Returns 0 if the request was handled and -1 otherwise.
+ */
+int iodine_router_on_route(http_s *h) {
+  if (!iodine_routes_count)
+    return -1;
+  fio_str_info_s method = fiobj_obj2cstr(h->method);
+  if (iodine_route_map_count(&iodine_route_exact)) {
+    iodine_route_s key = {.path = h->path};
+    iodine_route_s *r = iodine_route_map_find(
+        &iodine_route_exact, fiobj_obj2hash(h->path), &key);
+    iodine_route_s *any = NULL;
+    /* routes for a specific method are preferred over catch-all routes */
+    for (; r; r = r->next) {
+      if (!r->method) {
+        if (!any)
+          any = r;
+      } else if (iodine_route_method_match(r, method)) {
+        return iodine_route_perform(r, h, method);
+      }
+    }
+    if (any)
+      return iodine_route_perform(any, h, method);
+  }
+  if (iodine_route_prefixes_count) {
+    fio_str_info_s path = fiobj_obj2cstr(h->path);
+    for (size_t i = 0; i < iodine_route_prefixes_count; ++i) {
+      iodine_route_s *r = iodine_route_prefixes[i];
+      fio_str_info_s prefix = fiobj_obj2cstr(r->path);
+      if (prefix.len > path.len || memcmp(prefix.data, path.data, prefix.len) ||
+          !iodine_route_method_match(r, method))
+        continue;
+      if (!iodine_route_perform(r, h, method))
+        return 0;
+    }
+  }
+  return -1;
+}
+
+/* *****************************************************************************
+Adding routes
+***************************************************************************** */
+
+static void iodine_route_free(iodine_route_s *r) {
+  fiobj_free(r->name);
+  fiobj_free(r->method);
+  fiobj_free(r->path);
+  fiobj_free(r->folder);
+  fiobj_free(r->headers);
+  fiobj_free(r->body);
+  iodine_proxy_free(r->proxy);
+  free(r);
+}
+
+/* creates a new route (the method and path are validated / normalized) */
+static iodine_route_s *iodine_route_new(const char *method, size_t method_len,
+                                        const char *path, size_t path_len) {
+  if (!path || !path_len || (path[0] != '/' && path[0] != '*') ||
+      method_len > 32)
+    return NULL;
+  iodine_route_s *r = malloc(sizeof(*r));
+  FIO_ASSERT_ALLOC(r);
+  *r = (iodine_route_s){.status = 200};
+  if (method && method_len && !(method_len == 1 && method[0] == '*')) {
+    char tmp[32];
+    for (size_t i = 0; i < method_len; ++i)
+      tmp[i] = toupper(method[i]);
+    r->method = fiobj_str_new(tmp, method_len);
+  }
+  if (path[path_len - 1] == '*') {
+    r->prefix = 1;
+    --path_len;
+  }
+  r->path = fiobj_str_new(path, path_len);
+  r->name = fiobj_str_buf(method_len + path_len + 3);
+  if (r->method)
+    fiobj_str_join(r->name, r->method);
+  else
+    fiobj_str_write(r->name, "*", 1);
+  fiobj_str_write(r->name, " ", 1);
+  fiobj_str_write(r->name, path, path_len);
+  if (r->prefix)
+    fiobj_str_write(r->name, "*", 1);
+  return r;
+}
+
+/* adds a route, replacing any existing route with the same name */
+static void iodine_route_register(iodine_route_s *r) {
+  for (size_t i = 0; i < iodine_routes_count; ++i) {
+    if (!fiobj_iseq(iodine_routes[i]->name, r->name))
+      continue;
+    /* replace the existing route's content, so it keeps its position */
+    iodine_route_s *old = iodine_routes[i];
+    r->next = old->next;
+    FIOBJ tmp[6] = {old->name,   old->method,  old->path,
+                    old->folder, old->headers, old->body};
+    iodine_proxy_free(old->proxy);
+    *old = *r;
+    for (size_t j = 0; j < 6; ++j)
+      fiobj_free(tmp[j]);
+    free(r);
+    return;
+  }
+  iodine_routes =
+      realloc(iodine_routes, sizeof(*iodine_routes) * (iodine_routes_count + 1));
+  FIO_ASSERT_ALLOC(iodine_routes);
+  iodine_routes[iodine_routes_count++] = r;
+  if (r->prefix) {
+    iodine_route_prefixes =
+        realloc(iodine_route_prefixes, sizeof(*iodine_route_prefixes) *
+                                           (iodine_route_prefixes_count + 1));
+    FIO_ASSERT_ALLOC(iodine_route_prefixes);
+    /* keep longer prefixes first */
+    const size_t len = fiobj_obj2cstr(r->path).len;
+    size_t pos = iodine_route_prefixes_count;
+    while (pos &&
+           fiobj_obj2cstr(iodine_route_prefixes[pos - 1]->path).len < len) {
+      iodine_route_prefixes[pos] = iodine_route_prefixes[pos - 1];
+      --pos;
+    }
+    iodine_route_prefixes[pos] = r;
+    ++iodine_route_prefixes_count;
+    return;
+  }
+  iodine_route_s *head = iodine_route_map_find(
+      &iodine_route_exact, fiobj_obj2hash(r->path), r);
+  if (head) {
+    while (head->next)
+      head = head->next;
+    head->next = r;
+    return;
+  }
+  iodine_route_map_insert(&iodine_route_exact, fiobj_obj2hash(r->path), r);
+}
+
+/**
+ * Routes `method` + `path` requests to a C `handler`, bypassing Ruby.
+ *
+ * Routes should be added before the server starts. Returns -1 on error.
+ */
+int iodine_router_add(const char *method, const char *path,
+                      void (*handler)(http_s *h)) {
+  if (!handler || fio_is_running())
+    return -1;
+  iodine_route_s *r = iodine_route_new(method, (method ? strlen(method) : 0),
+                                       path, (path ? strlen(path) : 0));
+  if (!r)
+    return -1;
+  r->handler = handler;
+  iodine_route_register(r);
+  return 0;
+}
+
+/* *****************************************************************************
+Ruby API
+***************************************************************************** */
+
+static void iodine_router_test_state(void) {
+  if (fio_is_running())
+    rb_raise(rb_eRuntimeError,
+             "Iodine::Router routes can't be changed while iodine is running.");
+}
+
+static iodine_route_s *iodine_route_new_rb(VALUE method, VALUE path) {
+  if (method != Qnil)
+    Check_Type(method, T_STRING);
+  Check_Type(path, T_STRING);
+  iodine_route_s *r =
+      iodine_route_new((method == Qnil ? NULL : RSTRING_PTR(method)),
+                       (method == Qnil ? 0 : RSTRING_LEN(method)),
+                       RSTRING_PTR(path), RSTRING_LEN(path));
+  if (!r)
+    rb_raise(rb_eArgError, "Iodine::Router paths must start with a `/` (or "
+                           "`*`) and methods are limited to 32 bytes.");
+  return r;
+}
+
+/* collects the prebuilt response headers (lowercase names) */
+static int iodine_route_header_rb(VALUE key, VALUE val, VALUE route_) {
+  iodine_route_s *r = (iodine_route_s *)route_;
+  if (val == Qnil)
+    return ST_CONTINUE;
+  if (TYPE(val) == T_ARRAY) {
+    for (long i = 0; i < RARRAY_LEN(val); ++i)
+      iodine_route_header_rb(key, RARRAY_AREF(val, i), route_);
+    return ST_CONTINUE;
+  }
+  key = rb_obj_as_string(key);
+  val = rb_obj_as_string(val);
+  FIOBJ name = fiobj_str_new(RSTRING_PTR(key), RSTRING_LEN(key));
+  {
+    fio_str_info_s tmp = fiobj_obj2cstr(name);
+    for (size_t i = 0; i < tmp.len; ++i)
+      tmp.data[i] = tolower(tmp.data[i]);
+  }
+  /* newline (\n) delimited values are sent as separate headers */
+  char *pos = RSTRING_PTR(val);
+  char *end = pos + RSTRING_LEN(val);
+  while (pos < end) {
+    char *start = pos;
+    pos = memchr(pos, '\n', end - pos);
+    if (!pos)
+      pos = end;
+    fiobj_ary_push(r->headers, fiobj_dup(name));
+    fiobj_ary_push(r->headers, fiobj_str_new(start, pos - start));
+    ++pos;
+  }
+  fiobj_free(name);
+  return ST_CONTINUE;
+}
+
+/* parses a Rack response Array into a prebuilt response */
+static VALUE iodine_route_response_rb(VALUE route_) {
+  iodine_route_s *r = (iodine_route_s *)((VALUE *)route_)[0];
+  VALUE response = ((VALUE *)route_)[1];
+  Check_Type(response, T_ARRAY);
+  if (RARRAY_LEN(response) != 3)
+    rb_raise(rb_eArgError, "a Rack response Array ([status, headers, body]) "
+                           "is required.");
+  VALUE status = RARRAY_AREF(response, 0);
+  VALUE headers = RARRAY_AREF(response, 1);
+  VALUE body = RARRAY_AREF(response, 2);
+  long s = NUM2LONG(status);
+  if (s < 100 || s > 999)
+    rb_raise(rb_eRangeError, "invalid HTTP status code.");
+  r->status = (uint16_t)s;
+  if (headers != Qnil) {
+    Check_Type(headers, T_HASH);
+    rb_hash_foreach(headers, iodine_route_header_rb, (VALUE)r);
+  }
+  if (TYPE(body) == T_STRING) {
+    fiobj_str_write(r->body, RSTRING_PTR(body), RSTRING_LEN(body));
+  } else if (body != Qnil) {
+    Check_Type(body, T_ARRAY);
+    for (long i = 0; i < RARRAY_LEN(body); ++i) {
+      VALUE str = RARRAY_AREF(body, i);
+      Check_Type(str, T_STRING);
+      fiobj_str_write(r->body, RSTRING_PTR(str), RSTRING_LEN(str));
+    }
+  }
+  return Qnil;
+}
+
+/* frees a route that wasn't registered (exception handling) */
+static VALUE iodine_route_response_failed_rb(VALUE route_, VALUE exception) {
+  iodine_route_free((iodine_route_s *)((VALUE *)route_)[0]);
+  rb_exc_raise(exception);
+  return Qnil;
+}
+
+/**
+Routes requests to a prebuilt response, bypassing Ruby (no `env` is created
+and the GVL isn't required).
+
+`method` is a String (i.e., `"GET"`) or `nil` (or `"*"`) for any method.
+`GET` routes also answer `HEAD` requests.
+
+`path` is the exact request path (without the query). Paths ending with `*`
+match any path starting with the same prefix.
+
+`response` is a Rack style response Array, where the body is either a String or
+an Array of Strings.
+
+      Iodine::Router.route "GET", "/health",
+                           [200, {"content-type" => "text/plain"}, ["OK"]]
+
+Routes are tested before the public folder and before the Rack application is
+called. Routes must be set before iodine starts and replace existing routes with
+the same method and path.
+*/
+static VALUE iodine_router_route(VALUE self, VALUE method, VALUE path,
+                                 VALUE response) {
+  iodine_router_test_state();
+  iodine_route_s *r = iodine_route_new_rb(method, path);
+  r->headers = fiobj_ary_new();
+  r->body = fiobj_str_buf(0);
+  VALUE args[2] = {(VALUE)r, response};
+  rb_rescue2(iodine_route_response_rb, (VALUE)args,
+             iodine_route_response_failed_rb, (VALUE)args, rb_eException,
+             (VALUE)0);
+  iodine_route_register(r);
+  return Qtrue;
+  (void)self;
+}
+
+/**
+Serves static files from `folder` for any `GET` / `HEAD` request with a path
+starting with `path`, bypassing Ruby.
+
+      Iodine::Router.static "/assets", "./public/assets"
+      # GET /assets/app.js => ./public/assets/app.js
+
+Missing files are handled by the application, same as the public folder.
+*/
+static VALUE iodine_router_static(VALUE self, VALUE path, VALUE folder) {
+  iodine_router_test_state();
+  Check_Type(path, T_STRING);
+  Check_Type(folder, T_STRING);
+  if (!RSTRING_LEN(folder))
+    rb_raise(rb_eArgError, "a static route requires a folder.");
+  /* normalize the prefix (`/assets`, `/assets/` or a trailing asterisk) */
+  VALUE prefix = rb_str_dup(path);
+  while (RSTRING_LEN(prefix) && (RSTRING_PTR(prefix)[RSTRING_LEN(prefix) - 1] ==
+                                     '*' ||
+                                 RSTRING_PTR(prefix)[RSTRING_LEN(prefix) - 1] ==
+                                     '/'))
+    rb_str_set_len(prefix, RSTRING_LEN(prefix) - 1);
+  rb_str_cat(prefix, "*", 1);
+  iodine_route_s *r = iodine_route_new_rb(rb_str_new("GET", 3), prefix);
+  /* name the route `GET /assets/` followed by an asterisk */
+  fiobj_str_resize(r->name, fiobj_obj2cstr(r->name).len - 1);
+  fiobj_str_write(r->name, "/*", 2);
+  r->folder = fiobj_str_new(RSTRING_PTR(folder), RSTRING_LEN(folder));
+  iodine_route_register(r);
+  return Qtrue;
+  (void)self;
+}
+
+/**
+Forwards any request with a path starting with `path` to the `upstreams` (a
+URL String or an Array of URLs), bypassing Ruby.
+
+      Iodine::Router.proxy "/api", ["http://10.0.0.1:3000", "http://10.0.0.2:3000"],
+                           balance: :least_conn, strip_prefix: true
+      # GET /api/users?page=2 => GET /users?page=2 (on one of the upstreams)
+
+Each upstream has its own pool of keep-alive connections and responses are
+streamed to the client as they arrive. A `"/"` path proxies all requests.
+
+The following (optional) options are supported:
+
+:balance :: `:round_robin` (default) or `:least_conn`.
+
+:pool :: The maximum number of connections per upstream (defaults to 16).
+
+:timeout :: The time (in milliseconds) allowed for the upstream to respond (or
+            send more of the response). Defaults to 30,000 (30 seconds).
+
+:max_fails :: Consecutive connection errors / timeouts before the upstream is
+              skipped (defaults to 3, 0 disables the health checks). Timeouts
+              while the upstream waits for a slow client aren't counted.
+
+:fail_timeout :: The number of seconds a failed upstream is skipped (defaults
+                 to 10).
+
+:strip_prefix :: If true, `path` is removed from the forwarded request path.
+
+Upstreams that fail to respond result in a `502` (or `504` on timeout) response.
+Requests with a body handled by `:multipart` or `stream_body` and WebSocket /
+SSE upgrades aren't proxied.
+*/
+static VALUE iodine_router_proxy(int argc, VALUE *argv, VALUE self) {
+  iodine_router_test_state();
+  if (argc < 2 || argc > 3)
+    rb_raise(rb_eArgError, "wrong number of arguments (given %d, expected 2..3)",
+             argc);
+  VALUE path = argv[0];
+  Check_Type(path, T_STRING);
+  if (!RSTRING_LEN(path) || RSTRING_PTR(path)[0] != '/')
+    rb_raise(rb_eArgError, "Iodine::Router paths must start with a `/`.");
+  /* normalize the prefix (`/api`, `/api/` or a trailing asterisk) */
+  VALUE prefix = rb_str_dup(path);
+  while (RSTRING_LEN(prefix) && (RSTRING_PTR(prefix)[RSTRING_LEN(prefix) - 1] ==
+                                     '*' ||
+                                 RSTRING_PTR(prefix)[RSTRING_LEN(prefix) - 1] ==
+                                     '/'))
+    rb_str_set_len(prefix, RSTRING_LEN(prefix) - 1);
+  rb_str_cat(prefix, "*", 1);
+  iodine_proxy_s *proxy =
+      iodine_proxy_new(argv[1], (argc == 3 ? argv[2] : Qnil));
+  iodine_route_s *r = iodine_route_new(NULL, 0, RSTRING_PTR(prefix),
+                                       RSTRING_LEN(prefix));
+  /* name the route `* /api/` followed by an asterisk */
+  fiobj_str_resize(r->name, fiobj_obj2cstr(r->name).len - 1);
+  fiobj_str_write(r->name, "/*", 2);
+  r->proxy = proxy;
+  iodine_route_register(r);
+  return Qtrue;
+  (void)self;
+}
+
+/**
+Returns a Hash with the upstreams' statistics for each proxy route (an Array of
+Hashes, by route name, see {hits}).
+
+      Iodine::Router.proxy_stats.values.first
+      # => [{url: "http://10.0.0.1:3000", down: false, ...}]
+
+See {Iodine::HTTP::Client#stats} for the connection pool statistics.
+*/
+static VALUE iodine_router_proxy_stats(VALUE self) {
+  VALUE ret = rb_hash_new();
+  for (size_t i = 0; i < iodine_routes_count; ++i) {
+    if (!iodine_routes[i]->proxy)
+      continue;
+    fio_str_info_s name = fiobj_obj2cstr(iodine_routes[i]->name);
+    rb_hash_aset(ret, rb_str_new(name.data, name.len),
+                 iodine_proxy_stats(iodine_routes[i]->proxy));
+  }
+  return ret;
+  (void)self;
+}
+
+/**
+Returns a Hash with the number of requests handled by each route (since the
+process started, counted separately by each worker process).
+
+      Iodine::Router.hits # => {"GET /health" => 12, "GET /favicon.ico" => 3}
+
+Prefix and static routes are named after their prefix followed by `/` and an
+asterisk.
+*/
+static VALUE iodine_router_hits(VALUE self) {
+  VALUE ret = rb_hash_new();
+  for (size_t i = 0; i < iodine_routes_count; ++i) {
+    fio_str_info_s name = fiobj_obj2cstr(iodine_routes[i]->name);
+    rb_hash_aset(ret, rb_str_new(name.data, name.len),
+                 SIZET2NUM(iodine_routes[i]->hits));
+  }
+  return ret;
+  (void)self;
+}
+
+/** Removes all the routes. Routes can't be changed while iodine is running. */
+static VALUE iodine_router_clear(VALUE self) {
+  iodine_router_test_state();
+  iodine_route_map_free(&iodine_route_exact);
+  iodine_route_exact = (iodine_route_map_s)FIO_SET_INIT;
+  for (size_t i = 0; i < iodine_routes_count; ++i)
+    iodine_route_free(iodine_routes[i]);
+  free(iodine_routes);
+  free(iodine_route_prefixes);
+  iodine_routes = NULL;
+  iodine_route_prefixes = NULL;
+  iodine_routes_count = 0;
+  iodine_route_prefixes_count = 0;
+  return self;
+}
+
+/** Initializes the Iodine::Router module. */
+void iodine_router_init(void) {
+  /**
+  Iodine::Router handles constant endpoints (health checks, readiness probes,
+  etc') and static folders before the Rack application is called, without
+  creating a Rack `env` or entering the GVL.
+
+        Iodine::Router.route "GET", "/ping", [200, {}, ["pong"]]
+        Iodine::Router.static "/assets", "./public/assets"
+        Iodine::Router.proxy "/api", "http://localhost:3000"
+        Iodine.listen service: :http, handler: APP
+        Iodine.start
+
+  The routes are shared by all the HTTP services in the process.
+  */
+  VALUE tmp = rb_define_module_under(IodineModule, "Router");
+  rb_define_module_function(tmp, "route", iodine_router_route, 3);
+  rb_define_module_function(tmp, "static", iodine_router_static, 2);
+  rb_define_module_function(tmp, "proxy", iodine_router_proxy, -1);
+  rb_define_module_function(tmp, "proxy_stats", iodine_router_proxy_stats, 0);
+  rb_define_module_function(tmp, "hits", iodine_router_hits, 0);
+  rb_define_module_function(tmp, "clear", iodine_router_clear, 0);
+}
@@ -0,0 +1,30 @@
+#ifndef H_IODINE_ROUTER_H
+#define H_IODINE_ROUTER_H
+
+#include "iodine.h"
+
+#include "http.h"
+
+/** Initializes the Iodine::Router module. */
+void iodine_router_init(void);
+
+/**
+ * Routes `method` + `path` requests to a C `handler`, bypassing Ruby.
+ *
+ * A `NULL` (or `"*"`) `method` matches any method and a `path` ending with `*`
+ * is a prefix route. The handler is called from an IO thread (the GVL isn't
+ * held) and must send a response (i.e., using `http_finish`).
+ *
+ * Routes should be added before the server starts. Returns -1 on error.
+ */
+int iodine_router_add(const char *method, const char *path,
+                      void (*handler)(http_s *h));
+
+/**
+ * The HTTP `on_route` callback, handling requests that match a fast route.
+ *
+ * Returns 0 if the request was handled and -1 otherwise.
+ */
+int iodine_router_on_route(http_s *h);
+
+#endif
@@ -0,0 +1,754 @@
+/*
+Copyright: Boaz Segev, 2016-2019
+License: MIT
+
+Feel free to copy, use and enjoy according to the license provided.
+*/
+#include "iodine_scheduler.h"
+
+#include <ruby/thread.h>
+#include <ruby/version.h>
+
+#include <pthread.h>
+#include <unistd.h>
+
+/*
+The Iodine::Scheduler class implements a Ruby 3.0 `Fiber::Scheduler` using the
+facil.io reactor.
+
+A scheduler's fibers are resumed by the scheduler's thread, so events (IO
+readiness, timers, wake up calls and new tasks) are collected in a thread safe
+queue, which is consumed by the scheduler's thread (see `run`).
+
+IO readiness is reported by attaching a duplicated file descriptor to the
+reactor (the original file descriptor remains owned by the Ruby IO object) and
+timers are facil.io timers.
+*/
+
+#if RUBY_API_VERSION_MAJOR >= 3
+
+static VALUE IodineSchedulerClass;
+static VALUE FiberClass;
+
+static ID blocked_var_id;
+static ID fileno_id;
+static ID new_id;
+static ID raise_id;
+static ID resume_id;
+static ID run_id;
+static ID set_scheduler_id;
+static ID suspended_var_id;
+static ID timeouts_var_id;
+static ID waiting_var_id;
+static VALUE blocking_sym;
+
+/* the value reported for timers */
+#define IODINE_SCHEDULER_TIMEOUT (-1)
+/* the value reported by `unblock` */
+#define IODINE_SCHEDULER_WAKEUP (-2)
+
+/* Ruby's IO::READABLE, IO::PRIORITY and IO::WRITABLE */
+#define IODINE_SCHEDULER_READABLE 1
+#define IODINE_SCHEDULER_PRIORITY 2
+#define IODINE_SCHEDULER_WRITABLE 4
+
+/* *****************************************************************************
+The event queue
+***************************************************************************** */
+
+typedef struct iodine_scheduler_event_s {
+  struct iodine_scheduler_event_s *next;
+  /* the waiting fiber's id, 0 for C tasks */
+  uint64_t id;
+  int64_t value;
+  void (*task)(void *);
+  void *arg;
+} iodine_scheduler_event_s;
+
+typedef struct {
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  iodine_scheduler_event_s *head;
+  iodine_scheduler_event_s **tail;
+  /* the Ruby object, IO watches and timers hold references */
+  volatile uintptr_t ref;
+  /* the last id used (only accessed by the scheduler's thread) */
+  uint64_t last_id;
+  uint8_t waiting;
+  uint8_t interrupt;
+  uint8_t closed;
+} iodine_scheduler_s;
+
+static iodine_scheduler_s *iodine_scheduler_new(void) {
+  iodine_scheduler_s *s = fio_malloc(sizeof(*s));
+  FIO_ASSERT_ALLOC(s);
+  *s = (iodine_scheduler_s){.ref = 1};
+  s->tail = &s->head;
+  pthread_mutex_init(&s->lock, NULL);
+  pthread_cond_init(&s->cond, NULL);
+  return s;
+}
+
+static inline iodine_scheduler_s *iodine_scheduler_dup(iodine_scheduler_s *s) {
+  fio_atomic_add(&s->ref, 1);
+  return s;
+}
+
+static void iodine_scheduler_free(iodine_scheduler_s *s) {
+  if (fio_atomic_sub(&s->ref, 1))
+    return;
+  while (s->head) {
+    iodine_scheduler_event_s *ev = s->head;
+    s->head = ev->next;
+    fio_free(ev);
+  }
+  pthread_mutex_destroy(&s->lock);
+  pthread_cond_destroy(&s->cond);
+  fio_free(s);
+}
+
+/* adds an event to the queue, can be called from any thread */
+static void iodine_scheduler_push(iodine_scheduler_s *s, uint64_t id,
+                                  int64_t value, void (*task)(void *),
+                                  void *arg) {
+  iodine_scheduler_event_s *ev = fio_malloc(sizeof(*ev));
+  FIO_ASSERT_ALLOC(ev);
+  *ev = (iodine_scheduler_event_s){
+      .id = id, .value = value, .task = task, .arg = arg};
+  pthread_mutex_lock(&s->lock);
+  *s->tail = ev;
+  s->tail = &ev->next;
+  if (s->waiting)
+    pthread_cond_signal(&s->cond);
+  pthread_mutex_unlock(&s->lock);
+}
+
+/* *****************************************************************************
+Waking up the reactor (new timers might be due before the next poll cycle)
+***************************************************************************** */
+
+static struct {
+  fio_protocol_s pr;
+  intptr_t uuid;
+  int out;
+  pid_t pid;
+  fio_lock_i lock;
+} iodine_scheduler_waker = {.uuid = -1, .out = -1};
+
+static void iodine_scheduler_waker_on_data(intptr_t uuid, fio_protocol_s *pr) {
+  char buf[64];
+  while (fio_read(uuid, buf, 64) > 0)
+    ;
+  (void)pr;
+}
+
+static void iodine_scheduler_waker_on_close(intptr_t uuid,
+                                            fio_protocol_s *pr) {
+  fio_lock(&iodine_scheduler_waker.lock);
+  if (iodine_scheduler_waker.uuid == uuid) {
+    close(iodine_scheduler_waker.out);
+    iodine_scheduler_waker.out = -1;
+    iodine_scheduler_waker.uuid = -1;
+  }
+  fio_unlock(&iodine_scheduler_waker.lock);
+  (void)pr;
+}
+
+static void iodine_scheduler_waker_ping(intptr_t uuid, fio_protocol_s *pr) {
+  fio_touch(uuid);
+  (void)pr;
+}
+
+/* makes sure the reactor reviews the timers (call after adding a timer) */
+static void iodine_scheduler_wake_reactor(void) {
+  fio_lock(&iodine_scheduler_waker.lock);
+  if (iodine_scheduler_waker.pid != getpid() ||
+      !fio_is_valid(iodine_scheduler_waker.uuid)) {
+    /* (re)create the pipe (first call, after forking or after shutdown) */
+    int fds[2];
+    iodine_scheduler_waker.uuid = -1;
+    iodine_scheduler_waker.out = -1;
+    if (pipe(fds))
+      goto finish;
+    fio_set_non_block(fds[0]);
+    fio_set_non_block(fds[1]);
+    iodine_scheduler_waker.pr = (fio_protocol_s){
+        .on_data = iodine_scheduler_waker_on_data,
+        .on_close = iodine_scheduler_waker_on_close,
+        .ping = iodine_scheduler_waker_ping,
+    };
+    iodine_scheduler_waker.pid = getpid();
+    iodine_scheduler_waker.out = fds[1];
+    iodine_scheduler_waker.uuid = fio_fd2uuid(fds[0]);
+    fio_attach_fd(fds[0], &iodine_scheduler_waker.pr);
+    fio_timeout_set(iodine_scheduler_waker.uuid, 0);
+  }
+  if (iodine_scheduler_waker.out != -1 &&
+      write(iodine_scheduler_waker.out, "", 1) == -1) {
+    /* the pipe is full, the reactor will wake up anyway */
+  }
+finish:
+  fio_unlock(&iodine_scheduler_waker.lock);
+}
+
+/* *****************************************************************************
+IO readiness and timers
+***************************************************************************** */
+
+typedef struct {
+  fio_protocol_s pr;
+  iodine_scheduler_s *s;
+  uint64_t id;
+  int events;
+  fio_lock_i fired;
+} iodine_scheduler_watch_s;
+
+static void iodine_scheduler_watch_fire(intptr_t uuid,
+                                        iodine_scheduler_watch_s *w,
+                                        int events) {
+  if (fio_trylock(&w->fired))
+    return;
+  iodine_scheduler_push(w->s, w->id, events, NULL, NULL);
+  fio_force_close(uuid);
+}
+
+static void iodine_scheduler_watch_on_data(intptr_t uuid, fio_protocol_s *pr) {
+  iodine_scheduler_watch_s *w = (iodine_scheduler_watch_s *)pr;
+  if ((w->events & (IODINE_SCHEDULER_READABLE | IODINE_SCHEDULER_PRIORITY)))
+    iodine_scheduler_watch_fire(
+        uuid, w,
+        (w->events & (IODINE_SCHEDULER_READABLE | IODINE_SCHEDULER_PRIORITY)));
+}
+
+static void iodine_scheduler_watch_on_ready(intptr_t uuid,
+                                            fio_protocol_s *pr) {
+  iodine_scheduler_watch_s *w = (iodine_scheduler_watch_s *)pr;
+  if ((w->events & IODINE_SCHEDULER_WRITABLE))
+    iodine_scheduler_watch_fire(uuid, w, IODINE_SCHEDULER_WRITABLE);
+}
+
+static void iodine_scheduler_watch_on_close(intptr_t uuid,
+                                            fio_protocol_s *pr) {
+  iodine_scheduler_watch_s *w = (iodine_scheduler_watch_s *)pr;
+  /* errors, hang ups and shutdown: the IO will report the actual state */
+  if (!fio_trylock(&w->fired))
+    iodine_scheduler_push(w->s, w->id, w->events, NULL, NULL);
+  iodine_scheduler_free(w->s);
+  fio_free(w);
+  (void)uuid;
+}
+
+static void iodine_scheduler_watch_ping(intptr_t uuid, fio_protocol_s *pr) {
+  fio_touch(uuid);
+  (void)pr;
+}
+
+typedef struct {
+  iodine_scheduler_s *s;
+  uint64_t id;
+} iodine_scheduler_timer_s;
+
+static void iodine_scheduler_timer_on_due(void *t_) {
+  iodine_scheduler_timer_s *t = t_;
+  iodine_scheduler_push(t->s, t->id, IODINE_SCHEDULER_TIMEOUT, NULL, NULL);
+}
+
+static void iodine_scheduler_timer_on_finish(void *t_) {
+  iodine_scheduler_timer_s *t = t_;
+  iodine_scheduler_free(t->s);
+  fio_free(t);
+}
+
+/* reports `events` using the `id` once `fd` is ready (returns a watch uuid) */
+static intptr_t iodine_scheduler_watch(iodine_scheduler_s *s, int fd,
+                                       int events, uint64_t id) {
+  if (!fio_is_running())
+    rb_raise(rb_eRuntimeError, "Iodine::Scheduler requires a running reactor "
+                               "(see Iodine.start).");
+  int dup_fd = dup(fd);
+  if (dup_fd == -1)
+    rb_sys_fail("Iodine::Scheduler couldn't duplicate the file descriptor");
+  if ((size_t)dup_fd >= fio_capa()) {
+    close(dup_fd);
+    rb_raise(rb_eRuntimeError, "Iodine::Scheduler is out of file descriptors.");
+  }
+  iodine_scheduler_watch_s *w = fio_malloc(sizeof(*w));
+  FIO_ASSERT_ALLOC(w);
+  *w = (iodine_scheduler_watch_s){
+      .pr =
+          {
+              .on_data = iodine_scheduler_watch_on_data,
+              .on_ready = iodine_scheduler_watch_on_ready,
+              .on_close = iodine_scheduler_watch_on_close,
+              .ping = iodine_scheduler_watch_ping,
+          },
+      .s = iodine_scheduler_dup(s),
+      .id = id,
+      .events = events,
+  };
+  intptr_t uuid = fio_fd2uuid(dup_fd);
+  /* the file descriptor is a duplicate, mark it before it's polled */
+  fio_poll_shared(uuid);
+  fio_attach_fd(dup_fd, &w->pr);
+  fio_timeout_set(uuid, 0);
+  return uuid;
+}
+
+/* stops watching a file descriptor (see `iodine_scheduler_watch`) */
+static void iodine_scheduler_unwatch(intptr_t uuid) {
+  if (uuid == -1 || !fio_is_valid(uuid))
+    return;
+  fio_force_close(uuid);
+}
+
+/* reports a timeout using the `id` after `ms` milliseconds */
+static void iodine_scheduler_timer(iodine_scheduler_s *s, size_t ms,
+                                   uint64_t id) {
+  iodine_scheduler_timer_s *t = fio_malloc(sizeof(*t));
+  FIO_ASSERT_ALLOC(t);
+  *t = (iodine_scheduler_timer_s){.s = iodine_scheduler_dup(s), .id = id};
+  fio_run_every((ms ? ms : 1), 1, iodine_scheduler_timer_on_due, t,
+                iodine_scheduler_timer_on_finish);
+  if (ms < 1000 && fio_is_running())
+    iodine_scheduler_wake_reactor();
+}
+
+/* converts a Ruby duration (in seconds) to milliseconds */
+static size_t iodine_scheduler_duration2ms(VALUE duration) {
+  double ms = NUM2DBL(duration) * 1000;
+  if (ms <= 0)
+    return 0;
+  return (size_t)ms + ((double)(size_t)ms < ms);
+}
+
+/* *****************************************************************************
+Ruby object
+***************************************************************************** */
+
+static void iodine_scheduler_data_free(void *s_) { iodine_scheduler_free(s_); }
+
+static size_t iodine_scheduler_data_size(const void *s_) {
+  return sizeof(iodine_scheduler_s);
+  (void)s_;
+}
+
+static const rb_data_type_t iodine_scheduler_data_type = {
+    .wrap_struct_name = "IodineSchedulerData",
+    .function =
+        {
+            .dmark = NULL,
+            .dfree = iodine_scheduler_data_free,
+            .dsize = iodine_scheduler_data_size,
+        },
+    .data = NULL,
+    // .flags = RUBY_TYPED_FREE_IMMEDIATELY,
+};
+
+static VALUE iodine_scheduler_data_alloc_c(VALUE klass) {
+  VALUE self = TypedData_Wrap_Struct(klass, &iodine_scheduler_data_type,
+                                     iodine_scheduler_new());
+  /* fiber state is kept in hidden instance variables (marked by Ruby) */
+  rb_ivar_set(self, waiting_var_id, rb_hash_new());     /* id => fiber */
+  rb_ivar_set(self, suspended_var_id, rb_hash_new());   /* fiber => id */
+  rb_ivar_set(self, blocked_var_id, rb_hash_new());     /* fiber => id */
+  rb_ivar_set(self, timeouts_var_id, rb_hash_new());    /* id => [fiber, ...] */
+  return self;
+}
+
+static inline iodine_scheduler_s *iodine_scheduler2c(VALUE self) {
+  iodine_scheduler_s *s;
+  TypedData_Get_Struct(self, iodine_scheduler_s, &iodine_scheduler_data_type,
+                       s);
+  return s;
+}
+
+/* converts an event's value to the value returned by a suspended fiber */
+static inline VALUE iodine_scheduler_value2rb(int64_t value) {
+  switch (value) {
+  case IODINE_SCHEDULER_TIMEOUT:
+    return Qfalse;
+  case IODINE_SCHEDULER_WAKEUP:
+    return Qtrue;
+  }
+  return LL2NUM(value);
+}
+
+/* *****************************************************************************
+Suspending and resuming fibers
+***************************************************************************** */
+
+typedef struct {
+  iodine_scheduler_s *s;
+  iodine_scheduler_event_s *events;
+  uint8_t block;
+} iodine_scheduler_wait_s;
+
+static void *iodine_scheduler_wait_no_gvl(void *args_) {
+  iodine_scheduler_wait_s *args = args_;
+  iodine_scheduler_s *s = args->s;
+  pthread_mutex_lock(&s->lock);
+  while (!s->head && args->block && !s->interrupt) {
+    s->waiting = 1;
+    pthread_cond_wait(&s->cond, &s->lock);
+    s->waiting = 0;
+  }
+  args->events = s->head;
+  s->head = NULL;
+  s->tail = &s->head;
+  s->interrupt = 0;
+  pthread_mutex_unlock(&s->lock);
+  return NULL;
+}
+
+static void iodine_scheduler_wait_ubf(void *s_) {
+  iodine_scheduler_s *s = s_;
+  pthread_mutex_lock(&s->lock);
+  s->interrupt = 1;
+  pthread_cond_signal(&s->cond);
+  pthread_mutex_unlock(&s->lock);
+}
+
+/* performs a C task (see `iodine_scheduler_defer`) within a new fiber */
+static VALUE iodine_scheduler_task_proc(RB_BLOCK_CALL_FUNC_ARGLIST(arg,
+                                                                   ev_)) {
+  iodine_scheduler_event_s *ev = (iodine_scheduler_event_s *)ev_;
+  void (*task)(void *) = ev->task;
+  void *udata = ev->arg;
+  fio_free(ev);
+  task(udata);
+  return Qnil;
+  (void)arg;
+}
+
+/* creates a new non-blocking fiber */
+static VALUE iodine_scheduler_fiber_new(VALUE proc) {
+  VALUE opt = rb_hash_new();
+  rb_hash_aset(opt, blocking_sym, Qfalse);
+  return rb_funcall_with_block_kw(FiberClass, new_id, 1, &opt, proc,
+                                  RB_PASS_KEYWORDS);
+}
+
+/* waits for events (when `block` is set) and resumes the relevant fibers */
+static void iodine_scheduler_dispatch(VALUE self, uint8_t block) {
+  iodine_scheduler_wait_s args = {.s = iodine_scheduler2c(self),
+                                  .block = block};
+  if (block)
+    rb_thread_call_without_gvl(iodine_scheduler_wait_no_gvl, &args,
+                               iodine_scheduler_wait_ubf, args.s);
+  else
+    iodine_scheduler_wait_no_gvl(&args);
+  VALUE waiting = rb_ivar_get(self, waiting_var_id);
+  VALUE suspended = rb_ivar_get(self, suspended_var_id);
+  VALUE timeouts = rb_ivar_get(self, timeouts_var_id);
+  /* fibers are resumed by the scheduler's thread, which holds the GVL */
+  uint8_t in_GVL = IodineCaller.in_GVL();
+  IodineCaller.set_GVL(1);
+  while (args.events) {
+    iodine_scheduler_event_s *ev = args.events;
+    args.events = ev->next;
+    if (ev->task) {
+      VALUE fiber = iodine_scheduler_fiber_new(
+          rb_proc_new(iodine_scheduler_task_proc, (VALUE)ev));
+      IodineCaller.call(fiber, resume_id);
+      continue;
+    }
+    VALUE id = ULL2NUM(ev->id);
+    VALUE value = iodine_scheduler_value2rb(ev->value);
+    fio_free(ev);
+    VALUE fiber = rb_hash_lookup2(waiting, id, Qnil);
+    if (fiber != Qnil) {
+      IodineCaller.call2(fiber, resume_id, 1, &value);
+      continue;
+    }
+    VALUE timeout = rb_hash_delete(timeouts, id);
+    if (timeout == Qnil)
+      continue; /* stale event (i.e., a timer that wasn't needed) */
+    fiber = rb_ary_entry(timeout, 0);
+    if (rb_hash_lookup2(suspended, fiber, Qnil) == Qnil)
+      continue; /* the fiber isn't waiting on this scheduler */
+    IodineCaller.call2(fiber, raise_id, (int)(RARRAY_LEN(timeout) - 1),
+                       (VALUE *)RARRAY_CONST_PTR(timeout) + 1);
+  }
+  IodineCaller.set_GVL(in_GVL);
+}
+
+typedef struct {
+  VALUE self;
+  VALUE id;
+  VALUE fiber;
+  intptr_t watch;
+  uint8_t blocked;
+} iodine_scheduler_suspend_s;
+
+static VALUE iodine_scheduler_suspend_yield(VALUE args_) {
+  iodine_scheduler_suspend_s *args = (iodine_scheduler_suspend_s *)args_;
+  rb_hash_aset(rb_ivar_get(args->self, waiting_var_id), args->id, args->fiber);
+  rb_hash_aset(rb_ivar_get(args->self, suspended_var_id), args->fiber,
+               args->id);
+  if (args->blocked)
+    rb_hash_aset(rb_ivar_get(args->self, blocked_var_id), args->fiber,
+                 args->id);
+  return rb_fiber_yield(0, NULL);
+}
+
+static VALUE iodine_scheduler_suspend_cleanup(VALUE args_) {
+  iodine_scheduler_suspend_s *args = (iodine_scheduler_suspend_s *)args_;
+  rb_hash_delete(rb_ivar_get(args->self, waiting_var_id), args->id);
+  rb_hash_delete(rb_ivar_get(args->self, suspended_var_id), args->fiber);
+  if (args->blocked)
+    rb_hash_delete(rb_ivar_get(args->self, blocked_var_id), args->fiber);
+  iodine_scheduler_unwatch(args->watch);
+  return Qnil;
+}
+
+/* suspends the current fiber until an event is reported using `id` */
+static VALUE iodine_scheduler_suspend(VALUE self, uint64_t id, intptr_t watch,
+                                      uint8_t blocked) {
+  iodine_scheduler_suspend_s args = {
+      .self = self,
+      .id = ULL2NUM(id),
+      .fiber = rb_fiber_current(),
+      .watch = watch,
+      .blocked = blocked,
+  };
+  return rb_ensure(iodine_scheduler_suspend_yield, (VALUE)&args,
+                   iodine_scheduler_suspend_cleanup, (VALUE)&args);
+}
+
+/* *****************************************************************************
+The Fiber::Scheduler interface
+***************************************************************************** */
+
+/**
+Waits for the IO to become readable / writable (`events` is a combination of
+`IO::READABLE`, `IO::PRIORITY` and `IO::WRITABLE`).
+
+Returns the (possibly) ready events or `false` on timeout.
+*/
+static VALUE iodine_scheduler_io_wait(VALUE self, VALUE io, VALUE events,
+                                      VALUE timeout) {
+  iodine_scheduler_s *s = iodine_scheduler2c(self);
+  uint64_t id = ++s->last_id;
+  int fd = NUM2INT(rb_funcall(io, fileno_id, 0));
+  intptr_t watch = iodine_scheduler_watch(s, fd, NUM2INT(events), id);
+  if (timeout != Qnil)
+    iodine_scheduler_timer(s, iodine_scheduler_duration2ms(timeout), id);
+  return iodine_scheduler_suspend(self, id, watch, 0);
+}
+
+/** Suspends the current fiber for `duration` seconds (or forever). */
+static VALUE iodine_scheduler_kernel_sleep(int argc, VALUE *argv, VALUE self) {
+  iodine_scheduler_s *s = iodine_scheduler2c(self);
+  uint64_t id = ++s->last_id;
+  rb_check_arity(argc, 0, 1);
+  if (argc && argv[0] != Qnil)
+    iodine_scheduler_timer(s, iodine_scheduler_duration2ms(argv[0]), id);
+  iodine_scheduler_suspend(self, id, -1, 0);
+  return Qtrue;
+}
+
+/**
+Suspends the current fiber until `unblock` is called (i.e., waiting for a
+Mutex or a Queue) or until `timeout` seconds have passed.
+
+Returns `false` on timeout.
+*/
+static VALUE iodine_scheduler_block(int argc, VALUE *argv, VALUE self) {
+  iodine_scheduler_s *s = iodine_scheduler2c(self);
+  uint64_t id = ++s->last_id;
+  rb_check_arity(argc, 1, 2);
+  if (argc == 2 && argv[1] != Qnil)
+    iodine_scheduler_timer(s, iodine_scheduler_duration2ms(argv[1]), id);
+  return iodine_scheduler_suspend(self, id, -1, 1);
+}
+
+/** Resumes a fiber suspended by `block`. Can be called by any thread. */
+static VALUE iodine_scheduler_unblock(VALUE self, VALUE blocker, VALUE fiber) {
+  VALUE id = rb_hash_delete(rb_ivar_get(self, blocked_var_id), fiber);
+  if (id != Qnil)
+    iodine_scheduler_push(iodine_scheduler2c(self), NUM2ULL(id),
+                          IODINE_SCHEDULER_WAKEUP, NULL, NULL);
+  return Qnil;
+  (void)blocker;
+}
+
+/** Runs the block within a new non-blocking fiber (see `Fiber.schedule`). */
+static VALUE iodine_scheduler_fiber(int argc, VALUE *argv, VALUE self) {
+  rb_need_block();
+  VALUE fiber = iodine_scheduler_fiber_new(rb_block_proc());
+  rb_fiber_resume(fiber, argc, argv);
+  return fiber;
+  (void)self;
+}
+
+static VALUE iodine_scheduler_timeout_cleanup(VALUE id) {
+  rb_hash_delete(rb_ivar_get(rb_ary_entry(id, 1), timeouts_var_id),
+                 rb_ary_entry(id, 0));
+  return Qnil;
+}
+
+/**
+Runs the block, raising the exception (`klass`, `message`) within the current
+fiber if the block didn't return within `duration` seconds.
+*/
+static VALUE iodine_scheduler_timeout_after(int argc, VALUE *argv,
+                                            VALUE self) {
+  iodine_scheduler_s *s = iodine_scheduler2c(self);
+  rb_check_arity(argc, 2, UNLIMITED_ARGUMENTS);
+  rb_need_block();
+  uint64_t id = ++s->last_id;
+  VALUE timeout = rb_ary_new_from_values(argc, argv);
+  rb_ary_store(timeout, 0, rb_fiber_current());
+  rb_hash_aset(rb_ivar_get(self, timeouts_var_id), ULL2NUM(id), timeout);
+  iodine_scheduler_timer(s, iodine_scheduler_duration2ms(argv[0]), id);
+  return rb_ensure(rb_yield, argv[0], iodine_scheduler_timeout_cleanup,
+                   rb_ary_new_from_args(2, ULL2NUM(id), self));
+}
+
+/**
+Runs the scheduler's event loop until `close` is called.
+
+This is called by iodine's own scheduler thread and is only needed for custom
+scheduler threads that do nothing but run fibers.
+*/
+static VALUE iodine_scheduler_run(VALUE self) {
+  iodine_scheduler_s *s = iodine_scheduler2c(self);
+  while (!s->closed)
+    iodine_scheduler_dispatch(self, 1);
+  return self;
+}
+
+/** Runs the event loop until all the suspended fibers have completed. */
+static VALUE iodine_scheduler_close(VALUE self) {
+  iodine_scheduler_s *s = iodine_scheduler2c(self);
+  s->closed = 1;
+  while (RHASH_SIZE(rb_ivar_get(self, waiting_var_id)))
+    iodine_scheduler_dispatch(self, 1);
+  return Qnil;
+}
+
+/* *****************************************************************************
+The process wide scheduler thread (Rack requests running in fibers)
+***************************************************************************** */
+
+static VALUE iodine_scheduler_runner = Qnil;
+static iodine_scheduler_s *iodine_scheduler_runner_c;
+static pid_t iodine_scheduler_runner_pid;
+
+static VALUE iodine_scheduler_runner_thread(void *scheduler_) {
+  VALUE scheduler = (VALUE)scheduler_;
+  IodineCaller.set_GVL(1);
+  rb_funcall(FiberClass, set_scheduler_id, 1, scheduler);
+  IodineCaller.call(scheduler, run_id);
+  return Qnil;
+}
+
+/**
+ * Starts the process wide fiber scheduler thread (if it isn't running).
+ */
+int iodine_scheduler_start(void) {
+  if (iodine_scheduler_runner != Qnil &&
+      iodine_scheduler_runner_pid == getpid())
+    return 0;
+  if (!rb_respond_to(FiberClass, set_scheduler_id))
+    return -1;
+  iodine_scheduler_runner = rb_funcall(IodineSchedulerClass, new_id, 0);
+  if (iodine_scheduler_runner_c)
+    iodine_scheduler_free(iodine_scheduler_runner_c);
+  iodine_scheduler_runner_c =
+      iodine_scheduler_dup(iodine_scheduler2c(iodine_scheduler_runner));
+  iodine_scheduler_runner_pid = getpid();
+  rb_thread_create(iodine_scheduler_runner_thread,
+                   (void *)iodine_scheduler_runner);
+  return 0;
+}
+
+/* stops the scheduler thread once the reactor stops */
+static void iodine_scheduler_on_finish(void *ignr_) {
+  iodine_scheduler_s *s = iodine_scheduler_runner_c;
+  if (!s || iodine_scheduler_runner_pid != getpid())
+    return;
+  pthread_mutex_lock(&s->lock);
+  s->closed = 1;
+  s->interrupt = 1;
+  pthread_cond_signal(&s->cond);
+  pthread_mutex_unlock(&s->lock);
+  /* a new scheduler thread is started if the reactor is restarted */
+  iodine_scheduler_runner_pid = 0;
+  (void)ignr_;
+}
+
+/**
+ * Runs `task` within a new (non-blocking) fiber on the fiber scheduler thread.
+ */
+void iodine_scheduler_defer(void (*task)(void *), void *arg) {
+  iodine_scheduler_push(iodine_scheduler_runner_c, 0, 0, task, arg);
+}
+
+/* *****************************************************************************
+Initialization
+***************************************************************************** */
+
+void iodine_scheduler_init(void) {
+  blocked_var_id = rb_intern2("blocked", 7);
+  fileno_id = rb_intern2("fileno", 6);
+  new_id = rb_intern2("new", 3);
+  raise_id = rb_intern2("raise", 5);
+  resume_id = rb_intern2("resume", 6);
+  run_id = rb_intern2("run", 3);
+  set_scheduler_id = rb_intern("set_scheduler");
+  suspended_var_id = rb_intern2("suspended", 9);
+  timeouts_var_id = rb_intern2("timeouts", 8);
+  waiting_var_id = rb_intern2("waiting", 7);
+  blocking_sym = ID2SYM(rb_intern2("blocking", 8));
+  FiberClass = rb_const_get(rb_cObject, rb_intern2("Fiber", 5));
+  rb_global_variable(&iodine_scheduler_runner);
+  fio_state_callback_add(FIO_CALL_ON_FINISH, iodine_scheduler_on_finish, NULL);
+
+  /**
+  A Ruby 3.0 `Fiber::Scheduler` backed by the iodine reactor (IO readiness is
+  polled by the reactor and sleep / timeouts use iodine's timers).
+
+  The scheduler requires a running reactor (see {Iodine.start}):
+
+        Iodine.run do
+          Thread.new do
+            Fiber.set_scheduler Iodine::Scheduler.new
+            Fiber.schedule { sleep 1 ; puts "world" }
+            Fiber.schedule { puts "hello" }
+          end
+        end
+
+  The HTTP `:fiber` option (see {Iodine.listen}) runs Rack requests within
+  fibers managed by a process wide Iodine::Scheduler.
+  */
+  IodineSchedulerClass =
+      rb_define_class_under(IodineModule, "Scheduler", rb_cObject);
+  rb_define_alloc_func(IodineSchedulerClass, iodine_scheduler_data_alloc_c);
+  rb_define_method(IodineSchedulerClass, "io_wait", iodine_scheduler_io_wait,
+                   3);
+  rb_define_method(IodineSchedulerClass, "kernel_sleep",
+                   iodine_scheduler_kernel_sleep, -1);
+  rb_define_method(IodineSchedulerClass, "block", iodine_scheduler_block, -1);
+  rb_define_method(IodineSchedulerClass, "unblock", iodine_scheduler_unblock,
+                   2);
+  rb_define_method(IodineSchedulerClass, "fiber", iodine_scheduler_fiber, -1);
+  rb_define_method(IodineSchedulerClass, "timeout_after",
+                   iodine_scheduler_timeout_after, -1);
+  rb_define_method(IodineSchedulerClass, "run", iodine_scheduler_run, 0);
+  rb_define_method(IodineSchedulerClass, "close", iodine_scheduler_close, 0);
+}
+
+#else /* RUBY_API_VERSION_MAJOR < 3 */
+
+/* fiber schedulers require Ruby 3.0 */
+
+void iodine_scheduler_init(void) {}
+
+int iodine_scheduler_start(void) { return -1; }
+
+void iodine_scheduler_defer(void (*task)(void *), void *arg) {
+  task(arg);
+}
+
+#endif
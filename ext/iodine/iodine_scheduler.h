@@ -0,0 +1,26 @@
+#ifndef H_IODINE_SCHEDULER_H
+#define H_IODINE_SCHEDULER_H
+
+#include "iodine.h"
+
+/** Initializes the Iodine::Scheduler class. */
+void iodine_scheduler_init(void);
+
+/**
+ * Starts the process wide fiber scheduler thread (if it isn't running).
+ *
+ * Returns -1 if fiber schedulers aren't supported (Ruby < 3.0).
+ *
+ * Must be called while holding the GVL.
+ */
+int iodine_scheduler_start(void);
+
+/**
+ * Runs `task` within a new (non-blocking) fiber on the fiber scheduler thread.
+ *
+ * Can be called from any thread (the GVL isn't required), but only after a
+ * successful call to `iodine_scheduler_start`.
+ */
+void iodine_scheduler_defer(void (*task)(void *), void *arg);
+
+#endif
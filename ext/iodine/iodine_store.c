@@ -9,65 +9,100 @@
 #define FIO_SET_OBJ_TYPE uintptr_t
 #include <fio.h>
 
-static fio_lock_i iodine_storage_lock = FIO_LOCK_INIT;
-static fio_store_s iodine_storage = FIO_SET_INIT;
+#ifndef IODINE_STORE_SHARDS
+/* the number of (separately locked) storage shards, must be a power of 2 */
+#define IODINE_STORE_SHARDS 16
+#endif
+
+/* objects are sharded by their address, so locks are rarely contended */
+static struct {
+  fio_lock_i lock;
+  fio_store_s set;
+} iodine_storage[IODINE_STORE_SHARDS];
 static size_t iodine_storage_count_max = 0;
 
 #ifndef IODINE_DEBUG
 #define IODINE_DEBUG 0
 #endif
 
+static inline size_t storage_shard(VALUE obj) {
+  /* object slots are (at least) 8 byte aligned, mix the remaining bits */
+  return (size_t)((((uint64_t)obj >> 3) * 0x9E3779B97F4A7C15ULL) >> 32) &
+         (IODINE_STORE_SHARDS - 1);
+}
+
+static size_t storage_count(void) {
+  size_t count = 0;
+  for (size_t i = 0; i < IODINE_STORE_SHARDS; ++i)
+    count += fio_store_count(&iodine_storage[i].set);
+  return count;
+}
+
 /* *****************************************************************************
 API
 ***************************************************************************** */
 
 /** Adds an object to the storage (or increases it's reference count). */
 static VALUE storage_add(VALUE obj) {
-  if (!obj || obj == Qnil || obj == Qtrue || obj == Qfalse)
+  /* immediate values (nil, true, false, Fixnums, static Symbols...) */
+  if (!obj || RB_SPECIAL_CONST_P(obj))
     return obj;
+  const size_t i = storage_shard(obj);
   uintptr_t old = 0;
-  fio_lock(&iodine_storage_lock);
-  fio_store_overwrite(&iodine_storage, obj, 1, &old);
+  fio_lock(&iodine_storage[i].lock);
+  fio_store_overwrite(&iodine_storage[i].set, obj, 1, &old);
   if (old)
-    fio_store_overwrite(&iodine_storage, obj, old + 1, NULL);
-  if (iodine_storage_count_max < fio_store_count(&iodine_storage))
-    iodine_storage_count_max = fio_store_count(&iodine_storage);
-  fio_unlock(&iodine_storage_lock);
+    fio_store_overwrite(&iodine_storage[i].set, obj, old + 1, NULL);
+  fio_unlock(&iodine_storage[i].lock);
+#if IODINE_DEBUG
+  if (iodine_storage_count_max < storage_count())
+    iodine_storage_count_max = storage_count();
+#endif
   return obj;
 }
 /** Removes an object from the storage (or decreases it's reference count). */
 static VALUE storage_remove(VALUE obj) {
-  if (!obj || obj == Qnil || obj == Qtrue || obj == Qfalse ||
-      iodine_storage.count == 0)
+  if (!obj || RB_SPECIAL_CONST_P(obj))
+    return obj;
+  const size_t i = storage_shard(obj);
+  if (iodine_storage[i].set.count == 0)
     return obj;
-  fio_lock(&iodine_storage_lock);
+  fio_lock(&iodine_storage[i].lock);
   uintptr_t old = 0;
-  fio_store_remove(&iodine_storage, obj, 0, &old);
+  fio_store_remove(&iodine_storage[i].set, obj, 0, &old);
   if (old > 1)
-    fio_store_overwrite(&iodine_storage, obj, old - 1, NULL);
-  fio_unlock(&iodine_storage_lock);
+    fio_store_overwrite(&iodine_storage[i].set, obj, old - 1, NULL);
+  fio_unlock(&iodine_storage[i].lock);
   return obj;
 }
 /** Should be called after forking to reset locks */
-static void storage_after_fork(void) { iodine_storage_lock = FIO_LOCK_INIT; }
+static void storage_after_fork(void) {
+  for (size_t i = 0; i < IODINE_STORE_SHARDS; ++i)
+    iodine_storage[i].lock = FIO_LOCK_INIT;
+}
 
 /** Prints debugging information to the console. */
 static void storage_print(void) {
   FIO_LOG_DEBUG("Ruby <=> C Memory storage stats (pid: %d):\n", getpid());
-  fio_lock(&iodine_storage_lock);
   uintptr_t index = 0;
-  FIO_SET_FOR_LOOP(&iodine_storage, pos) {
-    if (pos->obj) {
-      fprintf(stderr, "[%" PRIuPTR "] => %" PRIuPTR " X obj %p type %d\n",
-              index++, pos->obj, (void *)pos->hash, TYPE(pos->hash));
+  size_t capa = 0;
+  for (size_t i = 0; i < IODINE_STORE_SHARDS; ++i) {
+    fio_lock(&iodine_storage[i].lock);
+    FIO_SET_FOR_LOOP(&iodine_storage[i].set, pos) {
+      if (pos->obj) {
+        fprintf(stderr, "[%" PRIuPTR "] => %" PRIuPTR " X obj %p type %d\n",
+                index++, pos->obj, (void *)pos->hash, TYPE(pos->hash));
+      }
     }
+    capa += iodine_storage[i].set.capa;
+    fio_unlock(&iodine_storage[i].lock);
   }
   fprintf(stderr, "Total of %" PRIuPTR " objects protected form GC\n", index);
   fprintf(stderr,
-          "Storage uses %" PRIuPTR " Hash bins for %" PRIuPTR " objects\n"
-          "The largest collection was %zu objects.\n",
-          iodine_storage.capa, iodine_storage.count, iodine_storage_count_max);
-  fio_unlock(&iodine_storage_lock);
+          "Storage uses %zu Hash bins (%d shards) for %zu objects\n"
+          "The largest collection was %zu objects%s.\n",
+          capa, IODINE_STORE_SHARDS, storage_count(), iodine_storage_count_max,
+          (IODINE_DEBUG ? "" : " (tracked when IODINE_DEBUG is set)"));
 }
 
 /**
@@ -87,24 +122,30 @@ static void storage_mark(void *ignore) {
   (void)ignore;
   if (FIO_LOG_LEVEL >= FIO_LOG_LEVEL_DEBUG)
     storage_print();
-  fio_lock(&iodine_storage_lock);
-  // fio_store_compact(&iodine_storage);
-  FIO_SET_FOR_LOOP(&iodine_storage, pos) {
-    if (pos->obj) {
-      rb_gc_mark((VALUE)pos->hash);
+  /* one shard is locked at a time, so other threads are rarely blocked */
+  for (size_t i = 0; i < IODINE_STORE_SHARDS; ++i) {
+    if (!iodine_storage[i].set.count)
+      continue;
+    fio_lock(&iodine_storage[i].lock);
+    FIO_SET_FOR_LOOP(&iodine_storage[i].set, pos) {
+      if (pos->obj) {
+        rb_gc_mark((VALUE)pos->hash);
+      }
     }
+    fio_unlock(&iodine_storage[i].lock);
   }
-  fio_unlock(&iodine_storage_lock);
 }
 
 /* clear the registry (end of lifetime) */
 static void storage_clear(void *ignore) {
   (void)ignore;
   FIO_LOG_DEBUG("Ruby<=>C Storage cleared.\n");
-  fio_lock(&iodine_storage_lock);
-  fio_store_free(&iodine_storage);
-  iodine_storage = (fio_store_s)FIO_SET_INIT;
-  fio_unlock(&iodine_storage_lock);
+  for (size_t i = 0; i < IODINE_STORE_SHARDS; ++i) {
+    fio_lock(&iodine_storage[i].lock);
+    fio_store_free(&iodine_storage[i].set);
+    iodine_storage[i].set = (fio_store_s)FIO_SET_INIT;
+    fio_unlock(&iodine_storage[i].lock);
+  }
 }
 
 /*
@@ -130,7 +171,10 @@ struct IodineStorage_s IodineStore = {
 
 /** Initializes the storage unit for first use. */
 void iodine_storage_init(void) {
-  fio_store_capa_require(&iodine_storage, 512);
+  for (size_t i = 0; i < IODINE_STORE_SHARDS; ++i) {
+    iodine_storage[i].lock = FIO_LOCK_INIT;
+    fio_store_capa_require(&iodine_storage[i].set, 64);
+  }
   VALUE tmp =
       rb_define_class_under(rb_cObject, "IodineObjectStorage", rb_cObject);
   VALUE storage_obj =
@@ -73,6 +73,10 @@ module Iodine
                 Iodine::Base::MonkeyPatch::RackUtils.instance_method(m) )
         end
       end
+      # Rack::Request parses the query using Rack::QueryParser directly
+      if defined?(::Rack::QueryParser)
+        ::Rack::QueryParser.prepend(Iodine::Base::MonkeyPatch::RackQueryParser)
+      end
     end
 
 
@@ -123,6 +127,14 @@ module Iodine
       Iodine.on_state(:on_finish, &block)
     end
 
+    module Base
+      # @private
+      # Starts a Ractor handling Rack requests for the HTTP `:ractors` mode (see {Iodine.listen}).
+      def self.ractor_new(app, pool)
+        Ractor.new(app, pool, name: 'iodine') { |rack_app, id| Iodine::Base.ractor_serve(rack_app, id) }
+      end
+    end
+
     module PubSub
       # @deprecated use {Iodine::PubSub.detach}.
       def self.dettach(engine)
@@ -37,6 +37,8 @@ module Iodine
 		#         Patched.rfc2109  0.685029   0.001956   0.686985 (  0.687607)
 		#
 		# Iodine uses the same code internally for HTTP timestamping (adding missing `Date` headers) and logging.
+		#
+		# {Iodine.patch_rack} also replaces `parse_query` and `parse_nested_query` (in `Rack::Utils` and `Rack::QueryParser`, used by `Rack::Request`) with native versions. See `bin/query_bench.rb` for a benchmark.
 		module Utils
 		end
 	end
@@ -0,0 +1,40 @@
+RSpec.describe 'Caching Rack responses', with_app: :cache, iodine_args: '-cache 16' do
+  it 'answers repeated requests from the cache' do
+    first = http_get('/hit')
+    second = http_get('/hit')
+
+    expect(first.code).to eql(200)
+    expect(second.code).to eql(200)
+    expect(first.body.to_s).to eql('/hit|1|http')
+    expect(second.body.to_s).to eql('/hit|1|http')
+  end
+
+  it 'answers concurrent requests with the leader response' do
+    bodies = 8.times.map { Thread.new { http_get('/slow').body.to_s } }.map(&:value)
+
+    expect(bodies.uniq).to eql(['/slow|1|http'])
+  end
+
+  it 'passes uncacheable resources to the application' do
+    bodies = 3.times.map { http_get('/pass').body.to_s }
+
+    expect(bodies).to eql(['/pass|1|http', '/pass|2|http', '/pass|3|http'])
+  end
+
+  it 'passes personalized requests to the application' do
+    first = http_get('/cookie').body.to_s
+    second = http_get('/cookie', headers: { 'Cookie' => 'id=1' }).body.to_s
+
+    expect(first).to eql('/cookie|1|http')
+    expect(second).to eql('/cookie|2|http')
+  end
+
+  it 'keys responses by scheme' do
+    plain = http_get('/scheme').body.to_s
+    secure = http_get('/scheme', headers: { 'Forwarded' => 'for=10.0.0.1;proto=https' }).body.to_s
+
+    expect(plain).to eql('/scheme|1|http')
+    expect(secure).to eql('/scheme|2|https')
+    expect(http_get('/scheme', headers: { 'Forwarded' => 'for=10.0.0.1;proto=https' }).body.to_s).to eql(secure)
+  end
+end
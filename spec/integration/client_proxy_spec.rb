@@ -0,0 +1,57 @@
+RSpec.describe 'HTTP client and reverse proxy', with_app: :client do
+  it 'sends GET requests using the client' do
+    response = http_get('/client?a=1')
+
+    expect(response.code).to eql(200)
+    expect(response.body.to_s).to eql('200|yes|GET|a=1||')
+  end
+
+  it 'sends request bodies using the client' do
+    response = http_post('/client?b=2', body: 'payload')
+
+    expect(response.body.to_s).to eql('200|yes|POST|b=2|payload|')
+  end
+
+  it 'reuses the client connections' do
+    5.times { expect(http_get('/client').code).to eql(200) }
+  end
+
+  it 'forwards requests to the upstream' do
+    response = http_get('/proxy/upstream?c=3')
+
+    expect(response.code).to eql(200)
+    expect(response.headers['X-Upstream']).to eql('yes')
+    expect(response.body.to_s).to eql('GET|c=3||127.0.0.1')
+  end
+
+  it 'forwards request bodies to the upstream' do
+    response = http_post('/proxy/upstream', body: 'data')
+
+    expect(response.code).to eql(200)
+    expect(response.body.to_s).to eql('POST||data|127.0.0.1')
+  end
+
+  it 'joins the X-Forwarded-For values' do
+    socket = TCPSocket.new('127.0.0.1', 2222)
+    socket.write("GET /proxy/headers HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n" \
+                 "X-Forwarded-For: 10.0.0.1\r\nX-Forwarded-For: 10.0.0.2, 10.0.0.3\r\n\r\n")
+    response = socket.read
+    socket.close
+
+    expect(response).to end_with("\r\n\r\n10.0.0.1, 10.0.0.2, 10.0.0.3, 127.0.0.1|nil|")
+  end
+
+  it 'removes the headers listed by the Connection header' do
+    response = http_get('/proxy/headers',
+                        headers: { 'Connection' => 'close, X-Secret', 'X-Secret' => '1', 'X-Keep' => '2' })
+
+    expect(response.body.to_s).to eql('127.0.0.1|nil|2')
+  end
+
+  it 'forwards the upstream status' do
+    response = http_get('/proxy/missing')
+
+    expect(response.code).to eql(404)
+    expect(response.body.to_s).to eql('missing')
+  end
+end
@@ -0,0 +1,22 @@
+RSpec.describe 'Handling requests within fibers', with_app: :fiber, iodine_args: '-fiber', if: RUBY_VERSION >= '3.0' do
+  it 'runs requests using the iodine scheduler' do
+    expect(http_get('/').body.to_s).to eql('Iodine::Scheduler')
+  end
+
+  it 'handles concurrent sleeping requests using a single thread' do
+    started = Process.clock_gettime(Process::CLOCK_MONOTONIC)
+    bodies = 8.times.map { Thread.new { http_get('/sleep').body.to_s } }.map(&:value)
+    took = Process.clock_gettime(Process::CLOCK_MONOTONIC) - started
+
+    expect(bodies).to all(eql('slept'))
+    expect(took).to be < 1.5
+  end
+
+  it 'waits for IO readiness' do
+    expect(http_get('/pipe').body.to_s).to eql('piped')
+  end
+
+  it 'times out blocking operations' do
+    expect(http_get('/timeout').body.to_s).to eql('timed out')
+  end
+end
@@ -0,0 +1,20 @@
+RSpec.describe 'Handling queued requests per GVL acquisition', with_app: :gvl_batch, iodine_args: '-gvl-batch 8' do
+  it 'answers concurrent requests with their own responses' do
+    responses = 16.times.map do |t|
+      Thread.new do
+        4.times.map do |i|
+          id = (t * 4) + i
+          response = i.even? ? http_get("/?id=#{id}") : http_post("/?id=#{id}", body: "body#{id}")
+          [id, response.code, response.headers['X-Id'], response.body.to_s]
+        end
+      end
+    end.flat_map(&:value)
+
+    expect(responses.size).to eql(64)
+    responses.each do |id, code, header, body|
+      expect(code).to eql(200)
+      expect(header).to eql(id.to_s)
+      expect(body).to eql(id.odd? ? "POST|#{id}|body#{id}" : "GET|#{id}|")
+    end
+  end
+end
@@ -0,0 +1,69 @@
+require 'digest'
+require 'json'
+require 'tmpdir'
+
+RSpec.describe 'Multipart form data', with_app: :multipart, iodine_args: '-multipart' do
+  let(:boundary) { 'iodine-spec-boundary' }
+
+  def part(name, value, filename: nil, type: nil)
+    head = +"--#{boundary}\r\nContent-Disposition: form-data; name=\"#{name}\""
+    head << "; filename=\"#{filename}\"" if filename
+    head << "\r\nContent-Type: #{type}" if type
+    "#{head}\r\n\r\n#{value}\r\n"
+  end
+
+  def post_form(path, *parts)
+    http_post(path, body: parts.join + "--#{boundary}--\r\n",
+                    headers: { 'Content-Type' => "multipart/form-data; boundary=#{boundary}" })
+  end
+
+  it 'nests form fields like Rack' do
+    response = post_form('/', part('a', 'hello'), part('user[name]', 'Jane Doe'),
+                         part('user[tags][]', 'x'), part('user[tags][]', 'y'))
+
+    expect(response.code).to eql(200)
+    expect(JSON.parse(response.body.to_s)).to eq(
+      'a' => 'hello', 'user' => { 'name' => 'Jane Doe', 'tags' => %w[x y] }
+    )
+  end
+
+  it 'writes uploaded files to named temporary files' do
+    data = Random.new(7).bytes(300_000)
+    response = post_form('/', part('file', data, filename: 'data.bin', type: 'application/octet-stream'))
+    file = JSON.parse(response.body.to_s)['file']
+
+    expect(file['filename']).to eql('data.bin')
+    expect(file['type']).to eql('application/octet-stream')
+    expect(file['size']).to eql(data.bytesize)
+    expect(file['md5']).to eql(Digest::MD5.hexdigest(data))
+    expect(file['path']).to start_with(Dir.tmpdir)
+    expect(file['named']).to eql(true)
+  end
+
+  it 'removes the temporary files once the request is complete' do
+    response = post_form('/', part('file', 'abc', filename: 'a.txt'))
+    path = JSON.parse(response.body.to_s)['file']['path']
+
+    expect(http_get("/exists?#{path}").body.to_s).to eql('false')
+  end
+
+  it 'keeps temporary files the application moved' do
+    target = post_form('/move', part('file', 'moved data', filename: 'm.txt')).body.to_s
+
+    expect(File.read(target)).to eql('moved data')
+    File.delete(target)
+  end
+
+  it 'ignores file fields without a selected file' do
+    response = post_form('/', part('a', '1'), part('empty', '', filename: ''))
+
+    expect(JSON.parse(response.body.to_s)).to eq('a' => '1')
+  end
+
+  it 'refuses malformed bodies' do
+    response = http_post('/', body: "--#{boundary}\r\nbroken",
+                              headers: { 'Content-Type' => "multipart/form-data; boundary=#{boundary}" })
+
+    expect(response.code).to eql(400)
+  end
+end
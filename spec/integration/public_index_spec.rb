@@ -0,0 +1,50 @@
+require 'tmpdir'
+require 'fileutils'
+
+PUBLIC_INDEX_FOLDER = Dir.mktmpdir('iodine_public')
+at_exit { FileUtils.remove_entry(PUBLIC_INDEX_FOLDER) }
+
+RSpec.describe 'Serving files added to the public folder', with_app: :echo, iodine_args: "-www #{PUBLIC_INDEX_FOLDER}" do
+  # the public folder index is updated asynchronously
+  def get_eventually(path, expected)
+    body = nil
+    20.times do
+      body = http_get(path).body.to_s
+      break if body == expected
+      sleep 0.05
+    end
+    body
+  end
+
+  before { File.write(File.join(PUBLIC_INDEX_FOLDER, 'existing.txt'), 'existing') }
+  after { Dir.children(PUBLIC_INDEX_FOLDER).each { |name| FileUtils.rm_rf(File.join(PUBLIC_INDEX_FOLDER, name)) } }
+
+  it 'serves files that existed when the server started' do
+    expect(http_get('/existing.txt').body.to_s).to eql('existing')
+  end
+
+  it 'serves files created after a request found them missing' do
+    expect(http_get('/created.txt').body.to_s).to eql('')
+
+    File.write(File.join(PUBLIC_INDEX_FOLDER, 'created.txt'), 'created')
+
+    expect(get_eventually('/created.txt', 'created')).to eql('created')
+  end
+
+  it 'serves files created in new folders' do
+    expect(http_get('/folder/nested.txt').body.to_s).to eql('')
+
+    FileUtils.mkdir_p(File.join(PUBLIC_INDEX_FOLDER, 'folder'))
+    File.write(File.join(PUBLIC_INDEX_FOLDER, 'folder', 'nested.txt'), 'nested')
+
+    expect(get_eventually('/folder/nested.txt', 'nested')).to eql('nested')
+  end
+
+  it 'passes requests for deleted files to the application' do
+    expect(http_get('/existing.txt').body.to_s).to eql('existing')
+
+    File.delete(File.join(PUBLIC_INDEX_FOLDER, 'existing.txt'))
+
+    expect(get_eventually('/existing.txt', '')).to eql('')
+  end
+end
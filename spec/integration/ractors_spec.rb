@@ -0,0 +1,23 @@
+RSpec.describe 'Handling requests using Ractors', with_app: :ractors, iodine_args: '-ractors 2', if: defined?(Ractor) do
+  it 'runs the application outside the main Ractor' do
+    expect(http_get('/ractor').body.to_s).to eql('false')
+  end
+
+  it 'copies the request and the response' do
+    response = http_post('/echo?id=1', body: 'hello')
+
+    expect(response.code).to eql(200)
+    expect(response.headers['X-Ractor']).to eql('yes')
+    expect(response.body.to_s).to eql('POST|id=1|hello')
+  end
+
+  it 'answers concurrent requests' do
+    bodies = 16.times.map { |i| Thread.new { http_get("/?id=#{i}").body.to_s } }.map(&:value)
+
+    expect(bodies).to eql(16.times.map { |i| "GET|id=#{i}|" })
+  end
+
+  it 'answers application errors with an error response' do
+    expect(http_get('/raise').code).to eql(500)
+  end
+end
@@ -0,0 +1,59 @@
+RSpec.describe 'Range requests', with_app: :echo, iodine_args: '-www spec/support/public' do
+  let(:file) { File.binread('spec/support/public/range.txt') }
+
+  def get_range(range)
+    http_get('/range.txt', headers: { 'Range' => range })
+  end
+
+  it 'returns the requested range' do
+    response = get_range('bytes=0-4')
+
+    expect(response.code).to eql(206)
+    expect(response.headers['Content-Range']).to eql("bytes 0-4/#{file.bytesize}")
+    expect(response.body.to_s).to eql(file[0..4])
+  end
+
+  it 'returns the end of the file for suffix ranges' do
+    response = get_range('bytes=-100')
+
+    expect(response.code).to eql(206)
+    expect(response.headers['Content-Range']).to eql("bytes 900-999/#{file.bytesize}")
+    expect(response.body.to_s).to eql(file[-100..-1])
+  end
+
+  it 'returns the whole file for suffix ranges longer than the file' do
+    response = get_range('bytes=-5000')
+
+    expect(response.code).to eql(206)
+    expect(response.body.to_s).to eql(file)
+  end
+
+  it 'limits ranges that end after the end of the file' do
+    response = get_range('bytes=10-20000')
+
+    expect(response.code).to eql(206)
+    expect(response.headers['Content-Range']).to eql("bytes 10-999/#{file.bytesize}")
+    expect(response.body.to_s).to eql(file[10..-1])
+  end
+
+  it 'returns the rest of the file for open ended ranges' do
+    response = get_range('bytes=990-')
+
+    expect(response.code).to eql(206)
+    expect(response.body.to_s).to eql(file[990..-1])
+  end
+
+  it 'refuses ranges that start after the end of the file' do
+    response = get_range('bytes=2000-')
+
+    expect(response.code).to eql(416)
+    expect(response.headers['Content-Range']).to eql("bytes */#{file.bytesize}")
+  end
+
+  it 'ignores invalid ranges' do
+    response = get_range('bytes=5-2')
+
+    expect(response.code).to eql(200)
+    expect(response.body.to_s).to eql(file)
+  end
+end
@@ -0,0 +1,48 @@
+RSpec.describe 'Routing requests using Iodine::Router', with_app: :router do
+  it 'answers exact routes by method' do
+    get = http_get('/health')
+    post = http_post('/health', body: 'x')
+
+    expect(get.code).to eql(200)
+    expect(get.headers['X-Route']).to eql('health')
+    expect(get.body.to_s).to eql('OK')
+    expect(post.code).to eql(201)
+    expect(post.body.to_s).to eql('posted')
+  end
+
+  it 'answers HEAD requests using the GET route' do
+    response = http_request(:head, '/health')
+
+    expect(response.code).to eql(200)
+    expect(response.headers['Content-Length']).to eql('2')
+    expect(response.body.to_s).to eql('')
+  end
+
+  it 'ignores the query when matching routes' do
+    expect(http_get('/health?check=1').body.to_s).to eql('OK')
+  end
+
+  it 'answers prefix routes' do
+    expect(http_get('/prefix/a/b').body.to_s).to eql('prefix')
+    expect(http_get('/prefix/').body.to_s).to eql('prefix')
+    expect(http_get('/prefixed').body.to_s).to eql('app')
+  end
+
+  it 'serves static folders' do
+    expect(http_get('/files/range.txt').body.to_s).to eql(File.read('spec/support/public/range.txt'))
+    expect(http_get('/files/../apps/router.ru').body.to_s).not_to include('Iodine::Router')
+  end
+
+  it 'passes other requests to the application' do
+    expect(http_get('/other').body.to_s).to eql('app')
+    expect(http_get('/files/missing.txt').body.to_s).to eql('app')
+  end
+
+  it 'counts route hits' do
+    2.times { http_get('/health') }
+    http_get('/prefix/x')
+    http_get('/files/range.txt')
+
+    expect(http_get('/hits').body.to_s).to eql('GET /files/*=1,GET /health=2,GET /prefix/*=1,POST /health=0')
+  end
+end
@@ -0,0 +1,53 @@
+require 'socket'
+
+RSpec.describe 'SSE pub/sub broadcasts', with_app: :sse do
+  # opens an EventSource connection and returns the socket (after the headers)
+  def sse_connect(path)
+    socket = TCPSocket.new('127.0.0.1', 2222)
+    socket.write("GET #{path} HTTP/1.1\r\nHost: localhost\r\nAccept: text/event-stream\r\n\r\n")
+    head = +''
+    head << socket.readpartial(4096) until head.include?("\r\n\r\n") || !IO.select([socket], nil, nil, 1)
+    expect(head).to start_with('HTTP/1.1 200')
+    socket
+  end
+
+  # reads the events available within the timeout
+  def read_events(socket, until_count)
+    data = +''
+    while data.scan("\r\n\r\n").size < until_count && IO.select([socket], nil, nil, 1)
+      chunk = socket.read_nonblock(4096, exception: false)
+      break if chunk.nil?
+      data << chunk unless chunk == :wait_readable
+    end
+    data
+  end
+
+  it 'sends every subscriber the same formatted events' do
+    sockets = Array.new(8) { sse_connect('/') }
+    block_socket = sse_connect('/block')
+    sleep 0.2 # subscriptions are made by `on_open`
+
+    http_post('/publish', body: "line1\nline2", headers: { 'Content-Type' => 'text/plain' })
+    http_post('/publish', body: 'second', headers: { 'Content-Type' => 'text/plain' })
+
+    events = sockets.map { |socket| read_events(socket, 2) }
+    expect(events.uniq).to eql(["data: line1\r\ndata: line2\r\n\r\ndata: second\r\n\r\n"])
+    expect(read_events(block_socket, 2)).to eql("data: block:line1\r\ndata: line2\r\n\r\ndata: block:second\r\n\r\n")
+  ensure
+    sockets&.each(&:close)
+    block_socket&.close
+  end
+
+  it 'keeps broadcasting after subscribers disconnect' do
+    leaving = Array.new(4) { sse_connect('/') }
+    staying = sse_connect('/')
+    sleep 0.2
+    leaving.each(&:close)
+    sleep 0.1
+
+    expect(http_post('/publish', body: 'still here', headers: { 'Content-Type' => 'text/plain' }).code).to eql(200)
+    expect(read_events(staying, 1)).to eql("data: still here\r\n\r\n")
+  ensure
+    staying&.close
+  end
+end
@@ -0,0 +1,54 @@
+require 'socket'
+
+RSpec.describe 'Streaming body errors', with_app: :stream_error do
+  # returns the raw response and whether the server closed the connection
+  def raw_get(path)
+    socket = TCPSocket.new('127.0.0.1', 2222)
+    socket.write("GET #{path} HTTP/1.1\r\nHost: localhost\r\n\r\n")
+    data = String.new
+    closed = false
+    while IO.select([socket], nil, nil, 1)
+      chunk = socket.read_nonblock(4096, exception: false)
+      next if chunk == :wait_readable
+      if chunk.nil?
+        closed = true
+        break
+      end
+      data << chunk
+    end
+    [data, closed]
+  rescue Errno::ECONNRESET
+    [data, true]
+  ensure
+    socket&.close
+  end
+
+  it 'completes successful streams' do
+    data, closed = raw_get('/')
+
+    expect(data).to end_with("0\r\n\r\n")
+    expect(closed).to eql(false)
+  end
+
+  it 'closes the connection without completing a failed each body' do
+    data, closed = raw_get('/each')
+
+    expect(data).to include('first')
+    expect(data).not_to end_with("0\r\n\r\n")
+    expect(closed).to eql(true)
+  end
+
+  it 'closes the connection without completing a failed streaming body' do
+    data, closed = raw_get('/proc')
+
+    expect(data).to include('first')
+    expect(data).not_to end_with("0\r\n\r\n")
+    expect(closed).to eql(true)
+  end
+
+  it 'answers 500 when the body fails before sending any data' do
+    data, = raw_get('/each_empty')
+
+    expect(data).to start_with('HTTP/1.1 500')
+  end
+end
@@ -0,0 +1,32 @@
+RSpec.describe 'Timing request phases', with_app: :timings, iodine_args: '-timings' do
+  def timings(response)
+    response.body.to_s.split(',').map { |pair| pair.split('=') }.to_h
+  end
+
+  it 'reports the phases known before the application is called' do
+    before = Time.now.to_f
+    phases = timings(http_get('/'))
+
+    expect(phases.keys).to eql(%w[received_at queue gvl])
+    expect(phases['received_at'].to_f).to be_between(before - 1, Time.now.to_f)
+    expect(phases['queue'].to_f).to be >= 0
+    expect(phases['gvl'].to_f).to be >= 0
+  end
+
+  it 'reports the time spent waiting for an upstream proxy' do
+    start = ((Time.now.to_f - 0.5) * 1000).round
+    phases = timings(http_get('/', headers: { 'X-Request-Start' => "t=#{start}" }))
+
+    expect(phases['proxy'].to_f).to be_between(500, 5000)
+  end
+
+  it 'collects the phases of completed requests' do
+    http_get('/sleep')
+    stats = timings(http_get('/stats'))
+
+    expect(stats.keys).to eql(%w[proxy queue gvl app body write total])
+    expect(stats['app']).to start_with('1:')
+    expect(stats['app'].split(':').last.to_i).to be >= 200
+    expect(stats['total'].split(':').last.to_i).to be >= 200
+  end
+end
@@ -0,0 +1,48 @@
+RSpec.describe 'to_path bodies', with_app: :to_path do
+  it 'sends the file using the response status and headers' do
+    response = http_get('/file?size=100')
+
+    expect(response.code).to eql(201)
+    expect(response.headers['Content-Type']).to eql('application/x-iodine')
+    expect(response.headers['Content-Length']).to eql('100')
+    expect(response.headers['Cache-Control']).to be_nil
+    expect(response.body.to_s).to eql('x' * 100)
+  end
+
+  it 'sends large files' do
+    response = http_get('/file?size=1048576&char=z')
+
+    expect(response.code).to eql(201)
+    expect(response.body.to_s.bytesize).to eql(1_048_576)
+    expect(response.body.to_s).to eql('z' * 1_048_576)
+  end
+
+  it 'sends the current file content' do
+    expect(http_get('/file?char=a').body.to_s).to eql('a' * 16)
+    expect(http_get('/file?char=b').body.to_s).to eql('b' * 16)
+  end
+
+  it 'sends the file for any request method' do
+    response = http_post('/file?size=10', body: 'ignored')
+
+    expect(response.code).to eql(201)
+    expect(response.body.to_s).to eql('x' * 10)
+  end
+
+  it 'answers HEAD requests without a body' do
+    response = http_request(:head, '/file?size=10')
+
+    expect(response.code).to eql(201)
+    expect(response.headers['Content-Length']).to eql('10')
+    expect(response.body.to_s).to eql('')
+  end
+
+  it 'closes the body once the file was sent' do
+    before = http_get('/closed').body.to_s.to_i
+    http_get('/file?size=1048576')
+    http_get('/file?size=10')
+    sleep 0.2
+
+    expect(http_get('/closed').body.to_s.to_i).to eql(before + 2)
+  end
+end
@@ -55,11 +55,16 @@ module Spec
           cmd = "bundle exec exe/iodine -w 1 -t 1 -p #{server_port}".dup
         end
         cmd += " -V 5 -log" if opts[:verbose]
-        pid = spawn_with_test_log("#{cmd} #{filename}", **opts)
+        cmd += " #{opts[:args]}" if opts[:args]
+        pid = spawn_with_test_log("#{cmd} #{filename}", **opts.slice(:verbose))
         wait_until_iodine_ready
         pid
       end
 
+      def http_request(verb, path, *args)
+        http_client.request(verb, "http://localhost:#{server_port}#{path}", *args)
+      end
+
       def with_app(name, **opts)
         pid = start_iodine_with_app(name, **opts)
 
@@ -89,7 +94,8 @@ RSpec.configure do |config|
   when_tagged_with_app = { with_app: ->(v) { !!v } }
 
   config.around(:each, when_tagged_with_app) do |ex|
-    with_app(ex.metadata[:with_app], verbose: ex.metadata[:verbose]) { ex.run }
+    with_app(ex.metadata[:with_app], verbose: ex.metadata[:verbose],
+                                     args: ex.metadata[:iodine_args]) { ex.run }
   end
 
   config.include(Spec::Support::IodineServer, type: :integration)
@@ -0,0 +1,26 @@
+RSpec.describe Iodine::Rack::Utils do
+  describe '.parse_query' do
+    it 'collects repeated keys like Rack' do
+      expect(described_class.parse_query('a=1&b=2&b=3')).to eq('a' => '1', 'b' => %w[2 3])
+    end
+
+    it 'unescapes keys and values like Rack' do
+      expect(described_class.parse_query('a+b=c%20d&e')).to eq('a b' => 'c d', 'e' => nil)
+    end
+  end
+
+  describe '.parse_nested_query' do
+    it 'nests Hashes and Arrays like Rack' do
+      expect(described_class.parse_nested_query('a[b]=1&c[]=2&c[]=3&d[][e]=4&d[][f]=5'))
+        .to eq('a' => { 'b' => '1' }, 'c' => %w[2 3], 'd' => [{ 'e' => '4', 'f' => '5' }])
+    end
+
+    it 'keeps the last value of repeated keys like Rack' do
+      expect(described_class.parse_nested_query('a=1&a=2&b')).to eq('a' => '2', 'b' => nil)
+    end
+
+    it 'raises on conflicting nesting like Rack' do
+      expect { described_class.parse_nested_query('a=1&a[b]=2') }.to raise_error(TypeError)
+    end
+  end
+end